@@ -46,11 +46,20 @@
  *----------------------------------------------------------*/
 
 #define configUSE_PREEMPTION                    1
+#if defined LINUX_HAL
+#define configUSE_TICKLESS_IDLE                 0
+#else
 #define configUSE_TICKLESS_IDLE                 1
+#endif
 #define configCPU_CLOCK_HZ                      (SystemCoreClock)
 #define configTICK_RATE_HZ                      ((TickType_t)1000)
 #define configMAX_PRIORITIES                    5
+#if defined LINUX_HAL
+/* Tasks are pthreads on the host, their stacks must fit at least PTHREAD_STACK_MIN */
+#define configMINIMAL_STACK_SIZE                ((unsigned short)4096)
+#else
 #define configMINIMAL_STACK_SIZE                ((unsigned short)40)
+#endif
 #define configMAX_TASK_NAME_LEN                 10
 #define configUSE_16_BIT_TICKS                  0
 #define configIDLE_SHOULD_YIELD                 1
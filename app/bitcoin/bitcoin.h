@@ -5,10 +5,16 @@
 #include <stdbool.h>
 #include <string.h>
 #include "mem.h"
+#include "bitcoin/compactsize.h"
 #include "bitcoin/psbt.h"
+#include "bitcoin/txid.h"
 
-#define BTC_MAX_INPUTS 40
-#define BTC_MAX_OUTPUTS 40
+#define BTC_TXID_LEN 32
+
+// inputs of the unsigned transaction have empty scripts, so each one is a txid, an index, a zero length and a sequence
+#define BTC_TXIN_LEN (BTC_TXID_LEN + sizeof(uint32_t) + 1 + sizeof(uint32_t))
+#define BTC_TXIN_INDEX_OFF BTC_TXID_LEN
+#define BTC_TXIN_SEQ_OFF (BTC_TXID_LEN + sizeof(uint32_t) + 1)
 
 #define SIGHASH_MASK 0x1f
 
@@ -60,14 +66,52 @@ typedef struct {
   bool change;
 } psbt_output_data_t;
 
+// What is kept of each input and output between reading the PSBT and signing it. The offsets are from the start of
+// the PSBT, utxo points to the amount of the spent output, which is followed by its script, and txout to the output in
+// the unsigned transaction. All other records of an input are only held while that input is being read
 typedef struct {
+  uint32_t utxo;
+  uint32_t sighash_flag;
+  uint8_t input_type;
+  bool can_sign;
+} btc_input_t;
+
+typedef struct {
+  uint32_t txout;
+  bool change;
+} btc_output_t;
+
+// Sighash material shared by all inputs, computed by btc_sighash_init() once the transaction is confirmed. The
+// tagged hash prefixes are kept as tag digests rather than midstates, since the hardware SHA-256 context cannot be
+// copied
+typedef struct {
+  uint8_t bip143_prevouts[SHA256_DIGEST_LENGTH];
+  uint8_t bip143_sequence[SHA256_DIGEST_LENGTH];
+  uint8_t bip143_outputs[SHA256_DIGEST_LENGTH];
+  uint8_t tap_sighash_tag[SHA256_DIGEST_LENGTH];
+  uint8_t tap_tweak_tag[SHA256_DIGEST_LENGTH];
+} btc_sighash_ctx_t;
+
+typedef struct {
+  const uint8_t* psbt;
   psbt_tx_t tx;
-  psbt_txin_t inputs[BTC_MAX_INPUTS];
-  psbt_txout_t outputs[BTC_MAX_OUTPUTS];
-  psbt_input_data_t input_data[BTC_MAX_INPUTS];
-  psbt_output_data_t output_data[BTC_MAX_OUTPUTS];
+  const uint8_t* txins;
+  const uint8_t* txouts;
+  size_t txouts_len;
+  btc_input_t* inputs;
+  btc_output_t* outputs;
+  psbt_record_ref_t* records;
   size_t input_count;
   size_t output_count;
+  size_t record_count;
+  size_t input_records;
+  size_t summary_len;
+  size_t summary_capacity;
+  size_t signable_count;
+
+  psbt_input_data_t input;
+  psbt_output_data_t output;
+  btc_txid_cache_t txid_cache;
 
   psbt_t psbt_out;
   int32_t index_in;
@@ -77,18 +121,56 @@ typedef struct {
   uint8_t hash_outputs[SHA256_DIGEST_LENGTH];
   uint8_t hash_amounts[SHA256_DIGEST_LENGTH];
   uint8_t hash_scriptpubkeys[SHA256_DIGEST_LENGTH];
+  btc_sighash_ctx_t sighash;
 
   uint32_t mfp;
   app_err_t error;
 } btc_tx_ctx_t;
 
+static inline const uint8_t* btc_txin(const btc_tx_ctx_t* tx, size_t index) {
+  return &tx->txins[index * BTC_TXIN_LEN];
+}
+
+static inline uint32_t btc_txin_u32(const btc_tx_ctx_t* tx, size_t index, size_t off) {
+  uint32_t val;
+  memcpy(&val, &btc_txin(tx, index)[off], sizeof(uint32_t));
+  return val;
+}
+
+// amount, script length and script, as found in transaction outputs and witness UTXOs
+static inline size_t btc_txout_script(const uint8_t* txout, const uint8_t** script) {
+  uint8_t* len = (uint8_t*) &txout[sizeof(uint64_t)];
+  *script = &len[compactsize_peek_length(*len)];
+  return compactsize_read(len, NULL);
+}
+
+static inline size_t btc_txout_len(const uint8_t* txout) {
+  const uint8_t* script;
+  size_t script_len = btc_txout_script(txout, &script);
+  return (script - txout) + script_len;
+}
+
+static inline const uint8_t* btc_input_utxo(const btc_tx_ctx_t* tx, size_t index) {
+  return &tx->psbt[tx->inputs[index].utxo];
+}
+
+static inline const uint8_t* btc_output_txout(const btc_tx_ctx_t* tx, size_t index) {
+  return &tx->psbt[tx->outputs[index].txout];
+}
+
+static inline uint64_t btc_amount(const uint8_t* txout) {
+  uint64_t amount;
+  memcpy(&amount, txout, sizeof(uint64_t));
+  return amount;
+}
+
 static inline bool btc_is_bip322(const btc_tx_ctx_t* tx) {
   return (tx->input_count == 1) &&
       (tx->output_count == 1) &&
-      (tx->inputs[0].sequence_number == 0) &&
-      (tx->inputs[0].index == 0) &&
-      !memcmp(tx->input_data[0].amount, ZERO32, sizeof(uint64_t)) &&
-      !memcmp(tx->outputs[0].amount, ZERO32, sizeof(uint64_t));
+      (btc_txin_u32(tx, 0, BTC_TXIN_SEQ_OFF) == 0) &&
+      (btc_txin_u32(tx, 0, BTC_TXIN_INDEX_OFF) == 0) &&
+      (btc_amount(btc_input_utxo(tx, 0)) == 0) &&
+      (btc_amount(btc_output_txout(tx, 0)) == 0);
 }
 
 #endif
@@ -277,6 +277,7 @@ psbt_result_t psbt_read(const uint8_t *src, size_t src_size, psbt_t *tx, psbt_el
           return PSBT_READ_ERROR;
         }
       } else {
+        elem.offset = tx->write_pos - tx->data;
         res = psbt_read_record(tx, src_size, &rec);
 
         if (res != PSBT_OK) {
@@ -297,6 +298,7 @@ psbt_result_t psbt_read(const uint8_t *src, size_t src_size, psbt_t *tx, psbt_el
           elem.type = PSBT_ELEM_RECORD;
           elem.index = kvs;
           elem.elem.rec = &rec;
+          elem.len = (tx->write_pos - tx->data) - elem.offset;
           elem_handler(&elem);
         }
       }
@@ -333,6 +335,48 @@ psbt_result_t psbt_read(const uint8_t *src, size_t src_size, psbt_t *tx, psbt_el
   return PSBT_OK;
 }
 
+void psbt_record_ref(const psbt_elem_t *elem, psbt_record_ref_t *ref) {
+  ref->offset = elem->offset;
+  ref->len = elem->len;
+  ref->index = elem->index;
+  ref->scope = elem->elem.rec->scope;
+  ref->type = elem->elem.rec->type;
+}
+
+psbt_result_t psbt_record_deref(const uint8_t *src, const psbt_record_ref_t *ref, psbt_record_t *rec) {
+  psbt_t tx;
+  size_t src_size = ref->offset + ref->len;
+
+  psbt_init(&tx, (uint8_t *) src, src_size);
+  tx.write_pos += ref->offset;
+
+  switch (ref->scope) {
+  case PSBT_SCOPE_GLOBAL:
+    tx.state = PSBT_ST_GLOBAL;
+    break;
+  case PSBT_SCOPE_INPUTS:
+    tx.state = PSBT_ST_INPUTS;
+    break;
+  case PSBT_SCOPE_OUTPUTS:
+    tx.state = PSBT_ST_OUTPUTS;
+    break;
+  default:
+    return PSBT_INVALID_STATE;
+  }
+
+  return psbt_read_record(&tx, src_size, rec);
+}
+
+// Appends already serialized PSBT data, which leaves the PSBT in the given state
+psbt_result_t psbt_write_raw(psbt_t *tx, const uint8_t *src, size_t len, enum psbt_state state) {
+  ASSERT_SPACE(len);
+  memcpy(tx->write_pos, src, len);
+  tx->write_pos += len;
+  tx->state = state;
+
+  return PSBT_OK;
+}
+
 psbt_result_t psbt_write_global_record(psbt_t *tx, psbt_record_t *rec) {
   if (tx->state == PSBT_ST_INIT) {
     // write header if we haven't yet
@@ -83,8 +83,20 @@ typedef struct {
     psbt_txelem_t *txelem;
     psbt_record_t *rec;
   } elem;
+  // position and encoded length of a record in the parsed PSBT
+  size_t offset;
+  size_t len;
 } psbt_elem_t;
 
+// Location of a record in a parsed PSBT, so that it can be found again or copied without parsing the PSBT again
+typedef struct {
+  uint32_t offset;
+  uint32_t len;
+  uint16_t index;
+  uint8_t scope;
+  uint8_t type;
+} psbt_record_ref_t;
+
 typedef void (psbt_elem_handler_t)(psbt_elem_t *rec);
 
 typedef struct {
@@ -97,12 +109,15 @@ typedef struct {
 
 size_t psbt_size(psbt_t *tx);
 psbt_result_t psbt_read(const uint8_t *src, size_t src_size, psbt_t *psbt, psbt_elem_handler_t *elem_handler, void* user_data);
+void psbt_record_ref(const psbt_elem_t *elem, psbt_record_ref_t *ref);
+psbt_result_t psbt_record_deref(const uint8_t *src, const psbt_record_ref_t *ref, psbt_record_t *rec);
 
 psbt_result_t psbt_write_global_record(psbt_t *tx, psbt_record_t *rec);
 psbt_result_t psbt_write_input_record(psbt_t *tx, psbt_record_t *rec);
 psbt_result_t psbt_write_output_record(psbt_t *tx, psbt_record_t *rec);
 psbt_result_t psbt_new_input_record_set(psbt_t *tx);
 psbt_result_t psbt_new_output_record_set(psbt_t *tx);
+psbt_result_t psbt_write_raw(psbt_t *tx, const uint8_t *src, size_t len, enum psbt_state state);
 
 psbt_result_t psbt_init(psbt_t *tx, uint8_t *dest, size_t dest_size);
 psbt_result_t psbt_finalize(psbt_t *tx);
@@ -0,0 +1,356 @@
+#include "sighash.h"
+#include "compactsize.h"
+#include "crypto/script.h"
+#include "crypto/sha2.h"
+
+static const uint8_t P2PKH_SCRIPT_PRE[4] = { 0x19, 0x76, 0xa9, 0x14 };
+static const uint8_t P2PKH_SCRIPT_POST[2] = { 0x88, 0xac };
+
+void btc_sighash_init(btc_tx_ctx_t* tx_ctx) {
+  btc_sighash_ctx_t* ctx = &tx_ctx->sighash;
+
+  SHA256_CTX sha256;
+  sha256_Init(&sha256);
+
+  for(int i = 0; i < tx_ctx->input_count; i++) {
+    sha256_Update(&sha256, btc_txin(tx_ctx, i), BTC_TXID_LEN + sizeof(uint32_t));
+  }
+
+  // Sub-hashes are stored as single SHA256, which is what BIP341 taproot requires.
+  // BIP143 segwit uses their double SHA256, kept separately in the sighash context.
+  sha256_Final(&sha256, tx_ctx->hash_prevouts);
+
+  sha256_Init(&sha256);
+
+  for(int i = 0; i < tx_ctx->input_count; i++) {
+    sha256_Update(&sha256, &btc_txin(tx_ctx, i)[BTC_TXIN_SEQ_OFF], sizeof(uint32_t));
+  }
+
+  sha256_Final(&sha256, tx_ctx->hash_sequence);
+
+  sha256_Init(&sha256);
+
+  for(int i = 0; i < tx_ctx->input_count; i++) {
+    sha256_Update(&sha256, btc_input_utxo(tx_ctx, i), sizeof(uint64_t));
+  }
+
+  sha256_Final(&sha256, tx_ctx->hash_amounts);
+
+  sha256_Init(&sha256);
+
+  for(int i = 0; i < tx_ctx->input_count; i++) {
+    const uint8_t* utxo = btc_input_utxo(tx_ctx, i);
+    sha256_Update(&sha256, &utxo[sizeof(uint64_t)], btc_txout_len(utxo) - sizeof(uint64_t));
+  }
+
+  sha256_Final(&sha256, tx_ctx->hash_scriptpubkeys);
+
+  sha256_Init(&sha256);
+  sha256_Update(&sha256, tx_ctx->txouts, tx_ctx->txouts_len);
+  sha256_Final(&sha256, tx_ctx->hash_outputs);
+
+  bool segwit = false;
+  bool taproot = false;
+
+  for (int i = 0; i < tx_ctx->input_count; i++) {
+    switch(tx_ctx->inputs[i].input_type) {
+    case BTC_INPUT_TYPE_P2WPKH:
+    case BTC_INPUT_TYPE_P2WSH:
+      segwit = true;
+      break;
+    case BTC_INPUT_TYPE_P2TR:
+      taproot = true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (segwit) {
+    sha256_Raw(tx_ctx->hash_prevouts, SHA256_DIGEST_LENGTH, ctx->bip143_prevouts);
+    sha256_Raw(tx_ctx->hash_sequence, SHA256_DIGEST_LENGTH, ctx->bip143_sequence);
+    sha256_Raw(tx_ctx->hash_outputs, SHA256_DIGEST_LENGTH, ctx->bip143_outputs);
+  }
+
+  if (taproot) {
+    sha256_Raw((uint8_t*) "TapSighash", 10, ctx->tap_sighash_tag);
+    sha256_Raw((uint8_t*) "TapTweak", 8, ctx->tap_tweak_tag);
+  }
+}
+
+app_err_t btc_sighash_legacy(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+  uint8_t sighash = input->sighash_flag & SIGHASH_MASK;
+  uint8_t anyonecanpay = input->sighash_flag & SIGHASH_ANYONECANPAY;
+
+  if ((sighash == SIGHASH_SINGLE) && (index >= tx_ctx->output_count)) {
+    return ERR_DATA;
+  }
+
+  SHA256_CTX sha256;
+  sha256_Init(&sha256);
+
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
+
+  const uint8_t* script;
+  size_t script_len;
+
+  if (input->input_type == BTC_INPUT_TYPE_LEGACY_WITH_REDEEM) {
+    script = input->redeem_script;
+    script_len = input->redeem_script_len;
+  } else {
+    script = input->script_pubkey;
+    script_len = input->script_pubkey_len;
+  }
+
+  uint8_t cscript_len[sizeof(uint64_t)];
+  uint8_t csize_len = compactsize_length(script_len);
+  compactsize_write(cscript_len, script_len);
+
+  uint8_t ccount[sizeof(uint64_t)];
+  const uint8_t* txin = btc_txin(tx_ctx, index);
+
+  if (anyonecanpay) {
+    uint8_t tmp = 1;
+    sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
+    sha256_Update(&sha256, txin, BTC_TXID_LEN + sizeof(uint32_t));
+    sha256_Update(&sha256, cscript_len, csize_len);
+    sha256_Update(&sha256, script, script_len);
+    sha256_Update(&sha256, &txin[BTC_TXIN_SEQ_OFF], sizeof(uint32_t));
+  } else if (sighash == SIGHASH_ALL) {
+    // the other inputs are serialized exactly as in the unsigned transaction, so they are hashed in place
+    compactsize_write(ccount, tx_ctx->input_count);
+    sha256_Update(&sha256, ccount, compactsize_length(tx_ctx->input_count));
+    sha256_Update(&sha256, tx_ctx->txins, index * BTC_TXIN_LEN);
+    sha256_Update(&sha256, txin, BTC_TXID_LEN + sizeof(uint32_t));
+    sha256_Update(&sha256, cscript_len, csize_len);
+    sha256_Update(&sha256, script, script_len);
+    sha256_Update(&sha256, &txin[BTC_TXIN_SEQ_OFF], sizeof(uint32_t) + ((tx_ctx->input_count - index - 1) * BTC_TXIN_LEN));
+  } else {
+    compactsize_write(ccount, tx_ctx->input_count);
+    sha256_Update(&sha256, ccount, compactsize_length(tx_ctx->input_count));
+
+    for (int i = 0; i < tx_ctx->input_count; i++) {
+      sha256_Update(&sha256, btc_txin(tx_ctx, i), BTC_TXID_LEN + sizeof(uint32_t));
+
+      if (i == index) {
+        sha256_Update(&sha256, cscript_len, csize_len);
+        sha256_Update(&sha256, script, script_len);
+        sha256_Update(&sha256, &txin[BTC_TXIN_SEQ_OFF], sizeof(uint32_t));
+      } else {
+        uint8_t tmp[1 + sizeof(uint32_t)] = { 0 };
+        sha256_Update(&sha256, tmp, sizeof(tmp));
+      }
+    }
+  }
+
+  if (sighash == SIGHASH_NONE) {
+    uint8_t tmp = 0;
+    sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
+  } else if (sighash == SIGHASH_SINGLE) {
+    compactsize_write(ccount, index + 1);
+    sha256_Update(&sha256, ccount, compactsize_length(index + 1));
+
+    for (int i = 0; i < index; i++) {
+      int64_t amount = -1;
+      uint8_t tmp = 0;
+      sha256_Update(&sha256, (uint8_t*) &amount, sizeof(uint64_t));
+      sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
+    }
+
+    const uint8_t* txout = btc_output_txout(tx_ctx, index);
+    sha256_Update(&sha256, txout, btc_txout_len(txout));
+  } else {
+    compactsize_write(ccount, tx_ctx->output_count);
+    sha256_Update(&sha256, ccount, compactsize_length(tx_ctx->output_count));
+    sha256_Update(&sha256, tx_ctx->txouts, tx_ctx->txouts_len);
+  }
+
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
+  sha256_Update(&sha256, (uint8_t*) &input->sighash_flag, sizeof(uint32_t));
+
+  sha256_Final(&sha256, digest);
+  sha256_Raw(digest, SHA256_DIGEST_LENGTH, digest);
+
+  return ERR_OK;
+}
+
+app_err_t btc_sighash_segwit(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX sha256;
+  sha256_Init(&sha256);
+
+  uint8_t sighash = input->sighash_flag & SIGHASH_MASK;
+  uint8_t anyonecanpay = input->sighash_flag & SIGHASH_ANYONECANPAY;
+
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
+
+  if (anyonecanpay) {
+    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
+  } else {
+    sha256_Update(&sha256, tx_ctx->sighash.bip143_prevouts, SHA256_DIGEST_LENGTH);
+  }
+
+  if (anyonecanpay || (sighash != SIGHASH_ALL)) {
+    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
+  } else {
+    sha256_Update(&sha256, tx_ctx->sighash.bip143_sequence, SHA256_DIGEST_LENGTH);
+  }
+
+  const uint8_t* txin = btc_txin(tx_ctx, index);
+  sha256_Update(&sha256, txin, BTC_TXID_LEN + sizeof(uint32_t));
+
+  if (input->input_type == BTC_INPUT_TYPE_P2WPKH) {
+    sha256_Update(&sha256, P2PKH_SCRIPT_PRE, sizeof(P2PKH_SCRIPT_PRE));
+    if (input->redeem_script) {
+      sha256_Update(&sha256, &input->redeem_script[2], BTC_PUBKEY_HASH_LEN);
+    } else {
+      sha256_Update(&sha256, &input->script_pubkey[2], BTC_PUBKEY_HASH_LEN);
+    }
+    sha256_Update(&sha256, P2PKH_SCRIPT_POST, sizeof(P2PKH_SCRIPT_POST));
+  } else {
+    uint8_t csize[sizeof(uint64_t)];
+    compactsize_write(csize, input->witness_script_len);
+    sha256_Update(&sha256, csize, compactsize_length(input->witness_script_len));
+    sha256_Update(&sha256, input->witness_script, input->witness_script_len);
+  }
+
+  sha256_Update(&sha256, input->amount, sizeof(uint64_t));
+  sha256_Update(&sha256, &txin[BTC_TXIN_SEQ_OFF], sizeof(uint32_t));
+
+  if (sighash == SIGHASH_ALL) {
+    sha256_Update(&sha256, tx_ctx->sighash.bip143_outputs, SHA256_DIGEST_LENGTH);
+  } else if ((sighash == SIGHASH_SINGLE) && (index < tx_ctx->output_count)) {
+    SOFT_SHA256_CTX inner_sha256;
+    uint8_t inner_digest[SHA256_DIGEST_LENGTH];
+    const uint8_t* txout = btc_output_txout(tx_ctx, index);
+    soft_sha256_Init(&inner_sha256);
+    soft_sha256_Update(&inner_sha256, txout, btc_txout_len(txout));
+    soft_sha256_Final(&inner_sha256, inner_digest);
+
+    soft_sha256_Init(&inner_sha256);
+    soft_sha256_Update(&inner_sha256, inner_digest, SHA256_DIGEST_LENGTH);
+    soft_sha256_Final(&inner_sha256, inner_digest);
+
+    sha256_Update(&sha256, inner_digest, SHA256_DIGEST_LENGTH);
+  } else {
+    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
+  }
+
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
+  sha256_Update(&sha256, (uint8_t*) &input->sighash_flag, sizeof(uint32_t));
+
+  sha256_Final(&sha256, digest);
+  sha256_Raw(digest, SHA256_DIGEST_LENGTH, digest);
+  return ERR_OK;
+}
+
+app_err_t btc_sighash_taproot(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+  uint8_t sighash = input->sighash_flag & 0xff;
+  uint8_t base_type = sighash & SIGHASH_MASK;
+  bool anyonecanpay = sighash & SIGHASH_ANYONECANPAY;
+
+  // SIGHASH_DEFAULT (0x00) signs over the whole transaction like SIGHASH_ALL
+  if (base_type == SIGHASH_DEFAULT) {
+    base_type = SIGHASH_ALL;
+  }
+
+  // only defined hash_type values are allowed (0x00, 0x01, 0x02, 0x03, 0x81, 0x82, 0x83)
+  switch (sighash) {
+  case SIGHASH_DEFAULT:
+  case SIGHASH_ALL:
+  case SIGHASH_NONE:
+  case SIGHASH_SINGLE:
+  case (SIGHASH_ALL | SIGHASH_ANYONECANPAY):
+  case (SIGHASH_NONE | SIGHASH_ANYONECANPAY):
+  case (SIGHASH_SINGLE | SIGHASH_ANYONECANPAY):
+    break;
+  default:
+    return ERR_DATA;
+  }
+
+  if ((base_type == SIGHASH_SINGLE) && (index >= tx_ctx->output_count)) {
+    return ERR_DATA; // SIGHASH_SINGLE without a corresponding output
+  }
+
+  // hash_TapSighash(0x00 || SigMsg): tagged hash with a single SHA256 over the
+  // tag prefix, the sighash epoch byte 0x00 and the signature message.
+  SHA256_CTX sha256;
+  sha256_Init(&sha256);
+  sha256_Update(&sha256, tx_ctx->sighash.tap_sighash_tag, SHA256_DIGEST_LENGTH);
+  sha256_Update(&sha256, tx_ctx->sighash.tap_sighash_tag, SHA256_DIGEST_LENGTH);
+  uint8_t epoch = 0;
+  sha256_Update(&sha256, &epoch, 1);
+
+  // hash_type
+  sha256_Update(&sha256, &sighash, 1);
+
+  // nVersion
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
+
+  // nLockTime
+  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
+
+  // Transaction level data
+  if (!anyonecanpay) {
+    sha256_Update(&sha256, tx_ctx->hash_prevouts, SHA256_DIGEST_LENGTH);
+    sha256_Update(&sha256, tx_ctx->hash_amounts, SHA256_DIGEST_LENGTH);
+    sha256_Update(&sha256, tx_ctx->hash_scriptpubkeys, SHA256_DIGEST_LENGTH);
+    sha256_Update(&sha256, tx_ctx->hash_sequence, SHA256_DIGEST_LENGTH);
+  }
+
+  if ((base_type != SIGHASH_NONE) && (base_type != SIGHASH_SINGLE)) {
+    sha256_Update(&sha256, tx_ctx->hash_outputs, SHA256_DIGEST_LENGTH);
+  }
+
+  // spend_type = (ext_flag * 2) + annex_present = 0 (no BIP342 extension, no annex)
+  uint8_t spend_type = 0;
+  sha256_Update(&sha256, &spend_type, 1);
+
+  if (anyonecanpay) {
+    const uint8_t* txin = btc_txin(tx_ctx, index);
+    // outpoint (32-byte txid + 4-byte index)
+    sha256_Update(&sha256, txin, BTC_TXID_LEN + sizeof(uint32_t));
+    // amount
+    sha256_Update(&sha256, input->amount, sizeof(uint64_t));
+    // scriptPubKey serialized as script inside CTxOut (compact size length prefix)
+    uint8_t csize[sizeof(uint64_t)];
+    compactsize_write(csize, input->script_pubkey_len);
+    sha256_Update(&sha256, csize, compactsize_length(input->script_pubkey_len));
+    sha256_Update(&sha256, input->script_pubkey, input->script_pubkey_len);
+    // nSequence
+    sha256_Update(&sha256, &txin[BTC_TXIN_SEQ_OFF], sizeof(uint32_t));
+  } else {
+    // input_index
+    uint32_t idx = index;
+    sha256_Update(&sha256, (uint8_t*) &idx, sizeof(uint32_t));
+  }
+
+  if (base_type == SIGHASH_SINGLE) {
+    // sha_single_output: single SHA256 of the corresponding output in CTxOut format
+    SOFT_SHA256_CTX inner;
+    uint8_t inner_digest[SHA256_DIGEST_LENGTH];
+    const uint8_t* txout = btc_output_txout(tx_ctx, index);
+    soft_sha256_Init(&inner);
+    soft_sha256_Update(&inner, txout, btc_txout_len(txout));
+    soft_sha256_Final(&inner, inner_digest);
+
+    sha256_Update(&sha256, inner_digest, SHA256_DIGEST_LENGTH);
+  }
+
+  sha256_Final(&sha256, digest);
+  return ERR_OK;
+}
+
+void btc_sighash_taptweak(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, uint8_t tweak[SHA256_DIGEST_LENGTH]) {
+  // t = hash_TapTweak(internal_key || merkle_root)
+  SHA256_CTX sha256;
+  sha256_Init(&sha256);
+  sha256_Update(&sha256, tx_ctx->sighash.tap_tweak_tag, SHA256_DIGEST_LENGTH);
+  sha256_Update(&sha256, tx_ctx->sighash.tap_tweak_tag, SHA256_DIGEST_LENGTH);
+  sha256_Update(&sha256, input->taproot_internal_key, BTC_TAPROOT_WITPROG_LEN);
+
+  if (input->has_taproot_merkle_root) {
+    sha256_Update(&sha256, input->taproot_merkle_root, SHA256_DIGEST_LENGTH);
+  }
+
+  sha256_Final(&sha256, tweak);
+}
@@ -0,0 +1,13 @@
+#ifndef __BTC_SIGHASH__
+#define __BTC_SIGHASH__
+
+#include "bitcoin/bitcoin.h"
+#include "error.h"
+
+void btc_sighash_init(btc_tx_ctx_t* tx_ctx);
+app_err_t btc_sighash_legacy(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+app_err_t btc_sighash_segwit(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+app_err_t btc_sighash_taproot(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+void btc_sighash_taptweak(const btc_tx_ctx_t* tx_ctx, const psbt_input_data_t* input, uint8_t tweak[SHA256_DIGEST_LENGTH]);
+
+#endif
@@ -0,0 +1,75 @@
+#include <string.h>
+#include "txid.h"
+#include "compactsize.h"
+
+static inline bool btc_is_segwit(const uint8_t* tx) {
+  return tx[4] == 0;
+}
+
+static inline const uint8_t* btc_skip_script(const uint8_t* p) {
+  uint32_t script_len = compactsize_read((uint8_t*) p, NULL);
+  return &p[compactsize_peek_length(*p) + script_len];
+}
+
+void btc_txid(const uint8_t* tx, size_t tx_len, uint8_t out[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX ctx;
+  sha256_Init(&ctx);
+
+  if (btc_is_segwit(tx)) {
+    // this tx has been parsed before so we know it is correctly formatted, we won't repeat the same checks.
+    // The txid leaves out the marker, the flag and the witnesses, so the inputs and outputs are hashed in one piece.
+    const uint8_t* start = &tx[sizeof(uint32_t) + sizeof(uint16_t)];
+    const uint8_t* p = start;
+
+    uint32_t count = compactsize_read((uint8_t*) p, NULL);
+    p += compactsize_peek_length(*p);
+
+    for(int i = 0; i < count; i++) {
+      p = btc_skip_script(&p[SHA256_DIGEST_LENGTH + sizeof(uint32_t)]) + sizeof(uint32_t);
+    }
+
+    count = compactsize_read((uint8_t*) p, NULL);
+    p += compactsize_peek_length(*p);
+
+    for(int i = 0; i < count; i++) {
+      p = btc_skip_script(&p[sizeof(uint64_t)]);
+    }
+
+    sha256_Update(&ctx, tx, sizeof(uint32_t));
+    sha256_Update(&ctx, start, p - start);
+    sha256_Update(&ctx, &tx[tx_len - 4], sizeof(uint32_t));
+  } else {
+    sha256_Update(&ctx, tx, tx_len);
+  }
+
+  sha256_Final(&ctx, out);
+  sha256_Raw(out, SHA256_DIGEST_LENGTH, out);
+}
+
+// Inputs spending outputs of the same transaction each carry a copy of it. Comparing a copy with one already verified
+// is much cheaper than hashing it again.
+bool btc_txid_verify(btc_txid_cache_t* cache, const uint8_t* tx, size_t tx_len, const uint8_t txid[SHA256_DIGEST_LENGTH]) {
+  for (int i = 0; i < BTC_TXID_CACHE_SIZE; i++) {
+    btc_txid_cache_entry_t* entry = &cache->entries[i];
+
+    if (entry->tx && (entry->tx_len == tx_len) && !memcmp(entry->txid, txid, SHA256_DIGEST_LENGTH) &&
+        ((entry->tx == tx) || !memcmp(entry->tx, tx, tx_len))) {
+      return true;
+    }
+  }
+
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  btc_txid(tx, tx_len, digest);
+
+  if (memcmp(digest, txid, SHA256_DIGEST_LENGTH)) {
+    return false;
+  }
+
+  btc_txid_cache_entry_t* entry = &cache->entries[cache->next];
+  entry->tx = tx;
+  entry->tx_len = tx_len;
+  entry->txid = txid;
+  cache->next = (cache->next + 1) % BTC_TXID_CACHE_SIZE;
+
+  return true;
+}
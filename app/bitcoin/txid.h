@@ -0,0 +1,27 @@
+#ifndef __BTC_TXID__
+#define __BTC_TXID__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "crypto/sha2.h"
+
+#define BTC_TXID_CACHE_SIZE 16
+
+// Transactions whose txid has already been verified. The transactions and txids are not copied, so they must stay in
+// place while the cache is used. A zeroed cache is empty.
+typedef struct {
+  const uint8_t* tx;
+  size_t tx_len;
+  const uint8_t* txid;
+} btc_txid_cache_entry_t;
+
+typedef struct {
+  btc_txid_cache_entry_t entries[BTC_TXID_CACHE_SIZE];
+  uint8_t next;
+} btc_txid_cache_t;
+
+void btc_txid(const uint8_t* tx, size_t tx_len, uint8_t out[SHA256_DIGEST_LENGTH]);
+bool btc_txid_verify(btc_txid_cache_t* cache, const uint8_t* tx, size_t tx_len, const uint8_t txid[SHA256_DIGEST_LENGTH]);
+
+#endif
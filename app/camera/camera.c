@@ -35,6 +35,7 @@ struct camera_exposure {
 
 APP_NOCACHE(uint8_t g_camera_fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE], CAMERA_BUFFER_ALIGN);
 static struct camera_exposure g_camera_exposure = { .exposure = EXPOSURE_DEF, .analog_gain = 1, .digital_gain = 1 };
+static uint32_t g_camera_processed;
 
 hal_err_t _camera_reset() {
   hal_gpio_set(GPIO_CAMERA_PWR, GPIO_SET);
@@ -111,6 +112,7 @@ hal_err_t camera_start() {
     return err;
   }
 
+  g_camera_processed = 0;
   err = hal_camera_start(g_camera_fb);
   return err;
 }
@@ -128,13 +130,24 @@ hal_err_t camera_stop() {
 
 hal_err_t camera_next_frame(uint8_t** frame) {
   ulTaskNotifyTakeIndexed(CAMERA_TASK_NOTIFICATION_IDX, pdFALSE, pdMS_TO_TICKS(CAMERA_FRAME_TIMEOUT));
-  return hal_camera_next_frame(frame);
+
+  if (hal_camera_next_frame(frame) != HAL_SUCCESS) {
+    return HAL_FAIL;
+  }
+
+  g_camera_processed++;
+  return HAL_SUCCESS;
 }
 
 hal_err_t camera_submit(uint8_t* frame) {
   return hal_camera_submit(frame);
 }
 
+void camera_get_stats(camera_stats_t* stats) {
+  stats->processed = g_camera_processed;
+  stats->dropped = hal_camera_dropped_frames();
+}
+
 hal_err_t camera_autoexposure(uint32_t total_luma) {
   if (total_luma < CAMERA_TARGET_LUMA_MIN) {
     if (g_camera_exposure.exposure < EXPOSURE_MAX) {
@@ -17,11 +17,18 @@ typedef enum {
   EXPOSURE_125,
 } camera_exposure_t;
 
+typedef struct {
+  uint32_t processed;
+  uint32_t dropped;
+} camera_stats_t;
+
 hal_err_t camera_start();
 hal_err_t camera_stop();
 
 hal_err_t camera_next_frame(uint8_t** frame);
 hal_err_t camera_submit(uint8_t* frame);
+// Frames processed and dropped since boot, for benches and debugging
+void camera_get_stats(camera_stats_t* stats);
 
 hal_err_t camera_autoexposure(uint32_t total_luma);
 
@@ -33,7 +33,11 @@ extern const uint8_t FW_VERSION[4];
 #define TEST_APP_ACCESSIBLE static
 #endif
 
+#ifdef __arm__
 #define OMG_BREAK() __asm__ volatile ("BKPT")
+#else
+#define OMG_BREAK() __builtin_trap()
+#endif
 
 #define APP_MAX(a,b)                    \
 ({                                      \
@@ -51,13 +55,20 @@ extern const uint8_t FW_VERSION[4];
 
 #define APP_TASK(__NAME__) __NAME__##_task
 
+#ifdef LINUX_HAL
+// host tasks run on pthreads and call into libc, which needs considerably more stack
+#define APP_STACK_SCALE 16
+#else
+#define APP_STACK_SCALE 1
+#endif
+
 #define _APP_DEF_TASK(__NAME__, __STACK_SIZE__) \
   void __NAME__##_task_entry(void* pvParameters); \
   static StaticTask_t __NAME__##_task_memory; \
-  static StackType_t __NAME__##_task_stack[__STACK_SIZE__]
+  static StackType_t __NAME__##_task_stack[(__STACK_SIZE__) * APP_STACK_SCALE]
 
 #define _APP_CREATE_TASK(__NAME__, __PRIO__) \
-  xTaskCreateStatic(__NAME__##_task_entry, #__NAME__, (sizeof(__NAME__##_task_stack)/sizeof(uint32_t)), NULL, __PRIO__, __NAME__##_task_stack, &__NAME__##_task_memory)
+  xTaskCreateStatic(__NAME__##_task_entry, #__NAME__, (sizeof(__NAME__##_task_stack)/sizeof(StackType_t)), NULL, __PRIO__, __NAME__##_task_stack, &__NAME__##_task_memory)
 
 #define APP_DEF_TASK(__NAME__, __STACK_SIZE__) \
   _APP_DEF_TASK(__NAME__, __STACK_SIZE__); \
@@ -73,6 +84,7 @@ extern const uint8_t FW_VERSION[4];
 #define APP_DEF_EXTERN_TASK(__NAME__) \
   extern TaskHandle_t APP_TASK(__NAME__)
 
+#ifdef __arm__
 static inline uint32_t rev32(uint32_t value) {
   __asm__ volatile (
       "REV %0, %0  \n"
@@ -90,6 +102,15 @@ static inline uint32_t rev16(uint16_t value) {
   );
   return value;
 }
+#else
+static inline uint32_t rev32(uint32_t value) {
+  return __builtin_bswap32(value);
+}
+
+static inline uint32_t rev16(uint16_t value) {
+  return __builtin_bswap16(value);
+}
+#endif
 
 static inline void rev32_all(uint32_t* out, uint32_t* in, size_t len) {
   len >>= 2;
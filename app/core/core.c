@@ -8,7 +8,9 @@
 #include "ethereum/eth_db.h"
 #include "mem.h"
 #include "keycard/keycard_cmdset.h"
+#include "pwr.h"
 #include "settings.h"
+#include "storage/fs.h"
 #include "storage/keys.h"
 #include "ui/ui_internal.h"
 #include "util/tlv.h"
@@ -597,11 +599,36 @@ void core_addresses_bitcoin() {
   core_addresses(LSTR(QR_ADDRESS_BTC_TITLE), BTC_NATIVE_SEGWIT_PURPOSE, BTC_MAINNET_COIN, core_btc_addr_encoder);
 }
 
+// At the main menu no entry pointer is held, so the flash is compacted until an event arrives. The steps run at idle
+// priority and each rewrites a single page, so an event waits for one page at most
+static BaseType_t core_wait_idle(uint32_t* events) {
+  UBaseType_t prio = uxTaskPriorityGet(NULL);
+  BaseType_t res;
+
+  vTaskPrioritySet(NULL, tskIDLE_PRIORITY);
+
+  while ((res = xTaskNotifyWaitIndexed(CORE_EVENT_IDX, 0, UINT32_MAX, events, 0)) != pdPASS) {
+    app_err_t err = fs_compact_step();
+    pwr_handle_deferred();
+
+    if (err != ERR_OK) {
+      break;
+    }
+  }
+
+  vTaskPrioritySet(NULL, prio);
+
+  return res;
+}
+
 core_evt_t core_wait_event(uint32_t timeout, uint8_t accept_usb) {
   uint32_t events;
 
-  BaseType_t res = pdFAIL;
-  res = xTaskNotifyWaitIndexed(CORE_EVENT_IDX, 0, UINT32_MAX, &events, timeout);
+  BaseType_t res = g_core.idle ? core_wait_idle(&events) : pdFAIL;
+
+  if (res != pdPASS) {
+    res = xTaskNotifyWaitIndexed(CORE_EVENT_IDX, 0, UINT32_MAX, &events, timeout);
+  }
 
   if (res != pdPASS) {
     return CORE_EVT_NONE;
@@ -8,6 +8,7 @@
 #include "crypto/sha3.h"
 #include "ethereum/ethUstream.h"
 #include "ethereum/eip712.h"
+#include "ethereum/eth_db.h"
 #include "keycard/keycard.h"
 #include "iso7816/smartcard.h"
 #include "ui/ui.h"
@@ -48,9 +49,15 @@ typedef struct {
   size_t cbor_len;
 } core_key_t;
 
+typedef struct {
+  SHA256_CTX sha2;
+} core_fw_upgrade_t;
+
 typedef struct {
   core_eth_tx_t eth_tx;
   core_msg_t msg;
+  core_fw_upgrade_t fw_upgrade;
+  eth_db_stage_t db_stage;
   eip712_ctx_t eip712;
   core_sig_t sig;
   core_key_t key;
@@ -58,6 +65,7 @@ typedef struct {
 
 typedef struct {
   bool ready;
+  bool idle;
   keycard_t keycard;
   command_t usb_command;
   uint32_t master_fingerprint;
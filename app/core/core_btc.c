@@ -4,28 +4,24 @@
 #include "bitcoin/bitcoin.h"
 #include "bitcoin/psbt.h"
 #include "bitcoin/compactsize.h"
+#include "bitcoin/sighash.h"
 #include "crypto/script.h"
-#include "crypto/sha2_soft.h"
 #include "crypto/util.h"
 #include "keycard/keycard_cmdset.h"
 #include "ur/ur_encode.h"
 #include "util/tlv.h"
 
-#define BTC_TXID_LEN 32
 #define BTC_MSG_MAGIC_LEN 25
 #define BTC_MSG_SIG_LEN 65
 
 #define BTC_MESSAGE_SIG_HEADER (27 + 4)
 
-static const uint8_t P2PKH_SCRIPT_PRE[4] = { 0x19, 0x76, 0xa9, 0x14 };
-static const uint8_t P2PKH_SCRIPT_POST[2] = { 0x88, 0xac };
-
 const uint8_t *const BTC_MSG_MAGIC = (uint8_t *) "\030Bitcoin Signed Message:\n";
 
 struct btc_utxo_ctx {
-  btc_tx_ctx_t* tx_ctx;
+  psbt_input_data_t* input;
   uint32_t output_count;
-  uint32_t input_index;
+  uint32_t output_index;
 };
 
 static void core_btc_utxo_handler(psbt_txelem_t* elem) {
@@ -35,66 +31,62 @@ static void core_btc_utxo_handler(psbt_txelem_t* elem) {
 
   struct btc_utxo_ctx* utxo_ctx = (struct btc_utxo_ctx*) elem->user_data;
 
-  if (utxo_ctx->tx_ctx->inputs[utxo_ctx->input_index].index != utxo_ctx->output_count++) {
+  if (utxo_ctx->output_index != utxo_ctx->output_count++) {
     return;
   }
 
   psbt_txout_t* tx_out = elem->elem.txout;
-  utxo_ctx->tx_ctx->input_data[utxo_ctx->input_index].amount = tx_out->amount;
-  utxo_ctx->tx_ctx->input_data[utxo_ctx->input_index].script_pubkey = tx_out->script;
-  utxo_ctx->tx_ctx->input_data[utxo_ctx->input_index].script_pubkey_len = tx_out->script_len;
+  utxo_ctx->input->amount = tx_out->amount;
+  utxo_ctx->input->script_pubkey = tx_out->script;
+  utxo_ctx->input->script_pubkey_len = tx_out->script_len;
 }
 
 static void core_btc_psbt_input_rec_handler(btc_tx_ctx_t* tx_ctx, size_t index, psbt_record_t* rec) {
-  if (index >= tx_ctx->input_count) {
-    tx_ctx->error = ERR_DATA;
-    return;
-  }
-
+  psbt_input_data_t* input = &tx_ctx->input;
   struct btc_utxo_ctx utxo_ctx;
 
   switch (rec->type) {
   case PSBT_IN_NON_WITNESS_UTXO:
-    utxo_ctx.tx_ctx = tx_ctx;
+    utxo_ctx.input = input;
     utxo_ctx.output_count = 0;
-    utxo_ctx.input_index = index;
-    tx_ctx->input_data[index].nonwitness_utxo = rec->val;
-    tx_ctx->input_data[index].nonwitness_utxo_len = rec->val_size;
+    utxo_ctx.output_index = btc_txin_u32(tx_ctx, index, BTC_TXIN_INDEX_OFF);
+    input->nonwitness_utxo = rec->val;
+    input->nonwitness_utxo_len = rec->val_size;
     if (psbt_btc_tx_parse(rec->val, rec->val_size, &utxo_ctx, core_btc_utxo_handler) != PSBT_OK) {
       tx_ctx->error = ERR_DECODE;
     }
     break;
   case PSBT_IN_REDEEM_SCRIPT:
-    tx_ctx->input_data[index].redeem_script = rec->val;
-    tx_ctx->input_data[index].redeem_script_len = rec->val_size;
+    input->redeem_script = rec->val;
+    input->redeem_script_len = rec->val_size;
     break;
   case PSBT_IN_WITNESS_SCRIPT:
-    tx_ctx->input_data[index].witness_script = rec->val;
-    tx_ctx->input_data[index].witness_script_len = rec->val_size;
+    input->witness_script = rec->val;
+    input->witness_script_len = rec->val_size;
     break;
   case PSBT_IN_WITNESS_UTXO:
     if (rec->val_size < 9) {
         tx_ctx->error = ERR_DECODE;
         return;
     }
-    if (rec->val[8] >= 253) {
+    if ((rec->val[8] >= 253) || (rec->val[8] != (rec->val_size - 9))) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    tx_ctx->input_data[index].amount = rec->val;
-    tx_ctx->input_data[index].script_pubkey = &rec->val[9];
-    tx_ctx->input_data[index].script_pubkey_len = rec->val_size - 9;
-    tx_ctx->input_data[index].witness = true;
+    input->amount = rec->val;
+    input->script_pubkey = &rec->val[9];
+    input->script_pubkey_len = rec->val_size - 9;
+    input->witness = true;
     break;
   case PSBT_IN_BIP32_DERIVATION:
     if (rec->val_size < 4) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    if (tx_ctx->input_data[index].master_fingerprint != tx_ctx->mfp) {
-      memcpy(&tx_ctx->input_data[index].master_fingerprint, rec->val, sizeof(uint32_t));
-      tx_ctx->input_data[index].bip32_path = &rec->val[4];
-      tx_ctx->input_data[index].bip32_path_len = rec->val_size - 4;
+    if (input->master_fingerprint != tx_ctx->mfp) {
+      memcpy(&input->master_fingerprint, rec->val, sizeof(uint32_t));
+      input->bip32_path = &rec->val[4];
+      input->bip32_path_len = rec->val_size - 4;
     }
     break;
   case PSBT_IN_SIGHASH_TYPE:
@@ -102,360 +94,115 @@ static void core_btc_psbt_input_rec_handler(btc_tx_ctx_t* tx_ctx, size_t index,
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    memcpy(&tx_ctx->input_data[index].sighash_flag, rec->val, sizeof(uint32_t));
+    memcpy(&input->sighash_flag, rec->val, sizeof(uint32_t));
     break;
   case PSBT_IN_TAP_INTERNAL_KEY:
     if (rec->val_size != 32) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    tx_ctx->input_data[index].taproot_internal_key = rec->val;
-    tx_ctx->input_data[index].has_taproot_internal_key = true;
+    input->taproot_internal_key = rec->val;
+    input->has_taproot_internal_key = true;
     break;
   case PSBT_IN_TAP_MERKLE_ROOT:
     if (rec->val_size != 32) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    tx_ctx->input_data[index].taproot_merkle_root = rec->val;
-    tx_ctx->input_data[index].has_taproot_merkle_root = true;
+    input->taproot_merkle_root = rec->val;
+    input->has_taproot_merkle_root = true;
     break;
   case PSBT_IN_TAP_BIP32_DERIVATION:
     if (rec->val_size < 5) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
-    if (tx_ctx->input_data[index].master_fingerprint != tx_ctx->mfp) {
-      memcpy(&tx_ctx->input_data[index].master_fingerprint, &rec->val[1], sizeof(uint32_t));
-      tx_ctx->input_data[index].bip32_path = &rec->val[5];
-      tx_ctx->input_data[index].bip32_path_len = rec->val_size - 5;
+    if (input->master_fingerprint != tx_ctx->mfp) {
+      memcpy(&input->master_fingerprint, &rec->val[1], sizeof(uint32_t));
+      input->bip32_path = &rec->val[5];
+      input->bip32_path_len = rec->val_size - 5;
     }
     break;
   }
 }
 
-static void core_btc_psbt_output_rec_handler(btc_tx_ctx_t* tx_ctx, size_t index, psbt_record_t* rec) {
-  if (index >= tx_ctx->output_count) {
-    tx_ctx->error = ERR_DATA;
-    return;
-  }
-
+static void core_btc_psbt_output_rec_handler(btc_tx_ctx_t* tx_ctx, psbt_record_t* rec) {
   if (rec->type == PSBT_OUT_BIP32_DERIVATION) {
     if (rec->val_size < 4) {
       tx_ctx->error = ERR_DECODE;
       return;
     }
 
-    if (tx_ctx->output_data[index].master_fingerprint != tx_ctx->mfp) {
-      memcpy(&tx_ctx->output_data[index].master_fingerprint, rec->val, sizeof(uint32_t));
-      tx_ctx->output_data[index].bip32_path = &rec->val[4];
-      tx_ctx->output_data[index].bip32_path_len = rec->val_size - 4;
+    if (tx_ctx->output.master_fingerprint != tx_ctx->mfp) {
+      memcpy(&tx_ctx->output.master_fingerprint, rec->val, sizeof(uint32_t));
+      tx_ctx->output.bip32_path = &rec->val[4];
+      tx_ctx->output.bip32_path_len = rec->val_size - 4;
     }
   }
 }
 
-static void core_btc_txelem_handler(btc_tx_ctx_t* tx_ctx, psbt_txelem_t* elem) {
-  switch (elem->elem_type) {
-  case PSBT_TXELEM_TX:
-    memcpy(&tx_ctx->tx, elem->elem.tx, sizeof(psbt_tx_t));
-    break;
-  case PSBT_TXELEM_TXIN:
-    if (tx_ctx->input_count < BTC_MAX_INPUTS) {
-      memcpy(&tx_ctx->inputs[tx_ctx->input_count++], elem->elem.txin, sizeof(psbt_txin_t));
-    } else {
-      tx_ctx->error = ERR_FULL;
-    }
-    break;
-  case PSBT_TXELEM_TXOUT:
-    if (tx_ctx->output_count < BTC_MAX_OUTPUTS) {
-      memcpy(&tx_ctx->outputs[tx_ctx->output_count++], elem->elem.txout, sizeof(psbt_txout_t));
-    } else {
-      tx_ctx->error = ERR_FULL;
-    }
-    break;
-  default:
-    break;
+static void* core_btc_summary_alloc(btc_tx_ctx_t* tx_ctx, size_t len) {
+  if ((tx_ctx->summary_capacity - tx_ctx->summary_len) < len) {
+    tx_ctx->error = ERR_FULL;
+    return NULL;
   }
-}
-
-static void core_btc_parser_cb(psbt_elem_t* rec) {
-  btc_tx_ctx_t* tx_ctx = (btc_tx_ctx_t*) rec->user_data;
 
-  if (rec->type == PSBT_ELEM_RECORD) {
-    switch (rec->elem.rec->scope) {
-    case PSBT_SCOPE_INPUTS:
-      core_btc_psbt_input_rec_handler(tx_ctx, rec->index, rec->elem.rec);
-      break;
-    case PSBT_SCOPE_OUTPUTS:
-      core_btc_psbt_output_rec_handler(tx_ctx, rec->index, rec->elem.rec);
-      break;
-    default:
-      break;
-    }
-  } else if (rec->type == PSBT_ELEM_TXELEM) {
-    core_btc_txelem_handler(tx_ctx, rec->elem.txelem);
-  }
+  void* p = &((uint8_t*) tx_ctx->inputs)[tx_ctx->summary_len];
+  memset(p, 0, len);
+  tx_ctx->summary_len += len;
+  return p;
 }
 
-static app_err_t core_btc_hash_legacy(btc_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
-  SHA256_CTX sha256;
-  sha256_Init(&sha256);
-
-  uint8_t sighash = tx_ctx->input_data[index].sighash_flag & SIGHASH_MASK;
-  uint8_t anyonecanpay = tx_ctx->input_data[index].sighash_flag & SIGHASH_ANYONECANPAY;
-
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
+static void core_btc_index_record(btc_tx_ctx_t* tx_ctx, psbt_elem_t* rec) {
+  psbt_record_ref_t* ref = core_btc_summary_alloc(tx_ctx, sizeof(psbt_record_ref_t));
 
-  uint8_t* script;
-  size_t script_len;
-
-  if (tx_ctx->input_data[index].input_type == BTC_INPUT_TYPE_LEGACY_WITH_REDEEM) {
-    script = tx_ctx->input_data[index].redeem_script;
-    script_len = tx_ctx->input_data[index].redeem_script_len;
-  } else {
-    script = tx_ctx->input_data[index].script_pubkey;
-    script_len = tx_ctx->input_data[index].script_pubkey_len;
-  }
-
-  uint8_t cscript_len[sizeof(uint64_t)];
-  uint8_t csize_len = compactsize_length(script_len);
-  compactsize_write(cscript_len, script_len);
-
-  if (anyonecanpay) {
-    uint8_t tmp = 1;
-    sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
-    sha256_Update(&sha256, tx_ctx->inputs[index].txid, BTC_TXID_LEN);
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].index, sizeof(uint32_t));
-    sha256_Update(&sha256, cscript_len, csize_len);
-    sha256_Update(&sha256, script, script_len);
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].sequence_number, sizeof(uint32_t));
-  } else{
-    for (int i = 0; i < tx_ctx->input_count; i++) {
-      sha256_Update(&sha256, (uint8_t*) &tx_ctx->input_count, sizeof(uint8_t));
-      sha256_Update(&sha256, tx_ctx->inputs[i].txid, BTC_TXID_LEN);
-      sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[i].index, sizeof(uint32_t));
-
-      if (i == index) {
-        sha256_Update(&sha256, cscript_len, csize_len);
-        sha256_Update(&sha256, script, script_len);
-      } else {
-        uint8_t tmp = 0;
-        sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
-      }
-
-      if ((sighash == SIGHASH_ALL) || (i == index)) {
-        sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[i].sequence_number, sizeof(uint32_t));
-      } else {
-        uint32_t tmp = 0;
-        sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint32_t));
-      }
+  if (ref) {
+    if (tx_ctx->record_count == 0) {
+      tx_ctx->records = ref;
     }
-  }
 
-  if (sighash == SIGHASH_NONE) {
-    uint8_t tmp = 0;
-    sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
-  } else {
-    uint8_t out_count = sighash == SIGHASH_SINGLE ? (index + 1) : tx_ctx->output_count;
-    sha256_Update(&sha256, (uint8_t*) &out_count, sizeof(uint8_t));
-    for (int i = 0; i < out_count; i++) {
-      if ((sighash == SIGHASH_ALL) || (i == index)) {
-        size_t len = ((uint32_t) tx_ctx->outputs[i].script - (uint32_t) tx_ctx->outputs[i].amount) + tx_ctx->outputs[i].script_len;
-        sha256_Update(&sha256, tx_ctx->outputs[i].amount, len);
-      } else {
-        int64_t amount = -1;
-        uint8_t tmp = 0;
-        sha256_Update(&sha256, (uint8_t*) &amount, sizeof(uint64_t));
-        sha256_Update(&sha256, (uint8_t*) &tmp, sizeof(uint8_t));
-      }
-    }
+    psbt_record_ref(rec, ref);
+    tx_ctx->record_count++;
   }
-
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->input_data[index].sighash_flag, sizeof(uint32_t));
-
-  sha256_Final(&sha256, digest);
-  sha256_Raw(digest, SHA256_DIGEST_LENGTH, digest);
-
-  return ERR_OK;
 }
 
-static app_err_t core_btc_hash_segwit(btc_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
-  SHA256_CTX sha256;
-  sha256_Init(&sha256);
-
-  // BIP143 uses double-SHA256 for the sub-hashes. core_btc_common_hashes stores
-  // single-SHA256 (as required by BIP341 taproot), so double-hash them here.
-  uint8_t hprev[SHA256_DIGEST_LENGTH];
-  uint8_t hseq[SHA256_DIGEST_LENGTH];
-  uint8_t hout[SHA256_DIGEST_LENGTH];
-  sha256_Raw(tx_ctx->hash_prevouts, SHA256_DIGEST_LENGTH, hprev);
-  sha256_Raw(tx_ctx->hash_sequence, SHA256_DIGEST_LENGTH, hseq);
-  sha256_Raw(tx_ctx->hash_outputs, SHA256_DIGEST_LENGTH, hout);
-
-  uint8_t sighash = tx_ctx->input_data[index].sighash_flag & SIGHASH_MASK;
-  uint8_t anyonecanpay = tx_ctx->input_data[index].sighash_flag & SIGHASH_ANYONECANPAY;
-
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
-
-  if (anyonecanpay) {
-    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
-  } else {
-    sha256_Update(&sha256, hprev, SHA256_DIGEST_LENGTH);
-  }
-
-  if (anyonecanpay || (sighash != SIGHASH_ALL)) {
-    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
-  } else {
-    sha256_Update(&sha256, hseq, SHA256_DIGEST_LENGTH);
-  }
-
-  sha256_Update(&sha256, tx_ctx->inputs[index].txid, BTC_TXID_LEN);
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].index, sizeof(uint32_t));
-
-  if (tx_ctx->input_data[index].input_type == BTC_INPUT_TYPE_P2WPKH) {
-    sha256_Update(&sha256, P2PKH_SCRIPT_PRE, sizeof(P2PKH_SCRIPT_PRE));
-    if (tx_ctx->input_data[index].redeem_script) {
-      sha256_Update(&sha256, &tx_ctx->input_data[index].redeem_script[2], BTC_PUBKEY_HASH_LEN);
-    } else {
-      sha256_Update(&sha256, &tx_ctx->input_data[index].script_pubkey[2], BTC_PUBKEY_HASH_LEN);
+static void core_btc_txelem_handler(btc_tx_ctx_t* tx_ctx, psbt_txelem_t* elem) {
+  switch (elem->elem_type) {
+  case PSBT_TXELEM_TX:
+    memcpy(&tx_ctx->tx, elem->elem.tx, sizeof(psbt_tx_t));
+    break;
+  case PSBT_TXELEM_TXIN:
+    // the unsigned transaction must have empty scripts, which keeps its inputs at a fixed size
+    if (elem->elem.txin->script_len) {
+      tx_ctx->error = ERR_DATA;
+      break;
     }
-    sha256_Update(&sha256, P2PKH_SCRIPT_POST, sizeof(P2PKH_SCRIPT_POST));
-  } else {
-    uint8_t csize[sizeof(uint64_t)];
-    compactsize_write(csize, tx_ctx->input_data[index].witness_script_len);
-    sha256_Update(&sha256, csize, compactsize_length(tx_ctx->input_data[index].witness_script_len));
-    sha256_Update(&sha256, tx_ctx->input_data[index].witness_script, tx_ctx->input_data[index].witness_script_len);
-  }
-
-  sha256_Update(&sha256, tx_ctx->input_data[index].amount, sizeof(uint64_t));
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].sequence_number, sizeof(uint32_t));
-
-  if (sighash == SIGHASH_ALL) {
-    sha256_Update(&sha256, hout, SHA256_DIGEST_LENGTH);
-  } else if ((sighash == SIGHASH_SINGLE) && (index < tx_ctx->output_count)) {
-    SOFT_SHA256_CTX inner_sha256;
-    uint8_t inner_digest[SHA256_DIGEST_LENGTH];
-    soft_sha256_Init(&inner_sha256);
-    size_t output_len = ((uint32_t) tx_ctx->outputs[index].script - (uint32_t) tx_ctx->outputs[index].amount) + tx_ctx->outputs[index].script_len;
-    soft_sha256_Update(&inner_sha256, tx_ctx->outputs[index].amount, output_len);
-    soft_sha256_Final(&inner_sha256, inner_digest);
-
-    soft_sha256_Init(&inner_sha256);
-    soft_sha256_Update(&inner_sha256, inner_digest, SHA256_DIGEST_LENGTH);
-    soft_sha256_Final(&inner_sha256, inner_digest);
-
-    sha256_Update(&sha256, inner_digest, SHA256_DIGEST_LENGTH);
-  } else {
-    sha256_Update(&sha256, ZERO32, SHA256_DIGEST_LENGTH);
-  }
 
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->input_data[index].sighash_flag, sizeof(uint32_t));
-
-  sha256_Final(&sha256, digest);
-  sha256_Raw(digest, SHA256_DIGEST_LENGTH, digest);
-  return ERR_OK;
-}
+    if (tx_ctx->input_count == 0) {
+      tx_ctx->txins = elem->elem.txin->txid;
+    }
 
-static app_err_t core_btc_hash_taproot(btc_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]) {
-  uint8_t sighash = tx_ctx->input_data[index].sighash_flag & 0xff;
-  uint8_t base_type = sighash & SIGHASH_MASK;
-  bool anyonecanpay = sighash & SIGHASH_ANYONECANPAY;
-
-  // SIGHASH_DEFAULT (0x00) signs over the whole transaction like SIGHASH_ALL
-  if (base_type == SIGHASH_DEFAULT) {
-    base_type = SIGHASH_ALL;
-  }
-
-  // only defined hash_type values are allowed (0x00, 0x01, 0x02, 0x03, 0x81, 0x82, 0x83)
-  switch (sighash) {
-  case SIGHASH_DEFAULT:
-  case SIGHASH_ALL:
-  case SIGHASH_NONE:
-  case SIGHASH_SINGLE:
-  case (SIGHASH_ALL | SIGHASH_ANYONECANPAY):
-  case (SIGHASH_NONE | SIGHASH_ANYONECANPAY):
-  case (SIGHASH_SINGLE | SIGHASH_ANYONECANPAY):
+    if (core_btc_summary_alloc(tx_ctx, sizeof(btc_input_t))) {
+      tx_ctx->input_count++;
+    }
     break;
-  default:
-    return ERR_DATA;
-  }
-
-  // hash_TapSighash(0x00 || SigMsg): tagged hash with a single SHA256 over the
-  // tag prefix, the sighash epoch byte 0x00 and the signature message.
-  uint8_t tag_hash[SHA256_DIGEST_LENGTH];
-  sha256_Raw((uint8_t*) "TapSighash", 10, tag_hash);
-
-  SHA256_CTX sha256;
-  sha256_Init(&sha256);
-  sha256_Update(&sha256, tag_hash, SHA256_DIGEST_LENGTH);
-  sha256_Update(&sha256, tag_hash, SHA256_DIGEST_LENGTH);
-  uint8_t epoch = 0;
-  sha256_Update(&sha256, &epoch, 1);
-
-  // hash_type
-  sha256_Update(&sha256, &sighash, 1);
-
-  // nVersion
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.version, sizeof(uint32_t));
-
-  // nLockTime
-  sha256_Update(&sha256, (uint8_t*) &tx_ctx->tx.lock_time, sizeof(uint32_t));
-
-  // Transaction level data
-  if (!anyonecanpay) {
-    sha256_Update(&sha256, tx_ctx->hash_prevouts, SHA256_DIGEST_LENGTH);
-    sha256_Update(&sha256, tx_ctx->hash_amounts, SHA256_DIGEST_LENGTH);
-    sha256_Update(&sha256, tx_ctx->hash_scriptpubkeys, SHA256_DIGEST_LENGTH);
-    sha256_Update(&sha256, tx_ctx->hash_sequence, SHA256_DIGEST_LENGTH);
-  }
-
-  if ((base_type != SIGHASH_NONE) && (base_type != SIGHASH_SINGLE)) {
-    sha256_Update(&sha256, tx_ctx->hash_outputs, SHA256_DIGEST_LENGTH);
-  }
-
-  // spend_type = (ext_flag * 2) + annex_present = 0 (no BIP342 extension, no annex)
-  uint8_t spend_type = 0;
-  sha256_Update(&sha256, &spend_type, 1);
-
-  if (anyonecanpay) {
-    // outpoint (32-byte txid + 4-byte index)
-    sha256_Update(&sha256, tx_ctx->inputs[index].txid, BTC_TXID_LEN);
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].index, sizeof(uint32_t));
-    // amount
-    sha256_Update(&sha256, tx_ctx->input_data[index].amount, sizeof(uint64_t));
-    // scriptPubKey serialized as script inside CTxOut (compact size length prefix)
-    uint8_t csize[sizeof(uint64_t)];
-    compactsize_write(csize, tx_ctx->input_data[index].script_pubkey_len);
-    sha256_Update(&sha256, csize, compactsize_length(tx_ctx->input_data[index].script_pubkey_len));
-    sha256_Update(&sha256, tx_ctx->input_data[index].script_pubkey, tx_ctx->input_data[index].script_pubkey_len);
-    // nSequence
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[index].sequence_number, sizeof(uint32_t));
-  } else {
-    // input_index
-    uint32_t idx = index;
-    sha256_Update(&sha256, (uint8_t*) &idx, sizeof(uint32_t));
-  }
-
-  if (base_type == SIGHASH_SINGLE) {
-    if (index >= tx_ctx->output_count) {
-      return ERR_DATA; // SIGHASH_SINGLE without a corresponding output
+  case PSBT_TXELEM_TXOUT:
+    if (tx_ctx->output_count == 0) {
+      tx_ctx->txouts = elem->elem.txout->amount;
+      tx_ctx->outputs = (btc_output_t*) &tx_ctx->inputs[tx_ctx->input_count];
     }
 
-    // sha_single_output: single SHA256 of the corresponding output in CTxOut format
-    SHA256_CTX inner;
-    uint8_t inner_digest[SHA256_DIGEST_LENGTH];
-    size_t output_len = ((uint32_t) tx_ctx->outputs[index].script - (uint32_t) tx_ctx->outputs[index].amount) + tx_ctx->outputs[index].script_len;
-    sha256_Init(&inner);
-    sha256_Update(&inner, tx_ctx->outputs[index].amount, output_len);
-    sha256_Final(&inner, inner_digest);
+    btc_output_t* out = core_btc_summary_alloc(tx_ctx, sizeof(btc_output_t));
 
-    sha256_Update(&sha256, inner_digest, SHA256_DIGEST_LENGTH);
+    if (out) {
+      out->txout = elem->elem.txout->amount - tx_ctx->psbt;
+      tx_ctx->txouts_len = (&elem->elem.txout->script[elem->elem.txout->script_len]) - tx_ctx->txouts;
+      tx_ctx->output_count++;
+    }
+    break;
+  default:
+    break;
   }
-
-  sha256_Final(&sha256, digest);
-  return ERR_OK;
 }
 
 static app_err_t core_btc_read_signature(uint8_t* data, uint8_t sighash, psbt_record_t* rec) {
@@ -552,358 +299,414 @@ static app_err_t core_btc_set_path(uint8_t* btc_bip32_path, uint32_t btc_bip32_p
   return ERR_OK;
 }
 
-static app_err_t core_btc_sign_input(btc_tx_ctx_t* tx_ctx, size_t index) {
-  if (!tx_ctx->input_data[index].can_sign) {
-    return ERR_OK;
+static inline bool core_btc_is_valid_redeem_script(uint8_t* script, size_t script_len, uint8_t* redeem_script, size_t redeem_script_len) {
+  if (script_is_p2sh(script, script_len)) {
+    uint8_t digest[RIPEMD160_DIGEST_LENGTH];
+    hash160(redeem_script, redeem_script_len, digest);
+
+    return memcmp(digest, &script[2], RIPEMD160_DIGEST_LENGTH) == 0;
   }
 
-  app_err_t err;
-  uint8_t digest[SHA256_DIGEST_LENGTH];
+  return false;
+}
 
-  switch(tx_ctx->input_data[index].input_type) {
-  case BTC_INPUT_TYPE_LEGACY:
-  case BTC_INPUT_TYPE_LEGACY_WITH_REDEEM:
-    err = core_btc_hash_legacy(tx_ctx, index, digest);
-    break;
-  case BTC_INPUT_TYPE_P2WPKH:
-  case BTC_INPUT_TYPE_P2WSH:
-    err = core_btc_hash_segwit(tx_ctx, index, digest);
-    break;
-  case BTC_INPUT_TYPE_P2TR:
-    err = core_btc_hash_taproot(tx_ctx, index, digest);
-    break;
-  default:
-    err = ERR_DATA;
-    break;
+static inline bool core_btc_is_valid_witness_script(uint8_t* script, size_t script_len, uint8_t* witness_script, size_t witness_script_len) {
+  if (script_is_p2wsh(script, script_len) && (witness_script != NULL)) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    sha256_Raw(witness_script, witness_script_len, digest);
+
+    return memcmp(digest, &script[2], SHA256_DIGEST_LENGTH) == 0;
   }
 
-  if (err != ERR_OK) {
-    return err == ERR_UNSUPPORTED ? ERR_OK : err;
+  return false;
+}
+
+static bool core_btc_pubkey_matches_output(const uint8_t* pubkey, const uint8_t* script, size_t script_len) {
+  uint8_t off;
+
+  if (script_is_p2pkh(script, script_len)) {
+    off = 3;
+  } else if (script_is_p2wpkh(script, script_len)) {
+    off = 2;
+  } else {
+    off = 0;
   }
 
-  keycard_t *kc = &g_core.keycard;
+  if (script_is_p2tr(script, script_len)) {
+    return memcmp(&pubkey[1], &script[2], 32) == 0;
+  }
+
+  uint8_t tmp[RIPEMD160_DIGEST_LENGTH];
+  hash160(pubkey, PUBKEY_COMPRESSED_LEN, tmp);
+
+  return memcmp(tmp, &script[off], RIPEMD160_DIGEST_LENGTH) == 0;
+}
 
-  if (core_btc_set_path(tx_ctx->input_data[index].bip32_path, tx_ctx->input_data[index].bip32_path_len) != ERR_OK) {
+static app_err_t core_btc_input_finish(btc_tx_ctx_t* tx_ctx, size_t index) {
+  psbt_input_data_t* input = &tx_ctx->input;
+  btc_input_t* summary = &tx_ctx->inputs[index];
+
+  // the amounts and scripts of all inputs are displayed and, for taproot, signed
+  if (!input->amount) {
     return ERR_DATA;
   }
 
-  psbt_record_t signature;
+  summary->utxo = input->amount - tx_ctx->psbt;
+  summary->sighash_flag = input->sighash_flag;
 
-  if (tx_ctx->input_data[index].input_type == BTC_INPUT_TYPE_P2TR) {
-    // For taproot the tweak value must be added to the signing key by the keycard.
-    // The "hash" argument is the concatenation of the BIP341 sighash (32 bytes)
-    // and the taproot tweak t = hash_TapTweak(internal_key || merkle_root) (32 bytes).
-    if (!tx_ctx->input_data[index].has_taproot_internal_key) {
-      return ERR_DATA;
-    }
+  if (input->master_fingerprint != tx_ctx->mfp) {
+    return ERR_OK;
+  }
 
-    uint8_t tag_hash[SHA256_DIGEST_LENGTH];
-    sha256_Raw((uint8_t*) "TapTweak", 8, tag_hash);
+  if (input->nonwitness_utxo && !btc_txid_verify(&tx_ctx->txid_cache, input->nonwitness_utxo, input->nonwitness_utxo_len, btc_txin(tx_ctx, index))) {
+    return ERR_DATA;
+  }
 
-    SHA256_CTX sha256;
-    sha256_Init(&sha256);
-    sha256_Update(&sha256, tag_hash, SHA256_DIGEST_LENGTH);
-    sha256_Update(&sha256, tag_hash, SHA256_DIGEST_LENGTH);
-    sha256_Update(&sha256, tx_ctx->input_data[index].taproot_internal_key, BTC_TAPROOT_WITPROG_LEN);
-    if (tx_ctx->input_data[index].has_taproot_merkle_root) {
-      sha256_Update(&sha256, tx_ctx->input_data[index].taproot_merkle_root, SHA256_DIGEST_LENGTH);
-    }
+  if (input->witness) {
+    uint8_t *script;
+    size_t script_len;
 
-    uint8_t hash_tweak[2 * SHA256_DIGEST_LENGTH];
-    memcpy(hash_tweak, digest, SHA256_DIGEST_LENGTH);
-    sha256_Final(&sha256, &hash_tweak[SHA256_DIGEST_LENGTH]);
+    if (input->redeem_script) {
+      if (!core_btc_is_valid_redeem_script(input->script_pubkey, input->script_pubkey_len, input->redeem_script, input->redeem_script_len)) {
+        return ERR_DATA;
+      }
 
-    if ((keycard_cmd_sign(kc, KEYCARD_SIGN_BIP340_SCHNORR, g_core.bip44_path, g_core.bip44_path_len, hash_tweak) != ERR_OK) || (APDU_SW(&kc->apdu) != 0x9000)) {
-      return ERR_CRYPTO;
+      script = input->redeem_script;
+      script_len = input->redeem_script_len;
+    } else {
+      script = input->script_pubkey;
+      script_len = input->script_pubkey_len;
     }
 
-    uint8_t* data = APDU_RESP(&kc->apdu);
-    if (core_btc_read_schnorr_signature(data, &signature) != ERR_OK) {
+    if (script_is_p2wpkh(script, script_len)) {
+      input->input_type = BTC_INPUT_TYPE_P2WPKH;
+    } else if (script_is_p2tr(script, script_len)) {
+      input->input_type = BTC_INPUT_TYPE_P2TR;
+    } else if (core_btc_is_valid_witness_script(script, script_len, input->witness_script, input->witness_script_len)) {
+      input->input_type = BTC_INPUT_TYPE_P2WSH;
+    } else {
       return ERR_DATA;
     }
-  } else {
-    if ((keycard_cmd_sign(kc, KEYCARD_SIGN_ECDSA_SECP256K1, g_core.bip44_path, g_core.bip44_path_len, digest) != ERR_OK) || (APDU_SW(&kc->apdu) != 0x9000)) {
-      return ERR_CRYPTO;
-    }
-
-    uint8_t* data = APDU_RESP(&kc->apdu);
-    if (core_btc_read_signature(data, tx_ctx->input_data[index].sighash_flag, &signature) != ERR_OK) {
+  } else if (input->redeem_script) {
+    if (!core_btc_is_valid_redeem_script(input->script_pubkey, input->script_pubkey_len, input->redeem_script, input->redeem_script_len)) {
       return ERR_DATA;
     }
+
+    input->input_type = BTC_INPUT_TYPE_LEGACY_WITH_REDEEM;
+  } else {
+    input->input_type = BTC_INPUT_TYPE_LEGACY;
   }
 
-  psbt_write_input_record(&tx_ctx->psbt_out, &signature);
+  if (input->sighash_flag == SIGHASH_DEFAULT && (input->input_type != BTC_INPUT_TYPE_P2TR)) {
+    input->sighash_flag = SIGHASH_ALL;
+  }
+
+  summary->sighash_flag = input->sighash_flag;
+  summary->input_type = input->input_type;
+  summary->can_sign = true;
+  tx_ctx->signable_count++;
 
   return ERR_OK;
 }
 
-static void core_btc_sign_handler(psbt_elem_t* rec) {
-  btc_tx_ctx_t* tx_ctx = (btc_tx_ctx_t*) rec->user_data;
+static app_err_t core_btc_output_finish(btc_tx_ctx_t* tx_ctx, size_t index) {
+  if (tx_ctx->output.master_fingerprint != tx_ctx->mfp) {
+    return ERR_OK;
+  }
 
-  if ((rec->type == PSBT_ELEM_TXELEM) || tx_ctx->error != ERR_OK) {
-    return;
+  uint8_t pub[PUBKEY_LEN];
+  if (core_btc_set_path(tx_ctx->output.bip32_path, tx_ctx->output.bip32_path_len) != ERR_OK) {
+    return ERR_DATA;
   }
 
-  switch(rec->elem.rec->scope) {
-  case PSBT_SCOPE_GLOBAL:
-    psbt_write_global_record(&tx_ctx->psbt_out, rec->elem.rec);
-    break;
-  case PSBT_SCOPE_INPUTS:
-    if (tx_ctx->index_in < rec->index) {
-      psbt_new_input_record_set(&tx_ctx->psbt_out);
-      tx_ctx->index_in++;
-      tx_ctx->error = core_btc_sign_input(tx_ctx, tx_ctx->index_in);
-    }
+  if (core_export_public(pub, NULL, NULL, NULL) != ERR_OK) {
+    return ERR_HW;
+  }
 
-    psbt_write_input_record(&tx_ctx->psbt_out, rec->elem.rec);
-    break;
-  case PSBT_SCOPE_OUTPUTS:
-    while (tx_ctx->index_out < rec->index) {
-      psbt_new_output_record_set(&tx_ctx->psbt_out);
-      tx_ctx->index_out++;
+  const uint8_t* script;
+  size_t script_len = btc_txout_script(btc_output_txout(tx_ctx, index), &script);
+  tx_ctx->outputs[index].change = core_btc_pubkey_matches_output(pub, script, script_len);
+
+  return ERR_OK;
+}
+
+// Input and output records are collected one record set at a time, and each set is checked and summarized once the
+// next one starts
+static void core_btc_read_inputs_until(btc_tx_ctx_t* tx_ctx, int32_t index) {
+  while ((tx_ctx->error == ERR_OK) && (tx_ctx->index_in < index)) {
+    if (tx_ctx->index_in >= 0) {
+      tx_ctx->error = core_btc_input_finish(tx_ctx, tx_ctx->index_in);
+
+      // only the records of the inputs to sign are read again
+      if (!tx_ctx->inputs[tx_ctx->index_in].can_sign) {
+        tx_ctx->summary_len -= (tx_ctx->record_count - tx_ctx->input_records) * sizeof(psbt_record_ref_t);
+        tx_ctx->record_count = tx_ctx->input_records;
+      }
     }
 
-    psbt_write_output_record(&tx_ctx->psbt_out, rec->elem.rec);
-    break;
+    memset(&tx_ctx->input, 0, sizeof(psbt_input_data_t));
+    tx_ctx->input_records = tx_ctx->record_count;
+    tx_ctx->index_in++;
   }
 }
 
-static inline bool core_btc_is_valid_redeem_script(uint8_t* script, size_t script_len, uint8_t* redeem_script, size_t redeem_script_len) {
-  if (script_is_p2sh(script, script_len)) {
-    uint8_t digest[RIPEMD160_DIGEST_LENGTH];
-    hash160(redeem_script, redeem_script_len, digest);
+static void core_btc_read_outputs_until(btc_tx_ctx_t* tx_ctx, int32_t index) {
+  while ((tx_ctx->error == ERR_OK) && (tx_ctx->index_out < index)) {
+    if (tx_ctx->index_out >= 0) {
+      tx_ctx->error = core_btc_output_finish(tx_ctx, tx_ctx->index_out);
+    }
 
-    return memcmp(digest, &script[2], RIPEMD160_DIGEST_LENGTH) == 0;
+    memset(&tx_ctx->output, 0, sizeof(psbt_output_data_t));
+    tx_ctx->index_out++;
   }
-
-  return false;
 }
 
-static inline bool core_btc_is_valid_witness_script(uint8_t* script, size_t script_len, uint8_t* witness_script, size_t witness_script_len) {
-  if (script_is_p2wsh(script, script_len) && (witness_script != NULL)) {
-    uint8_t digest[SHA256_DIGEST_LENGTH];
-    sha256_Raw(witness_script, witness_script_len, digest);
+static void core_btc_parser_cb(psbt_elem_t* rec) {
+  btc_tx_ctx_t* tx_ctx = (btc_tx_ctx_t*) rec->user_data;
 
-    return memcmp(digest, &script[2], SHA256_DIGEST_LENGTH) == 0;
+  if (tx_ctx->error != ERR_OK) {
+    return;
   }
 
-  return false;
-}
+  if (rec->type == PSBT_ELEM_RECORD) {
+    switch (rec->elem.rec->scope) {
+    case PSBT_SCOPE_INPUTS:
+      if (rec->index >= tx_ctx->input_count) {
+        tx_ctx->error = ERR_DATA;
+        return;
+      }
 
-static inline bool btc_is_segwit(uint8_t* tx) {
-  return tx[4] == 0;
-}
+      core_btc_read_inputs_until(tx_ctx, rec->index);
 
-static void btc_generate_txid(uint8_t* tx, size_t tx_len, uint8_t out[SHA256_DIGEST_LENGTH]) {
-  SHA256_CTX ctx;
-  sha256_Init(&ctx);
-
-  if (btc_is_segwit(tx)) {
-    uint8_t* p = tx;
-    // this tx has been parsed before so we know it is correctly formatted, we won't repeat the same checks
-    sha256_Update(&ctx, p, sizeof(uint32_t));
-    p += sizeof(uint32_t) + sizeof(uint16_t);
-
-    uint32_t count = compactsize_read(p, NULL);
-    uint32_t lenlen = compactsize_peek_length(*p);
-    sha256_Update(&ctx, p, lenlen);
-    p += lenlen;
-
-    for(int i = 0; i < count; i++) {
-      sha256_Update(&ctx, p, SHA256_DIGEST_LENGTH + sizeof(uint32_t));
-      p += SHA256_DIGEST_LENGTH + sizeof(uint32_t);
-      uint32_t scriptlen = compactsize_read(p, NULL);
-      lenlen = compactsize_peek_length(*p);
-      sha256_Update(&ctx, p, lenlen + scriptlen + sizeof(uint32_t));
-      p += lenlen + scriptlen + sizeof(uint32_t);
-    }
+      if (tx_ctx->error == ERR_OK) {
+        core_btc_psbt_input_rec_handler(tx_ctx, rec->index, rec->elem.rec);
+        core_btc_index_record(tx_ctx, rec);
+      }
+      break;
+    case PSBT_SCOPE_OUTPUTS:
+      if (rec->index >= tx_ctx->output_count) {
+        tx_ctx->error = ERR_DATA;
+        return;
+      }
 
-    count = compactsize_read(p, NULL);
-    lenlen = compactsize_peek_length(*p);
-    sha256_Update(&ctx, p, lenlen);
-    p += lenlen;
-
-    for(int i = 0; i < count; i++) {
-      sha256_Update(&ctx, p, sizeof(uint64_t));
-      p += sizeof(uint64_t);
-      uint32_t scriptlen = compactsize_read(p, NULL);
-      lenlen = compactsize_peek_length(*p);
-      sha256_Update(&ctx, p, lenlen + scriptlen);
-      p += lenlen + scriptlen;
-    }
+      core_btc_read_inputs_until(tx_ctx, tx_ctx->input_count);
+      core_btc_read_outputs_until(tx_ctx, rec->index);
 
-    sha256_Update(&ctx, &tx[tx_len - 4], sizeof(uint32_t));
-  } else {
-    sha256_Update(&ctx, tx, tx_len);
+      if (tx_ctx->error == ERR_OK) {
+        core_btc_psbt_output_rec_handler(tx_ctx, rec->elem.rec);
+      }
+      break;
+    default:
+      break;
+    }
+  } else if (rec->type == PSBT_ELEM_TXELEM) {
+    core_btc_txelem_handler(tx_ctx, rec->elem.txelem);
   }
-
-  sha256_Final(&ctx, out);
-  sha256_Raw(out, SHA256_DIGEST_LENGTH, out);
 }
 
-static inline bool btc_validate_tx_hash(uint8_t* tx, size_t tx_len, uint8_t expected_hash[SHA256_DIGEST_LENGTH]) {
-  uint8_t digest[SHA256_DIGEST_LENGTH];
-  btc_generate_txid(tx, tx_len, digest);
-  return memcmp(expected_hash, digest, SHA256_DIGEST_LENGTH) == 0;
-}
+// An input going through the signing pipeline. Its digest is computed while the card signs the previous input, so
+// everything needed to sign it is kept here rather than in the input data of the context
+typedef struct {
+  size_t index;
+  size_t end;
+  bool sign;
+  keycard_sign_algo_t algo;
+  uint8_t* bip32_path;
+  uint32_t bip32_path_len;
+  uint8_t hash[2 * SHA256_DIGEST_LENGTH];
+} core_btc_sign_job_t;
 
-static bool core_btc_pubkey_matches_output(const uint8_t* pubkey, const psbt_txout_t* out) {
-  uint8_t off;
+// Reads back the records of the first signable input from index on and computes its digest. The index of the job is
+// the input count once no input is left
+static app_err_t core_btc_prepare_input(btc_tx_ctx_t* tx_ctx, const psbt_record_ref_t** ref, size_t index, core_btc_sign_job_t* job) {
+  const psbt_record_ref_t* refs_end = &tx_ctx->records[tx_ctx->record_count];
 
-  if (script_is_p2pkh(out->script, out->script_len)) {
-    off = 3;
-  } else if (script_is_p2wpkh(out->script, out->script_len)) {
-    off = 2;
-  } else {
-    off = 0;
+  while ((index < tx_ctx->input_count) && !tx_ctx->inputs[index].can_sign) {
+    index++;
   }
 
-  if (script_is_p2tr(out->script, out->script_len)) {
-    return memcmp(&pubkey[1], &out->script[2], 32) == 0;
-  }
+  job->index = index;
+  job->end = 0;
+  job->sign = false;
 
-  uint8_t tmp[RIPEMD160_DIGEST_LENGTH];
-  hash160(pubkey, PUBKEY_COMPRESSED_LEN, tmp);
+  if (index == tx_ctx->input_count) {
+    return ERR_OK;
+  }
 
-  return memcmp(tmp, &out->script[off], RIPEMD160_DIGEST_LENGTH) == 0;
-}
+  btc_input_t* summary = &tx_ctx->inputs[index];
+  psbt_input_data_t* input = &tx_ctx->input;
+  memset(input, 0, sizeof(psbt_input_data_t));
 
-static app_err_t core_btc_validate(btc_tx_ctx_t* tx_ctx) {
-  bool can_sign_something = false;
+  for (; (*ref < refs_end) && ((*ref)->index == index); (*ref)++) {
+    psbt_record_t rec;
 
-  for (int i = 0; i < tx_ctx->input_count; i++) {
-    if (tx_ctx->input_data[i].master_fingerprint == tx_ctx->mfp) {
-      tx_ctx->input_data[i].can_sign = true;
-      can_sign_something = true;
-    } else {
-      continue;
+    if (psbt_record_deref(tx_ctx->psbt, *ref, &rec) != PSBT_OK) {
+      return ERR_DATA;
     }
 
-    if (tx_ctx->input_data[i].nonwitness_utxo && !btc_validate_tx_hash(tx_ctx->input_data[i].nonwitness_utxo, tx_ctx->input_data[i].nonwitness_utxo_len, tx_ctx->inputs[i].txid)) {
-      return ERR_DATA;
+    // the spent output is taken from the input summary, so the UTXOs are not parsed again
+    if ((rec.type != PSBT_IN_NON_WITNESS_UTXO) && (rec.type != PSBT_IN_WITNESS_UTXO)) {
+      core_btc_psbt_input_rec_handler(tx_ctx, index, &rec);
     }
 
-    if (tx_ctx->input_data[i].witness) {
-      uint8_t *script;
-      size_t script_len;
+    job->end = (*ref)->offset + (*ref)->len;
+  }
 
-      if (tx_ctx->input_data[i].redeem_script) {
-        if (!core_btc_is_valid_redeem_script(tx_ctx->input_data[i].script_pubkey, tx_ctx->input_data[i].script_pubkey_len, tx_ctx->input_data[i].redeem_script, tx_ctx->input_data[i].redeem_script_len)) {
-          return ERR_DATA;
-        }
+  input->input_type = summary->input_type;
+  input->sighash_flag = summary->sighash_flag;
+  input->amount = (uint8_t*) btc_input_utxo(tx_ctx, index);
+  input->script_pubkey_len = btc_txout_script(input->amount, (const uint8_t**) &input->script_pubkey);
 
-        script = tx_ctx->input_data[i].redeem_script;
-        script_len = tx_ctx->input_data[i].redeem_script_len;
-      } else {
-        script = tx_ctx->input_data[i].script_pubkey;
-        script_len = tx_ctx->input_data[i].script_pubkey_len;
-      }
+  app_err_t err;
 
-      if (script_is_p2wpkh(script, script_len)) {
-        tx_ctx->input_data[i].input_type = BTC_INPUT_TYPE_P2WPKH;
-      } else if (script_is_p2tr(script, script_len)) {
-        tx_ctx->input_data[i].input_type = BTC_INPUT_TYPE_P2TR;
-      } else if (core_btc_is_valid_witness_script(script, script_len, tx_ctx->input_data[i].witness_script, tx_ctx->input_data[i].witness_script_len)) {
-        tx_ctx->input_data[i].input_type = BTC_INPUT_TYPE_P2WSH;
-      } else {
-        return ERR_DATA;
-      }
-    } else if (tx_ctx->input_data[i].script_pubkey) {
-      if (tx_ctx->input_data[i].redeem_script) {
-        if (!core_btc_is_valid_redeem_script(tx_ctx->input_data[i].script_pubkey, tx_ctx->input_data[i].script_pubkey_len, tx_ctx->input_data[i].redeem_script, tx_ctx->input_data[i].redeem_script_len)) {
-          return ERR_DATA;
-        }
-
-        tx_ctx->input_data[i].input_type = BTC_INPUT_TYPE_LEGACY_WITH_REDEEM;
-      } else {
-        tx_ctx->input_data[i].input_type = BTC_INPUT_TYPE_LEGACY;
-      }
-    } else {
+  switch(input->input_type) {
+  case BTC_INPUT_TYPE_LEGACY:
+  case BTC_INPUT_TYPE_LEGACY_WITH_REDEEM:
+    err = btc_sighash_legacy(tx_ctx, input, index, job->hash);
+    break;
+  case BTC_INPUT_TYPE_P2WPKH:
+  case BTC_INPUT_TYPE_P2WSH:
+    err = btc_sighash_segwit(tx_ctx, input, index, job->hash);
+    break;
+  case BTC_INPUT_TYPE_P2TR:
+    err = btc_sighash_taproot(tx_ctx, input, index, job->hash);
+    break;
+  default:
+    err = ERR_DATA;
+    break;
+  }
+
+  if (err != ERR_OK) {
+    return err == ERR_UNSUPPORTED ? ERR_OK : err;
+  }
+
+  if (input->input_type == BTC_INPUT_TYPE_P2TR) {
+    // For taproot the tweak value must be added to the signing key by the keycard.
+    // The "hash" argument is the concatenation of the BIP341 sighash (32 bytes)
+    // and the taproot tweak t = hash_TapTweak(internal_key || merkle_root) (32 bytes).
+    if (!input->has_taproot_internal_key) {
       return ERR_DATA;
     }
 
-    if (tx_ctx->input_data[i].sighash_flag == SIGHASH_DEFAULT && (tx_ctx->input_data[i].input_type != BTC_INPUT_TYPE_P2TR)) {
-      tx_ctx->input_data[i].sighash_flag = SIGHASH_ALL;
-    }    
+    btc_sighash_taptweak(tx_ctx, input, &job->hash[SHA256_DIGEST_LENGTH]);
+    job->algo = KEYCARD_SIGN_BIP340_SCHNORR;
+  } else {
+    job->algo = KEYCARD_SIGN_ECDSA_SECP256K1;
   }
 
-  for (int i = 0; i < tx_ctx->output_count; i++) {
-    if (tx_ctx->output_data[i].master_fingerprint == tx_ctx->mfp) {
-      uint8_t pub[PUBKEY_LEN];
-      if (core_btc_set_path(tx_ctx->output_data[i].bip32_path, tx_ctx->output_data[i].bip32_path_len) != ERR_OK) {
-        return ERR_DATA;
-      }
+  job->bip32_path = input->bip32_path;
+  job->bip32_path_len = input->bip32_path_len;
+  job->sign = true;
 
-      if (core_export_public(pub, NULL, NULL, NULL) != ERR_OK) {
-        return ERR_HW;
-      }
+  return ERR_OK;
+}
 
-      tx_ctx->output_data[i].change = core_btc_pubkey_matches_output(pub, &tx_ctx->outputs[i]);
-    }
+static app_err_t core_btc_submit_input(core_btc_sign_job_t* job) {
+  if (core_btc_set_path(job->bip32_path, job->bip32_path_len) != ERR_OK) {
+    return ERR_DATA;
   }
 
-  return can_sign_something ? ERR_OK : ERR_MISMATCH;
-}
+  if (keycard_cmd_sign_async(&g_core.keycard, job->algo, g_core.bip44_path, g_core.bip44_path_len, job->hash) != ERR_OK) {
+    return ERR_CRYPTO;
+  }
 
-static inline app_err_t core_btc_confirm(btc_tx_ctx_t* tx_ctx) {
-  return ui_display_btc_tx(tx_ctx) == CORE_EVT_UI_OK ? ERR_OK : ERR_CANCEL;
+  return ERR_OK;
 }
 
-static void core_btc_common_hashes(btc_tx_ctx_t* tx_ctx) {
-  SHA256_CTX sha256;
-  sha256_Init(&sha256);
+static app_err_t core_btc_finish_input(btc_tx_ctx_t* tx_ctx, core_btc_sign_job_t* job) {
+  keycard_t *kc = &g_core.keycard;
 
-  for(int i = 0; i < tx_ctx->input_count; i++) {
-    sha256_Update(&sha256, tx_ctx->inputs[i].txid, BTC_TXID_LEN);
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[i].index, sizeof(uint32_t));
+  if ((keycard_cmd_wait(kc) != ERR_OK) || (APDU_SW(&kc->apdu) != 0x9000)) {
+    return ERR_CRYPTO;
   }
 
-  // Sub-hashes are stored as single SHA256, which is what BIP341 taproot requires.
-  // BIP143 segwit double-hashes them at point of use (see core_btc_hash_segwit).
-  sha256_Final(&sha256, tx_ctx->hash_prevouts);
+  psbt_record_t signature;
+  uint8_t* data = APDU_RESP(&kc->apdu);
 
-  sha256_Init(&sha256);
+  if (job->algo == KEYCARD_SIGN_BIP340_SCHNORR) {
+    if (core_btc_read_schnorr_signature(data, &signature) != ERR_OK) {
+      return ERR_DATA;
+    }
+  } else if (core_btc_read_signature(data, tx_ctx->inputs[job->index].sighash_flag, &signature) != ERR_OK) {
+    return ERR_DATA;
+  }
 
-  for(int i = 0; i < tx_ctx->input_count; i++) {
-    sha256_Update(&sha256, (uint8_t*) &tx_ctx->inputs[i].sequence_number, sizeof(uint32_t));
+  if (psbt_write_input_record(&tx_ctx->psbt_out, &signature) != PSBT_OK) {
+    return ERR_FULL;
   }
 
-  sha256_Final(&sha256, tx_ctx->hash_sequence);
+  return ERR_OK;
+}
 
-  sha256_Init(&sha256);
+// The signed PSBT is the received one with a signature appended to the record set of each signed input. It is copied
+// in spans between the signatures and the records of the inputs to sign are read back from the index, so the PSBT is
+// not parsed again. Signing is pipelined: while the card signs an input its records are copied to the output and the
+// digest of the next input is computed, then the signature is appended and the next input is submitted.
+static app_err_t core_btc_sign(btc_tx_ctx_t* tx_ctx, size_t psbt_len) {
+  core_btc_sign_job_t jobs[2];
+  core_btc_sign_job_t* job = &jobs[0];
+  core_btc_sign_job_t* next = &jobs[1];
+  const psbt_record_ref_t* ref = tx_ctx->records;
+  size_t copied = 0;
 
-  for(int i = 0; i < tx_ctx->input_count; i++) {
-    sha256_Update(&sha256, tx_ctx->input_data[i].amount, sizeof(uint64_t));
-  }
+  app_err_t err = core_btc_prepare_input(tx_ctx, &ref, 0, job);
 
-  sha256_Final(&sha256, tx_ctx->hash_amounts);
+  while ((err == ERR_OK) && (job->index < tx_ctx->input_count)) {
+    bool submitted = false;
 
-  sha256_Init(&sha256);
+    if (job->sign) {
+      err = core_btc_submit_input(job);
+      submitted = err == ERR_OK;
+    }
 
-  for(int i = 0; i < tx_ctx->input_count; i++) {
-    uint8_t csize[sizeof(uint64_t)];
-    compactsize_write(csize, tx_ctx->input_data[i].script_pubkey_len);
-    sha256_Update(&sha256, csize, compactsize_length(tx_ctx->input_data[i].script_pubkey_len));
-    sha256_Update(&sha256, tx_ctx->input_data[i].script_pubkey, tx_ctx->input_data[i].script_pubkey_len);
-  }
+    size_t end = APP_MAX(job->end, copied);
+
+    if ((err == ERR_OK) && (psbt_write_raw(&tx_ctx->psbt_out, &tx_ctx->psbt[copied], end - copied, PSBT_ST_INPUTS) != PSBT_OK)) {
+      err = ERR_FULL;
+    }
 
-  sha256_Final(&sha256, tx_ctx->hash_scriptpubkeys);
+    copied = end;
+    app_err_t next_err = (err == ERR_OK) ? core_btc_prepare_input(tx_ctx, &ref, job->index + 1, next) : ERR_OK;
 
-  sha256_Init(&sha256);
+    // a submitted command is always waited for, so the card is idle whenever signing stops
+    if (submitted) {
+      app_err_t sign_err = core_btc_finish_input(tx_ctx, job);
+      err = (err == ERR_OK) ? sign_err : err;
+    }
+
+    err = (err == ERR_OK) ? next_err : err;
+
+    core_btc_sign_job_t* tmp = job;
+    job = next;
+    next = tmp;
+  }
+
+  if (err != ERR_OK) {
+    return err;
+  }
 
-  for(int i = 0; i < tx_ctx->output_count; i++) {
-    size_t len = ((uint32_t) tx_ctx->outputs[i].script - (uint32_t) tx_ctx->outputs[i].amount) + tx_ctx->outputs[i].script_len;
-    sha256_Update(&sha256, tx_ctx->outputs[i].amount, len);
+  if (psbt_write_raw(&tx_ctx->psbt_out, &tx_ctx->psbt[copied], psbt_len - copied, PSBT_ST_FINALIZED) != PSBT_OK) {
+    return ERR_FULL;
   }
 
-  sha256_Final(&sha256, tx_ctx->hash_outputs);
+  return ERR_OK;
 }
 
-static app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint8_t** psbt_out, size_t* out_len) {
+static inline app_err_t core_btc_confirm(btc_tx_ctx_t* tx_ctx) {
+  return ui_display_btc_tx(tx_ctx) == CORE_EVT_UI_OK ? ERR_OK : ERR_CANCEL;
+}
+
+TEST_APP_ACCESSIBLE app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint8_t** psbt_out, size_t* out_len) {
+  // the context is followed by the input and output summaries, the index of the records of the inputs to sign and
+  // then by the signed PSBT
   btc_tx_ctx_t* tx_ctx = (btc_tx_ctx_t*) g_camera_fb[1];
+  size_t ctx_len = (sizeof(btc_tx_ctx_t) + 3) & ~0x3;
   memset(tx_ctx, 0, sizeof(btc_tx_ctx_t));
-  *psbt_out = &g_camera_fb[1][(sizeof(btc_tx_ctx_t) + 3) & ~0x3];
-  size_t psbt_out_len = CAMERA_FB_SIZE - ((sizeof(btc_tx_ctx_t) + 3) & ~0x3);
+  tx_ctx->psbt = psbt_in;
+  tx_ctx->inputs = (btc_input_t*) &g_camera_fb[1][ctx_len];
+  tx_ctx->summary_capacity = CAMERA_FB_SIZE - ctx_len;
+  tx_ctx->index_in = -1;
+  tx_ctx->index_out = -1;
 
   uint32_t mfp;
 
@@ -915,14 +718,17 @@ static app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint
 
   psbt_t psbt;
   psbt_init(&psbt, (uint8_t*) psbt_in, psbt_len);
-  psbt_read(psbt_in, psbt_len, &psbt, core_btc_parser_cb, tx_ctx);
 
-  if (tx_ctx->error != ERR_OK) {
-    ui_info(ICON_INFO_ERROR, LSTR(INFO_MALFORMED_DATA_MSG), LSTR(INFO_MALFORMED_DATA_SUB), 0);
-    return tx_ctx->error;
+  if ((psbt_read(psbt_in, psbt_len, &psbt, core_btc_parser_cb, tx_ctx) != PSBT_OK) && (tx_ctx->error == ERR_OK)) {
+    tx_ctx->error = ERR_DATA;
   }
 
-  tx_ctx->error = core_btc_validate(tx_ctx);
+  core_btc_read_inputs_until(tx_ctx, tx_ctx->input_count);
+  core_btc_read_outputs_until(tx_ctx, tx_ctx->output_count);
+
+  if ((tx_ctx->error == ERR_OK) && (tx_ctx->signable_count == 0)) {
+    tx_ctx->error = ERR_MISMATCH;
+  }
 
   switch(tx_ctx->error) {
   case ERR_OK:
@@ -930,35 +736,33 @@ static app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint
   case ERR_MISMATCH:
     ui_info(ICON_INFO_ERROR, LSTR(INFO_CANNOT_SIGN), LSTR(INFO_CANNOT_SIGN_SUB), 0);
     return ERR_MISMATCH;
-  case ERR_DATA:
-    ui_info(ICON_INFO_ERROR, LSTR(INFO_MALFORMED_DATA_MSG), LSTR(INFO_MALFORMED_DATA_SUB), 0);
-    return ERR_DATA;
-  default:
+  case ERR_HW:
     ui_card_transport_error();
     return ERR_CRYPTO;
+  default:
+    ui_info(ICON_INFO_ERROR, LSTR(INFO_MALFORMED_DATA_MSG), LSTR(INFO_MALFORMED_DATA_SUB), 0);
+    return tx_ctx->error;
   }
 
   if (core_btc_confirm(tx_ctx) != ERR_OK) {
     return ERR_CANCEL;
   }
 
-  core_btc_common_hashes(tx_ctx);
+  btc_sighash_init(tx_ctx);
 
-  psbt_init(&psbt, (uint8_t*) psbt_in, psbt_len);
-  psbt_init(&tx_ctx->psbt_out, *psbt_out, psbt_out_len);
+  size_t summary_len = (tx_ctx->summary_len + 3) & ~0x3;
+  *psbt_out = &g_camera_fb[1][ctx_len + summary_len];
+  size_t psbt_out_len = tx_ctx->summary_capacity - summary_len;
 
-  tx_ctx->index_in = -1;
-  tx_ctx->index_out = -1;
+  psbt_init(&tx_ctx->psbt_out, *psbt_out, psbt_out_len);
 
-  if (psbt_read(psbt_in, psbt_len, &psbt, core_btc_sign_handler, tx_ctx) != PSBT_OK) {
-    ui_info(ICON_INFO_ERROR, LSTR(INFO_MALFORMED_DATA_MSG), LSTR(INFO_MALFORMED_DATA_SUB), 0);
-    return ERR_DATA;
-  }
+  tx_ctx->error = core_btc_sign(tx_ctx, psbt_size(&psbt));
 
   switch(tx_ctx->error) {
   case ERR_OK:
     break;
   case ERR_DATA:
+  case ERR_FULL:
     ui_info(ICON_INFO_ERROR, LSTR(INFO_MALFORMED_DATA_MSG), LSTR(INFO_MALFORMED_DATA_SUB), 0);
     return ERR_DATA;
   default:
@@ -966,11 +770,6 @@ static app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint
     return ERR_CRYPTO;
   }
 
-  while(++tx_ctx->index_out < tx_ctx->output_count) {
-    psbt_new_output_record_set(&tx_ctx->psbt_out);
-  }
-
-  psbt_finalize(&tx_ctx->psbt_out);
   *out_len = psbt_size(&tx_ctx->psbt_out);
 
   return ERR_OK;
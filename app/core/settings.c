@@ -7,47 +7,47 @@
 
 #include <string.h>
 
-#define FS_SETTINGS 0x5331
-
 struct __attribute__((packed)) settings_entry {
   fs_entry_t entry;
   settings_t settings;
 };
 
 settings_t g_settings;
-static struct settings_entry* _settings_entry;
 
 fs_action_t _settings_match_settings(void* ctx, fs_entry_t* entry) {
-  return entry->magic == FS_SETTINGS ? FS_ACCEPT : FS_REJECT;
+  return entry->magic == FS_SETTINGS_MAGIC ? FS_ACCEPT : FS_REJECT;
 }
 
 void settings_load() {
   i18n_set_strings(i18n_english_strings);
-  _settings_entry = (struct settings_entry*) fs_find(_settings_match_settings, NULL);
+  struct settings_entry* stored = (struct settings_entry*) fs_find_key(FS_SETTINGS_MAGIC, NULL, _settings_match_settings, NULL);
 
-  if (!_settings_entry) {
+  if (!stored) {
     g_settings.enable_usb = SETTINGS_DEF_ENABLE_USB;
     g_settings.skip_help = SETTINGS_DEF_SKIP_HELP;
     g_settings.lcd_brightness = SETTINGS_DEF_LCD_BRIGHTNESS;
     g_settings.shutdown_timeout = SETTINGS_DEF_SHUTDOWN_TIMEOUT;
   } else {
-    memcpy(&g_settings, &_settings_entry->settings, sizeof(settings_t));
+    memcpy(&g_settings, &stored->settings, sizeof(settings_t));
   }
 }
 
 void settings_commit() {
-  if (_settings_entry) {
-    if (!memcmp(&g_settings, &_settings_entry->settings, sizeof(settings_t))) {
+  // looked up again each time, since compacting the filesystem moves entries
+  struct settings_entry* stored = (struct settings_entry*) fs_find_key(FS_SETTINGS_MAGIC, NULL, _settings_match_settings, NULL);
+
+  if (stored) {
+    if (!memcmp(&g_settings, &stored->settings, sizeof(settings_t))) {
       return;
     }
 
-    if (fs_erase(&_settings_entry->entry) != ERR_OK) {
+    if (fs_erase(&stored->entry) != ERR_OK) {
       return;
     }
   }
 
   APP_ALIGNED(struct settings_entry entry, 4);
-  entry.entry.magic = FS_SETTINGS;
+  entry.entry.magic = FS_SETTINGS_MAGIC;
   entry.entry.len = sizeof(settings_t);
   memcpy(&entry.settings, &g_settings, sizeof(settings_t));
   fs_write(&entry.entry, sizeof(struct settings_entry));
@@ -7,6 +7,7 @@
 #include "ethereum/eth_db.h"
 #include "mem.h"
 #include "iso7816/smartcard.h"
+#include "storage/fw.h"
 #include "storage/keys.h"
 #include "pwr.h"
 #include "ui/ui.h"
@@ -116,23 +117,19 @@ void device_help() {
   ui_display_msg_qr(LSTR(HELP_TITLE), addr, &addr[8]);
 }
 
-static app_err_t updater_verify_db(uint8_t* data, size_t data_len) {
-  uint8_t digest[SHA256_DIGEST_LENGTH];
-  size_t len = data_len - SIG_LEN;
-
-  sha256_Raw(data, len, digest);
-
+static app_err_t updater_verify_db(const uint8_t digest[SHA256_DIGEST_LENGTH], const uint8_t sig[ETH_DB_SIG_LEN]) {
   const uint8_t* key;
   key_read_public(DB_VERIFICATION_KEY, &key);
-  return ecdsa_verify(&secp256k1, key, &data[len], digest) ? ERR_DATA : ERR_OK;
+  return ecdsa_verify(&secp256k1, key, sig, digest) ? ERR_DATA : ERR_OK;
 }
 
-static app_err_t updater_database_update(uint8_t* data, size_t len, bool require_confirmation) {
+static app_err_t updater_database_update(eth_db_stage_t* stage, bool require_confirmation) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
   uint32_t version;
 
-  if ((len < MIN_DB_LEN) ||
-      (updater_verify_db(data, len) != ERR_OK) ||
-      (eth_db_extract_version(data, &version) != ERR_OK)) {
+  if ((eth_db_stage_finish(stage, digest, &version) != ERR_OK) ||
+      (updater_verify_db(digest, stage->sig) != ERR_OK)) {
+    eth_db_stage_discard();
     ui_info(ICON_INFO_ERROR, LSTR(DB_UPDATE_INVALID), LSTR(INFO_TRY_AGAIN), 0);
     return ERR_DATA;
   }
@@ -141,10 +138,11 @@ static app_err_t updater_database_update(uint8_t* data, size_t len, bool require
   append_db_version(version_string, version);
 
   if (require_confirmation && (ui_info(ICON_INFO_UPLOAD, LSTR(DB_UPDATE_CONFIRM), version_string, UI_INFO_CANCELLABLE) != CORE_EVT_UI_OK)) {
+    eth_db_stage_discard();
     return ERR_CANCEL;
   }
 
-  app_err_t err = eth_db_update(data, len - SIG_LEN);
+  app_err_t err = eth_db_stage_activate(stage);
   if (err == ERR_OK) {
     ui_info(ICON_INFO_SUCCESS, LSTR(DB_UPDATE_OK), version_string, 0);
   } else {
@@ -165,15 +163,13 @@ static void updater_clear_flash_area() {
   hal_flash_end_program();
 }
 
+// The received segments are already hashed, only the erased tail of the area remains
 static app_err_t updater_verify_firmware() {
   uint8_t* const fw_upgrade_area = (uint8_t*) HAL_FLASH_FW_UPGRADE_AREA;
+  fw_hash_update(&g_core.data.fw_upgrade.sha2, fw_upgrade_area, g_core.data.msg.received, (FW_AREA_LEN - g_core.data.msg.received));
 
   uint8_t digest[SHA256_DIGEST_LENGTH];
-  SHA256_CTX sha2;
-  sha256_Init(&sha2);
-  sha256_Update(&sha2, fw_upgrade_area, HAL_FW_HEADER_OFFSET);
-  sha256_Update(&sha2, &fw_upgrade_area[HAL_FW_HEADER_OFFSET + SIG_LEN], ((HAL_FLASH_FW_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE) - (HAL_FW_HEADER_OFFSET + SIG_LEN)));
-  sha256_Final(&sha2, digest);
+  sha256_Final(&g_core.data.fw_upgrade.sha2, digest);
 
   const uint8_t* key;
   key_read_public(FW_VERIFICATION_KEY, &key);
@@ -194,7 +190,7 @@ static inline uint8_t updater_progress() {
 }
 
 static app_err_t updater_confirm_fw_upgrade() {
-  uint32_t ver_off = ((uint32_t ) FW_VERSION) - HAL_FLASH_FW_START_ADDR;
+  uint32_t ver_off = ((uintptr_t) FW_VERSION) - HAL_FLASH_FW_START_ADDR;
   uint8_t* ver_buf = (uint8_t*)(HAL_FLASH_FW_UPGRADE_AREA + ver_off);
 
   // don't consider beta when checking version
@@ -238,6 +234,9 @@ app_err_t updater_usb_fw_upgrade(command_t *cmd, apdu_t* apdu) {
     len -= 4;
 
     updater_clear_flash_area();
+
+    // the USB command loop keeps the core task busy until the upload ends, so the hash context stays ours in between
+    sha256_Init(&g_core.data.fw_upgrade.sha2);
   }
 
   if ((len % HAL_FLASH_WORD_SIZE) || (g_core.data.msg.received + len) > (HAL_FLASH_FW_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)) {
@@ -247,9 +246,17 @@ app_err_t updater_usb_fw_upgrade(command_t *cmd, apdu_t* apdu) {
 
   uint8_t* const fw_upgrade_area = (uint8_t*) HAL_FLASH_FW_UPGRADE_AREA;
   hal_flash_begin_program();
-  hal_flash_program(data, &fw_upgrade_area[g_core.data.msg.received], len);
+  hal_err_t err = hal_flash_program(data, &fw_upgrade_area[g_core.data.msg.received], len);
   hal_flash_end_program();
 
+  if (err != HAL_SUCCESS) {
+    core_usb_err_sw(apdu, 0x6f, 0x00);
+    return ERR_HW;
+  }
+
+  // hashing what was programmed rather than what was received also checks the writes
+  fw_hash_update(&g_core.data.fw_upgrade.sha2, fw_upgrade_area, g_core.data.msg.received, len);
+
   g_core.data.msg.received += len;
   ui_update_progress(LSTR(FW_UPGRADE_TITLE), updater_progress());
 
@@ -297,24 +304,36 @@ app_err_t updater_usb_db_upgrade(apdu_t* apdu) {
     g_core.data.msg.received = 0;
     data += 4;
     len -= 4;
+
+    // the database is staged in flash as it arrives, so its size is only limited by the free data pages. The heap
+    // is not used by anything else during the update and buffers the page being received
+    app_err_t err = g_core.data.msg.len < MIN_DB_LEN ? ERR_DATA : eth_db_stage_begin(&g_core.data.db_stage, g_core.data.msg.len, g_mem_heap);
+
+    if (err != ERR_OK) {
+      core_usb_err_sw(apdu, 0x6a, err == ERR_FULL ? 0x84 : 0x80);
+      return ERR_DATA;
+    }
   }
 
-  if ((g_core.data.msg.received + len) > MEM_HEAP_SIZE) {
+  if ((g_core.data.msg.received + len) > g_core.data.msg.len) {
+    eth_db_stage_discard();
     core_usb_err_sw(apdu, 0x6a, 0x80);
     return ERR_DATA;
   }
 
-  memcpy(&g_mem_heap[g_core.data.msg.received], data, len);
+  app_err_t err = eth_db_stage_write(&g_core.data.db_stage, data, len);
+
+  if (err != ERR_OK) {
+    eth_db_stage_discard();
+    core_usb_err_sw(apdu, 0x6a, err == ERR_FULL ? 0x84 : 0x80);
+    return ERR_DATA;
+  }
 
   g_core.data.msg.received += len;
   ui_update_progress(LSTR(DB_UPDATE_TITLE), updater_progress());
 
-
-  if (g_core.data.msg.received > g_core.data.msg.len) {
-    core_usb_err_sw(apdu, 0x6a, 0x80);
-    return ERR_DATA;
-  } else if (g_core.data.msg.received == g_core.data.msg.len) {
-    app_err_t err = updater_database_update(g_mem_heap, g_core.data.msg.len, true);
+  if (g_core.data.msg.received == g_core.data.msg.len) {
+    err = updater_database_update(&g_core.data.db_stage, true);
 
     switch(err) {
     case ERR_OK:
@@ -67,3 +67,46 @@ uint32_t crc32(const uint8_t* data, size_t len) {
   return out;
 }
 
+// x^(2^n) modulo the CRC-32 polynomial, in the reflected bit order of the CRC
+static const uint32_t crc32_x2n_table[32] = {
+  0x40000000, 0x20000000, 0x08000000, 0x00800000, 0x00008000, 0xedb88320, 0xb1e6b092, 0xa06a2517,
+  0xed627dae, 0x88d14467, 0xd7bbfe6a, 0xec447f11, 0x8e7ea170, 0x6427800e, 0x4d47bae0, 0x09fe548f,
+  0x83852d0f, 0x30362f1a, 0x7b5a9cc3, 0x31fec169, 0x9fec022a, 0x6c8dedc4, 0x15d6874d, 0x5fde7a4e,
+  0xbad90e37, 0x2e4e5eef, 0x4eaba214, 0xa8a472c0, 0x429a969e, 0x148d302a, 0xc40ba6d0, 0xc4e22c3c,
+};
+
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+
+  while (1) {
+    if (a & m) {
+      p ^= b;
+
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+
+    m >>= 1;
+    b = (b & 1) ? ((b >> 1) ^ 0xedb88320) : (b >> 1);
+  }
+
+  return p;
+}
+
+uint32_t crc32_shift(uint32_t crc, size_t len) {
+  uint32_t p = 1u << 31;
+  int k = 3;
+
+  while (len) {
+    if (len & 1) {
+      p = crc32_multmodp(crc32_x2n_table[k & 31], p);
+    }
+
+    len >>= 1;
+    k++;
+  }
+
+  return crc32_multmodp(p, crc);
+}
@@ -31,4 +31,8 @@ void crc32_update(crc32_ctx_t* ctx, const uint8_t* data, size_t len);
 
 uint32_t crc32(const uint8_t* data, size_t len);
 
+// Advances a CRC register over len zero bytes. With the initial and final inversion left out the CRC32
+// is linear, so the CRC of data assembled out of order can be combined from the CRCs of its pieces.
+uint32_t crc32_shift(uint32_t crc, size_t len);
+
 #endif
@@ -1,6 +1,12 @@
 #include "util.h"
 #include "common.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 const char* const HEX_DIGITS = "0123456789abcdef";
 
 uint32_t pad_iso9797_m1(uint8_t* data, uint8_t plen, uint32_t size) {
@@ -162,3 +168,40 @@ bool atoi256BE(const char* str, size_t len, uint8_t out[32]) {
 
   return true;
 }
+
+void memxor(uint8_t* dst, const uint8_t* src, size_t len) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  for (; (i + 16) <= len; i += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i*) &dst[i]);
+    _mm_storeu_si128((__m128i*) &dst[i], _mm_xor_si128(d, _mm_loadu_si128((const __m128i*) &src[i])));
+  }
+#elif defined(__ARM_NEON)
+  for (; (i + 16) <= len; i += 16) {
+    vst1q_u8(&dst[i], veorq_u8(vld1q_u8(&dst[i]), vld1q_u8(&src[i])));
+  }
+#endif
+
+  // the buffers need not be aligned, memcpy compiles to plain (unaligned) loads and stores
+  for (; (i + 8) <= len; i += 8) {
+    uint64_t d, s;
+    memcpy(&d, &dst[i], 8);
+    memcpy(&s, &src[i], 8);
+    d ^= s;
+    memcpy(&dst[i], &d, 8);
+  }
+
+  if ((i + 4) <= len) {
+    uint32_t d, s;
+    memcpy(&d, &dst[i], 4);
+    memcpy(&s, &src[i], 4);
+    d ^= s;
+    memcpy(&dst[i], &d, 4);
+    i += 4;
+  }
+
+  for (; i < len; i++) {
+    dst[i] ^= src[i];
+  }
+}
@@ -21,6 +21,7 @@ size_t strnlen(const char *s, size_t maxlen);
 bool base16_decode(const char* s, uint8_t* out, size_t s_len);
 void base16_encode(const uint8_t* data, char* out, size_t len);
 bool atoi256BE(const char* str, size_t len, uint8_t out[32]);
+void memxor(uint8_t* dst, const uint8_t* src, size_t len);
 
 static inline int memcmp_ct(const uint8_t* a, const uint8_t* b, size_t length) {
   int compareSum = 0;
@@ -5,7 +5,6 @@
 #include "crypto/address.h"
 #include "eth_data.h"
 #include "mem.h"
-#include "storage/fs.h"
 
 struct eth_func_search_ctx {
   uint32_t selector;
@@ -125,27 +124,19 @@ app_err_t eth_data_tuple_get_elem(eth_abi_type_t type, uint8_t idx, const uint8_
   return ERR_OK;
 }
 
-fs_action_t eth_data_find_exact_function(void* ctx, fs_entry_t* entry) {
-  if (entry->magic != FS_ABI_MAGIC) {
-    return FS_REJECT;
-  }
-
+static bool eth_data_find_exact_function(void* ctx, const uint8_t* record) {
   struct eth_func_find_exact_ctx* search_ctx = (struct eth_func_find_exact_ctx*) ctx;
-  const eth_abi_function_t* func = FS_ENTRY_DATA(const eth_abi_function_t*, entry);
+  const eth_abi_function_t* func = (const eth_abi_function_t*) record;
 
-  return ((func->selector == search_ctx->selector) && (func->ext_selector == search_ctx->ext_selector)) ? FS_ACCEPT : FS_REJECT;
+  return func->ext_selector == search_ctx->ext_selector;
 }
 
-fs_action_t eth_data_find_function(void* ctx, fs_entry_t* entry) {
-  if (entry->magic != FS_ABI_MAGIC) {
-    return FS_REJECT;
-  }
-
+static bool eth_data_find_function(void* ctx, const uint8_t* record) {
   struct eth_func_search_ctx* search_ctx = (struct eth_func_search_ctx*) ctx;
-  const eth_abi_function_t* func = FS_ENTRY_DATA(const eth_abi_function_t*, entry);
+  const eth_abi_function_t* func = (const eth_abi_function_t*) record;
 
-  if ((func->selector != search_ctx->selector) || (search_ctx->has_value && !(func->attrs & ETH_FUNC_PAYABLE))) {
-    return FS_REJECT;
+  if (search_ctx->has_value && !(func->attrs & ETH_FUNC_PAYABLE)) {
+    return false;
   }
 
   size_t args = 0;
@@ -157,7 +148,7 @@ fs_action_t eth_data_find_function(void* ctx, fs_entry_t* entry) {
     size_t out_len;
 
     if (eth_data_tuple_get_elem(arg->type, args, search_ctx->args, search_ctx->args_len, &out, &out_len) != ERR_OK) {
-      return FS_REJECT;
+      return false;
     }
 
     if ((arg->type & (ETH_ABI_COMPOSITE | ETH_ABI_DYNAMIC)) != 0) {
@@ -169,10 +160,10 @@ fs_action_t eth_data_find_function(void* ctx, fs_entry_t* entry) {
   }
 
   if (strict_size && (ETH_ABI_TUPLE_SIZE(args) != search_ctx->args_len)) {
-    return FS_REJECT;
+    return false;
   }
 
-  return FS_ACCEPT;
+  return true;
 }
 
 const eth_abi_function_t* eth_data_recognize(const uint8_t* data, uint32_t data_len, bool has_value) {
@@ -186,13 +177,8 @@ const eth_abi_function_t* eth_data_recognize(const uint8_t* data, uint32_t data_
   search_ctx.args_len = data_len - sizeof(uint32_t);
   search_ctx.has_value = has_value;
 
-  fs_entry_t* found = fs_find(eth_data_find_function, &search_ctx);
-
-  if (found) {
-    return FS_ENTRY_DATA(const eth_abi_function_t*, found);
-  }
-
-  return NULL;
+  eth_db_abi_call_t call = { .args_len = search_ctx.args_len, .has_value = has_value };
+  return (const eth_abi_function_t*) eth_db_lookup_abi(search_ctx.selector, &call, eth_data_find_function, &search_ctx);
 }
 
 eip712_data_type_t eip712_recognize(const eip712_ctx_t* ctx) {
@@ -348,7 +334,7 @@ static app_err_t eth_data_format_array(const eth_abi_argument_t* abi, const uint
       return ERR_DATA;
     }
 
-    size_t buf_len = (((uint32_t) args) + args_len) - ((uint32_t) elem_data);
+    size_t buf_len = (((uintptr_t) args) + args_len) - ((uintptr_t) elem_data);
 
     if (eth_data_format_type(abi, elem_data, elem_len, buf_len, out, out_cap, out_len) != ERR_OK) {
       return ERR_DATA;
@@ -387,7 +373,7 @@ static app_err_t eth_data_format_tuple(const eth_abi_argument_t* abi, const uint
       return ERR_DATA;
     }
 
-    size_t buf_len = (((uint32_t) args) + args_len) - ((uint32_t) elem_data);
+    size_t buf_len = (((uintptr_t) args) + args_len) - ((uintptr_t) elem_data);
 
     if (eth_data_format_type(abi, elem_data, elem_len, buf_len, out, out_cap, out_len) != ERR_OK) {
       return ERR_DATA;
@@ -557,11 +543,9 @@ static app_err_t eth_data_format_execute_call(const eth_abi_function_t* abi, con
       return ERR_DATA;
     }
 
-    fs_entry_t* found = fs_find(eth_data_find_exact_function, &find_ctx);
-    const eth_abi_function_t* abi;
-    if (found) {
-      abi = FS_ENTRY_DATA(const eth_abi_function_t*, found);
-    } else {
+    const eth_abi_function_t* abi = (const eth_abi_function_t*) eth_db_lookup_abi(find_ctx.selector, NULL, eth_data_find_exact_function, &find_ctx);
+
+    if (!abi) {
       return ERR_DATA;
     }
 
@@ -1,13 +1,30 @@
 #include "eth_db.h"
+#include "common.h"
+#include "mem.h"
 #include "storage/fs.h"
 #include <string.h>
 
-#define FS_CHAIN_MAGIC 0x4348
-#define FS_ERC20_MAGIC 0x3020
-#define FS_VERSION_MAGIC 0x4532
 #define FS_DELTA_MAGIC 0x444c
 
+#define STAGE_HEADER_LEN (sizeof(fs_entry_t) + sizeof(uint16_t))
+#define STAGE_CHUNK_LEN (FS_PAGE_DATA_SIZE - STAGE_HEADER_LEN)
+#define STAGE_COMMIT_SEQ 0xffff
+
+// Pages other than the staged chunks are counted three quarters full when checking that an update fits, since an
+// entry not fitting the rest of a page goes to the next one and tables are at most a quarter page
+#define STAGE_PAGE_FILL ((FS_PAGE_DATA_SIZE * 3) / 4)
+
 #define ERC20_NET_LEN 24
+#define ABI_KEY_LEN 8
+#define ABI_SHAPED_KEY_LEN (ABI_KEY_LEN + sizeof(uint16_t))
+#define ABI_WORD_LEN 32
+
+#define FILTER_HASH_BASIS 0x811c9dc5
+#define FILTER_HASH_STEP_BASIS 0x050c5d1f
+#define FILTER_HASH_PRIME 0x01000193
+#define FILTER_ERC20 0
+#define FILTER_ABI 1
+#define FILTER_COUNT 2
 
 struct __attribute__((packed)) chain_raw_desc {
   fs_entry_t _entry;
@@ -27,6 +44,26 @@ struct __attribute__((packed)) abi_raw_desc {
   uint8_t data[];
 };
 
+// A v2 table holds count rows of a key followed by the 16-bit offset from rows of its record. Rows are sorted by key
+// and each table covers a range of keys of its section, so that it can be searched in place
+struct __attribute__((packed)) table_desc {
+  fs_entry_t _entry;
+  uint16_t count;
+  uint8_t key_len;
+  uint8_t rows[];
+};
+
+// A Bloom filter over the keys of a section, valid only for the database version it was built with. Filters are not
+// erased by other firmware, so a stale one can be left behind and must not be trusted
+struct __attribute__((packed)) filter_desc {
+  fs_entry_t _entry;
+  uint16_t section;
+  uint8_t hashes;
+  uint8_t _reserved;
+  uint32_t version;
+  uint8_t bits[];
+};
+
 struct __attribute__((packed)) version_desc {
   fs_entry_t _entry;
   uint32_t version;
@@ -41,6 +78,19 @@ struct __attribute__((packed)) delta_desc {
   uint8_t data[];
 };
 
+// Staged chunks always fill a page after its header, so that erasing or compacting other entries never moves them
+struct __attribute__((packed)) stage_desc {
+  fs_entry_t _entry;
+  uint16_t seq;
+  uint8_t data[];
+};
+
+struct __attribute__((packed)) stage_commit_desc {
+  fs_entry_t _entry;
+  uint16_t seq;
+  uint32_t len;
+};
+
 struct delta_erase_ctx {
   uint8_t* erase_chain;
   uint8_t* erase_token;
@@ -50,6 +100,45 @@ struct delta_erase_ctx {
   uint16_t erase_abi_len;
 };
 
+struct stage_usage_ctx {
+  size_t len;
+  bool keep_db;
+};
+
+struct table_find_ctx {
+  uint16_t magic;
+  const uint8_t* key;
+  size_t key_len;
+  const eth_db_abi_call_t* call;
+  eth_db_abi_match_t match;
+  void* match_ctx;
+  const uint8_t* record;
+  bool seen;
+};
+
+struct lookup_cache_entry {
+  uint16_t magic;
+  uint8_t key[ERC20_NET_LEN];
+  const uint8_t* record;
+  uint32_t used;
+};
+
+struct abi_find_ctx {
+  uint32_t selector;
+  eth_db_abi_match_t match;
+  void* match_ctx;
+};
+
+static struct {
+  struct lookup_cache_entry entries[ETH_DB_CACHE_SIZE];
+  uint32_t generation;
+  uint32_t clock;
+  uint8_t count;
+  uint8_t filters_ready;
+  const struct filter_desc* filters[FILTER_COUNT];
+  eth_db_cache_stats_t stats;
+} g_eth_db_cache;
+
 fs_action_t _eth_db_match_chain(void* ctx, fs_entry_t* entry) {
   if (entry->magic != FS_CHAIN_MAGIC) {
     return FS_REJECT;
@@ -83,55 +172,182 @@ fs_action_t _eth_db_match_erc20(void* ctx, fs_entry_t* entry) {
   return FS_REJECT;
 }
 
+fs_action_t _eth_db_match_abi(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_ABI_MAGIC) {
+    return FS_REJECT;
+  }
+
+  struct abi_find_ctx* find_ctx = (struct abi_find_ctx*) ctx;
+  const uint8_t* func = FS_ENTRY_DATA(const uint8_t*, entry);
+
+  if (memcmp(func, &find_ctx->selector, sizeof(uint32_t))) {
+    return FS_REJECT;
+  }
+
+  return find_ctx->match(find_ctx->match_ctx, func) ? FS_ACCEPT : FS_REJECT;
+}
+
+static bool _eth_db_abi_shape_fits(const eth_db_abi_call_t* call, const uint8_t* row) {
+  uint16_t shape = row[ABI_KEY_LEN] | (row[ABI_KEY_LEN + 1] << 8);
+  uint32_t static_len = (shape & ETH_DB_ABI_SHAPE_WORDS) * ABI_WORD_LEN;
+
+  if (call->has_value && !(shape & ETH_DB_ABI_SHAPE_PAYABLE)) {
+    return false;
+  }
+
+  return (shape & ETH_DB_ABI_SHAPE_DYNAMIC) ? (call->args_len >= static_len) : (call->args_len == static_len);
+}
+
+fs_action_t _eth_db_match_table(void* ctx, fs_entry_t* entry) {
+  struct table_find_ctx* find_ctx = (struct table_find_ctx*) ctx;
+
+  if (entry->magic != find_ctx->magic) {
+    return FS_REJECT;
+  }
+
+  find_ctx->seen = true;
+
+  const struct table_desc* table = (const struct table_desc*) entry;
+  size_t row_len = table->key_len + sizeof(uint16_t);
+
+  if ((table->key_len < find_ctx->key_len) || !table->count) {
+    return FS_REJECT;
+  }
+
+  // tables hold disjoint key ranges, so most of them are skipped here
+  if ((memcmp(find_ctx->key, table->rows, find_ctx->key_len) < 0) ||
+      (memcmp(find_ctx->key, &table->rows[(table->count - 1) * row_len], find_ctx->key_len) > 0)) {
+    return FS_REJECT;
+  }
+
+  int lo = 0;
+  int hi = table->count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if (memcmp(&table->rows[mid * row_len], find_ctx->key, find_ctx->key_len) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  for (; lo < table->count; lo++) {
+    const uint8_t* row = &table->rows[lo * row_len];
+
+    if (memcmp(row, find_ctx->key, find_ctx->key_len)) {
+      break;
+    }
+
+    if (find_ctx->call && (table->key_len >= ABI_SHAPED_KEY_LEN) && !_eth_db_abi_shape_fits(find_ctx->call, row)) {
+      continue;
+    }
+
+    const uint8_t* record = &table->rows[row[table->key_len] | (row[table->key_len + 1] << 8)];
+
+    if (!find_ctx->match || find_ctx->match(find_ctx->match_ctx, record)) {
+      find_ctx->record = record;
+      return FS_ACCEPT;
+    }
+  }
+
+  return FS_REJECT;
+}
+
 fs_action_t _eth_db_match_version(void* ctx, fs_entry_t* entry) {
   return entry->magic == FS_VERSION_MAGIC ? FS_ACCEPT : FS_REJECT;
 }
 
+fs_action_t _eth_db_match_filter(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_FILTER_MAGIC) {
+    return FS_REJECT;
+  }
+
+  const struct filter_desc* filter = (const struct filter_desc*) entry;
+  const struct filter_desc* wanted = (const struct filter_desc*) ctx;
+
+  if ((entry->len <= (sizeof(struct filter_desc) - sizeof(fs_entry_t))) || !filter->hashes) {
+    return FS_REJECT;
+  }
+
+  return ((filter->section == wanted->section) && (filter->version == wanted->version)) ? FS_ACCEPT : FS_REJECT;
+}
+
 fs_action_t _eth_db_match_all(void* ctx, fs_entry_t* entry) {
-  return ((entry->magic == FS_CHAIN_MAGIC) || (entry->magic == FS_ERC20_MAGIC) || (entry->magic == FS_VERSION_MAGIC) || (entry->magic == FS_ABI_MAGIC)) ? FS_REJECT : FS_ACCEPT;
+  switch(entry->magic) {
+  case FS_FILTER_MAGIC:
+  case FS_CHAIN_MAGIC:
+  case FS_ERC20_MAGIC:
+  case FS_VERSION_MAGIC:
+  case FS_ABI_MAGIC:
+  case FS_CHAIN_TABLE_MAGIC:
+  case FS_ERC20_TABLE_MAGIC:
+  case FS_ABI_TABLE_MAGIC:
+    return FS_REJECT;
+  default:
+    return FS_ACCEPT;
+  }
 }
 
-static inline fs_action_t _eth_db_match_erase_chain(struct delta_erase_ctx* ctx, struct chain_raw_desc* entry) {
+static bool _eth_db_erase_chain(struct delta_erase_ctx* ctx, const uint8_t* chain_id) {
   for (int i = 0; i < ctx->erase_chain_len; i += 4) {
-    if (!memcmp(&entry->chain_id, &ctx->erase_chain[i], 4)) {
-      return FS_REJECT;
+    if (!memcmp(chain_id, &ctx->erase_chain[i], 4)) {
+      return true;
     }
   }
 
-  return FS_ACCEPT;
+  return false;
 }
 
-static inline fs_action_t _eth_db_match_erase_token(struct delta_erase_ctx* ctx, struct erc20_raw_desc* entry) {
-  uint8_t* ticker = entry->data + (entry->net_count * ERC20_NET_LEN) + 1;
+static bool _eth_db_erase_ticker(struct delta_erase_ctx* ctx, const uint8_t* ticker) {
   size_t off = 0;
 
   while (off < ctx->erase_token_len) {
-    size_t ticker_off = 0;
+    const char* erase_ticker = (const char*) &ctx->erase_token[off];
 
-    while(1) {
-      if (ticker[ticker_off] != ctx->erase_token[off]) {
-        while(ctx->erase_token[off++] != '\0') {
-          continue;
-        }
+    if (!strcmp(erase_ticker, (const char*) ticker)) {
+      return true;
+    }
 
-        break;
-      }
+    off += strlen(erase_ticker) + 1;
+  }
 
-      if (ticker[ticker_off] == '\0') {
-        return FS_REJECT;
-      }
+  return false;
+}
 
-      ticker_off++;
-      off++;
+static bool _eth_db_erase_abi(struct delta_erase_ctx* ctx, const uint8_t* full_selector) {
+  for (int i = 0; i < ctx->erase_abi_len; i += ABI_KEY_LEN) {
+    if (!memcmp(full_selector, &ctx->erase_abi[i], ABI_KEY_LEN)) {
+      return true;
     }
   }
 
-  return FS_ACCEPT;
+  return false;
 }
 
-static inline fs_action_t _eth_db_match_erase_abi(struct delta_erase_ctx* ctx, struct abi_raw_desc* entry) {
-  for (int i = 0; i < ctx->erase_abi_len; i += 8) {
-    if (!memcmp(&entry->full_selector, &ctx->erase_abi[i], 8)) {
+// A table goes as soon as one of its rows is erased. Token rows are matched on the ticker in their record, the
+// others on their key. The delta then brings the table back with the rows which have been kept
+static fs_action_t _eth_db_match_erase_table(struct delta_erase_ctx* ctx, const struct table_desc* table) {
+  size_t row_len = table->key_len + sizeof(uint16_t);
+
+  for (int i = 0; i < table->count; i++) {
+    const uint8_t* row = &table->rows[i * row_len];
+    bool erase;
+
+    switch(table->_entry.magic) {
+    case FS_CHAIN_TABLE_MAGIC:
+      erase = _eth_db_erase_chain(ctx, row);
+      break;
+    case FS_ERC20_TABLE_MAGIC:
+      erase = _eth_db_erase_ticker(ctx, &table->rows[(row[table->key_len] | (row[table->key_len + 1] << 8)) + 1]);
+      break;
+    default:
+      erase = _eth_db_erase_abi(ctx, row);
+      break;
+    }
+
+    if (erase) {
       return FS_REJECT;
     }
   }
@@ -140,28 +356,200 @@ static inline fs_action_t _eth_db_match_erase_abi(struct delta_erase_ctx* ctx, s
 }
 
 fs_action_t _eth_db_match_delta(void* ctx, fs_entry_t* entry) {
+  struct delta_erase_ctx* erase_ctx = (struct delta_erase_ctx*) ctx;
+  struct erc20_raw_desc* erc20;
+
   switch(entry->magic) {
   case FS_VERSION_MAGIC:
+  case FS_FILTER_MAGIC:
     return FS_REJECT;
   case FS_CHAIN_MAGIC:
-    return _eth_db_match_erase_chain((struct delta_erase_ctx*) ctx, (struct chain_raw_desc*) entry);
+    return _eth_db_erase_chain(erase_ctx, (const uint8_t*) &((struct chain_raw_desc*) entry)->chain_id) ? FS_REJECT : FS_ACCEPT;
   case FS_ERC20_MAGIC:
-    return _eth_db_match_erase_token((struct delta_erase_ctx*) ctx, (struct erc20_raw_desc*) entry);
+    erc20 = (struct erc20_raw_desc*) entry;
+    return _eth_db_erase_ticker(erase_ctx, erc20->data + (erc20->net_count * ERC20_NET_LEN) + 1) ? FS_REJECT : FS_ACCEPT;
   case FS_ABI_MAGIC:
-    return _eth_db_match_erase_abi((struct delta_erase_ctx*) ctx, (struct abi_raw_desc*) entry);
+    return _eth_db_erase_abi(erase_ctx, FS_ENTRY_DATA(const uint8_t*, entry)) ? FS_REJECT : FS_ACCEPT;
+  case FS_CHAIN_TABLE_MAGIC:
+  case FS_ERC20_TABLE_MAGIC:
+  case FS_ABI_TABLE_MAGIC:
+    return _eth_db_match_erase_table(erase_ctx, (const struct table_desc*) entry);
   default:
     return FS_ACCEPT;
   }
 }
 
+// Looks the key up in the v2 tables of a section. ERR_UNSUPPORTED means that the database has no such tables
+// and must be read as v1
+static app_err_t _eth_db_table_find(struct table_find_ctx* find_ctx) {
+  find_ctx->record = NULL;
+  find_ctx->seen = false;
+
+  fs_find_key(find_ctx->magic, NULL, _eth_db_match_table, find_ctx);
+
+  if (find_ctx->record) {
+    return ERR_OK;
+  }
+
+  return find_ctx->seen ? ERR_DATA : ERR_UNSUPPORTED;
+}
+
+static void _eth_db_cache_validate() {
+  if (g_eth_db_cache.generation != fs_generation()) {
+    g_eth_db_cache.count = 0;
+    g_eth_db_cache.filters_ready = 0;
+    g_eth_db_cache.generation = fs_generation();
+  }
+}
+
+static const struct filter_desc* _eth_db_filter(int idx, uint16_t section) {
+  _eth_db_cache_validate();
+
+  if (!(g_eth_db_cache.filters_ready & (1 << idx))) {
+    uint32_t version;
+    g_eth_db_cache.filters[idx] = NULL;
+
+    if (eth_db_lookup_version(&version) == ERR_OK) {
+      struct filter_desc wanted = { .section = section, .version = version };
+      g_eth_db_cache.filters[idx] = (const struct filter_desc*) fs_find_key(FS_FILTER_MAGIC, &section, _eth_db_match_filter, &wanted);
+    }
+
+    g_eth_db_cache.filters_ready |= (1 << idx);
+  }
+
+  return g_eth_db_cache.filters[idx];
+}
+
+static uint32_t _eth_db_filter_hash(uint32_t hash, const uint8_t* key, size_t key_len) {
+  for (int i = 0; i < key_len; i++) {
+    hash = (hash ^ key[i]) * FILTER_HASH_PRIME;
+  }
+
+  return hash;
+}
+
+// False only when the key is surely not in the section. Without a filter every key might be
+static bool _eth_db_filter_may_contain(int idx, uint16_t section, const uint8_t* key, size_t key_len) {
+  const struct filter_desc* filter = _eth_db_filter(idx, section);
+
+  if (!filter) {
+    return true;
+  }
+
+  uint32_t bits = (filter->_entry.len - (sizeof(struct filter_desc) - sizeof(fs_entry_t))) * 8;
+  uint32_t hash = _eth_db_filter_hash(FILTER_HASH_BASIS, key, key_len);
+  uint32_t step = _eth_db_filter_hash(FILTER_HASH_STEP_BASIS, key, key_len) | 1;
+
+  for (int i = 0; i < filter->hashes; i++) {
+    uint32_t bit = hash % bits;
+
+    if (!(filter->bits[bit >> 3] & (1 << (bit & 7)))) {
+      g_eth_db_cache.stats.filtered++;
+      return false;
+    }
+
+    hash += step;
+  }
+
+  return true;
+}
+
+// Returns the cached entry for the key, or the one to replace on a miss with its magic cleared
+static struct lookup_cache_entry* _eth_db_cache_get(uint16_t magic, const uint8_t* key, size_t key_len) {
+  _eth_db_cache_validate();
+
+  struct lookup_cache_entry* lru = &g_eth_db_cache.entries[0];
+
+  for (int i = 0; i < g_eth_db_cache.count; i++) {
+    struct lookup_cache_entry* entry = &g_eth_db_cache.entries[i];
+
+    if ((entry->magic == magic) && !memcmp(entry->key, key, key_len)) {
+      entry->used = ++g_eth_db_cache.clock;
+      g_eth_db_cache.stats.hits++;
+      return entry;
+    }
+
+    if (entry->used < lru->used) {
+      lru = entry;
+    }
+  }
+
+  g_eth_db_cache.stats.misses++;
+
+  if (g_eth_db_cache.count < ETH_DB_CACHE_SIZE) {
+    lru = &g_eth_db_cache.entries[g_eth_db_cache.count++];
+  }
+
+  lru->magic = 0;
+  return lru;
+}
+
+static void _eth_db_cache_put(struct lookup_cache_entry* entry, uint16_t magic, const uint8_t* key, size_t key_len, const uint8_t* record) {
+  entry->magic = magic;
+  memcpy(entry->key, key, key_len);
+  entry->record = record;
+  entry->used = ++g_eth_db_cache.clock;
+}
+
+static const uint8_t* _eth_db_chain_lookup(chain_desc_t* chain) {
+  struct table_find_ctx find_ctx = { .magic = FS_CHAIN_TABLE_MAGIC, .key = (const uint8_t*) &chain->chain_id, .key_len = sizeof(uint32_t), .match = NULL };
+
+  if (_eth_db_table_find(&find_ctx) != ERR_UNSUPPORTED) {
+    return find_ctx.record;
+  }
+
+  struct chain_raw_desc* chain_data = (struct chain_raw_desc*) fs_find_key(FS_CHAIN_MAGIC, &chain->chain_id, _eth_db_match_chain, chain);
+  return chain_data ? (const uint8_t*) chain_data->data : NULL;
+}
+
+static const char* _eth_db_chain_record(chain_desc_t* chain) {
+  const uint8_t* key = (const uint8_t*) &chain->chain_id;
+  struct lookup_cache_entry* cached = _eth_db_cache_get(FS_CHAIN_MAGIC, key, sizeof(uint32_t));
+
+  if (!cached->magic) {
+    _eth_db_cache_put(cached, FS_CHAIN_MAGIC, key, sizeof(uint32_t), _eth_db_chain_lookup(chain));
+  }
+
+  return (const char*) cached->record;
+}
+
+static const uint8_t* _eth_db_erc20_lookup(erc20_desc_t* erc20, const uint8_t* key) {
+  if (!_eth_db_filter_may_contain(FILTER_ERC20, FS_ERC20_TABLE_MAGIC, key, ERC20_NET_LEN)) {
+    return NULL;
+  }
+
+  struct table_find_ctx find_ctx = { .magic = FS_ERC20_TABLE_MAGIC, .key = key, .key_len = ERC20_NET_LEN, .match = NULL };
+
+  if (_eth_db_table_find(&find_ctx) != ERR_UNSUPPORTED) {
+    return find_ctx.record;
+  }
+
+  struct erc20_raw_desc* erc20_data = (struct erc20_raw_desc*) fs_find_key(FS_ERC20_MAGIC, key, _eth_db_match_erc20, erc20);
+  return erc20_data ? (erc20_data->data + (erc20_data->net_count * ERC20_NET_LEN)) : NULL;
+}
+
+static const uint8_t* _eth_db_erc20_record(erc20_desc_t* erc20) {
+  uint8_t key[ERC20_NET_LEN];
+  memcpy(key, &erc20->chain, 4);
+  memcpy(&key[4], erc20->addr, 20);
+
+  struct lookup_cache_entry* cached = _eth_db_cache_get(FS_ERC20_MAGIC, key, ERC20_NET_LEN);
+
+  if (!cached->magic) {
+    _eth_db_cache_put(cached, FS_ERC20_MAGIC, key, ERC20_NET_LEN, _eth_db_erc20_lookup(erc20, key));
+  }
+
+  return cached->record;
+}
+
 app_err_t eth_db_lookup_chain(chain_desc_t* chain) {
-  struct chain_raw_desc* chain_data = (struct chain_raw_desc*) fs_find(_eth_db_match_chain, chain);
+  const char* data = _eth_db_chain_record(chain);
 
-  if (!chain_data) {
+  if (!data) {
     return ERR_DATA;
   }
 
-  chain->ticker = chain_data->data;
+  chain->ticker = data;
   chain->name = chain->ticker + strlen(chain->ticker) + 1;
   chain->short_name = chain->name + strlen(chain->name) + 1;
 
@@ -169,21 +557,36 @@ app_err_t eth_db_lookup_chain(chain_desc_t* chain) {
 }
 
 app_err_t eth_db_lookup_erc20(erc20_desc_t* erc20) {
-  struct erc20_raw_desc* erc20_data = (struct erc20_raw_desc*) fs_find(_eth_db_match_erc20, erc20);
+  const uint8_t* data = _eth_db_erc20_record(erc20);
 
-  if (!erc20_data) {
+  if (!data) {
     return ERR_DATA;
   }
 
-  uint8_t* data = erc20_data->data + (erc20_data->net_count * ERC20_NET_LEN);
   erc20->decimals = *(data++);
-  erc20->ticker = (char *) data;
+  erc20->ticker = (const char *) data;
 
   return ERR_OK;
 }
 
+const uint8_t* eth_db_lookup_abi(uint32_t selector, const eth_db_abi_call_t* call, eth_db_abi_match_t match, void* ctx) {
+  if (!_eth_db_filter_may_contain(FILTER_ABI, FS_ABI_TABLE_MAGIC, (const uint8_t*) &selector, sizeof(uint32_t))) {
+    return NULL;
+  }
+
+  struct table_find_ctx find_ctx = { .magic = FS_ABI_TABLE_MAGIC, .key = (const uint8_t*) &selector, .key_len = sizeof(uint32_t), .call = call, .match = match, .match_ctx = ctx };
+
+  if (_eth_db_table_find(&find_ctx) != ERR_UNSUPPORTED) {
+    return find_ctx.record;
+  }
+
+  struct abi_find_ctx abi_ctx = { .selector = selector, .match = match, .match_ctx = ctx };
+  fs_entry_t* entry = fs_find_key(FS_ABI_MAGIC, &selector, _eth_db_match_abi, &abi_ctx);
+  return entry ? FS_ENTRY_DATA(const uint8_t*, entry) : NULL;
+}
+
 app_err_t eth_db_lookup_version(uint32_t* version) {
-  struct version_desc* version_data = (struct version_desc*) fs_find(_eth_db_match_version, NULL);
+  struct version_desc* version_data = (struct version_desc*) fs_find_key(FS_VERSION_MAGIC, NULL, _eth_db_match_version, NULL);
 
   if (!version_data) {
     return ERR_DATA;
@@ -194,25 +597,57 @@ app_err_t eth_db_lookup_version(uint32_t* version) {
   return ERR_OK;
 }
 
-static app_err_t eth_full_db_rewrite(fs_entry_t* entries, size_t len) {
+void eth_db_cache_flush() {
+  g_eth_db_cache.count = 0;
+}
+
+void eth_db_get_cache_stats(eth_db_cache_stats_t* stats) {
+  *stats = g_eth_db_cache.stats;
+}
+
+static app_err_t eth_full_db_erase() {
   app_err_t err = fs_erase_all(_eth_db_match_all, NULL);
 
   // since our matcher doesn't know when it has reached completion, if everything went OK the error code
   // will be ERR_DATA on success.
-  if (err != ERR_DATA) {
-    return err;
+  return err == ERR_DATA ? ERR_OK : err;
+}
+
+// Checks that the erase lists and the version entry following them are within the delta
+static size_t _eth_db_delta_len(struct delta_desc* delta, size_t len) {
+  if (len < sizeof(struct delta_desc)) {
+    return 0;
   }
 
-  return fs_write(entries, len);
+  size_t off = sizeof(struct delta_desc) + delta->erase_chain_len + delta->erase_token_len + delta->erase_abi_len;
+
+  if (((off + sizeof(struct version_desc)) > len) || (delta->erase_chain_len % 4) || (delta->erase_abi_len % ABI_KEY_LEN)) {
+    return 0;
+  }
+
+  if (delta->erase_token_len && (delta->data[delta->erase_chain_len + delta->erase_token_len - 1] != '\0')) {
+    return 0;
+  }
+
+  struct version_desc* ver_data = (struct version_desc*) &((uint8_t*) delta)[off];
+  return ver_data->_entry.magic == FS_VERSION_MAGIC ? off : 0;
 }
 
-__attribute__((unused)) static app_err_t eth_delta_db_update(struct delta_desc* delta, size_t len) {
-  uint32_t version;
-  if (eth_db_lookup_version(&version) != ERR_OK) {
-    return ERR_HW;
+// When resuming, a delta which already erased or replaced the version entry is applied again. Entries it adds
+// without erasing anything can then be found twice, which does not change lookups
+static app_err_t eth_delta_db_erase(struct delta_desc* delta, size_t len, size_t* off, bool resume) {
+  *off = _eth_db_delta_len(delta, len);
+
+  if (!*off) {
+    return ERR_DATA;
   }
 
-  if (delta->old_version != version) {
+  uint32_t version;
+  if (eth_db_lookup_version(&version) != ERR_OK) {
+    if (!resume) {
+      return ERR_HW;
+    }
+  } else if ((delta->old_version != version) && !(resume && (((struct version_desc*) &((uint8_t*) delta)[*off])->version == version))) {
     return ERR_VERSION;
   }
 
@@ -225,39 +660,32 @@ __attribute__((unused)) static app_err_t eth_delta_db_update(struct delta_desc*
       .erase_abi_len = delta->erase_abi_len
   };
 
-  fs_entry_t* entries = (fs_entry_t*) &delta->data[delta->erase_chain_len + delta->erase_token_len + delta->erase_abi_len];
-
-  size_t off = sizeof(struct delta_desc) + delta->erase_chain_len + delta->erase_token_len + delta->erase_abi_len;
-
-  if (off > len) {
-    return ERR_DATA;
-  }
-
+  // only the pages holding erased entries are rewritten, the new entries then go in the free space
   app_err_t err = fs_erase_all(_eth_db_match_delta, &erase_ctx);
 
   // since our matcher doesn't know when it has reached completion, if everything went OK the error code
-  // will be ERR_DATA on success. This could be optimized if noticeable delays are observed.
-  if (err != ERR_DATA) {
-    return err;
-  }
-
-  return fs_write(entries, (len - off));
+  // will be ERR_DATA on success.
+  return err == ERR_DATA ? ERR_OK : err;
 }
 
-static inline uint16_t eth_db_get_magic(uint8_t* data) {
+static inline uint16_t eth_db_get_magic(const uint8_t* data) {
   return data[0] | (data[1] << 8);
 }
 
-app_err_t eth_db_update(uint8_t* data, size_t len) {
+// Erases what the update replaces and gives the offset of the entries it brings
+static app_err_t _eth_db_update_erase(uint8_t* data, size_t len, size_t* off, bool resume) {
   switch(eth_db_get_magic(data)) {
   case FS_VERSION_MAGIC:
-    return eth_full_db_rewrite((fs_entry_t*) data, len);
+    *off = 0;
+    return eth_full_db_erase();
+  case FS_DELTA_MAGIC:
+    return eth_delta_db_erase((struct delta_desc*) data, len, off, resume);
   default:
     return ERR_UNSUPPORTED;
   }
 }
 
-app_err_t eth_db_extract_version(uint8_t* data, uint32_t* version) {
+app_err_t eth_db_extract_version(uint8_t* data, size_t len, uint32_t* version) {
   struct version_desc* ver_data;
   struct delta_desc* delta;
 
@@ -267,6 +695,11 @@ app_err_t eth_db_extract_version(uint8_t* data, uint32_t* version) {
     break;
   case FS_DELTA_MAGIC:
     delta = (struct delta_desc*) data;
+
+    if (!_eth_db_delta_len(delta, len)) {
+      return ERR_DATA;
+    }
+
     ver_data = (struct version_desc*) (&delta->data[delta->erase_chain_len + delta->erase_token_len + delta->erase_abi_len]);
     break;
   default:
@@ -276,3 +709,284 @@ app_err_t eth_db_extract_version(uint8_t* data, uint32_t* version) {
   *version = ver_data->version;
   return ERR_OK;
 }
+
+static fs_action_t _eth_db_match_stage(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_STAGE_MAGIC) {
+    return FS_REJECT;
+  }
+
+  return ((struct stage_desc*) entry)->seq == *((uint16_t*) ctx) ? FS_ACCEPT : FS_REJECT;
+}
+
+static fs_action_t _eth_db_match_staged(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_STAGE_MAGIC ? FS_ACCEPT : FS_REJECT;
+}
+
+static fs_action_t _eth_db_match_not_staged(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_STAGE_MAGIC ? FS_REJECT : FS_ACCEPT;
+}
+
+static fs_action_t _eth_db_stage_usage(void* ctx, fs_entry_t* entry) {
+  struct stage_usage_ctx* usage_ctx = (struct stage_usage_ctx*) ctx;
+
+  if ((entry->magic != FS_STAGE_MAGIC) && (usage_ctx->keep_db || (_eth_db_match_all(NULL, entry) == FS_ACCEPT))) {
+    usage_ctx->len += sizeof(fs_entry_t) + entry->len;
+  }
+
+  return FS_REJECT;
+}
+
+// Applying an update writes its entries while all staged chunks are still in flash, so these, the data the update
+// keeps and the entries it brings must fit at once. Full updates erase the old database first, deltas keep most of
+// it. One page is left for the spare of the log and one for the commit entry
+static bool _eth_db_stage_fits(size_t len, bool keep_db) {
+  size_t chunks = (len + STAGE_CHUNK_LEN - 1) / STAGE_CHUNK_LEN;
+
+  if ((chunks + 2) >= HAL_FLASH_DATA_BLOCK_COUNT) {
+    return false;
+  }
+
+  struct stage_usage_ctx usage_ctx = { .len = len, .keep_db = keep_db };
+  fs_find(_eth_db_stage_usage, &usage_ctx);
+
+  return usage_ctx.len <= ((HAL_FLASH_DATA_BLOCK_COUNT - chunks - 2) * STAGE_PAGE_FILL);
+}
+
+static struct stage_desc* _eth_db_stage_chunk(uint16_t seq) {
+  return (struct stage_desc*) fs_find_key(FS_STAGE_MAGIC, &seq, _eth_db_match_stage, &seq);
+}
+
+// The digest covers the chunk as programmed, read back from flash like the firmware upgrade does
+static app_err_t _eth_db_stage_flush(eth_db_stage_t* stage) {
+  struct stage_desc* chunk = (struct stage_desc*) stage->chunk;
+  chunk->_entry.magic = FS_STAGE_MAGIC;
+  chunk->_entry.len = FS_PAGE_DATA_SIZE - sizeof(fs_entry_t);
+  chunk->seq = stage->seq++;
+
+  app_err_t err = fs_write(&chunk->_entry, FS_PAGE_DATA_SIZE);
+
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  chunk = _eth_db_stage_chunk(stage->seq - 1);
+
+  if (!chunk) {
+    return ERR_HW;
+  }
+
+  sha256_Update(&stage->sha2, chunk->data, stage->chunk_len);
+  stage->chunk_len = 0;
+
+  return ERR_OK;
+}
+
+// Writes the entries of the staged database. Entries split between two chunks are joined in g_flash_swap
+static app_err_t _eth_db_stage_apply(size_t len, bool resume) {
+  for (uint16_t seq = 1; (seq * STAGE_CHUNK_LEN) < len; seq++) {
+    if (!_eth_db_stage_chunk(seq)) {
+      return ERR_DATA;
+    }
+  }
+
+  struct stage_desc* chunk = _eth_db_stage_chunk(0);
+
+  if (!chunk) {
+    return ERR_DATA;
+  }
+
+  size_t off;
+  app_err_t err = _eth_db_update_erase(chunk->data, APP_MIN(len, STAGE_CHUNK_LEN), &off, resume);
+
+  if (err != ERR_OK) {
+    return err;
+  }
+
+  fs_entry_t* split = (fs_entry_t*) g_flash_swap;
+  size_t split_len = 0;
+
+  for (uint16_t seq = 0; (seq * STAGE_CHUNK_LEN) < len; seq++) {
+    chunk = _eth_db_stage_chunk(seq);
+
+    if (!chunk) {
+      return ERR_DATA;
+    }
+
+    size_t data_len = APP_MIN((len - (seq * STAGE_CHUNK_LEN)), STAGE_CHUNK_LEN);
+    size_t i = seq ? 0 : off;
+
+    while (i < data_len) {
+      if (split_len) {
+        size_t entry_len = split_len < sizeof(fs_entry_t) ? sizeof(fs_entry_t) : (sizeof(fs_entry_t) + split->len);
+        size_t copy_len = APP_MIN((entry_len - split_len), (data_len - i));
+        memcpy(&g_flash_swap[split_len], &chunk->data[i], copy_len);
+        split_len += copy_len;
+        i += copy_len;
+
+        if (split_len < sizeof(fs_entry_t)) {
+          continue;
+        } else if (split->len > (HAL_FLASH_BLOCK_SIZE - sizeof(fs_entry_t))) {
+          return ERR_DATA;
+        } else if (split_len == (sizeof(fs_entry_t) + split->len)) {
+          if ((err = fs_write(split, split_len)) != ERR_OK) {
+            return err;
+          }
+
+          split_len = 0;
+        }
+
+        continue;
+      }
+
+      size_t end = i;
+
+      while ((data_len - end) >= sizeof(fs_entry_t)) {
+        size_t entry_len = sizeof(fs_entry_t) + ((fs_entry_t*) &chunk->data[end])->len;
+
+        if (entry_len > HAL_FLASH_BLOCK_SIZE) {
+          return ERR_DATA;
+        } else if ((end + entry_len) > data_len) {
+          break;
+        }
+
+        end += entry_len;
+      }
+
+      if (end > i) {
+        if ((err = fs_write((fs_entry_t*) &chunk->data[i], (end - i))) != ERR_OK) {
+          return err;
+        }
+
+        i = end;
+      } else {
+        split_len = data_len - i;
+        memcpy(g_flash_swap, &chunk->data[i], split_len);
+        i = data_len;
+      }
+    }
+  }
+
+  return split_len ? ERR_DATA : ERR_OK;
+}
+
+static app_err_t _eth_db_stage_commit(bool resume) {
+  struct stage_commit_desc* commit = (struct stage_commit_desc*) _eth_db_stage_chunk(STAGE_COMMIT_SEQ);
+  app_err_t err = ERR_OK;
+
+  if (commit) {
+    err = _eth_db_stage_apply(commit->len, resume);
+
+    // without the commit entry the chunks left by an interrupted discard are never applied again
+    commit = (struct stage_commit_desc*) _eth_db_stage_chunk(STAGE_COMMIT_SEQ);
+
+    if (commit) {
+      fs_erase(&commit->_entry);
+    }
+  }
+
+  eth_db_stage_discard();
+
+  return err;
+}
+
+void eth_db_stage_discard() {
+  fs_erase_all(_eth_db_match_not_staged, NULL);
+}
+
+app_err_t eth_db_stage_begin(eth_db_stage_t* stage, size_t len, uint8_t* chunk) {
+  if (len < (ETH_DB_SIG_LEN + sizeof(struct version_desc))) {
+    return ERR_DATA;
+  }
+
+  if (fs_find(_eth_db_match_staged, NULL)) {
+    eth_db_stage_discard();
+  }
+
+  stage->chunk = chunk;
+  stage->len = len - ETH_DB_SIG_LEN;
+  stage->received = 0;
+  stage->chunk_len = 0;
+  stage->seq = 0;
+  sha256_Init(&stage->sha2);
+
+  return _eth_db_stage_fits(stage->len, false) ? ERR_OK : ERR_FULL;
+}
+
+app_err_t eth_db_stage_write(eth_db_stage_t* stage, const uint8_t* data, size_t len) {
+  if ((stage->received + len) > (stage->len + ETH_DB_SIG_LEN)) {
+    return ERR_DATA;
+  }
+
+  while (len) {
+    if (stage->received >= stage->len) {
+      memcpy(&stage->sig[stage->received - stage->len], data, len);
+      stage->received += len;
+      break;
+    }
+
+    size_t copy_len = APP_MIN(len, APP_MIN((stage->len - stage->received), (STAGE_CHUNK_LEN - stage->chunk_len)));
+    memcpy(&stage->chunk[STAGE_HEADER_LEN + stage->chunk_len], data, copy_len);
+
+    stage->chunk_len += copy_len;
+    stage->received += copy_len;
+    data += copy_len;
+    len -= copy_len;
+
+    if ((stage->chunk_len == STAGE_CHUNK_LEN) || (stage->received == stage->len)) {
+      app_err_t err = _eth_db_stage_flush(stage);
+
+      if (err != ERR_OK) {
+        return err;
+      }
+    }
+  }
+
+  return ERR_OK;
+}
+
+app_err_t eth_db_stage_finish(eth_db_stage_t* stage, uint8_t digest[SHA256_DIGEST_LENGTH], uint32_t* version) {
+  if (stage->received != (stage->len + ETH_DB_SIG_LEN)) {
+    return ERR_DATA;
+  }
+
+  sha256_Final(&stage->sha2, digest);
+
+  struct stage_desc* chunk = _eth_db_stage_chunk(0);
+
+  if (!chunk) {
+    return ERR_HW;
+  }
+
+  return eth_db_extract_version(chunk->data, APP_MIN(stage->len, STAGE_CHUNK_LEN), version);
+}
+
+// Only the update staged tells whether it is a delta, which is checked again against the data it keeps
+app_err_t eth_db_stage_activate(eth_db_stage_t* stage) {
+  struct stage_desc* chunk = _eth_db_stage_chunk(0);
+
+  if (!chunk || !_eth_db_stage_fits(stage->len, eth_db_get_magic(chunk->data) == FS_DELTA_MAGIC)) {
+    eth_db_stage_discard();
+    return ERR_FULL;
+  }
+
+  struct stage_commit_desc commit = {
+      ._entry = { .magic = FS_STAGE_MAGIC, .len = sizeof(struct stage_commit_desc) - sizeof(fs_entry_t) },
+      .seq = STAGE_COMMIT_SEQ,
+      .len = stage->len
+  };
+
+  if (fs_write(&commit._entry, sizeof(commit)) != ERR_OK) {
+    eth_db_stage_discard();
+    return ERR_HW;
+  }
+
+  return _eth_db_stage_commit(false);
+}
+
+app_err_t eth_db_stage_resume() {
+  if (!fs_find(_eth_db_match_staged, NULL)) {
+    return ERR_OK;
+  }
+
+  return _eth_db_stage_commit(true);
+}
@@ -1,11 +1,13 @@
 #ifndef _ETH_DB_H_
 #define _ETH_DB_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 #include "error.h"
+#include "crypto/sha2.h"
 
-#define FS_ABI_MAGIC 0x4142
+#define ETH_DB_SIG_LEN 64
 
 typedef struct {
   uint32_t chain_id;
@@ -21,10 +23,58 @@ typedef struct {
   uint8_t decimals;
 } erc20_desc_t;
 
+// Chain and token records resolved since the filesystem last changed, found or not. The lookups repeated while a
+// transaction is shown are then answered from RAM
+#ifndef ETH_DB_CACHE_SIZE
+#define ETH_DB_CACHE_SIZE 8
+#endif
+
+// filtered counts the token and ABI lookups the database filters answered as missing without searching
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t filtered;
+} eth_db_cache_stats_t;
+
+// An update received in segments and staged in flash. len is the length of the database without its signature.
+// chunk buffers the page being received, FS_PAGE_DATA_SIZE bytes which must stay untouched until the update is staged
+typedef struct {
+  SHA256_CTX sha2;
+  uint8_t* chunk;
+  size_t len;
+  size_t received;
+  size_t chunk_len;
+  uint16_t seq;
+  uint8_t sig[ETH_DB_SIG_LEN];
+} eth_db_stage_t;
+
+typedef bool (*eth_db_abi_match_t)(void* ctx, const uint8_t* func);
+
+// The calldata the candidates of a selector are matched against. v2 ABI tables can keep the shape of each function
+// after its selector: the number of argument words, whether any argument is dynamic, making that a minimum, and
+// whether it is payable. Candidates of another shape are then skipped without reading their arguments
+typedef struct {
+  uint32_t args_len;
+  bool has_value;
+} eth_db_abi_call_t;
+
+#define ETH_DB_ABI_SHAPE_WORDS 0x0fff
+#define ETH_DB_ABI_SHAPE_DYNAMIC 0x4000
+#define ETH_DB_ABI_SHAPE_PAYABLE 0x8000
+
 app_err_t eth_db_lookup_chain(chain_desc_t* chain);
 app_err_t eth_db_lookup_erc20(erc20_desc_t* erc20);
 app_err_t eth_db_lookup_version(uint32_t* version);
-app_err_t eth_db_update(uint8_t* data, size_t len);
-app_err_t eth_db_extract_version(uint8_t* data, uint32_t* version);
+const uint8_t* eth_db_lookup_abi(uint32_t selector, const eth_db_abi_call_t* call, eth_db_abi_match_t match, void* ctx);
+app_err_t eth_db_extract_version(uint8_t* data, size_t len, uint32_t* version);
+void eth_db_cache_flush();
+void eth_db_get_cache_stats(eth_db_cache_stats_t* stats);
+
+app_err_t eth_db_stage_begin(eth_db_stage_t* stage, size_t len, uint8_t* chunk);
+app_err_t eth_db_stage_write(eth_db_stage_t* stage, const uint8_t* data, size_t len);
+app_err_t eth_db_stage_finish(eth_db_stage_t* stage, uint8_t digest[SHA256_DIGEST_LENGTH], uint32_t* version);
+app_err_t eth_db_stage_activate(eth_db_stage_t* stage);
+app_err_t eth_db_stage_resume();
+void eth_db_stage_discard();
 
 #endif
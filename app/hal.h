@@ -12,6 +12,8 @@
 
 #ifdef STM32_HAL
 #include "stm32.h" // IWYU pragma: export
+#elif defined(LINUX_HAL)
+#include "linux_hal.h" // IWYU pragma: export
 #else
 #error "Unsupported platform"
 #endif
@@ -50,6 +52,7 @@ hal_err_t hal_camera_start(uint8_t fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE]);
 hal_err_t hal_camera_stop();
 hal_err_t hal_camera_next_frame(uint8_t** fb);
 hal_err_t hal_camera_submit(uint8_t* fb);
+uint32_t hal_camera_dropped_frames();
 
 // Screen
 #define SCREEN_WIDTH 320
@@ -179,6 +182,7 @@ int hal_bn_cmp(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE]);
 
 // Timer
 hal_err_t hal_delay_us(uint32_t usec);
+uint32_t hal_get_ms();
 void hal_tick();
 
 // Flash
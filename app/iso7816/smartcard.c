@@ -9,6 +9,9 @@
 #define SC_DEFAULT_ETU10NS 9300
 #define SC_MAX_TIMEOUT_MS 1000
 
+// The APDU whose response is being received. Only one can be in flight, since it is part of the T=1 exchange
+static apdu_t* g_smartcard_apdu;
+
 static inline void smartcard_state_reset(smartcard_t* sc) {
   sc->send_seq = 0;
   sc->recv_seq = 0;
@@ -69,7 +72,7 @@ void smartcard_out(smartcard_t* sc) {
   sc->state = SC_NOT_PRESENT;
 }
 
-static inline app_err_t smartcard_wait(smartcard_t* sc) {
+app_err_t smartcard_wait(smartcard_t* sc) {
   BaseType_t res = pdFAIL;
   uint32_t err;
   res = xTaskNotifyWaitIndexed(SMARTCARD_TASK_NOTIFICATION_IDX, 0, UINT32_MAX, &err, pdMS_TO_TICKS(SC_MAX_TIMEOUT_MS));
@@ -114,3 +117,25 @@ app_err_t smartcard_send_apdu(smartcard_t* sc, apdu_t* apdu) {
     return ERR_UNSUPPORTED;
   }
 }
+
+app_err_t smartcard_send_apdu_async(smartcard_t* sc, apdu_t* apdu) {
+  configASSERT(g_smartcard_apdu == NULL);
+
+  if (sc->atr.default_protocol != SC_T1) {
+    return ERR_UNSUPPORTED;
+  }
+
+  if (t1_transmit_async(sc, apdu) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  g_smartcard_apdu = apdu;
+  return ERR_OK;
+}
+
+app_err_t smartcard_wait_apdu(smartcard_t* sc) {
+  apdu_t* apdu = g_smartcard_apdu;
+  g_smartcard_apdu = NULL;
+
+  return t1_wait(sc, apdu);
+}
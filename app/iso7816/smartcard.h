@@ -68,6 +68,13 @@ app_err_t smartcard_transmit(smartcard_t* sc, const uint8_t* buf, uint32_t len);
 app_err_t smartcard_transmit_sync(smartcard_t* sc, const uint8_t* buf, uint32_t len);
 app_err_t smartcard_receive(smartcard_t* sc, uint8_t* buf, uint32_t len);
 app_err_t smartcard_receive_sync(smartcard_t* sc, uint8_t* buf, uint32_t len);
+app_err_t smartcard_wait(smartcard_t* sc);
 app_err_t smartcard_send_apdu(smartcard_t* sc, apdu_t* apdu);
 
+// Sends the APDU and returns once the response is being received by the UART, so the caller can work while the card
+// processes it. The APDU must not be touched until smartcard_wait_apdu returns, and no other APDU can be sent in the
+// meantime
+app_err_t smartcard_send_apdu_async(smartcard_t* sc, apdu_t* apdu);
+app_err_t smartcard_wait_apdu(smartcard_t* sc);
+
 #endif
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "hal.h"
 #include "iso7816/t1.h"
 
@@ -9,6 +10,9 @@
 #define T1_MAX_RESP_BLOCKS (APDU_BUF_LEN + 16)
 #define T1_MAX_LRC_RETRIES 3
 
+// Header of the response to the last block sent, received in the background while the caller works
+static uint8_t g_t1_resp_header[3];
+
 static inline uint8_t t1_lrc(uint8_t* header, uint8_t* data, uint32_t len) {
   uint8_t lrc = header[0] ^ header[1] ^ header[2];
 
@@ -109,17 +113,32 @@ static app_err_t t1_handle_r(smartcard_t* sc, uint8_t pcb) {
   return ERR_OK;
 }
 
-static app_err_t t1_handle_resp(smartcard_t* sc, apdu_t* apdu) {
+static void t1_expect_block(smartcard_t* sc) {
+  hal_smartcard_set_timeout(sc->t1_bwt * sc->t1_bwt_factor);
+  sc->t1_bwt_factor = 1;
+}
+
+// With pending set, the reception of the first header was started by t1_transmit_last and is only collected here
+static app_err_t t1_handle_resp(smartcard_t* sc, apdu_t* apdu, uint8_t pending) {
   uint8_t lrc_retries = 0;
   uint16_t blocks = 0;
 
   for(;;) {
     uint8_t header[3];
 
-    hal_smartcard_set_timeout(sc->t1_bwt * sc->t1_bwt_factor);
-    sc->t1_bwt_factor = 1;
-    if (smartcard_receive_sync(sc, header, 3) != ERR_OK) {
-      return ERR_TXRX;
+    if (pending) {
+      pending = 0;
+
+      if (smartcard_wait(sc) != ERR_OK) {
+        return ERR_TXRX;
+      }
+
+      memcpy(header, g_t1_resp_header, 3);
+    } else {
+      t1_expect_block(sc);
+      if (smartcard_receive_sync(sc, header, 3) != ERR_OK) {
+        return ERR_TXRX;
+      }
     }
 
     uint16_t blen = header[2];
@@ -203,7 +222,37 @@ static app_err_t t1_handle_resp(smartcard_t* sc, apdu_t* apdu) {
   }
 }
 
-app_err_t t1_transmit(smartcard_t* sc, apdu_t* apdu) {
+static app_err_t t1_transmit_i(smartcard_t* sc, uint8_t* data, uint8_t blen, uint8_t more) {
+  uint8_t header[3];
+
+  header[0] = T1_NAD;
+  header[1] = T1_I_BLOCK | T1_I_SEQ(sc->send_seq) | more;
+  header[2] = blen;
+
+  uint8_t lrc = t1_lrc(header, data, blen);
+
+  if (smartcard_transmit_sync(sc, header, 3) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  if (smartcard_transmit_sync(sc, data, blen) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  return smartcard_transmit_sync(sc, &lrc, 1);
+}
+
+// Sends the last block of the APDU and starts receiving the header of the response without waiting for it
+static app_err_t t1_transmit_last(smartcard_t* sc, uint8_t* data, uint8_t blen) {
+  if (t1_transmit_i(sc, data, blen, T1_I_LAST) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  t1_expect_block(sc);
+  return smartcard_receive(sc, g_t1_resp_header, 3);
+}
+
+app_err_t t1_transmit_async(smartcard_t* sc, apdu_t* apdu) {
   if (sc->atr.t1_ifsc == 0) {
     return ERR_TXRX;
   }
@@ -212,35 +261,21 @@ app_err_t t1_transmit(smartcard_t* sc, apdu_t* apdu) {
   uint8_t to_send = APDU_LEN(apdu);
   uint8_t resend = 0;
 
-  while(to_send > 0 && (resend < 2)) {
-    uint8_t header[3];
-    uint8_t blen = MIN(to_send, sc->atr.t1_ifsc);
-
-    header[0] = T1_NAD;
-    header[1] = T1_I_BLOCK | T1_I_SEQ(sc->send_seq) | ((to_send > sc->atr.t1_ifsc) ? T1_I_MORE : T1_I_LAST);
-    header[2] = blen;
-
-    uint8_t lrc = t1_lrc(header, data, blen);
-
-    if (smartcard_transmit_sync(sc, header, 3) != ERR_OK) {
-      return ERR_TXRX;
-    }
-    
-    if (smartcard_transmit_sync(sc, data, blen) != ERR_OK) {
+  // the card acknowledges chained blocks at once, only the response to the last one takes time
+  while(to_send > sc->atr.t1_ifsc) {
+    if (resend == 2) {
       return ERR_TXRX;
     }
 
-    if (smartcard_transmit_sync(sc, &lrc, 1) != ERR_OK) {
+    if (t1_transmit_i(sc, data, sc->atr.t1_ifsc, T1_I_MORE) != ERR_OK) {
       return ERR_TXRX;
     }
 
-    uint8_t res = t1_handle_resp(sc, apdu);
-
-    switch(res) {
+    switch(t1_handle_resp(sc, apdu, 0)) {
       case ERR_OK:
         sc->send_seq = sc->send_seq ^ 1;
-        to_send -= blen;
-        data += blen;
+        to_send -= sc->atr.t1_ifsc;
+        data += sc->atr.t1_ifsc;
         resend = 0;
         break;
       case ERR_RETRY:
@@ -251,7 +286,34 @@ app_err_t t1_transmit(smartcard_t* sc, apdu_t* apdu) {
     }
   }
 
-  return (to_send == 0) && (apdu->lr >= 2) ? ERR_OK : ERR_TXRX;
+  return t1_transmit_last(sc, data, to_send);
+}
+
+app_err_t t1_wait(smartcard_t* sc, apdu_t* apdu) {
+  uint8_t len = APDU_LEN(apdu);
+  uint8_t blen = len - (sc->atr.t1_ifsc * ((len - 1) / sc->atr.t1_ifsc));
+  uint8_t* data = &apdu->data[len - blen];
+
+  app_err_t err = t1_handle_resp(sc, apdu, 1);
+
+  if (err == ERR_RETRY) {
+    err = (t1_transmit_last(sc, data, blen) == ERR_OK) ? t1_handle_resp(sc, apdu, 1) : ERR_TXRX;
+  }
+
+  if (err != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  sc->send_seq = sc->send_seq ^ 1;
+  return (apdu->lr >= 2) ? ERR_OK : ERR_TXRX;
+}
+
+app_err_t t1_transmit(smartcard_t* sc, apdu_t* apdu) {
+  if (t1_transmit_async(sc, apdu) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  return t1_wait(sc, apdu);
 }
 
 app_err_t t1_negotiate_ifsd(smartcard_t* sc, int retry) {
@@ -261,7 +323,7 @@ app_err_t t1_negotiate_ifsd(smartcard_t* sc, int retry) {
     return ERR_TXRX;
   }
 
-  if (t1_handle_resp(sc, NULL) == ERR_OK) {
+  if (t1_handle_resp(sc, NULL, 0) == ERR_OK) {
     return ERR_OK;
   }
 
@@ -269,7 +331,7 @@ app_err_t t1_negotiate_ifsd(smartcard_t* sc, int retry) {
     return ERR_TXRX;
   }
 
-  if (t1_handle_resp(sc, NULL) != ERR_OK) {
+  if (t1_handle_resp(sc, NULL, 0) != ERR_OK) {
     return ERR_TXRX;
   }
 
@@ -33,6 +33,8 @@
 
 
 app_err_t t1_transmit(smartcard_t* sc, apdu_t* apdu);
+app_err_t t1_transmit_async(smartcard_t* sc, apdu_t* apdu);
+app_err_t t1_wait(smartcard_t* sc, apdu_t* apdu);
 app_err_t t1_negotiate_ifsd(smartcard_t* sc, int retry);
 
 #endif
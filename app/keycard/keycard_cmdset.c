@@ -225,20 +225,35 @@ app_err_t keycard_cmd_export_key(keycard_t* kc, uint8_t export_type, uint8_t* pa
   return securechannel_send_apdu(&kc->sc, &kc->ch, &kc->apdu, path, len);
 }
 
-app_err_t keycard_cmd_sign(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash) {
+static uint8_t keycard_sign_apdu(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash, uint8_t* data) {
   APDU_RESET(&kc->apdu);
   APDU_CLA(&kc->apdu) = 0x80;
   APDU_INS(&kc->apdu) = 0xc0;
   APDU_P1(&kc->apdu) = 1;
   APDU_P2(&kc->apdu) = algo;
 
-  SC_BUF(data, 104);
   uint8_t hash_len = (algo == KEYCARD_SIGN_BIP340_SCHNORR) ? 64 : 32;
 
   memcpy(data, hash, hash_len);
   memcpy(&data[hash_len], path, path_len);
 
-  return securechannel_send_apdu(&kc->sc, &kc->ch, &kc->apdu, data, (hash_len + path_len));
+  return hash_len + path_len;
+}
+
+app_err_t keycard_cmd_sign(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash) {
+  SC_BUF(data, 104);
+  uint8_t len = keycard_sign_apdu(kc, algo, path, path_len, hash, data);
+  return securechannel_send_apdu(&kc->sc, &kc->ch, &kc->apdu, data, len);
+}
+
+app_err_t keycard_cmd_sign_async(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash) {
+  SC_BUF(data, 104);
+  uint8_t len = keycard_sign_apdu(kc, algo, path, path_len, hash, data);
+  return securechannel_send_apdu_async(&kc->sc, &kc->ch, &kc->apdu, data, len);
+}
+
+app_err_t keycard_cmd_wait(keycard_t* kc) {
+  return securechannel_wait_apdu(&kc->sc, &kc->ch, &kc->apdu);
 }
 
 app_err_t keycard_cmd_factory_reset(keycard_t* kc) {
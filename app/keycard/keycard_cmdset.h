@@ -31,6 +31,10 @@ app_err_t keycard_cmd_load_seed(keycard_t* kc, uint8_t* seed);
 app_err_t keycard_cmd_load_key(keycard_t* kc, uint8_t* key_template, uint8_t len);
 app_err_t keycard_cmd_export_key(keycard_t* kc, uint8_t export_type, uint8_t* path, uint8_t len);
 app_err_t keycard_cmd_sign(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash);
+// Like keycard_cmd_sign, but returns as soon as the command is on its way. kc->apdu holds the response once
+// keycard_cmd_wait returns, and no other command can be sent before that
+app_err_t keycard_cmd_sign_async(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash);
+app_err_t keycard_cmd_wait(keycard_t* kc);
 app_err_t keycard_cmd_factory_reset(keycard_t* kc);
 app_err_t keycard_cmd_get_data(keycard_t* kc);
 app_err_t keycard_cmd_set_data(keycard_t* kc, uint8_t* data, uint8_t len);
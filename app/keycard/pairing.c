@@ -3,8 +3,6 @@
 #include "crypto/aes.h"
 #include <string.h>
 
-#define FS_PAIRING_MAGIC 0x5041
-
 struct pairing_match_ctx {
   const uint8_t* instance_uid;
   fs_action_t match_action;
@@ -24,7 +22,7 @@ fs_action_t _pairing_match_uid(void* ctx, fs_entry_t* entry) {
 
 app_err_t pairing_read(pairing_t* out) {
   struct pairing_match_ctx match_ctx = {.instance_uid = out->instance_uid, .match_action = FS_ACCEPT, .mismatch_action = FS_REJECT};
-  pairing_t* entry = (pairing_t*) fs_find(_pairing_match_uid, &match_ctx);
+  pairing_t* entry = (pairing_t*) fs_find_key(FS_PAIRING_MAGIC, out->instance_uid, _pairing_match_uid, &match_ctx);
 
   if (!entry) {
     return ERR_DATA;
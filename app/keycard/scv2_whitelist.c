@@ -2,8 +2,6 @@
 #include "storage/fs.h"
 #include <string.h>
 
-#define FS_SCV2_WHITELIST_MAGIC 0x5343
-
 typedef struct __attribute__ ((packed)) {
   fs_entry_t _fs_data;
   uint8_t pubkey[SCV2_WHITELIST_PUBKEY_LEN];
@@ -35,7 +33,7 @@ app_err_t scv2_whitelist_check(const uint8_t pubkey[SCV2_WHITELIST_PUBKEY_LEN])
     .mismatch_action = FS_REJECT,
   };
 
-  fs_entry_t* entry = fs_find(_scv2_whitelist_match_pubkey, &match_ctx);
+  fs_entry_t* entry = fs_find_key(FS_SCV2_WHITELIST_MAGIC, pubkey, _scv2_whitelist_match_pubkey, &match_ctx);
 
   return entry ? ERR_OK : ERR_DATA;
 }
@@ -55,6 +55,49 @@ app_err_t securechannel_send_apdu(smartcard_t* card, secure_channel_t *sc, apdu_
   return err;
 }
 
+app_err_t securechannel_send_apdu_async(smartcard_t* card, secure_channel_t *sc, apdu_t* apdu, uint8_t* data, uint32_t len) {
+  if (!sc->open) {
+    return ERR_CRYPTO;
+  }
+
+  app_err_t err;
+  if (sc->version == SC_V2) {
+    err = securechannel_v2_protect_apdu(&sc->v2, apdu, data, len);
+  } else if (sc->version == SC_V1) {
+    err = securechannel_v1_protect_apdu(&sc->v1, apdu, data, len);
+  } else {
+    return ERR_CRYPTO;
+  }
+
+  if (err == ERR_OK) {
+    err = smartcard_send_apdu_async(card, apdu) == ERR_OK ? ERR_OK : ERR_TXRX;
+  }
+
+  if (err != ERR_OK) {
+    sc->open = 0;
+  }
+
+  return err;
+}
+
+app_err_t securechannel_wait_apdu(smartcard_t* card, secure_channel_t *sc, apdu_t* apdu) {
+  app_err_t err;
+
+  if (smartcard_wait_apdu(card) != ERR_OK) {
+    err = ERR_TXRX;
+  } else if (sc->version == SC_V2) {
+    err = securechannel_v2_decrypt_apdu(&sc->v2, apdu);
+  } else {
+    err = securechannel_v1_decrypt_apdu(&sc->v1, apdu);
+  }
+
+  if (err != ERR_OK) {
+    sc->open = 0;
+  }
+
+  return err;
+}
+
 void securechannel_close(secure_channel_t* sc) {
   if (sc->version == SC_V2) {
     securechannel_v2_close(&sc->v2);
@@ -36,6 +36,10 @@ typedef struct __attribute__((packed, aligned(4))) {
 app_err_t securechannel_open(secure_channel_t* sc, smartcard_t* card, apdu_t* apdu, sc_version_t version, void* context_data);
 app_err_t securechannel_init(smartcard_t* card, secure_channel_t* sc, apdu_t* apdu, sc_version_t version, uint8_t* sc_data, uint8_t* data, uint32_t len);
 app_err_t securechannel_send_apdu(smartcard_t* card, secure_channel_t *sc, apdu_t* apdu, uint8_t* data, uint32_t len);
+// The two halves of securechannel_send_apdu, with the card working in between. Every APDU submitted must be waited
+// for before the next one is sent, since the IV or nonce of the channel follows each response
+app_err_t securechannel_send_apdu_async(smartcard_t* card, secure_channel_t *sc, apdu_t* apdu, uint8_t* data, uint32_t len);
+app_err_t securechannel_wait_apdu(smartcard_t* card, secure_channel_t *sc, apdu_t* apdu);
 void securechannel_close(secure_channel_t* sc);
 
 #endif
@@ -168,7 +168,7 @@ app_err_t securechannel_v2_init(smartcard_t* card, secure_channel_v2_t* sc, apdu
   return ERR_OK;
 }
 
-app_err_t securechannel_v2_send_apdu(smartcard_t* card, secure_channel_v2_t* sc, apdu_t* apdu, uint8_t* data, uint32_t len) {
+app_err_t securechannel_v2_protect_apdu(secure_channel_v2_t* sc, apdu_t* apdu, uint8_t* data, uint32_t len) {
   uint8_t* apdu_data = APDU_DATA(apdu);
   memcpy(apdu_data, &APDU_CLA(apdu), 4);
   apdu_data[4] = len;
@@ -192,10 +192,10 @@ app_err_t securechannel_v2_send_apdu(smartcard_t* card, secure_channel_v2_t* sc,
   APDU_SET_LC(apdu, len + 5 + SCV2_TAG_SIZE);
   APDU_SET_LE(apdu, 0);
 
-  if (smartcard_send_apdu(card, apdu) != ERR_OK) {
-    return ERR_TXRX;
-  }
+  return ERR_OK;
+}
 
+app_err_t securechannel_v2_decrypt_apdu(secure_channel_v2_t* sc, apdu_t* apdu) {
   if (APDU_SW(apdu) == 0x6982) {
     return ERR_CRYPTO;
   }
@@ -223,6 +223,19 @@ app_err_t securechannel_v2_send_apdu(smartcard_t* card, secure_channel_v2_t* sc,
   return ERR_OK;
 }
 
+app_err_t securechannel_v2_send_apdu(smartcard_t* card, secure_channel_v2_t* sc, apdu_t* apdu, uint8_t* data, uint32_t len) {
+  app_err_t err;
+  if ((err = securechannel_v2_protect_apdu(sc, apdu, data, len)) != ERR_OK) {
+    return err;
+  }
+
+  if (smartcard_send_apdu(card, apdu) != ERR_OK) {
+    return ERR_TXRX;
+  }
+
+  return securechannel_v2_decrypt_apdu(sc, apdu);
+}
+
 void securechannel_v2_close(secure_channel_v2_t* sc) {
   memzero(sc->key_h2c, AES_128_KEY_SIZE);
   memzero(sc->key_c2h, AES_128_KEY_SIZE);
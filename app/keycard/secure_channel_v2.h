@@ -65,6 +65,18 @@ app_err_t securechannel_v2_init(smartcard_t* card, secure_channel_v2_t* sc, apdu
  */
 app_err_t securechannel_v2_send_apdu(smartcard_t* card, secure_channel_v2_t* sc, apdu_t* apdu, uint8_t* data, uint32_t len);
 
+/**
+ * Encrypt an APDU into a SECURED_APDU, ready to be sent. This is the first half
+ * of securechannel_v2_send_apdu, for callers which send the APDU themselves.
+ */
+app_err_t securechannel_v2_protect_apdu(secure_channel_v2_t* sc, apdu_t* apdu, uint8_t* data, uint32_t len);
+
+/**
+ * Check and decrypt the response to an APDU protected with
+ * securechannel_v2_protect_apdu, advancing the nonce counter.
+ */
+app_err_t securechannel_v2_decrypt_apdu(secure_channel_v2_t* sc, apdu_t* apdu);
+
 /**
  * Close a V2 secure channel session, clearing keys.
  */
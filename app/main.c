@@ -4,6 +4,8 @@
 #include "hal.h"
 
 #include "core/settings.h"
+#include "storage/fs.h"
+#include "ethereum/eth_db.h"
 
 #define USB_STACK_SIZE 800
 #define USB_TASK_PRIO 1
@@ -19,12 +21,14 @@ APP_DEF_TASK(core, CORE_STACK_SIZE);
 APP_DEF_TASK(ui, UI_STACK_SIZE);
 
 #define FW_MAJOR 1
-#define FW_MINOR 3
+#define FW_MINOR 4
 #define FW_PATCH 0
 
 // Beta version. 0 means release.
 // Although not customary, to keep downgrade protection simple betas of the next release
-// share the main version number with the current stable release
+// share the main version number with the current stable release. Betas changing the flash
+// filesystem format take the number of their release instead, so that the stable release
+// cannot be installed over them
 #define FW_BETA 1
 
 __attribute__((section(".fw_signature"))) __attribute__((__used__)) const uint8_t FW_SIGNATURE[64];
@@ -32,6 +36,9 @@ __attribute__((section(".fw_version"))) __attribute__((__used__)) const uint8_t
 
 int main(void) {
   hal_init();
+  fs_init();
+  fs_set_mode(FS_MODE_LOG);
+  eth_db_stage_resume();
   settings_load();
 
   APP_CREATE_TASK(usb, USB_TASK_PRIO);
@@ -4,7 +4,11 @@
 APP_ALIGNED(uint8_t g_mem_heap[MEM_HEAP_SIZE], 4);
 APP_ALIGNED(uint8_t g_flash_swap[HAL_FLASH_BLOCK_SIZE], 4);
 
+#ifdef STM32_HAL
 APP_SECTION(uint32_t g_bootcmd, ".bootcmd,\"aw\",%nobits@");
+#else
+uint32_t g_bootcmd;
+#endif
 
 const uint8_t ZERO32[32] __attribute__((aligned(4))) = {
   0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
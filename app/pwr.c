@@ -6,8 +6,15 @@
 #include "core/settings.h"
 #include "hal.h"
 #include "pwr.h"
+#include "storage/fs.h"
 #include "usb/usb.h"
 
+#define PWR_DEFERRED_NONE 0
+#define PWR_DEFERRED_OFF 1
+#define PWR_DEFERRED_REBOOT 2
+
+static volatile uint8_t g_pwr_deferred;
+
 static void pwr_graceful_shutdown() {
   while(hal_flash_busy()) {
     ;
@@ -28,6 +35,45 @@ void pwr_shutdown() {
 #endif
 }
 
+// A compaction step owns the flash until it returns, so it is told to give up its copy and the core task shuts down
+// in pwr_handle_deferred() once the step returned
+static void pwr_request_from_isr(uint8_t req) {
+  if (fs_compact_abort()) {
+    g_pwr_deferred = req;
+  } else if (req == PWR_DEFERRED_REBOOT) {
+    pwr_reboot();
+  } else {
+    pwr_shutdown();
+  }
+}
+
+void pwr_reboot_from_isr() {
+  pwr_request_from_isr(PWR_DEFERRED_REBOOT);
+}
+
+void pwr_shutdown_from_isr() {
+  pwr_request_from_isr(PWR_DEFERRED_OFF);
+}
+
+void pwr_handle_deferred() {
+  uint8_t req = g_pwr_deferred;
+
+  if (req == PWR_DEFERRED_NONE) {
+    return;
+  }
+
+  g_pwr_deferred = PWR_DEFERRED_NONE;
+
+  if (req == PWR_DEFERRED_REBOOT) {
+    pwr_reboot();
+  } else {
+    pwr_shutdown();
+  }
+
+  // still powered from USB, compaction can go on
+  fs_compact_resume();
+}
+
 void pwr_usb_plugged(bool from_isr) {
   if (g_settings.enable_usb && g_core.ready) {
     hal_usb_start();
@@ -57,18 +103,18 @@ void pwr_usb_unplugged(bool from_isr) {
 
 void pwr_smartcard_inserted() {
 #ifndef TEST_APP
-  pwr_reboot();
+  pwr_reboot_from_isr();
 #endif
 }
 
 void pwr_smartcard_removed() {
 #ifndef TEST_APP
-  pwr_shutdown();
+  pwr_shutdown_from_isr();
 #endif
 }
 
 void pwr_inactivity_timer_elapsed() {
-  pwr_shutdown();
+  pwr_shutdown_from_isr();
 }
 
 uint8_t pwr_battery_level() {
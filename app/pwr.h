@@ -6,9 +6,16 @@
 
 #define PWR_BATTERY_CHARGING 255
 
+// Do not return, except pwr_shutdown() when the device stays powered from USB
 void pwr_reboot();
 void pwr_shutdown();
 
+// For interrupts. While the core task runs a flash compaction step they only abort it and leave the shutdown to
+// pwr_handle_deferred(), which the core task calls after each step
+void pwr_reboot_from_isr();
+void pwr_shutdown_from_isr();
+void pwr_handle_deferred();
+
 void pwr_usb_plugged(bool from_isr);
 void pwr_usb_unplugged(bool from_isr);
 
@@ -826,6 +826,7 @@ static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to, spa
 
 #define THRESHOLD_S_DEN 8
 #define THRESHOLD_T     5
+#define QUIRC_TRACK_WARMUP_ROWS 2
 #define THRESHOLD_S (QUIRC_WIDTH / THRESHOLD_S_DEN)
 
 // to use multiply instead of divide (not too many bits or we'll overflow)
@@ -834,6 +835,161 @@ static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to, spa
 #define FRACMUL ((32768 * (THRESHOLD_S - 1)) / THRESHOLD_S)
 #define FRACMUL2 ((0x100000 * (100 - THRESHOLD_T)) / (200 * THRESHOLD_S))
 
+/* The moving averages form two serial chains snaking through the whole
+ * image, so they are computed with scalar code, writing each direction to
+ * its own buffer. Summing the two averages, deriving the threshold,
+ * binarising and accumulating the luma are independent for each pixel and
+ * are done in a single vectorised pass. All variants are bit-exact with the
+ * scalar FRACMUL/FRACMUL2 formulation.
+ *
+ * The averages never exceed 255 * 32768 / (32768 - FRACMUL), so their sum
+ * fits in 16 bits.
+ */
+_Static_assert((QUIRC_TRACK_ALIGN % 16) == 0, "the threshold kernels process 16 pixels at a time");
+_Static_assert((QUIRC_WIDTH % QUIRC_TRACK_ALIGN) == 0, "the frame width must be a multiple of the region alignment");
+
+#if defined(__ARM_FEATURE_SIMD32)
+#include <arm_acle.h>
+
+static uint32_t threshold_binarize(quirc_pixel_t *row, const uint16_t *avg_w, const uint16_t *avg_u, int len)
+{
+    uint32_t luma = 0;
+
+    for (int x = 0; x < len; x += 4) {
+        uint32_t px;
+        memcpy(&px, &row[x], 4);
+
+        uint32_t t = ((((avg_w[x] + avg_u[x]) * FRACMUL2) >> 20)) |
+                     ((((avg_w[x + 1] + avg_u[x + 1]) * FRACMUL2) >> 20) << 8) |
+                     ((((avg_w[x + 2] + avg_u[x + 2]) * FRACMUL2) >> 20) << 16) |
+                     ((((avg_w[x + 3] + avg_u[x + 3]) * FRACMUL2) >> 20) << 24);
+
+        luma = __usada8(px, 0, luma);
+
+        // GE flags are set where px >= t, those pixels are white
+        __usub8(px, t);
+        px = __sel(QUIRC_PIXEL_WHITE * 0x01010101, QUIRC_PIXEL_BLACK * 0x01010101);
+        memcpy(&row[x], &px, 4);
+    }
+
+    return luma;
+}
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+static uint32_t threshold_binarize(quirc_pixel_t *row, const uint16_t *avg_w, const uint16_t *avg_u, int len)
+{
+    const __m128i mul = _mm_set1_epi16(FRACMUL2);
+    const __m128i black = _mm_set1_epi8(QUIRC_PIXEL_BLACK);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i luma = zero;
+
+    for (int x = 0; x < len; x += 16) {
+        __m128i px = _mm_loadu_si128((const __m128i *) &row[x]);
+
+        __m128i lo = _mm_add_epi16(_mm_loadu_si128((const __m128i *) &avg_w[x]), _mm_loadu_si128((const __m128i *) &avg_u[x]));
+        __m128i hi = _mm_add_epi16(_mm_loadu_si128((const __m128i *) &avg_w[x + 8]), _mm_loadu_si128((const __m128i *) &avg_u[x + 8]));
+
+        // (sum * FRACMUL2) >> 20 as the high half of the product shifted by 4
+        lo = _mm_srli_epi16(_mm_mulhi_epu16(lo, mul), 4);
+        hi = _mm_srli_epi16(_mm_mulhi_epu16(hi, mul), 4);
+        __m128i t = _mm_packus_epi16(lo, hi);
+
+        luma = _mm_add_epi64(luma, _mm_sad_epu8(px, zero));
+
+        // px < t where the saturated t - px is non-zero
+        __m128i white = _mm_cmpeq_epi8(_mm_subs_epu8(t, px), zero);
+        _mm_storeu_si128((__m128i *) &row[x], _mm_andnot_si128(white, black));
+    }
+
+    return _mm_cvtsi128_si32(luma) + _mm_cvtsi128_si32(_mm_unpackhi_epi64(luma, luma));
+}
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+
+static uint32_t threshold_binarize(quirc_pixel_t *row, const uint16_t *avg_w, const uint16_t *avg_u, int len)
+{
+    const uint8x16_t black = vdupq_n_u8(QUIRC_PIXEL_BLACK);
+    uint32x4_t luma = vdupq_n_u32(0);
+
+    for (int x = 0; x < len; x += 16) {
+        uint8x16_t px = vld1q_u8(&row[x]);
+
+        uint16x8_t lo = vaddq_u16(vld1q_u16(&avg_w[x]), vld1q_u16(&avg_u[x]));
+        uint16x8_t hi = vaddq_u16(vld1q_u16(&avg_w[x + 8]), vld1q_u16(&avg_u[x + 8]));
+
+        uint16x4_t t0 = vshrn_n_u32(vmull_n_u16(vget_low_u16(lo), FRACMUL2), 16);
+        uint16x4_t t1 = vshrn_n_u32(vmull_n_u16(vget_high_u16(lo), FRACMUL2), 16);
+        uint16x4_t t2 = vshrn_n_u32(vmull_n_u16(vget_low_u16(hi), FRACMUL2), 16);
+        uint16x4_t t3 = vshrn_n_u32(vmull_n_u16(vget_high_u16(hi), FRACMUL2), 16);
+        uint8x16_t t = vcombine_u8(vshrn_n_u16(vcombine_u16(t0, t1), 4), vshrn_n_u16(vcombine_u16(t2, t3), 4));
+
+        luma = vpadalq_u16(luma, vpaddlq_u8(px));
+        vst1q_u8(&row[x], vandq_u8(vcltq_u8(px, t), black));
+    }
+
+    uint64x2_t sum = vpaddlq_u32(luma);
+    return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1);
+}
+#else
+static uint32_t threshold_binarize(quirc_pixel_t *row, const uint16_t *avg_w, const uint16_t *avg_u, int len)
+{
+    uint32_t luma = 0;
+
+    for (int x = 0; x < len; x++) {
+        luma += row[x];
+        //            if (row[x] < row_average[x] * (100 - THRESHOLD_T) / (200 * threshold_s))
+        if (row[x] < (((avg_w[x] + avg_u[x]) * FRACMUL2) >> 20))
+            row[x] = QUIRC_PIXEL_BLACK;
+        else
+            row[x] = QUIRC_PIXEL_WHITE;
+    }
+
+    return luma;
+}
+#endif
+
+/* Pixels outside the region of interest are binarised against a fixed
+ * threshold derived from the average luma of the previous frame. They are
+ * not scanned, but this keeps the preview meaningful and gives sensible
+ * values to the sampling of codes reaching past the region.
+ */
+static uint32_t threshold_fixed(quirc_pixel_t *row, int len, uint8_t t)
+{
+    uint32_t luma = 0;
+
+    for (int x = 0; x < len; x++) {
+        luma += row[x];
+        row[x] = row[x] < t ? QUIRC_PIXEL_BLACK : QUIRC_PIXEL_WHITE;
+    }
+
+    return luma;
+}
+
+/* Surrounds the region of interest with white pixels, so that flood fills
+ * started inside never leave it.
+ */
+static void threshold_fence(struct quirc *q)
+{
+    const struct quirc_rect *r = &q->roi;
+    int x0 = r->x0 > 0 ? r->x0 - 1 : r->x0;
+    int x1 = r->x1 < QUIRC_WIDTH ? r->x1 + 1 : r->x1;
+
+    if (r->y0 > 0)
+        memset(&q->pixels[(r->y0 - 1) * QUIRC_WIDTH + x0], QUIRC_PIXEL_WHITE, x1 - x0);
+
+    if (r->y1 < QUIRC_HEIGHT)
+        memset(&q->pixels[r->y1 * QUIRC_WIDTH + x0], QUIRC_PIXEL_WHITE, x1 - x0);
+
+    for (int y = r->y0; y < r->y1; y++) {
+        if (r->x0 > 0)
+            q->pixels[y * QUIRC_WIDTH + r->x0 - 1] = QUIRC_PIXEL_WHITE;
+
+        if (r->x1 < QUIRC_WIDTH)
+            q->pixels[y * QUIRC_WIDTH + r->x1] = QUIRC_PIXEL_WHITE;
+    }
+}
+
 uint32_t quirc_threshold(struct quirc *q)
 {
     int x, y;
@@ -841,21 +997,52 @@ uint32_t quirc_threshold(struct quirc *q)
     int avg_u = 0;
     uint32_t total_luma = 0;
     quirc_pixel_t *row = q->pixels;
+    uint16_t row_avg_w[QUIRC_WIDTH] __attribute__((aligned(16)));
+    uint16_t row_avg_u[QUIRC_WIDTH] __attribute__((aligned(16)));
+    int tracking = q->track.enabled;
+
+    if (tracking) {
+        q->roi = q->track.next;
+        // start the averages from their steady state for the last frame luma
+        avg_w = avg_u = (q->track.luma << 15) / (32768 - FRACMUL);
+    } else {
+        q->roi = (struct quirc_rect) { 0, 0, QUIRC_WIDTH, QUIRC_HEIGHT };
+    }
 
-    for (y = 0; y < QUIRC_HEIGHT; y++) {
-        int row_average[QUIRC_WIDTH];
+    const int x0 = q->roi.x0;
+    const int x1 = q->roi.x1;
+    const int width = x1 - x0;
+    const uint8_t fixed_t = (q->track.luma * (100 - THRESHOLD_T)) / 100;
 
-        memset(row_average, 0, QUIRC_WIDTH * 4);
+    // let the averages settle on the pixels right above the region
+    for (y = q->roi.y0 - QUIRC_TRACK_WARMUP_ROWS; y < q->roi.y0; y++) {
+        if (y < 0)
+            continue;
+
+        const quirc_pixel_t *warm = &q->pixels[y * QUIRC_WIDTH];
+
+        for (x = 0; x < width; x++) {
+            avg_w = ((avg_w * FRACMUL) >> 15) + warm[(y & 1) ? x0 + x : x1 - 1 - x];
+            avg_u = ((avg_u * FRACMUL) >> 15) + warm[(y & 1) ? x1 - 1 - x : x0 + x];
+        }
+    }
 
-        for (x = 0; x < QUIRC_WIDTH; x++) {
+    for (y = 0; y < QUIRC_HEIGHT; y++) {
+        if (y < q->roi.y0 || y >= q->roi.y1) {
+            total_luma += threshold_fixed(row, QUIRC_WIDTH, fixed_t);
+            row += QUIRC_WIDTH;
+            continue;
+        }
+
+        for (x = 0; x < width; x++) {
             int w, u;
 
             if (y & 1) {
-                w = x;
-                u = QUIRC_WIDTH - 1 - x;
+                w = x0 + x;
+                u = x1 - 1 - x;
             } else {
-                w = QUIRC_WIDTH - 1 - x;
-                u = x;
+                w = x1 - 1 - x;
+                u = x0 + x;
             }
 
 //            avg_w = (avg_w * (threshold_s - 1)) / threshold_s + row[w];
@@ -865,22 +1052,25 @@ uint32_t quirc_threshold(struct quirc *q)
             avg_w = ((avg_w * FRACMUL) >> 15) + row[w];
             avg_u = ((avg_u * FRACMUL) >> 15) + row[u];
 
-            row_average[w] += avg_w;
-            row_average[u] += avg_u;
+            row_avg_w[w] = avg_w;
+            row_avg_u[u] = avg_u;
         }
 
-        for (x = 0; x < QUIRC_WIDTH; x++) {
-            total_luma += row[x];
-            //            if (row[x] < row_average[x] * (100 - THRESHOLD_T) / (200 * threshold_s))
-            if (row[x] < ((row_average[x] * FRACMUL2) >> 20))
-                row[x] = QUIRC_PIXEL_BLACK;
-            else
-                row[x] = QUIRC_PIXEL_WHITE;
+        total_luma += threshold_binarize(&row[x0], &row_avg_w[x0], &row_avg_u[x0], width);
+
+        if (tracking) {
+            total_luma += threshold_fixed(row, x0, fixed_t);
+            total_luma += threshold_fixed(&row[x1], QUIRC_WIDTH - x1, fixed_t);
         }
 
         row += QUIRC_WIDTH;
     }
 
+    if (tracking)
+        threshold_fence(q);
+
+    q->track.luma = total_luma / (QUIRC_WIDTH * QUIRC_HEIGHT);
+
     return total_luma;
 } /* threshold() */
 
@@ -1088,8 +1278,8 @@ static void finder_scan(struct quirc *q, int y)
     int run_count = 0;
     int pb[5] = {0};
 
-    last_color = row[0];
-    for (x = 1; x < QUIRC_WIDTH; x++) {
+    last_color = row[q->roi.x0];
+    for (x = q->roi.x0 + 1; x < q->roi.x1; x++) {
         color = row[x];
 
         if (/* x && */ color != last_color) {
@@ -1747,13 +1937,77 @@ uint8_t *quirc_begin(struct quirc *q, int *w, int *h)
     return q->pixels;
 }
 
+/* Restricts the next frame to a padded bounding box around the first grid
+ * found, or falls back to full frames after too many misses.
+ */
+static void track_update(struct quirc *q)
+{
+    struct quirc_track *t = &q->track;
+
+    if (!q->num_grids) {
+        if (t->enabled && (++t->misses > QUIRC_TRACK_MAX_MISSES))
+            t->enabled = 0;
+
+        return;
+    }
+
+    const struct quirc_grid *qr = &q->grids[0];
+    struct quirc_point p[4];
+    int x0 = QUIRC_WIDTH;
+    int y0 = QUIRC_HEIGHT;
+    int x1 = 0;
+    int y1 = 0;
+
+    perspective_map(qr->c, 0.0, 0.0, &p[0]);
+    perspective_map(qr->c, qr->grid_size, 0.0, &p[1]);
+    perspective_map(qr->c, qr->grid_size, qr->grid_size, &p[2]);
+    perspective_map(qr->c, 0.0, qr->grid_size, &p[3]);
+
+    for (int i = 0; i < 4; i++) {
+        x0 = p[i].x < x0 ? p[i].x : x0;
+        y0 = p[i].y < y0 ? p[i].y : y0;
+        x1 = p[i].x > x1 ? p[i].x : x1;
+        y1 = p[i].y > y1 ? p[i].y : y1;
+    }
+
+    int pad = ((x1 - x0) > (y1 - y0) ? (x1 - x0) : (y1 - y0)) / QUIRC_TRACK_PADDING_DEN;
+    pad = pad < QUIRC_TRACK_MIN_PADDING ? QUIRC_TRACK_MIN_PADDING : pad;
+
+    x0 = x0 - pad;
+    y0 = y0 - pad;
+    x1 = x1 + pad;
+    y1 = y1 + pad;
+
+    x0 = x0 < 0 ? 0 : (x0 & ~(QUIRC_TRACK_ALIGN - 1));
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 >= QUIRC_WIDTH ? QUIRC_WIDTH : ((x1 + QUIRC_TRACK_ALIGN) & ~(QUIRC_TRACK_ALIGN - 1));
+    y1 = y1 >= QUIRC_HEIGHT ? QUIRC_HEIGHT : y1 + 1;
+
+    if (x1 <= x0 || y1 <= y0) {
+        t->enabled = 0;
+        return;
+    }
+
+    t->next = (struct quirc_rect) { x0, y0, x1, y1 };
+    t->enabled = 1;
+    t->misses = 0;
+}
+
 void quirc_end(struct quirc *q)
 {
-    for (int i = 0; i < QUIRC_HEIGHT; i++)
+    for (int i = q->roi.y0; i < q->roi.y1; i++)
         finder_scan(q, i);
 
     for (int i = 0; i < q->num_capstones; i++)
         test_grouping(q, i);
+
+    track_update(q);
+}
+
+void quirc_track_reset(struct quirc *q)
+{
+    memset(&q->track, 0, sizeof(q->track));
+    q->roi = (struct quirc_rect) { 0, 0, QUIRC_WIDTH, QUIRC_HEIGHT };
 }
 
 void quirc_extract(const struct quirc *q, int index,
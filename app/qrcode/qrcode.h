@@ -40,6 +40,15 @@ extern "C" {
 #define QUIRC_WIDTH 480
 #define QUIRC_HEIGHT 480
 
+/* Once a code is found, following frames are only scanned in a padded box
+ * around it. Tracking stops after the given number of frames without a
+ * code. Horizontal bounds are aligned for the threshold kernels.
+ */
+#define QUIRC_TRACK_MAX_MISSES 3
+#define QUIRC_TRACK_ALIGN 16
+#define QUIRC_TRACK_MIN_PADDING 24
+#define QUIRC_TRACK_PADDING_DEN 4
+
 /* Limits on the maximum size of QR-codes and their content.
  * Payload size is an overstimated approximation based on version number for
  * the alphanumeric type.
@@ -92,6 +101,21 @@ struct quirc_grid {
     float               c[QUIRC_PERSPECTIVE_PARAMS];
 };
 
+/* Region of the image, x1 and y1 are exclusive. */
+struct quirc_rect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+struct quirc_track {
+    int                 enabled;
+    int                 misses;
+    uint32_t            luma;
+    struct quirc_rect   next;
+};
+
 struct quirc {
     quirc_pixel_t           *pixels;
 
@@ -103,6 +127,10 @@ struct quirc {
 
     int                     num_grids;
     struct quirc_grid       grids[QUIRC_MAX_GRIDS];
+
+    /* Kept last: the decoder reuses the start of this structure */
+    struct quirc_rect       roi;
+    struct quirc_track      track;
 };
 
 /* Set image buffer */
@@ -121,6 +149,11 @@ uint8_t *quirc_begin(struct quirc *q, int *w, int *h);
 uint32_t quirc_threshold(struct quirc *q);
 void quirc_end(struct quirc *q);
 
+/* Forgets the tracked code position, so that the next frame is scanned
+ * entirely. Must be called before starting a new scan session.
+ */
+void quirc_track_reset(struct quirc *q);
+
 /* This enum describes the various decoder errors which may occur. */
 typedef enum {
     QUIRC_SUCCESS = 0,
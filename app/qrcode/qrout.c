@@ -1,5 +1,6 @@
 #include "qrcodegen.h"
 #include "qrout.h"
+#include "mem.h"
 #include "core/settings.h"
 #include "screen/screen.h"
 #include "ur/ur.h"
@@ -13,6 +14,18 @@
 #define QR_BUF_LEN qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION)
 #define QR_MAX_SEGMENT_LENGTH 200
 
+// Animated frames carry fountain parts, which look random, so the penalty based choice among the 8 masks
+// gains nothing but costs 8 full symbol evaluations per frame
+#define QR_ANIMATED_MASK qrcodegen_Mask_0
+
+// The camera buffers are free while a QR is displayed and hold the symbols of the first cycle of
+// frames, which is then replayed instead of encoded again
+#define QR_CACHE ((uint8_t*) g_camera_fb)
+#define QR_CACHE_SIZE sizeof(g_camera_fb)
+
+// Frames in the cached cycle per part. Shorter cycles make scanners missing frames wait noticeably longer
+#define QR_CACHE_CYCLE 4
+
 static inline void qrout_brightness_up(uint8_t* brightness) {
   if (*brightness < LCD_MAX_BRIGHTNESS) {
     *brightness += LCD_BRIGHTNESS_STEP;
@@ -29,14 +42,12 @@ static inline void qrout_brightness_down(uint8_t* brightness) {
   hal_pwm_set_dutycycle(PWM_BACKLIGHT, *brightness);
 }
 
-app_err_t qrout_display(const char* str, uint16_t start_y, uint16_t max_y) {
-  uint8_t tmpBuf[QR_BUF_LEN];
-  uint8_t qrcode[QR_BUF_LEN];
-
-  if (!qrcodegen_encodeText(str, tmpBuf, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, QR_MAX_VERSION, qrcodegen_Mask_AUTO, 1)) {
-    return ERR_DATA;
-  }
+static inline size_t qrout_symbol_len(const uint8_t* qrcode) {
+  int qrsize = qrcodegen_getSize(qrcode);
+  return (((qrsize * qrsize) + 7) / 8) + 1;
+}
 
+static app_err_t qrout_draw(const uint8_t* qrcode, uint16_t start_y, uint16_t max_y) {
   screen_area_t qrarea;
   qrarea.height = max_y - start_y;
 
@@ -53,6 +64,17 @@ app_err_t qrout_display(const char* str, uint16_t start_y, uint16_t max_y) {
   return ERR_OK;
 }
 
+app_err_t qrout_display(const char* str, uint16_t start_y, uint16_t max_y) {
+  uint8_t tmpBuf[QR_BUF_LEN];
+  uint8_t qrcode[QR_BUF_LEN];
+
+  if (!qrcodegen_encodeText(str, tmpBuf, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, QR_MAX_VERSION, qrcodegen_Mask_AUTO, 1)) {
+    return ERR_DATA;
+  }
+
+  return qrout_draw(qrcode, start_y, max_y);
+}
+
 static void qrout_prepare_canvas_options(const char* title, icon_t right) {
   dialog_blank_color(0, SCREEN_COLOR_WHITE);
 
@@ -100,36 +122,88 @@ static app_err_t qrout_display_single_ur(ur_out_t* ur, uint16_t start_y) {
   }
 }
 
-static app_err_t qrout_display_animated_ur(ur_out_t* ur, uint16_t start_y) {
-  char urstr[QR_BUF_LEN/2];
-
-  while(1) {
-    if (ur_encode_next(ur, urstr, sizeof(urstr)) != ERR_OK) {
-      return ERR_DATA;
-    }
-
-    if (qrout_display(urstr, start_y, (SCREEN_HEIGHT - TH_SCREEN_MARGIN/2)) != ERR_OK) {
-      return ERR_DATA;
-    }
-
-    uint8_t brightness = g_settings.lcd_brightness;
+// Waits for the end of the frame started at start, handling the keys pressed in the meantime
+static app_err_t qrout_wait_frame(TickType_t start, uint8_t* brightness) {
+  TickType_t elapsed;
 
-    switch(ui_wait_keypress(QR_FRAME_DURATION)) {
+  while((elapsed = (xTaskGetTickCount() - start)) < pdMS_TO_TICKS(QR_FRAME_DURATION)) {
+    switch(ui_wait_keypress(pdMS_TO_TICKS(QR_FRAME_DURATION) - elapsed)) {
     case KEYPAD_KEY_CANCEL:
     case KEYPAD_KEY_BACK:
       return ERR_CANCEL;
     case KEYPAD_KEY_CONFIRM:
       return ERR_OK;
     case KEYPAD_KEY_UP:
-      qrout_brightness_up(&brightness);
+      qrout_brightness_up(brightness);
       break;
     case KEYPAD_KEY_DOWN:
-      qrout_brightness_down(&brightness);
+      qrout_brightness_down(brightness);
       break;
     default:
       break;
     }
   }
+
+  return ERR_NEED_MORE_DATA;
+}
+
+// The first cycle, each part once as is followed by fountain mixes, is encoded and stored in the cache,
+// then replayed in a loop. A scanner missing frames can complete the message from the mixes without
+// waiting for the exact frame it missed to come back. Frames start at a fixed period regardless of how
+// long they take to produce. If the cycle does not fit, the frames keep being encoded one by one.
+static app_err_t qrout_display_animated_ur(ur_out_t* ur, uint16_t start_y) {
+  char urstr[QR_BUF_LEN/2];
+  uint8_t tmpBuf[QR_BUF_LEN];
+  uint8_t brightness = g_settings.lcd_brightness;
+
+  uint32_t cycle = ur->part.ur_part_seqLen * QR_CACHE_CYCLE;
+  uint32_t encoded = 0;
+  uint8_t* cache_end = QR_CACHE;
+  uint8_t* frame = QR_CACHE;
+  bool caching = true;
+
+  while(1) {
+    TickType_t start = xTaskGetTickCount();
+
+    if (encoded < cycle) {
+      if (caching && ((QR_CACHE_SIZE - (frame - QR_CACHE)) < QR_BUF_LEN)) {
+        caching = false;
+      }
+
+      if (!caching) {
+        frame = QR_CACHE;
+      }
+
+      if (ur_encode_next(ur, urstr, sizeof(urstr)) != ERR_OK) {
+        return ERR_DATA;
+      }
+
+      if (!qrcodegen_encodeText(urstr, tmpBuf, frame, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, QR_MAX_VERSION, QR_ANIMATED_MASK, 1)) {
+        return ERR_DATA;
+      }
+
+      if (caching) {
+        encoded++;
+        cache_end = frame + qrout_symbol_len(frame);
+      }
+    } else if (frame == cache_end) {
+      frame = QR_CACHE;
+    }
+
+    if (qrout_draw(frame, start_y, (SCREEN_HEIGHT - TH_SCREEN_MARGIN/2)) != ERR_OK) {
+      return ERR_DATA;
+    }
+
+    if (caching) {
+      frame += qrout_symbol_len(frame);
+    }
+
+    app_err_t err = qrout_wait_frame(start, &brightness);
+
+    if (err != ERR_NEED_MORE_DATA) {
+      return err;
+    }
+  }
 }
 
 app_err_t qrout_display_ur() {
@@ -3,7 +3,6 @@
 #include "mem.h"
 #include "qrcode.h"
 #include "camera/camera.h"
-#include "crypto/crc32.h"
 #include "screen/screen.h"
 #include "ui/theme.h"
 #include "ui/ui_internal.h"
@@ -18,23 +17,25 @@
 #define QR_TICK_COUNT 20
 #define QR_TICK_PERCENT 5
 
+// the preview lives at the end of the heap, past the space given to the UR decoder. The flash swap buffer cannot be
+// used, since power interrupts may commit the settings through it while scanning
+#define QRSCAN_UR_MAX_LEN (MEM_HEAP_SIZE - CAM_OUT_PREVIEW_SIZE)
+
+_Static_assert(CAM_OUT_PREVIEW_SIZE < (MEM_HEAP_SIZE / 8), "the camera preview must leave most of the heap to the UR decoder");
+
+// qrscan_decode stores the decoded data over the start of the quirc context
+_Static_assert(offsetof(struct quirc, roi) >= sizeof(struct quirc_data), "the decoded data would overwrite the tracker state");
+
 typedef struct {
   uint16_t prev_color;
   uint8_t prev_percent_done;
   uint8_t score;
 } qrscan_indicator_t;
 
-app_err_t qrscan_decode(struct quirc *qrctx, ur_t* ur) {
-  struct quirc_code qrcode;
+app_err_t qrscan_decode(struct quirc *qrctx, const struct quirc_code *qrcode, ur_t* ur) {
   struct quirc_data *qrdata = (struct quirc_data *)qrctx;
 
-  if (quirc_count(qrctx) != 1) {
-    return ERR_SCAN;
-  }
-
-  quirc_extract(qrctx, 0, &qrcode);
-
-  if (!quirc_decode(&qrcode, qrdata)) {
+  if (!quirc_decode(qrcode, qrdata)) {
     if (g_ui_cmd.params.qrscan.type == NO_UR) {
       data_t* out = g_ui_cmd.params.qrscan.out;
       out->len = qrdata->payload_len;
@@ -62,7 +63,7 @@ app_err_t qrscan_deserialize(ur_t* ur) {
     return ERR_DATA;
   }
 
-  if ((ur->crc != 0) && (crc32(ur->data, ur->data_len) != ur->crc)) {
+  if ((ur->crc != 0) && (ur->data_crc != ur->crc)) {
     return ERR_DATA;
   }
 
@@ -151,8 +152,11 @@ static inline void qrscan_draw_indicator(qrscan_indicator_t* indicator, uint8_t
 
 app_err_t qrscan_scan() {
   struct quirc qrctx;
+  struct quirc_code qrcode;
   app_err_t res = ERR_OK;
-  ur_t ur = { .data_max_len = MEM_HEAP_SIZE, .data = g_mem_heap, .percent_done = 0, .crc = 0};
+  ur_t ur = { .data_max_len = QRSCAN_UR_MAX_LEN, .data = g_mem_heap, .percent_done = 0, .crc = 0};
+  uint8_t* preview = &g_mem_heap[QRSCAN_UR_MAX_LEN];
+  bool previewing = false;
 
   screen_fill_area(&screen_fullarea, TH_COLOR_QR_BG);
   dialog_nav_hints(ICON_NAV_CANCEL, ICON_NONE);
@@ -166,6 +170,7 @@ app_err_t qrscan_scan() {
 
   qrscan_indicator_t indicator;
   qrscan_reset_and_draw_indicator(&indicator);
+  quirc_track_reset(&qrctx);
 
   while (1) {
     if (camera_next_frame(&fb) != HAL_SUCCESS) {
@@ -177,28 +182,46 @@ app_err_t qrscan_scan() {
 
     uint32_t total_luma = quirc_threshold(&qrctx);
     camera_autoexposure(total_luma);
-    screen_camera_passthrough(fb);
+
+    // the previous preview streamed while the last frame was decoded and this one captured
+    if (previewing) {
+      screen_wait();
+    }
+
+    qrscan_draw_indicator(&indicator, ur.percent_done);
+    screen_camera_preview(fb, preview);
+    previewing = screen_camera_passthrough(preview) == HAL_SUCCESS;
 
     quirc_end(&qrctx);
 
-    app_err_t qrerr = qrscan_decode(&qrctx, &ur);
+    bool found = quirc_count(&qrctx) == 1;
+
+    if (found) {
+      quirc_extract(&qrctx, 0, &qrcode);
+    }
+
+    // decoding only needs the extracted code, so the sensor can already refill the frame
+    if (camera_submit(fb) != HAL_SUCCESS) {
+      res = ERR_HW;
+      goto end;
+    }
+
+    app_err_t qrerr = found ? qrscan_decode(&qrctx, &qrcode, &ur) : ERR_SCAN;
     indicator.score--;
 
     if (qrerr == ERR_OK) {
       indicator.score = QR_SCORE_GREEN;
       hal_inactivity_timer_reset();
       if (qrscan_deserialize(&ur) == ERR_OK) {
-        screen_wait();
         goto end;
       } else {
         ur.crc = 0;
         ur.percent_done = 0;
         screen_wait();
+        previewing = false;
         qrscan_reset_and_draw_indicator(&indicator);
-        goto next_scan;
       }
     } else if (qrerr == ERR_QRNOUR) {
-      screen_wait();
       goto end;
     } else if (qrerr == ERR_DECODE && indicator.score < QR_SCORE_YELLOW) {
       indicator.score = QR_SCORE_YELLOW;
@@ -206,16 +229,6 @@ app_err_t qrscan_scan() {
       indicator.score = QR_SCORE_GREEN;
     }
 
-    screen_wait();
-
-next_scan:
-    if (camera_submit(fb) != HAL_SUCCESS) {
-      res = ERR_HW;
-      goto end;
-    }
-
-    qrscan_draw_indicator(&indicator, ur.percent_done);
-
     keypad_key_t k = ui_wait_keypress(0);
 
     if (k != KEYPAD_KEY_INVALID) {
@@ -232,6 +245,10 @@ next_scan:
   }
 
 end:
+  if (previewing) {
+    screen_wait();
+  }
+
   camera_stop();
   return res;
 }
@@ -1,7 +1,6 @@
 #include "app_tasks.h"
 #include "screen.h"
 #include "common.h"
-#include "qrcode/qrcodegen.h"
 #include "FreeRTOS.h"
 #include "task.h"
 #include <string.h>
@@ -11,6 +10,7 @@
 #define SCREEN_CAMERA_Y 0
 
 #define MAX_GLYPHS_PER_LINE 50
+#define SCREEN_FB_LINES 2
 
 const screen_area_t screen_fullarea = { 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT };
 const screen_area_t screen_camarea = { SCREEN_CAMERA_X, SCREEN_CAMERA_Y, CAM_OUT_WIDTH, CAM_OUT_HEIGHT };
@@ -22,11 +22,12 @@ struct screen_render_ctx {
   int render_size;
   int scale;
   int y_repeat;
+  int fb_lines;
 };
 
 static struct screen_render_ctx g_screen_render_ctx;
 
-APP_NOCACHE(uint16_t g_screen_fb[SCREEN_WIDTH], 2);
+APP_NOCACHE(uint16_t g_screen_fb[SCREEN_WIDTH * SCREEN_FB_LINES], 2);
 
 static void screen_signal() {
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
@@ -34,6 +35,8 @@ static void screen_signal() {
   portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+_Static_assert((CAM_OUT_WIDTH % 8) == 0, "preview rows must be byte aligned");
+
 static void screen_camera_line() {
   if (g_screen_render_ctx.y >= CAM_OUT_HEIGHT) {
     screen_signal();
@@ -41,23 +44,38 @@ static void screen_camera_line() {
   }
 
   for(int x = 0; x < CAM_OUT_WIDTH; x++) {
-    uint8_t luma = *g_screen_render_ctx.data;
-    g_screen_render_ctx.data += 2;
-    g_screen_fb[x] = luma ? SCREEN_COLOR_BLACK : SCREEN_COLOR_WHITE;
+    uint8_t dark = g_screen_render_ctx.data[x >> 3] & (0x80 >> (x & 7));
+    g_screen_fb[x] = dark ? SCREEN_COLOR_BLACK : SCREEN_COLOR_WHITE;
   }
 
-  g_screen_render_ctx.data += CAMERA_WIDTH;
+  g_screen_render_ctx.data += (CAM_OUT_WIDTH / 8);
   g_screen_render_ctx.y++;
 
   screen_draw_pixels(g_screen_fb, CAM_OUT_WIDTH, screen_camera_line);
 }
 
-hal_err_t screen_camera_passthrough(const uint8_t* fb) {
+void screen_camera_preview(const uint8_t* fb, uint8_t preview[CAM_OUT_PREVIEW_SIZE]) {
+  for (int y = 0; y < CAM_OUT_HEIGHT; y++) {
+    for (int x = 0; x < CAM_OUT_WIDTH; x += 8) {
+      uint8_t bits = 0;
+
+      for (int i = 0; i < 8; i++) {
+        bits = (bits << 1) | (fb[(x + i) * 2] != 0);
+      }
+
+      *preview++ = bits;
+    }
+
+    fb += (CAMERA_WIDTH * 2);
+  }
+}
+
+hal_err_t screen_camera_passthrough(const uint8_t preview[CAM_OUT_PREVIEW_SIZE]) {
   if (screen_set_drawing_window(&screen_camarea) != HAL_SUCCESS) {
     return HAL_FAIL;
   }
 
-  g_screen_render_ctx.data = (uint8_t*) fb;
+  g_screen_render_ctx.data = preview;
   g_screen_render_ctx.y = 0;
 
   screen_camera_line();
@@ -65,30 +83,40 @@ hal_err_t screen_camera_passthrough(const uint8_t* fb) {
   return HAL_SUCCESS;
 }
 
+// Each module row is expanded once and sent scale times. The repeated lines go out together as far as
+// the line buffer allows, so there are fewer transfers and interrupts than one per line.
 static void screen_qr_line() {
+  int width = g_screen_render_ctx.render_size;
+
   if (g_screen_render_ctx.y_repeat == 0) {
     if (g_screen_render_ctx.y >= g_screen_render_ctx.qr_size) {
       screen_signal();
       return;
     }
 
-    int fb_x = 0;
+    const uint8_t* modules = &g_screen_render_ctx.data[1];
+    int idx = g_screen_render_ctx.y * g_screen_render_ctx.qr_size;
+    uint16_t* fb = g_screen_fb;
 
-    for(int x = 0; x < g_screen_render_ctx.qr_size; x++) {
-      uint8_t module = qrcodegen_getModule(g_screen_render_ctx.data, x, g_screen_render_ctx.y);
+    for(int x = 0; x < g_screen_render_ctx.qr_size; x++, idx++) {
+      uint16_t color = ((modules[idx >> 3] >> (idx & 7)) & 1) ? SCREEN_COLOR_BLACK : SCREEN_COLOR_WHITE;
       int x_repeat = g_screen_render_ctx.scale;
       while(x_repeat--) {
-        g_screen_fb[fb_x++] = module ? SCREEN_COLOR_BLACK : SCREEN_COLOR_WHITE;
+        *(fb++) = color;
       }
     }
 
+    for (int i = 1; i < g_screen_render_ctx.fb_lines; i++) {
+      memcpy(&g_screen_fb[i * width], g_screen_fb, (width * sizeof(uint16_t)));
+    }
+
     g_screen_render_ctx.y++;
-    g_screen_render_ctx.y_repeat = (g_screen_render_ctx.scale - 1);
-  } else {
-    g_screen_render_ctx.y_repeat--;
+    g_screen_render_ctx.y_repeat = g_screen_render_ctx.scale;
   }
 
-  screen_draw_pixels(g_screen_fb, g_screen_render_ctx.render_size, screen_qr_line);
+  int lines = APP_MIN(g_screen_render_ctx.y_repeat, g_screen_render_ctx.fb_lines);
+  g_screen_render_ctx.y_repeat -= lines;
+  screen_draw_pixels(g_screen_fb, (width * lines), screen_qr_line);
 }
 
 hal_err_t screen_draw_qrcode(const screen_area_t* area, const uint8_t* qrcode, int qrsize, int scale) {
@@ -102,6 +130,7 @@ hal_err_t screen_draw_qrcode(const screen_area_t* area, const uint8_t* qrcode, i
   g_screen_render_ctx.render_size = area->width;
   g_screen_render_ctx.scale =  scale;
   g_screen_render_ctx.y_repeat = 0;
+  g_screen_render_ctx.fb_lines = APP_MIN(scale, (SCREEN_WIDTH * SCREEN_FB_LINES) / area->width);
 
   screen_qr_line();
 
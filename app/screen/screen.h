@@ -63,6 +63,7 @@ extern const screen_area_t screen_fullarea;
 
 #define CAM_OUT_WIDTH (CAMERA_WIDTH/2)
 #define CAM_OUT_HEIGHT (CAMERA_HEIGHT/2)
+#define CAM_OUT_PREVIEW_SIZE ((CAM_OUT_WIDTH * CAM_OUT_HEIGHT) / 8)
 
 // Low level API
 hal_err_t screen_init();
@@ -82,7 +83,8 @@ hal_err_t screen_draw_centered_string(screen_text_ctx_t* ctx, const char* str);
 size_t screen_draw_text_offset(screen_text_ctx_t* ctx, uint16_t start_x, uint16_t max_x, uint16_t max_y, const uint8_t* text, size_t len, bool dry_run, bool centered);
 hal_err_t screen_fill_area(const screen_area_t* area, uint16_t color);
 hal_err_t screen_draw_area(const screen_area_t* area, const uint16_t* pixels);
-hal_err_t screen_camera_passthrough(const uint8_t* fb);
+void screen_camera_preview(const uint8_t* fb, uint8_t preview[CAM_OUT_PREVIEW_SIZE]);
+hal_err_t screen_camera_passthrough(const uint8_t preview[CAM_OUT_PREVIEW_SIZE]);
 hal_err_t screen_draw_qrcode(const screen_area_t* area, const uint8_t* qrcode, int qrsize, int scale);
 
 static inline size_t screen_draw_text(screen_text_ctx_t* ctx, uint16_t max_x, uint16_t max_y, const uint8_t* text, size_t len, bool dry_run, bool centered) {
@@ -1,32 +1,96 @@
 #include "fs.h"
 #include "mem.h"
+#include "keycard/application_info.h"
+#include "keycard/scv2_whitelist.h"
 
+#include <stdlib.h>
 #include <string.h>
 
+// fs_erase_all() writes tombstones for at most this many entries, larger erasures rewrite the pages
+#define FS_LOG_ERASE_BATCH 8
+
+// Tombstones are only written while they all fit the dead set, otherwise the page is rewritten at once. Sessions
+// erase a few settings, pairing or whitelist entries and at most a batch of database entries, and with the compaction
+// done at the main menu the set peaks at 25 entries in fs-log-bench
+#ifndef FS_LOG_MAX_DEAD
+#define FS_LOG_MAX_DEAD 32
+#endif
+
+// Garbage a page needs before idle compaction rewrites it, unless the log head is about to reach it
+#define FS_LOG_COMPACT_MIN (HAL_FLASH_BLOCK_SIZE / 8)
+#define FS_LOG_ERASE_AHEAD 4
+
 struct fs_find_ctx {
   fs_predicate_t predicate;
   void* ctx;
   fs_entry_t* found;
 };
 
-struct fs_write_ctx {
-  size_t total_length;
-  uint8_t* last_write;
-  fs_entry_t* next_entry;
-  app_err_t err;
+struct fs_index_ctx {
+  uint32_t page;
+  uint8_t* addr;
+  uint8_t collect;
 };
 
 struct fs_erase_ctx {
   uint32_t block;
+  int page;
   size_t off;
   uint8_t* data;
   uint8_t pending_erase;
   uint8_t stop;
+  uint8_t compact;
+  fs_predicate_t predicate;
+  void* ctx;
+  app_err_t err;
+  uint32_t rewritten[(HAL_FLASH_BLOCK_COUNT + 31) / 32];
+};
+
+struct fs_move_ctx {
+  int page;
+  uint8_t* dest;
+  size_t off;
+  uint8_t drop;
+  uint8_t stop;
+  uint8_t compact;
+  uint8_t abortable;
+  uint8_t copy_only;
   fs_predicate_t predicate;
   void* ctx;
   app_err_t err;
 };
 
+struct fs_usage_ctx {
+  int page;
+  size_t garbage;
+};
+
+struct fs_collect_ctx {
+  fs_predicate_t predicate;
+  void* ctx;
+  fs_entry_t* entries[FS_LOG_ERASE_BATCH];
+  uint8_t count;
+  uint8_t overflow;
+  uint8_t stop;
+};
+
+// Pages copied to the spare name the page they replace, with its erase count, so that the copy can be completed at
+// boot when power was lost before that page was erased
+struct __attribute__((packed)) fs_page_header {
+  fs_entry_t _entry;
+  uint32_t erases;
+  uint16_t source;
+  uint16_t reserved;
+  uint32_t source_erases;
+};
+
+struct __attribute__((packed)) fs_tombstone {
+  fs_entry_t _entry;
+  uint16_t page;
+  uint16_t off;
+  uint32_t erases;
+};
+
 enum fs_iterator_action {
   FS_ITER_END,
   FS_ITER_NEXT,
@@ -34,14 +98,119 @@ enum fs_iterator_action {
   FS_ITER_SKIP_PAGE
 };
 
+// How the log sees an entry: live entries are those visible to callers, kept tombstones are copied when their page
+// is rewritten and garbage is dropped
+enum fs_log_state {
+  FS_LOG_LIVE,
+  FS_LOG_HEADER,
+  FS_LOG_TOMBSTONE,
+  FS_LOG_GARBAGE
+};
+
 #define FS_MAGIC_FREE 0xffff
 #define FS_MAGIC_PAD_MASK 0x00c0
 #define FS_MAGIC_PAD 0x0080
 
+// Each index record holds the 32-bit hash of a key and the location of its entry, the page above the offset in it.
+// Sorting the records groups them by hash and, within the same hash, by their position in flash
+#define FS_INDEX_OFF_BITS 13
+
+_Static_assert(HAL_FLASH_BLOCK_SIZE <= (1 << FS_INDEX_OFF_BITS), "page offsets do not fit the index records");
+
+#define FS_LOC(__PAGE__, __OFF__) (((__PAGE__) << FS_INDEX_OFF_BITS) | (__OFF__))
+#define FS_LOC_PAGE(__LOC__) ((__LOC__) >> FS_INDEX_OFF_BITS)
+#define FS_LOC_OFF(__LOC__) ((__LOC__) & ((1 << FS_INDEX_OFF_BITS) - 1))
+
+// Each dead set record holds the location of the erased entry above the page of its tombstone
+#define FS_DEAD_PAGE_BITS 8
+#define FS_DEAD_PAGE_MASK ((1 << FS_DEAD_PAGE_BITS) - 1)
+
+_Static_assert(HAL_FLASH_DATA_BLOCK_COUNT <= (1 << FS_DEAD_PAGE_BITS), "pages do not fit the dead set records");
+_Static_assert(sizeof(struct fs_page_header) == FS_PAGE_HEADER_LEN, "the page header must fill a flash word");
+
+#define FS_PAGE_BIT(__MAP__, __PAGE__) ((__MAP__)[(__PAGE__) / 32] & (1U << ((__PAGE__) % 32)))
+#define FS_PAGE_SET(__MAP__, __PAGE__) ((__MAP__)[(__PAGE__) / 32] |= (1U << ((__PAGE__) % 32)))
+#define FS_PAGE_CLEAR(__MAP__, __PAGE__) ((__MAP__)[(__PAGE__) / 32] &= ~(1U << ((__PAGE__) % 32)))
+
+#define FS_PAGE_NONE 0xffff
+
+// Where the key is found in the data of an entry and how many records the index keeps for the magic. Records of
+// erased entries stay until their page is rewritten, so often rewritten entries need room for the dead set too.
+// Tokens have no key of their own, they are found through the erc-20 tables and the lookup cache of the database
+typedef struct {
+  uint16_t magic;
+  uint8_t key_len;
+  uint16_t max_keys;
+} fs_key_desc_t;
+
+static const fs_key_desc_t FS_KEYS[] = {
+  { .magic = FS_CHAIN_MAGIC, .key_len = 4, .max_keys = 32 },
+  { .magic = FS_ABI_MAGIC, .key_len = 4, .max_keys = 64 },
+  { .magic = FS_VERSION_MAGIC, .key_len = 0, .max_keys = 4 },
+  { .magic = FS_CHAIN_TABLE_MAGIC, .key_len = 0, .max_keys = 4 },
+  { .magic = FS_ERC20_TABLE_MAGIC, .key_len = 0, .max_keys = 48 },
+  { .magic = FS_ABI_TABLE_MAGIC, .key_len = 0, .max_keys = 8 },
+  { .magic = FS_PAIRING_MAGIC, .key_len = APP_INFO_INSTANCE_UID_LEN, .max_keys = 16 },
+  { .magic = FS_SETTINGS_MAGIC, .key_len = 0, .max_keys = FS_LOG_MAX_DEAD + 4 },
+  { .magic = FS_SCV2_WHITELIST_MAGIC, .key_len = SCV2_WHITELIST_PUBKEY_LEN, .max_keys = 16 },
+  { .magic = FS_STAGE_MAGIC, .key_len = 2, .max_keys = 40 },
+  { .magic = FS_FILTER_MAGIC, .key_len = 2, .max_keys = 4 },
+};
+
+#define FS_KEY_COUNT (sizeof(FS_KEYS) / sizeof(fs_key_desc_t))
+
+_Static_assert(FS_KEY_COUNT <= 16, "the overflow flags do not fit");
+
+// The max_keys of all magics added up, 2176 bytes of records
+#define FS_INDEX_MAX_KEYS 272
+
+typedef struct {
+  uint32_t hash;
+  uint32_t loc;
+} fs_index_rec_t;
+
+// The records of each magic live in their own sorted slice, so a magic with more keys than expected cannot take
+// the room of the others. Its lookups fall back to a linear scan instead
+static struct {
+  fs_index_rec_t recs[FS_INDEX_MAX_KEYS];
+  uint16_t base[FS_KEY_COUNT + 1];
+  uint16_t count[FS_KEY_COUNT];
+  uint16_t free[HAL_FLASH_DATA_BLOCK_COUNT];
+  uint16_t overflow;
+  uint8_t ready;
+} g_fs_index;
+
+// Erased entries waiting for compaction, sorted by location, and what the log knows of each page. The erase
+// count of a page without header is the lowest its next header can have without reviving stale tombstones. The
+// spare is a blank page the log never writes to, where rewritten pages are copied before being erased
+static struct {
+  uint32_t dead[FS_LOG_MAX_DEAD];
+  uint32_t erases[HAL_FLASH_DATA_BLOCK_COUNT];
+  uint32_t headers[(HAL_FLASH_DATA_BLOCK_COUNT + 31) / 32];
+  uint32_t dirty[(HAL_FLASH_DATA_BLOCK_COUNT + 31) / 32];
+  uint16_t dead_count;
+  uint16_t head;
+  int16_t spare;
+  uint8_t spare_dirty;
+  fs_mode_t mode;
+} g_fs_log;
+
+static volatile uint8_t g_fs_compacting;
+static volatile uint8_t g_fs_abort;
+
+static struct {
+  uint32_t requested;
+  uint32_t programmed;
+  uint32_t erased;
+  uint32_t blocked_ms;
+} g_fs_stats;
+
+static uint32_t g_fs_generation;
+
 typedef enum fs_iterator_action (*fs_iterator_cb_t)(void* ctx, fs_entry_t* entry, size_t* to_skip);
 
 static fs_action_t _fs_erase_one(void* ctx, fs_entry_t* entry) {
-  return ((uint32_t) ctx) == ((uint32_t) entry) ? FS_STOP : FS_ACCEPT;
+  return ((uintptr_t) ctx) == ((uintptr_t) entry) ? FS_STOP : FS_ACCEPT;
 }
 
 static uint8_t* _fs_get_page(uint32_t idx) {
@@ -60,6 +229,235 @@ static uint8_t* _fs_get_page(uint32_t idx) {
   return (uint8_t*) (map[off].addr + (HAL_FLASH_BLOCK_SIZE * idx));
 }
 
+static int _fs_page_index(uintptr_t addr) {
+  const hal_flash_data_segment_t *map = hal_flash_get_data_segments();
+
+  int idx = 0;
+
+  for (int i = 0; idx < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    if ((addr >= map[i].addr) && (addr < (map[i].addr + (map[i].count * HAL_FLASH_BLOCK_SIZE)))) {
+      return idx + ((addr - map[i].addr) / HAL_FLASH_BLOCK_SIZE);
+    }
+
+    idx += map[i].count;
+  }
+
+  return -1;
+}
+
+static inline uint32_t _fs_page_off(fs_entry_t* entry) {
+  return (((uintptr_t) entry) - HAL_FLASH_ADDR) % HAL_FLASH_BLOCK_SIZE;
+}
+
+static inline bool _fs_in_swap(const uint8_t* p) {
+  return (p >= g_flash_swap) && (p < &g_flash_swap[HAL_FLASH_BLOCK_SIZE]);
+}
+
+static hal_err_t _fs_program(const uint8_t* data, uint8_t* addr, size_t len) {
+  g_fs_stats.programmed += len;
+  return hal_flash_program(data, addr, len);
+}
+
+static hal_err_t _fs_erase_block(uint32_t block) {
+  g_fs_stats.erased++;
+  return hal_flash_erase(block);
+}
+
+static void _fs_page_header_init(struct fs_page_header* header, uint32_t erases) {
+  header->_entry.magic = FS_PAGE_MAGIC;
+  header->_entry.len = sizeof(struct fs_page_header) - sizeof(fs_entry_t);
+  header->erases = erases;
+  header->source = FS_PAGE_NONE;
+  header->reserved = 0xffff;
+  header->source_erases = UINT32_MAX;
+}
+
+static void _fs_log_page_header(uint32_t page) {
+  struct fs_page_header* header = (struct fs_page_header*) _fs_get_page(page);
+
+  if (header->_entry.magic == FS_PAGE_MAGIC) {
+    FS_PAGE_SET(g_fs_log.headers, page);
+    g_fs_log.erases[page] = header->erases;
+  } else {
+    FS_PAGE_CLEAR(g_fs_log.headers, page);
+  }
+}
+
+// Lower bound of the location in the dead set
+static int _fs_log_find(uint32_t loc) {
+  int lo = 0;
+  int hi = g_fs_log.dead_count;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if ((g_fs_log.dead[mid] >> FS_DEAD_PAGE_BITS) < loc) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo;
+}
+
+static bool _fs_log_is_dead(uint32_t loc) {
+  if (!g_fs_log.dead_count) {
+    return false;
+  }
+
+  int i = _fs_log_find(loc);
+  return (i < g_fs_log.dead_count) && ((g_fs_log.dead[i] >> FS_DEAD_PAGE_BITS) == loc);
+}
+
+static void _fs_log_add_dead(uint32_t loc, uint32_t tombstone_page) {
+  int i = _fs_log_find(loc);
+
+  // tombstones are only written while the set has room for them, so it cannot be full here
+  if (((i < g_fs_log.dead_count) && ((g_fs_log.dead[i] >> FS_DEAD_PAGE_BITS) == loc)) || (g_fs_log.dead_count == FS_LOG_MAX_DEAD)) {
+    return;
+  }
+
+  memmove(&g_fs_log.dead[i + 1], &g_fs_log.dead[i], (g_fs_log.dead_count - i) * sizeof(uint32_t));
+  g_fs_log.dead[i] = (loc << FS_DEAD_PAGE_BITS) | tombstone_page;
+  g_fs_log.dead_count++;
+  FS_PAGE_SET(g_fs_log.dirty, FS_LOC_PAGE(loc));
+}
+
+// A tombstone holds the erase count of the page of its entry, so it goes stale as soon as that page is rewritten
+static inline bool _fs_log_tombstone_valid(const struct fs_tombstone* tombstone) {
+  return (tombstone->page < HAL_FLASH_DATA_BLOCK_COUNT) && FS_PAGE_BIT(g_fs_log.headers, tombstone->page) &&
+      (g_fs_log.erases[tombstone->page] == tombstone->erases);
+}
+
+static void _fs_log_collect(uint32_t page, const struct fs_tombstone* tombstone) {
+  if (_fs_log_tombstone_valid(tombstone)) {
+    _fs_log_add_dead(FS_LOC(tombstone->page, tombstone->off), page);
+    return;
+  }
+
+  FS_PAGE_SET(g_fs_log.dirty, page);
+
+  // the page lost its header with an interrupted rewrite, the next one must not make this tombstone valid again
+  if ((tombstone->page < HAL_FLASH_DATA_BLOCK_COUNT) && !FS_PAGE_BIT(g_fs_log.headers, tombstone->page) &&
+      (g_fs_log.erases[tombstone->page] <= tombstone->erases)) {
+    g_fs_log.erases[tombstone->page] = tombstone->erases + 1;
+  }
+}
+
+static enum fs_log_state _fs_log_state(int page, fs_entry_t* entry) {
+  const struct fs_tombstone* tombstone;
+
+  switch(entry->magic) {
+  case FS_PAGE_MAGIC:
+    return FS_LOG_HEADER;
+  case FS_TOMBSTONE_MAGIC:
+    tombstone = (const struct fs_tombstone*) entry;
+    page = page < 0 ? _fs_page_index((uintptr_t) entry) : page;
+
+    // a tombstone for its own page goes with the rewrite dropping its entry
+    return (_fs_log_tombstone_valid(tombstone) && (tombstone->page != page)) ? FS_LOG_TOMBSTONE : FS_LOG_GARBAGE;
+  default:
+    if (!g_fs_log.dead_count) {
+      return FS_LOG_LIVE;
+    }
+
+    page = page < 0 ? _fs_page_index((uintptr_t) entry) : page;
+    return _fs_log_is_dead(FS_LOC(page, _fs_page_off(entry))) ? FS_LOG_GARBAGE : FS_LOG_LIVE;
+  }
+}
+
+// Forgets the erased entries of a rewritten page. Their tombstones are now stale and garbage of the pages holding them
+static void _fs_log_page_erased(uint32_t page) {
+  _fs_log_page_header(page);
+  FS_PAGE_CLEAR(g_fs_log.dirty, page);
+
+  int count = 0;
+
+  for (int i = 0; i < g_fs_log.dead_count; i++) {
+    uint32_t dead = g_fs_log.dead[i];
+
+    if (FS_LOC_PAGE(dead >> FS_DEAD_PAGE_BITS) != page) {
+      g_fs_log.dead[count++] = dead;
+    } else if ((dead & FS_DEAD_PAGE_MASK) != page) {
+      FS_PAGE_SET(g_fs_log.dirty, dead & FS_DEAD_PAGE_MASK);
+    }
+  }
+
+  g_fs_log.dead_count = count;
+}
+
+// The tombstones of a page copied to the spare are now there
+static void _fs_log_page_moved(uint32_t from, uint32_t to) {
+  for (int i = 0; i < g_fs_log.dead_count; i++) {
+    if ((g_fs_log.dead[i] & FS_DEAD_PAGE_MASK) == from) {
+      g_fs_log.dead[i] = (g_fs_log.dead[i] & ~FS_DEAD_PAGE_MASK) | to;
+    }
+  }
+}
+
+static void _fs_log_build() {
+  g_fs_log.dead_count = 0;
+  memset(g_fs_log.erases, 0, sizeof(g_fs_log.erases));
+  memset(g_fs_log.dirty, 0, sizeof(g_fs_log.dirty));
+  g_fs_log.head = 0;
+  g_fs_log.spare = -1;
+  g_fs_log.spare_dirty = 0;
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    _fs_log_page_header(i);
+  }
+}
+
+static bool _fs_page_blank(const uint8_t* p) {
+  const uint32_t* words = (const uint32_t*) p;
+
+  for (int i = 0; i < (HAL_FLASH_BLOCK_SIZE / sizeof(uint32_t)); i++) {
+    if (words[i] != UINT32_MAX) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Completes the copies to the spare interrupted before the erase of the page they replace, then erases the pages
+// left partially written by an interrupted copy or erase. Those start blank, so writes would program over them
+static void _fs_log_recover() {
+  if (hal_flash_begin_program() != HAL_SUCCESS) {
+    return;
+  }
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    const struct fs_page_header* header = (const struct fs_page_header*) _fs_get_page(i);
+
+    if (!FS_PAGE_BIT(g_fs_log.headers, i) || (header->source >= HAL_FLASH_DATA_BLOCK_COUNT)) {
+      continue;
+    }
+
+    uint32_t source = header->source;
+
+    if (FS_PAGE_BIT(g_fs_log.headers, source) && (g_fs_log.erases[source] == header->source_erases)) {
+      _fs_erase_block(HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) _fs_get_page(source)));
+      _fs_log_page_header(source);
+    }
+
+    if (!FS_PAGE_BIT(g_fs_log.headers, source) && (g_fs_log.erases[source] <= header->source_erases)) {
+      g_fs_log.erases[source] = header->source_erases + 1;
+    }
+  }
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    uint8_t* p = _fs_get_page(i);
+
+    if ((((fs_entry_t*) p)->magic == FS_MAGIC_FREE) && !_fs_page_blank(p)) {
+      _fs_erase_block(HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) p));
+    }
+  }
+
+  hal_flash_end_program();
+}
+
 static enum fs_iterator_action _fs_get_entry(void* ctx, fs_entry_t* entry, size_t* to_skip) {
   struct fs_find_ctx* find_ctx = (struct fs_find_ctx *) ctx;
 
@@ -67,6 +465,10 @@ static enum fs_iterator_action _fs_get_entry(void* ctx, fs_entry_t* entry, size_
     return FS_ITER_SKIP_PAGE;
   }
 
+  if (_fs_log_state(-1, entry) != FS_LOG_LIVE) {
+    return FS_ITER_NEXT;
+  }
+
   switch(find_ctx->predicate(find_ctx->ctx, entry)) {
   case FS_REJECT:
     return FS_ITER_NEXT;
@@ -84,51 +486,23 @@ static hal_err_t _fs_pad(uint8_t* addr) {
     return HAL_SUCCESS;
   }
 
-  size_t padlen = HAL_FLASH_WORD_SIZE - (((uint32_t) addr) & (HAL_FLASH_WORD_SIZE - 1));
-  uint8_t padding[padlen];
+  size_t padlen = (HAL_FLASH_WORD_SIZE - (((uintptr_t) addr) & (HAL_FLASH_WORD_SIZE - 1))) & (HAL_FLASH_WORD_SIZE - 1);
 
-  for (int i = 0; i < padlen; i++) {
-    padding[i] = FS_MAGIC_PAD | (padlen - i);
+  if (!padlen) {
+    return HAL_SUCCESS;
   }
 
-  return hal_flash_program(padding, addr, padlen);
-}
-
-static enum fs_iterator_action _fs_write_entries(void* ctx, fs_entry_t* entry, size_t* to_skip) {
-  struct fs_write_ctx* write_ctx = (struct fs_write_ctx *) ctx;
-
-  if (entry->magic == FS_MAGIC_FREE) {
-    size_t total_entry_len = (write_ctx->next_entry->len + 4);
-    size_t off = ((uint32_t) entry) & (HAL_FLASH_BLOCK_SIZE - 1);
-    if ((HAL_FLASH_BLOCK_SIZE - off) < total_entry_len) {
-      _fs_pad(write_ctx->last_write);
-      write_ctx->last_write = NULL;
-      return FS_ITER_SKIP_PAGE;
-    }
-
-    if (hal_flash_program((uint8_t*) write_ctx->next_entry, (uint8_t*) entry, total_entry_len) != HAL_SUCCESS) {
-      write_ctx->err = ERR_HW;
-    }
-
-    write_ctx->last_write = ((uint8_t*) entry) + total_entry_len;
-    write_ctx->total_length -= total_entry_len;
-
-    if (write_ctx->total_length == 0) {
-      if (_fs_pad(write_ctx->last_write) != HAL_SUCCESS) {
-        write_ctx->err = ERR_HW;
-      }
+  uint8_t padding[padlen];
 
-      return FS_ITER_END;
-    } else {
-      write_ctx->next_entry = (fs_entry_t*) (((uint32_t) write_ctx->next_entry) + total_entry_len);
-      *to_skip = total_entry_len;
-      return FS_ITER_SKIP_BYTES;
-    }
+  for (int i = 0; i < padlen; i++) {
+    padding[i] = FS_MAGIC_PAD | (padlen - i);
   }
 
-  return FS_ITER_NEXT;
+  return _fs_program(padding, addr, padlen);
 }
 
+// In the log mode the rewritten page starts with a header holding its erase count, unless the kept entries fill it,
+// which happens only with pages written before headers existed
 static void _fs_commit_block(struct fs_erase_ctx* erase_ctx) {
   if (!erase_ctx->pending_erase) {
     erase_ctx->off = 0;
@@ -137,31 +511,39 @@ static void _fs_commit_block(struct fs_erase_ctx* erase_ctx) {
 
   erase_ctx->pending_erase = 0;
 
-  if (hal_flash_erase(erase_ctx->block) != HAL_SUCCESS) {
+  if (_fs_erase_block(erase_ctx->block) != HAL_SUCCESS) {
     erase_ctx->err = ERR_HW;
     return;
   }
 
-  if (erase_ctx->off == 0) {
-    return;
+  erase_ctx->rewritten[erase_ctx->block / 32] |= 1U << (erase_ctx->block % 32);
+  uint32_t erases = ++g_fs_log.erases[erase_ctx->page];
+
+  if ((g_fs_log.mode == FS_MODE_LOG) && (erase_ctx->off <= FS_PAGE_DATA_SIZE)) {
+    memmove(&erase_ctx->data[FS_PAGE_HEADER_LEN], erase_ctx->data, erase_ctx->off);
+    _fs_page_header_init((struct fs_page_header*) erase_ctx->data, erases);
+    erase_ctx->off += FS_PAGE_HEADER_LEN;
   }
 
-  size_t padlen = HAL_FLASH_WORD_SIZE - (erase_ctx->off & (HAL_FLASH_WORD_SIZE - 1));
+  size_t padlen = (HAL_FLASH_WORD_SIZE - (erase_ctx->off & (HAL_FLASH_WORD_SIZE - 1))) & (HAL_FLASH_WORD_SIZE - 1);
 
   while (padlen) {
     erase_ctx->data[erase_ctx->off++] = FS_MAGIC_PAD | padlen--;
   }
 
-  if (hal_flash_program(erase_ctx->data, (uint8_t*) HAL_FLASH_BLOCK_ADDR(erase_ctx->block), erase_ctx->off) != HAL_SUCCESS) {
+  if (_fs_program(erase_ctx->data, (uint8_t*) HAL_FLASH_BLOCK_ADDR(erase_ctx->block), erase_ctx->off) != HAL_SUCCESS) {
     erase_ctx->err = ERR_HW;
   }
 
   erase_ctx->off = 0;
+  _fs_log_page_erased(erase_ctx->page);
 }
 
+// Headers are written again by the commit and garbage is dropped, also causing the rewrite when compacting. Valid
+// tombstones are kept without asking the predicate, a missing predicate keeps all other entries
 static enum fs_iterator_action _fs_erase_entries(void* ctx, fs_entry_t* entry, size_t* to_skip) {
   struct fs_erase_ctx* erase_ctx = (struct fs_erase_ctx *) ctx;
-  int block = HAL_FLASH_ADDR_TO_BLOCK((uint32_t)entry);
+  int block = HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) entry);
 
   if (erase_ctx->block != block) {
     _fs_commit_block(erase_ctx);
@@ -169,15 +551,31 @@ static enum fs_iterator_action _fs_erase_entries(void* ctx, fs_entry_t* entry, s
     if (erase_ctx->stop) {
       return FS_ITER_END;
     }
-  }
 
-  erase_ctx->block = block;
+    erase_ctx->block = block;
+    erase_ctx->page = _fs_page_index((uintptr_t) entry);
+  }
 
   if (entry->magic == FS_MAGIC_FREE) {
     return FS_ITER_SKIP_PAGE;
   }
 
-  fs_action_t action = erase_ctx->stop ? FS_ACCEPT : erase_ctx->predicate(erase_ctx->ctx, entry);
+  fs_action_t action;
+
+  switch(_fs_log_state(erase_ctx->page, entry)) {
+  case FS_LOG_HEADER:
+    return FS_ITER_NEXT;
+  case FS_LOG_GARBAGE:
+    erase_ctx->pending_erase |= erase_ctx->compact;
+    return FS_ITER_NEXT;
+  case FS_LOG_TOMBSTONE:
+    action = FS_ACCEPT;
+    break;
+  default:
+    action = (erase_ctx->stop || !erase_ctx->predicate) ? FS_ACCEPT : erase_ctx->predicate(erase_ctx->ctx, entry);
+    break;
+  }
+
   int copy_len;
 
   switch(action) {
@@ -199,6 +597,85 @@ static enum fs_iterator_action _fs_erase_entries(void* ctx, fs_entry_t* entry, s
   return FS_ITER_NEXT;
 }
 
+// Decides like _fs_erase_entries() which entries a rewrite keeps. Without destination it only finds whether the rewrite
+// drops any and how long the kept entries are, otherwise it programs them there
+static enum fs_iterator_action _fs_move_entries(void* ctx, fs_entry_t* entry, size_t* to_skip) {
+  struct fs_move_ctx* move_ctx = (struct fs_move_ctx *) ctx;
+
+  if (entry->magic == FS_MAGIC_FREE) {
+    return FS_ITER_SKIP_PAGE;
+  }
+
+  fs_action_t action;
+
+  switch(_fs_log_state(move_ctx->page, entry)) {
+  case FS_LOG_HEADER:
+    return FS_ITER_NEXT;
+  case FS_LOG_GARBAGE:
+    move_ctx->drop |= move_ctx->compact;
+    return FS_ITER_NEXT;
+  case FS_LOG_TOMBSTONE:
+    action = FS_ACCEPT;
+    break;
+  default:
+    action = (move_ctx->stop || !move_ctx->predicate) ? FS_ACCEPT : move_ctx->predicate(move_ctx->ctx, entry);
+    break;
+  }
+
+  if (action != FS_ACCEPT) {
+    move_ctx->drop = 1;
+    move_ctx->stop |= action == FS_STOP;
+    return FS_ITER_NEXT;
+  }
+
+  size_t len = entry->len + 4;
+
+  if (move_ctx->dest) {
+    if (move_ctx->abortable && g_fs_abort) {
+      move_ctx->err = ERR_CANCEL;
+      return FS_ITER_END;
+    }
+
+    if (_fs_program((uint8_t*) entry, &move_ctx->dest[move_ctx->off], len) != HAL_SUCCESS) {
+      move_ctx->err = ERR_HW;
+      return FS_ITER_END;
+    }
+  }
+
+  move_ctx->off += len;
+  return FS_ITER_NEXT;
+}
+
+static enum fs_iterator_action _fs_collect_entries(void* ctx, fs_entry_t* entry, size_t* to_skip) {
+  struct fs_collect_ctx* collect_ctx = (struct fs_collect_ctx *) ctx;
+
+  if (entry->magic == FS_MAGIC_FREE) {
+    return FS_ITER_SKIP_PAGE;
+  }
+
+  if (_fs_log_state(-1, entry) != FS_LOG_LIVE) {
+    return FS_ITER_NEXT;
+  }
+
+  fs_action_t action = collect_ctx->predicate(collect_ctx->ctx, entry);
+
+  if (action == FS_ACCEPT) {
+    return FS_ITER_NEXT;
+  } else if (collect_ctx->count == FS_LOG_ERASE_BATCH) {
+    collect_ctx->overflow = 1;
+    return FS_ITER_END;
+  }
+
+  collect_ctx->entries[collect_ctx->count++] = entry;
+
+  if (action == FS_STOP) {
+    collect_ctx->stop = 1;
+    return FS_ITER_END;
+  }
+
+  return FS_ITER_NEXT;
+}
+
 static enum fs_iterator_action _fs_iterate_page(uint8_t* p, fs_iterator_cb_t cb, void *ctx) {
   size_t off = 0;
 
@@ -236,49 +713,702 @@ static void _fs_iterate(fs_iterator_cb_t cb, void *ctx) {
   }
 }
 
-fs_entry_t* fs_find(fs_predicate_t predicate, void* ctx) {
-  struct fs_find_ctx finder_ctx = { .predicate = predicate, .ctx = ctx, .found = NULL };
-  _fs_iterate(_fs_get_entry, &finder_ctx);
-  return finder_ctx.found;
-}
+static enum fs_iterator_action _fs_log_usage(void* ctx, fs_entry_t* entry, size_t* to_skip) {
+  struct fs_usage_ctx* usage_ctx = (struct fs_usage_ctx *) ctx;
 
-app_err_t fs_write(fs_entry_t* first_entry, size_t total_length) {
-  if (hal_flash_begin_program() != HAL_SUCCESS) {
-    return ERR_HW;
+  if (entry->magic == FS_MAGIC_FREE) {
+    return FS_ITER_SKIP_PAGE;
   }
 
-  struct fs_write_ctx write_ctx = { .total_length = total_length, .last_write = NULL, .next_entry = first_entry, .err = ERR_OK };
-  _fs_iterate(_fs_write_entries, &write_ctx);
+  if (_fs_log_state(usage_ctx->page, entry) == FS_LOG_GARBAGE) {
+    usage_ctx->garbage += entry->len + 4;
+  }
 
-  hal_flash_end_program();
+  return FS_ITER_NEXT;
+}
 
-  return write_ctx.total_length ? ERR_FULL : write_ctx.err;
+static size_t _fs_log_garbage(uint32_t page) {
+  struct fs_usage_ctx usage_ctx = { .page = page, .garbage = 0 };
+  _fs_iterate_page(_fs_get_page(page), _fs_log_usage, &usage_ctx);
+  return usage_ctx.garbage;
 }
 
-app_err_t fs_erase(fs_entry_t* entry) {
-  if (hal_flash_begin_program() != HAL_SUCCESS) {
-    return ERR_HW;
-  }
+static inline size_t _fs_log_compact_min() {
+  return g_fs_log.dead_count > (FS_LOG_MAX_DEAD / 2) ? 1 : FS_LOG_COMPACT_MIN;
+}
 
-  struct fs_erase_ctx erase_ctx = { .block = 0, .data = g_flash_swap, .predicate = _fs_erase_one, .ctx = entry, .err = ERR_DATA, .stop = 0, .pending_erase = 0 };
-  _fs_iterate_page((uint8_t*) HAL_FLASH_BLOCK_ADDR(HAL_FLASH_ADDR_TO_BLOCK((uint32_t)entry)), _fs_erase_entries, &erase_ctx);
-  _fs_commit_block(&erase_ctx);
+// The page whose rewrite frees the most, among those with enough garbage. Pages the log head is about to reach
+// qualify with any garbage, so that writes find their space there without waiting for a rewrite. The head page
+// itself is left to fill, which would otherwise be rewritten after each deletion
+static int _fs_log_candidate(size_t min_garbage) {
+  int best = -1;
+  size_t best_garbage = 0;
 
-  hal_flash_end_program();
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    if (!FS_PAGE_BIT(g_fs_log.dirty, i)) {
+      continue;
+    }
 
-  return erase_ctx.err;
-}
+    size_t garbage = _fs_log_garbage(i);
 
-app_err_t fs_erase_all(fs_predicate_t predicate, void* ctx) {
-  if (hal_flash_begin_program() != HAL_SUCCESS) {
-    return ERR_HW;
-  }
+    if (!garbage) {
+      FS_PAGE_CLEAR(g_fs_log.dirty, i);
+      continue;
+    }
 
-  struct fs_erase_ctx erase_ctx = { .block = 0, .data = g_flash_swap, .predicate = predicate, .ctx = ctx, .err = ERR_DATA, .stop = 0, .pending_erase = 0 };
-  _fs_iterate(_fs_erase_entries, &erase_ctx);
+    int ahead = ((i - g_fs_log.head) + HAL_FLASH_DATA_BLOCK_COUNT) % HAL_FLASH_DATA_BLOCK_COUNT;
+
+    if ((garbage < min_garbage) && ((g_fs_log.mode != FS_MODE_LOG) || (ahead == 0) || (ahead > FS_LOG_ERASE_AHEAD))) {
+      continue;
+    }
+
+    if (garbage > best_garbage) {
+      best = i;
+      best_garbage = garbage;
+    }
+  }
+
+  return best;
+}
+
+static int _fs_key_desc(uint16_t magic) {
+  for (int i = 0; i < FS_KEY_COUNT; i++) {
+    if (FS_KEYS[i].magic == magic) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// 32-bit FNV-1a, the magic is not hashed since each magic has its own records
+static uint32_t _fs_key_hash(const uint8_t* key, size_t len) {
+  uint32_t hash = 0x811c9dc5;
+
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ key[i]) * 0x01000193;
+  }
+
+  return hash;
+}
+
+static int _fs_index_cmp(const void* a, const void* b) {
+  const fs_index_rec_t* ra = (const fs_index_rec_t*) a;
+  const fs_index_rec_t* rb = (const fs_index_rec_t*) b;
+
+  if (ra->hash != rb->hash) {
+    return (ra->hash > rb->hash) - (ra->hash < rb->hash);
+  }
+
+  return (ra->loc > rb->loc) - (ra->loc < rb->loc);
+}
+
+static void _fs_index_entry(uint32_t loc, fs_entry_t* entry) {
+  int k = _fs_key_desc(entry->magic);
+
+  if ((k < 0) || (entry->len < FS_KEYS[k].key_len)) {
+    return;
+  }
+
+  if (g_fs_index.count[k] == (g_fs_index.base[k + 1] - g_fs_index.base[k])) {
+    g_fs_index.overflow |= (1 << k);
+    return;
+  }
+
+  fs_index_rec_t* rec = &g_fs_index.recs[g_fs_index.base[k] + g_fs_index.count[k]++];
+  rec->hash = _fs_key_hash(FS_ENTRY_DATA(const uint8_t*, entry), FS_KEYS[k].key_len);
+  rec->loc = loc;
+}
+
+static enum fs_iterator_action _fs_index_entries(void* ctx, fs_entry_t* entry, size_t* to_skip) {
+  struct fs_index_ctx* index_ctx = (struct fs_index_ctx *) ctx;
+  uint32_t off = ((uint8_t*) entry) - index_ctx->addr;
+
+  if (entry->magic == FS_MAGIC_FREE) {
+    g_fs_index.free[index_ctx->page] = off;
+    return FS_ITER_SKIP_PAGE;
+  }
+
+  if (index_ctx->collect && (entry->magic == FS_TOMBSTONE_MAGIC)) {
+    _fs_log_collect(index_ctx->page, (const struct fs_tombstone*) entry);
+  }
+
+  // erased entries keep their records until the page is rewritten, lookups skip them
+  _fs_index_entry(FS_LOC(index_ctx->page, off), entry);
+  return FS_ITER_NEXT;
+}
+
+static void _fs_index_scan_page(uint32_t page, uint8_t collect) {
+  struct fs_index_ctx index_ctx = { .page = page, .addr = _fs_get_page(page), .collect = collect };
+  g_fs_index.free[page] = HAL_FLASH_BLOCK_SIZE;
+  _fs_iterate_page(index_ctx.addr, _fs_index_entries, &index_ctx);
+}
+
+static inline void _fs_index_sort() {
+  for (int k = 0; k < FS_KEY_COUNT; k++) {
+    qsort(&g_fs_index.recs[g_fs_index.base[k]], g_fs_index.count[k], sizeof(fs_index_rec_t), _fs_index_cmp);
+  }
+}
+
+// Drops the records of the pages set in the bitmap, their pages must be scanned again afterwards
+static void _fs_index_drop(const uint32_t* pages) {
+  for (int k = 0; k < FS_KEY_COUNT; k++) {
+    fs_index_rec_t* recs = &g_fs_index.recs[g_fs_index.base[k]];
+    int count = 0;
+
+    for (int i = 0; i < g_fs_index.count[k]; i++) {
+      if (!FS_PAGE_BIT(pages, FS_LOC_PAGE(recs[i].loc))) {
+        recs[count++] = recs[i];
+      }
+    }
+
+    g_fs_index.count[k] = count;
+  }
+}
+
+// When collecting, the tombstones found are added to the dead set, which needs the headers of all pages read first
+static void _fs_index_build(uint8_t collect) {
+  uint32_t base = 0;
+
+  for (int k = 0; k < FS_KEY_COUNT; k++) {
+    g_fs_index.base[k] = base;
+    base = APP_MIN(base + FS_KEYS[k].max_keys, FS_INDEX_MAX_KEYS);
+    g_fs_index.count[k] = 0;
+  }
+
+  g_fs_index.base[FS_KEY_COUNT] = base;
+  g_fs_index.overflow = 0;
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    _fs_index_scan_page(i, collect);
+  }
+
+  _fs_index_sort();
+  g_fs_index.ready = 1;
+}
+
+// Replaces the records of a page which has been written or rewritten. The index must be sorted again afterwards
+static void _fs_index_page(uint32_t page) {
+  uint32_t pages[(HAL_FLASH_DATA_BLOCK_COUNT + 31) / 32] = { 0 };
+  FS_PAGE_SET(pages, page);
+  _fs_index_drop(pages);
+  _fs_index_scan_page(page, 0);
+}
+
+// Replaces the records of all pages whose block is set in the given bitmap, then sorts the index
+static void _fs_index_rewritten(const uint32_t* blocks) {
+  uint32_t pages[(HAL_FLASH_DATA_BLOCK_COUNT + 31) / 32] = { 0 };
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    int block = HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) _fs_get_page(i));
+
+    if (blocks[block / 32] & (1U << (block % 32))) {
+      FS_PAGE_SET(pages, i);
+    }
+  }
+
+  _fs_index_drop(pages);
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    if (FS_PAGE_BIT(pages, i)) {
+      _fs_index_scan_page(i, 0);
+    }
+  }
+
+  _fs_index_sort();
+}
+
+static inline void _fs_index_ready() {
+  if (!g_fs_index.ready) {
+    _fs_index_build(0);
+  }
+}
+
+// Writes entries from the given page on, wrapping around, and leaves in next_entry and total_length those which did
+// not fit. In the log mode blank pages get a header first, unless the entry only fits without it
+static app_err_t _fs_write(uint32_t first_page, uint8_t** next_entry, size_t* total_length, int* last_page) {
+  if (hal_flash_begin_program() != HAL_SUCCESS) {
+    return ERR_HW;
+  }
+
+  app_err_t err = ERR_OK;
+
+  for (int n = 0; (n < HAL_FLASH_DATA_BLOCK_COUNT) && *total_length; n++) {
+    int i = (first_page + n) % HAL_FLASH_DATA_BLOCK_COUNT;
+
+    if (i == g_fs_log.spare) {
+      if ((g_fs_log.mode == FS_MODE_LOG) || g_fs_log.spare_dirty) {
+        continue;
+      }
+
+      g_fs_log.spare = -1;
+    }
+
+    uint8_t* page = _fs_get_page(i);
+    size_t off = g_fs_index.free[i];
+    size_t start = off;
+
+    while (*total_length) {
+      size_t total_entry_len = ((fs_entry_t*) *next_entry)->len + 4;
+
+      if ((off == 0) && (g_fs_log.mode == FS_MODE_LOG) && (total_entry_len <= FS_PAGE_DATA_SIZE)) {
+        struct fs_page_header header;
+        _fs_page_header_init(&header, g_fs_log.erases[i]);
+
+        if (_fs_program((uint8_t*) &header, page, FS_PAGE_HEADER_LEN) != HAL_SUCCESS) {
+          err = ERR_HW;
+        }
+
+        off = FS_PAGE_HEADER_LEN;
+      }
+
+      if ((HAL_FLASH_BLOCK_SIZE - off) < total_entry_len) {
+        break;
+      }
+
+      if (_fs_program(*next_entry, &page[off], total_entry_len) != HAL_SUCCESS) {
+        err = ERR_HW;
+      }
+
+      off += total_entry_len;
+      *next_entry += total_entry_len;
+      *total_length -= total_entry_len;
+    }
+
+    if (off == start) {
+      continue;
+    }
+
+    if ((off < HAL_FLASH_BLOCK_SIZE) && (_fs_pad(&page[off]) != HAL_SUCCESS)) {
+      err = ERR_HW;
+    }
+
+    if (start == 0) {
+      _fs_log_page_header(i);
+    }
+
+    _fs_index_page(i);
+
+    if (last_page) {
+      *last_page = i;
+    }
+
+    if (g_fs_log.mode == FS_MODE_LOG) {
+      g_fs_log.head = i;
+    }
+  }
+
+  _fs_index_sort();
+  hal_flash_end_program();
+
+  return err;
+}
+
+// A blank page for the rewrites of the log mode, taken from the end of the data area. One left partially written by
+// an abandoned copy is erased first
+static int _fs_log_spare() {
+  if ((g_fs_log.spare >= 0) && g_fs_log.spare_dirty) {
+    uint32_t block = HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) _fs_get_page(g_fs_log.spare));
+
+    if ((hal_flash_begin_program() != HAL_SUCCESS) || (_fs_erase_block(block) != HAL_SUCCESS)) {
+      hal_flash_end_program();
+      return -1;
+    }
+
+    hal_flash_end_program();
+    g_fs_log.erases[g_fs_log.spare]++;
+    g_fs_log.spare_dirty = 0;
+  }
+
+  for (int i = HAL_FLASH_DATA_BLOCK_COUNT - 1; (g_fs_log.spare < 0) && (i >= 0); i--) {
+    if (g_fs_index.free[i] == 0) {
+      g_fs_log.spare = i;
+    }
+  }
+
+  return g_fs_log.spare;
+}
+
+// Rewrites a page through g_flash_swap, erasing it before programming the kept entries back
+static app_err_t _fs_rewrite_in_place(uint32_t page, struct fs_move_ctx* move_ctx) {
+  if (hal_flash_begin_program() != HAL_SUCCESS) {
+    return ERR_HW;
+  }
+
+  struct fs_erase_ctx erase_ctx = { .block = UINT32_MAX, .data = g_flash_swap, .predicate = move_ctx->stop ? NULL : move_ctx->predicate, .ctx = move_ctx->ctx, .err = ERR_OK, .stop = 0, .pending_erase = 0, .compact = move_ctx->compact };
+  _fs_iterate_page(_fs_get_page(page), _fs_erase_entries, &erase_ctx);
   _fs_commit_block(&erase_ctx);
 
   hal_flash_end_program();
 
+  _fs_index_page(page);
+  _fs_index_sort();
+
+  move_ctx->stop |= erase_ctx.stop;
   return erase_ctx.err;
 }
+
+// Rewrites a page without its garbage when compacting and without the entries the predicate drops. In the log mode
+// the kept entries are copied to the spare, whose header is programmed last and names this page, then this page is
+// erased and becomes the spare. Until the header is programmed the copy is a blank page to the scan and after it the
+// boot completes the copy, so that power can be lost at any point. Pages without header or whose entries would not
+// fit after one are rewritten in place, unless only copies are allowed
+static app_err_t _fs_rewrite_page(uint32_t page, struct fs_move_ctx* move_ctx) {
+  uint8_t* src = _fs_get_page(page);
+  uint8_t stop = move_ctx->stop;
+
+  move_ctx->page = page;
+  move_ctx->dest = NULL;
+  move_ctx->off = FS_PAGE_HEADER_LEN;
+  move_ctx->drop = 0;
+  move_ctx->err = ERR_OK;
+  _fs_iterate_page(src, _fs_move_entries, move_ctx);
+
+  if (!move_ctx->drop) {
+    return ERR_OK;
+  }
+
+  int spare = g_fs_log.mode == FS_MODE_LOG ? _fs_log_spare() : -1;
+  move_ctx->stop = stop;
+
+  if ((spare < 0) || !FS_PAGE_BIT(g_fs_log.headers, page) || (move_ctx->off > HAL_FLASH_BLOCK_SIZE)) {
+    return move_ctx->copy_only ? ERR_FULL : _fs_rewrite_in_place(page, move_ctx);
+  }
+
+  if (hal_flash_begin_program() != HAL_SUCCESS) {
+    return ERR_HW;
+  }
+
+  uint8_t* dest = _fs_get_page(spare);
+  move_ctx->dest = dest;
+  move_ctx->off = FS_PAGE_HEADER_LEN;
+  _fs_iterate_page(src, _fs_move_entries, move_ctx);
+
+  bool copied = move_ctx->off > FS_PAGE_HEADER_LEN;
+
+  if (copied && (move_ctx->err == ERR_OK)) {
+    struct fs_page_header header;
+    _fs_page_header_init(&header, g_fs_log.erases[spare]);
+    header.source = page;
+    header.source_erases = g_fs_log.erases[page];
+
+    if ((_fs_pad(&dest[move_ctx->off]) != HAL_SUCCESS) || (_fs_program((uint8_t*) &header, dest, FS_PAGE_HEADER_LEN) != HAL_SUCCESS)) {
+      move_ctx->err = ERR_HW;
+    }
+  }
+
+  if (move_ctx->err != ERR_OK) {
+    g_fs_log.spare_dirty = copied;
+    hal_flash_end_program();
+    return move_ctx->err;
+  }
+
+  if (_fs_erase_block(HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) src)) != HAL_SUCCESS) {
+    move_ctx->err = ERR_HW;
+  }
+
+  hal_flash_end_program();
+
+  g_fs_log.erases[page]++;
+  _fs_log_page_erased(page);
+
+  if (copied) {
+    _fs_log_page_header(spare);
+    _fs_log_page_moved(page, spare);
+
+    if (g_fs_log.head == page) {
+      g_fs_log.head = spare;
+    }
+
+    g_fs_log.spare = page;
+    _fs_index_page(spare);
+  }
+
+  _fs_index_page(page);
+  _fs_index_sort();
+
+  return move_ctx->err;
+}
+
+static inline app_err_t _fs_compact_page(uint32_t page, uint8_t abortable, uint8_t copy_only) {
+  struct fs_move_ctx move_ctx = { .predicate = NULL, .ctx = NULL, .stop = 0, .compact = 1, .abortable = abortable, .copy_only = copy_only };
+  return _fs_rewrite_page(page, &move_ctx);
+}
+
+// Appends a tombstone for each entry. Nothing is written when not in the log mode, when an entry is on a page without
+// header or when the dead set has no room for all of them, the caller then rewrites the pages instead
+static app_err_t _fs_log_erase(fs_entry_t** entries, int count) {
+  if ((g_fs_log.mode != FS_MODE_LOG) || ((g_fs_log.dead_count + count) > FS_LOG_MAX_DEAD)) {
+    return ERR_FULL;
+  }
+
+  for (int i = 0; i < count; i++) {
+    int page = _fs_page_index((uintptr_t) entries[i]);
+
+    if ((page < 0) || !FS_PAGE_BIT(g_fs_log.headers, page)) {
+      return ERR_DATA;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    int page = _fs_page_index((uintptr_t) entries[i]);
+    struct fs_tombstone tombstone = {
+      ._entry = { .magic = FS_TOMBSTONE_MAGIC, .len = sizeof(struct fs_tombstone) - sizeof(fs_entry_t) },
+      .page = page,
+      .off = _fs_page_off(entries[i]),
+      .erases = g_fs_log.erases[page]
+    };
+
+    uint8_t* next_entry = (uint8_t*) &tombstone;
+    size_t len = sizeof(tombstone);
+    int tombstone_page;
+
+    app_err_t err = _fs_write(g_fs_log.head, &next_entry, &len, &tombstone_page);
+
+    if (err != ERR_OK) {
+      return err;
+    } else if (len) {
+      return ERR_FULL;
+    }
+
+    _fs_log_add_dead(FS_LOC(page, tombstone.off), tombstone_page);
+  }
+
+  return ERR_OK;
+}
+
+static app_err_t _fs_erase_in_place(fs_entry_t* entry) {
+  int page = _fs_page_index((uintptr_t) entry);
+
+  if (page < 0) {
+    return ERR_DATA;
+  }
+
+  struct fs_move_ctx move_ctx = { .predicate = _fs_erase_one, .ctx = entry, .stop = 0, .compact = 0, .abortable = 0, .copy_only = 0 };
+  app_err_t err = _fs_rewrite_page(page, &move_ctx);
+
+  return ((err == ERR_OK) && !move_ctx.stop) ? ERR_DATA : err;
+}
+
+// In the log mode the pages are rewritten one at a time, each through the spare
+static app_err_t _fs_erase_all_in_place(fs_predicate_t predicate, void* ctx) {
+  if (g_fs_log.mode == FS_MODE_LOG) {
+    struct fs_move_ctx move_ctx = { .predicate = predicate, .ctx = ctx, .stop = 0, .compact = 0, .abortable = 0, .copy_only = 0 };
+
+    for (int i = 0; (i < HAL_FLASH_DATA_BLOCK_COUNT) && !move_ctx.stop; i++) {
+      app_err_t err = _fs_rewrite_page(i, &move_ctx);
+
+      if (err != ERR_OK) {
+        return err;
+      }
+    }
+
+    return move_ctx.stop ? ERR_OK : ERR_DATA;
+  }
+
+  if (hal_flash_begin_program() != HAL_SUCCESS) {
+    return ERR_HW;
+  }
+
+  struct fs_erase_ctx erase_ctx = { .block = UINT32_MAX, .data = g_flash_swap, .predicate = predicate, .ctx = ctx, .err = ERR_DATA, .stop = 0, .pending_erase = 0, .compact = 0 };
+  _fs_iterate(_fs_erase_entries, &erase_ctx);
+  _fs_commit_block(&erase_ctx);
+
+  hal_flash_end_program();
+
+  // only the rewritten pages change, unless keys did not fit before and rebuilding gives them another chance
+  if (g_fs_index.overflow) {
+    _fs_index_build(0);
+  } else {
+    _fs_index_rewritten(erase_ctx.rewritten);
+  }
+
+  return erase_ctx.err;
+}
+
+void fs_init() {
+  g_fs_generation++;
+  _fs_log_build();
+  _fs_log_recover();
+  _fs_index_build(1);
+  _fs_log_spare();
+}
+
+void fs_set_mode(fs_mode_t mode) {
+  g_fs_log.mode = mode;
+
+  if (mode == FS_MODE_LOG) {
+    _fs_index_ready();
+    _fs_log_spare();
+  }
+}
+
+fs_entry_t* fs_find(fs_predicate_t predicate, void* ctx) {
+  struct fs_find_ctx finder_ctx = { .predicate = predicate, .ctx = ctx, .found = NULL };
+  _fs_iterate(_fs_get_entry, &finder_ctx);
+  return finder_ctx.found;
+}
+
+fs_entry_t* fs_find_key(uint16_t magic, const void* key, fs_predicate_t predicate, void* ctx) {
+  _fs_index_ready();
+
+  int k = _fs_key_desc(magic);
+
+  if ((k < 0) || (g_fs_index.overflow & (1 << k))) {
+    return fs_find(predicate, ctx);
+  }
+
+  const fs_index_rec_t* recs = &g_fs_index.recs[g_fs_index.base[k]];
+  uint32_t hash = _fs_key_hash(key, FS_KEYS[k].key_len);
+  int lo = 0;
+  int hi = g_fs_index.count[k];
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+
+    if (recs[mid].hash < hash) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  while ((lo < g_fs_index.count[k]) && (recs[lo].hash == hash)) {
+    uint32_t loc = recs[lo++].loc;
+
+    if (_fs_log_is_dead(loc)) {
+      continue;
+    }
+
+    fs_entry_t* entry = (fs_entry_t*) (_fs_get_page(FS_LOC_PAGE(loc)) + FS_LOC_OFF(loc));
+
+    switch(predicate(ctx, entry)) {
+    case FS_REJECT:
+      break;
+    case FS_ACCEPT:
+      return entry;
+    case FS_STOP:
+      return NULL;
+    }
+  }
+
+  return NULL;
+}
+
+app_err_t fs_write(fs_entry_t* first_entry, size_t total_length) {
+  uint32_t start = hal_get_ms();
+  _fs_index_ready();
+  g_fs_generation++;
+
+  g_fs_stats.requested += total_length;
+  uint8_t* next_entry = (uint8_t*) first_entry;
+  app_err_t err = _fs_write((g_fs_log.mode == FS_MODE_LOG ? g_fs_log.head : 0), &next_entry, &total_length, NULL);
+
+  // the log reclaims its garbage when full. Pages which cannot be copied to the spare are rewritten through
+  // g_flash_swap, so not when writing from it
+  while (total_length && (err == ERR_OK) && (g_fs_log.mode == FS_MODE_LOG)) {
+    int page = _fs_log_candidate(1);
+
+    if (page < 0) {
+      break;
+    }
+
+    if ((err = _fs_compact_page(page, 0, _fs_in_swap(next_entry))) == ERR_OK) {
+      err = _fs_write(page, &next_entry, &total_length, NULL);
+    }
+  }
+
+  fs_add_blocked_time(hal_get_ms() - start);
+
+  return total_length ? ERR_FULL : err;
+}
+
+app_err_t fs_erase(fs_entry_t* entry) {
+  uint32_t start = hal_get_ms();
+  _fs_index_ready();
+  g_fs_generation++;
+
+  app_err_t err = _fs_log_erase(&entry, 1);
+
+  if (err != ERR_OK) {
+    err = _fs_erase_in_place(entry);
+  }
+
+  fs_add_blocked_time(hal_get_ms() - start);
+
+  return err;
+}
+
+// In the log mode the entries to erase are collected first and, if few, get tombstones. Otherwise the predicate is
+// called again on the entries while rewriting the pages
+app_err_t fs_erase_all(fs_predicate_t predicate, void* ctx) {
+  uint32_t start = hal_get_ms();
+  _fs_index_ready();
+  g_fs_generation++;
+
+  if (g_fs_log.mode == FS_MODE_LOG) {
+    struct fs_collect_ctx collect_ctx = { .predicate = predicate, .ctx = ctx, .count = 0, .overflow = 0, .stop = 0 };
+    _fs_iterate(_fs_collect_entries, &collect_ctx);
+
+    if (!collect_ctx.overflow && (!collect_ctx.count || (_fs_log_erase(collect_ctx.entries, collect_ctx.count) == ERR_OK))) {
+      fs_add_blocked_time(hal_get_ms() - start);
+      return collect_ctx.stop ? ERR_OK : ERR_DATA;
+    }
+  }
+
+  app_err_t err = _fs_erase_all_in_place(predicate, ctx);
+  fs_add_blocked_time(hal_get_ms() - start);
+
+  return err;
+}
+
+app_err_t fs_compact_step() {
+  if (g_fs_abort) {
+    return ERR_CANCEL;
+  }
+
+  _fs_index_ready();
+
+  int page = _fs_log_candidate(_fs_log_compact_min());
+
+  if (page < 0) {
+    return ERR_DATA;
+  }
+
+  g_fs_generation++;
+  g_fs_compacting = 1;
+  app_err_t err = _fs_compact_page(page, 1, 1);
+  g_fs_compacting = 0;
+
+  return err;
+}
+
+bool fs_compact_abort() {
+  if (!g_fs_compacting) {
+    return false;
+  }
+
+  g_fs_abort = 1;
+  return true;
+}
+
+void fs_compact_resume() {
+  g_fs_abort = 0;
+}
+
+void fs_get_stats(fs_stats_t* stats) {
+  stats->requested = g_fs_stats.requested;
+  stats->programmed = g_fs_stats.programmed;
+  stats->erased = g_fs_stats.erased;
+  stats->blocked_ms = g_fs_stats.blocked_ms;
+  stats->tombstones = g_fs_log.dead_count;
+  memcpy(stats->page_erases, g_fs_log.erases, sizeof(stats->page_erases));
+}
+
+uint32_t fs_generation() {
+  return g_fs_generation;
+}
+
+void fs_add_blocked_time(uint32_t ms) {
+  g_fs_stats.blocked_ms += ms;
+}
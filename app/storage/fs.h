@@ -4,8 +4,28 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "error.h"
+#include "hal.h"
 
-#define FS_ENTRY_DATA(__TYPE__, __ENTRY__) (__TYPE__)(((uint32_t) __ENTRY__) + sizeof(fs_entry_t))
+#define FS_ENTRY_DATA(__TYPE__, __ENTRY__) (__TYPE__)(((uintptr_t) __ENTRY__) + sizeof(fs_entry_t))
+
+#define FS_CHAIN_MAGIC 0x4348
+#define FS_ERC20_MAGIC 0x3020
+#define FS_ABI_MAGIC 0x4142
+#define FS_VERSION_MAGIC 0x4532
+#define FS_CHAIN_TABLE_MAGIC 0x4354
+#define FS_ERC20_TABLE_MAGIC 0x5454
+#define FS_ABI_TABLE_MAGIC 0x4154
+#define FS_PAIRING_MAGIC 0x5041
+#define FS_SETTINGS_MAGIC 0x5331
+#define FS_SCV2_WHITELIST_MAGIC 0x5343
+#define FS_STAGE_MAGIC 0x5354
+#define FS_FILTER_MAGIC 0x4642
+#define FS_PAGE_MAGIC 0x5047
+#define FS_TOMBSTONE_MAGIC 0x5442
+
+// Every page written by the log mode starts with a header, so this is the longest entry (header included)
+#define FS_PAGE_HEADER_LEN 16
+#define FS_PAGE_DATA_SIZE (HAL_FLASH_BLOCK_SIZE - FS_PAGE_HEADER_LEN)
 
 typedef struct __attribute__((packed)) {
   uint16_t magic;
@@ -18,11 +38,49 @@ typedef enum {
   FS_STOP
 } fs_action_t;
 
+// In the log mode deletions append tombstones instead of rewriting pages, written pages start with a header and
+// writes go on from the last written page. The garbage is reclaimed by fs_compact_step(), which moves the entries of
+// the page it rewrites to a spare page before erasing it, so it must only run while no entry pointer is held.
+// Predicates given to fs_erase_all() must not have side effects, since they can be called twice on the same entries.
+// Firmware before 1.4.0 does not know tombstones and would see erased entries again, the in-place mode keeps the
+// format it reads
+typedef enum {
+  FS_MODE_IN_PLACE,
+  FS_MODE_LOG
+} fs_mode_t;
+
+typedef struct {
+  uint32_t requested;
+  uint32_t programmed;
+  uint32_t erased;
+  uint32_t blocked_ms;
+  uint16_t tombstones;
+  uint32_t page_erases[HAL_FLASH_DATA_BLOCK_COUNT];
+} fs_stats_t;
+
 typedef fs_action_t (*fs_predicate_t)(void* ctx, fs_entry_t* entry);
 
+void fs_init();
+void fs_set_mode(fs_mode_t mode);
 fs_entry_t* fs_find(fs_predicate_t predicate, void* ctx);
+fs_entry_t* fs_find_key(uint16_t magic, const void* key, fs_predicate_t predicate, void* ctx);
 app_err_t fs_write(fs_entry_t* first_entry, size_t total_length);
 app_err_t fs_erase(fs_entry_t* entry);
 app_err_t fs_erase_all(fs_predicate_t predicate, void* ctx);
 
+app_err_t fs_compact_step();
+
+// Can be called from interrupts. Returns whether a fs_compact_step() is running, which then gives up before finishing
+// its copy, leaving the flash as it was. Later steps return ERR_CANCEL until fs_compact_resume() is called
+bool fs_compact_abort();
+void fs_compact_resume();
+
+// requested are the bytes given to fs_write, programmed all those written to flash, including moved entries,
+// tombstones, page headers and padding. page_erases are the counts kept in the page headers
+void fs_get_stats(fs_stats_t* stats);
+void fs_add_blocked_time(uint32_t ms);
+
+// Changes whenever entries are written, erased or moved, so that callers keeping entry pointers know to drop them
+uint32_t fs_generation();
+
 #endif
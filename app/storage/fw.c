@@ -0,0 +1,15 @@
+#include "fw.h"
+#include "common.h"
+
+void fw_hash_update(SHA256_CTX* sha2, const uint8_t* area, size_t off, size_t len) {
+  const size_t end = off + len;
+
+  if (off < HAL_FW_HEADER_OFFSET) {
+    sha256_Update(sha2, &area[off], (APP_MIN(end, HAL_FW_HEADER_OFFSET) - off));
+  }
+
+  if (end > (HAL_FW_HEADER_OFFSET + FW_SIG_LEN)) {
+    const size_t start = APP_MAX(off, (HAL_FW_HEADER_OFFSET + FW_SIG_LEN));
+    sha256_Update(sha2, &area[start], (end - start));
+  }
+}
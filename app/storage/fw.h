@@ -0,0 +1,16 @@
+#ifndef __FW__
+#define __FW__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hal.h"
+#include "crypto/sha2.h"
+
+#define FW_SIG_LEN 64
+#define FW_AREA_LEN (HAL_FLASH_FW_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)
+
+// Hashes a part of a firmware area as signed, that is without the signature found in the header. Hashing all parts in
+// order gives the digest the bootloader computes over the whole area
+void fw_hash_update(SHA256_CTX* sha2, const uint8_t* area, size_t off, size_t len);
+
+#endif
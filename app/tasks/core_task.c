@@ -106,7 +106,11 @@ void core_task_entry(void* pvParameters) {
   core_print_fingerprint(fingerprint);
 
   while(1) {
-    switch(ui_menu((g_core.keycard.name[0] ? g_core.keycard.name : fingerprint), &menu_mainmenu, &selected, -1, 1, UI_MENU_NOCANCEL, 0, 0)) {
+    g_core.idle = true;
+    core_evt_t evt = ui_menu((g_core.keycard.name[0] ? g_core.keycard.name : fingerprint), &menu_mainmenu, &selected, -1, 1, UI_MENU_NOCANCEL, 0, 0);
+    g_core.idle = false;
+
+    switch(evt) {
     case CORE_EVT_USB_CMD:
       core_usb_run();
       break;
@@ -626,14 +626,13 @@ void dialog_confirm_btc_summary(const btc_tx_ctx_t* tx) {
   bool has_sighash_none = false;
 
   for (int i = 0; i < tx->input_count; i++) {
-    uint64_t t;
-    memcpy(&t, tx->input_data[i].amount, sizeof(uint64_t));
+    uint64_t t = btc_amount(btc_input_utxo(tx, i));
     total_input += t;
-    if (tx->input_data[i].can_sign) {
+    if (tx->inputs[i].can_sign) {
       signed_amount += t;
     }
 
-    if ((tx->input_data[i].sighash_flag & SIGHASH_MASK) == SIGHASH_NONE) {
+    if ((tx->inputs[i].sighash_flag & SIGHASH_MASK) == SIGHASH_NONE) {
       has_sighash_none = true;
     }
   }
@@ -642,10 +641,9 @@ void dialog_confirm_btc_summary(const btc_tx_ctx_t* tx) {
   int dest_idx = -1;
 
   for (int i = 0; i < tx->output_count; i++) {
-    uint64_t t;
-    memcpy(&t, tx->outputs[i].amount, sizeof(uint64_t));
+    uint64_t t = btc_amount(btc_output_txout(tx, i));
     total_output += t;
-    if (tx->output_data[i].change) {
+    if (tx->outputs[i].change) {
       change += t;
     } else {
       if (dest_idx == -1) {
@@ -677,7 +675,9 @@ void dialog_confirm_btc_summary(const btc_tx_ctx_t* tx) {
 
     if (dest_idx >= 0) {
       dialog_label_2lines(&ctx, LSTR(TX_ADDRESS));
-      if (!script_output_to_address(tx->outputs[dest_idx].script, tx->outputs[dest_idx].script_len, buf)) {
+      const uint8_t* script;
+      size_t script_len = btc_txout_script(btc_output_txout(tx, dest_idx), &script);
+      if (!script_output_to_address(script, script_len, buf)) {
         strcpy(buf, LSTR(TX_UNKNOWN_ADDRESS));
       }
       dialog_data_2lines(&ctx, buf);
@@ -731,19 +731,20 @@ void dialog_confirm_btc_inouts(const btc_tx_ctx_t* tx, size_t page) {
     char* idx = (char *) u32toa(i, (uint8_t *) buf, BIGNUM_STRING_LEN);
     dialog_data(&ctx, idx);
 
-    uint64_t t;
-    memcpy(&t, tx->input_data[i].amount, sizeof(uint64_t));
-    dialog_btc_amount(&ctx, TX_AMOUNT, t);
+    const uint8_t* utxo = btc_input_utxo(tx, i);
+    dialog_btc_amount(&ctx, TX_AMOUNT, btc_amount(utxo));
 
     dialog_label(&ctx, LSTR(TX_SIGN_SCHEME));
-    dialog_btc_sign_scheme_format(buf, tx->input_data[i].sighash_flag);
+    dialog_btc_sign_scheme_format(buf, tx->inputs[i].sighash_flag);
     dialog_data(&ctx, buf);
 
     dialog_label(&ctx, LSTR(TX_SIGNED));
-    dialog_data(&ctx, tx->input_data[i].can_sign ? LSTR(TX_YES) : LSTR(TX_NO));
+    dialog_data(&ctx, tx->inputs[i].can_sign ? LSTR(TX_YES) : LSTR(TX_NO));
 
     dialog_label_2lines(&ctx, LSTR(TX_SPENDER));
-    if (!script_output_to_address(tx->input_data[i].script_pubkey, tx->input_data[i].script_pubkey_len, buf)) {
+    const uint8_t* script;
+    size_t script_len = btc_txout_script(utxo, &script);
+    if (!script_output_to_address(script, script_len, buf)) {
       strcpy(buf, LSTR(TX_UNKNOWN_ADDRESS));
     }
     dialog_data_2lines(&ctx, buf);
@@ -759,15 +760,16 @@ void dialog_confirm_btc_inouts(const btc_tx_ctx_t* tx, size_t page) {
     char* idx = (char *) u32toa(i, (uint8_t *) buf, BIGNUM_STRING_LEN);
     dialog_data(&ctx, idx);
 
-    uint64_t t;
-    memcpy(&t, tx->outputs[i].amount, sizeof(uint64_t));
-    dialog_btc_amount(&ctx, TX_AMOUNT, t);
+    const uint8_t* txout = btc_output_txout(tx, i);
+    dialog_btc_amount(&ctx, TX_AMOUNT, btc_amount(txout));
 
     dialog_label(&ctx, LSTR(TX_CHANGE));
-    dialog_data(&ctx, tx->output_data[i].change ? LSTR(TX_YES) : LSTR(TX_NO));
+    dialog_data(&ctx, tx->outputs[i].change ? LSTR(TX_YES) : LSTR(TX_NO));
 
     dialog_label_2lines(&ctx, LSTR(TX_ADDRESS));
-    if (!script_output_to_address(tx->outputs[i].script, tx->outputs[i].script_len, buf)) {
+    const uint8_t* script;
+    size_t script_len = btc_txout_script(txout, &script);
+    if (!script_output_to_address(script, script_len, buf)) {
       strcpy(buf, LSTR(TX_UNKNOWN_ADDRESS));
     }
     dialog_data_2lines(&ctx, buf);
@@ -786,7 +788,9 @@ app_err_t dialog_confirm_bip322(const btc_tx_ctx_t* tx) {
   char buf[BIGNUM_STRING_LEN];
 
   dialog_label_2lines(&ctx, LSTR(TX_ADDRESS));
-  if (!script_output_to_address(tx->input_data[0].script_pubkey, tx->input_data[0].script_pubkey_len, buf)) {
+  const uint8_t* script;
+  size_t script_len = btc_txout_script(btc_input_utxo(tx, 0), &script);
+  if (!script_output_to_address(script, script_len, buf)) {
     strcpy(buf, LSTR(TX_UNKNOWN_ADDRESS));
   }
   dialog_data_2lines(&ctx, buf);
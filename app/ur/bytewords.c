@@ -1,51 +1,73 @@
 #include "bytewords.h"
 #include "common.h"
 #include "crypto/crc32.h"
-#include <ctype.h>
 
+// Generated by tools/bytewords-lut.py
 const static uint8_t BW_DECODE_LUT[] = {
-    0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x02, 0x00,
-    0x00, 0x00, 0x09, 0x07, 0x00, 0x00, 0x00, 0x03, 0x08, 0x00, 0x0e, 0x14, 0x00, 0x0b, 0x10, 0x00,
-    0x12, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x0d, 0x00, 0x00,
-    0x13, 0x00, 0x11, 0x15, 0x1d, 0x00, 0x00, 0x00, 0x1c, 0x19, 0x00, 0x17, 0x00, 0x00, 0x1e, 0x21,
-    0x16, 0x23, 0x00, 0x22, 0x00, 0x00, 0x18, 0x1f, 0x00, 0x00, 0x1b, 0x20, 0x1a, 0x00, 0x25, 0x00,
-    0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x27, 0x00, 0x24, 0x2f, 0x2e, 0x2b, 0x00, 0x2d, 0x00, 0x2a,
-    0x26, 0x29, 0x00, 0x00, 0x2c, 0x00, 0x30, 0x00, 0x00, 0x00, 0x35, 0x00, 0x34, 0x00, 0x00, 0x31,
-    0x00, 0x00, 0x00, 0x00, 0x37, 0x36, 0x33, 0x00, 0x00, 0x00, 0x39, 0x38, 0x00, 0x00, 0x00, 0x00,
-    0x32, 0x00, 0x00, 0x00, 0x00, 0x48, 0x45, 0x00, 0x46, 0x3f, 0x00, 0x00, 0x00, 0x47, 0x3e, 0x3c,
-    0x00, 0x41, 0x00, 0x3b, 0x3d, 0x3a, 0x00, 0x00, 0x42, 0x43, 0x44, 0x40, 0x49, 0x00, 0x00, 0x50,
-    0x4a, 0x00, 0x00, 0x54, 0x00, 0x00, 0x00, 0x4e, 0x52, 0x00, 0x55, 0x00, 0x00, 0x4b, 0x4c, 0x4d,
-    0x53, 0x00, 0x4f, 0x00, 0x51, 0x00, 0x00, 0x00, 0x00, 0x58, 0x5f, 0x56, 0x57, 0x5c, 0x00, 0x00,
-    0x59, 0x5d, 0x00, 0x60, 0x00, 0x5b, 0x00, 0x00, 0x61, 0x5a, 0x00, 0x00, 0x00, 0x00, 0x5e, 0x00,
-    0x63, 0x00, 0x00, 0x62, 0x64, 0x00, 0x00, 0x65, 0x00, 0x00, 0x00, 0x00, 0x6a, 0x69, 0x67, 0x00,
-    0x00, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6b, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x73, 0x6f, 0x00, 0x6d, 0x70, 0x72, 0x00, 0x00, 0x71, 0x6e, 0x00, 0x00,
-    0x00, 0x00, 0x74, 0x6c, 0x00, 0x7e, 0x00, 0x00, 0x7c, 0x00, 0x7b, 0x00, 0x7d, 0x00, 0x79, 0x00,
-    0x00, 0x7a, 0x76, 0x75, 0x00, 0x00, 0x78, 0x77, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x7f,
-    0x00, 0x89, 0x8a, 0x82, 0x8d, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x86, 0x88, 0x85, 0x00, 0x84,
-    0x83, 0x87, 0x8b, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x95, 0x91, 0x00, 0x00, 0x90,
-    0x00, 0x00, 0x98, 0x00, 0x00, 0x8e, 0x92, 0x00, 0x00, 0x00, 0x97, 0x96, 0x93, 0x00, 0x94, 0x00,
-    0x8f, 0x00, 0x00, 0xa0, 0x00, 0x9b, 0x9f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x99, 0x00, 0x9e,
-    0x00, 0x00, 0x00, 0x00, 0x9c, 0x9d, 0x00, 0x00, 0x00, 0x00, 0x9a, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xa2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa6, 0x00, 0xa5, 0x00, 0x00, 0x00, 0x00, 0xa7, 0xa3,
-    0x00, 0x00, 0x00, 0xa4, 0xa1, 0x00, 0xb1, 0x00, 0x00, 0xa8, 0xaf, 0xb0, 0x00, 0x00, 0x00, 0x00,
-    0xaa, 0xae, 0xad, 0x00, 0x00, 0x00, 0x00, 0xb2, 0xac, 0xa9, 0x00, 0x00, 0x00, 0x00, 0xab, 0x00,
-    0x00, 0x00, 0x00, 0xb3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xb4, 0x00, 0x00, 0x00, 0xba, 0xb5, 0xbc,
-    0x00, 0xb9, 0x00, 0x00, 0xbb, 0xb7, 0x00, 0xbe, 0xb8, 0xb6, 0x00, 0x00, 0xbf, 0xc0, 0x00, 0x00,
-    0x00, 0x00, 0xbd, 0x00, 0xc2, 0xcb, 0x00, 0x00, 0xc1, 0xcc, 0xca, 0x00, 0x00, 0x00, 0xc5, 0x00,
-    0x00, 0xcd, 0xc9, 0xc8, 0x00, 0xc3, 0xc4, 0xc7, 0x00, 0x00, 0xc6, 0x00, 0x00, 0x00, 0xd9, 0xd6,
-    0x00, 0xd2, 0xd3, 0x00, 0x00, 0x00, 0xd0, 0x00, 0xcf, 0xd5, 0x00, 0xda, 0xce, 0xd8, 0x00, 0x00,
-    0xd7, 0xd1, 0x00, 0x00, 0x00, 0x00, 0xd4, 0x00, 0x00, 0x00, 0x00, 0x00, 0xde, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xdc, 0x00, 0x00, 0xdf, 0x00, 0xdd, 0x00, 0x00, 0x00, 0x00,
-    0xdb, 0x00, 0xe6, 0x00, 0x00, 0xe7, 0xe4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe3, 0x00, 0x00,
-    0xe2, 0x00, 0x00, 0x00, 0xe8, 0xe0, 0x00, 0x00, 0xe5, 0x00, 0xe1, 0x00, 0x00, 0x00, 0x00, 0xea,
-    0xed, 0xf3, 0x00, 0x00, 0x00, 0x00, 0xf4, 0xe9, 0xeb, 0xf1, 0x00, 0xec, 0x00, 0x00, 0xef, 0xf0,
-    0x00, 0x00, 0x00, 0x00, 0xee, 0xf2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf5, 0xf7, 0x00, 0xf6, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0xf9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfd, 0x00, 0xfe, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00, 0xfb, 0x00, 0x00, 0x00, 0xfa, 0xfc, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x02,
+    0x00, 0x00, 0x00, 0x09, 0x07, 0x00, 0x00, 0x00, 0x03, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0e, 0x14, 0x00, 0x0b, 0x10, 0x00, 0x12, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x0c, 0x00,
+    0x00, 0x00, 0x00, 0x0f, 0x0d, 0x00, 0x00, 0x13, 0x00, 0x11, 0x15, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x1d, 0x00, 0x00, 0x00, 0x1c, 0x19, 0x00, 0x17, 0x00, 0x00, 0x1e, 0x21, 0x16, 0x23, 0x00,
+    0x22, 0x00, 0x00, 0x18, 0x1f, 0x00, 0x00, 0x1b, 0x20, 0x1a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x25, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x27, 0x00, 0x24, 0x2f, 0x2e, 0x2b, 0x00,
+    0x2d, 0x00, 0x2a, 0x26, 0x29, 0x00, 0x00, 0x2c, 0x00, 0x30, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x35, 0x00, 0x34, 0x00, 0x00, 0x31, 0x00, 0x00, 0x00, 0x00, 0x37, 0x36, 0x33,
+    0x00, 0x00, 0x00, 0x39, 0x38, 0x00, 0x00, 0x00, 0x00, 0x32, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x48, 0x45, 0x00, 0x46, 0x3f, 0x00, 0x00, 0x00, 0x47, 0x3e, 0x3c, 0x00,
+    0x41, 0x00, 0x3b, 0x3d, 0x3a, 0x00, 0x00, 0x42, 0x43, 0x44, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x49, 0x00, 0x00, 0x50, 0x4a, 0x00, 0x00, 0x54, 0x00, 0x00, 0x00, 0x4e, 0x52, 0x00, 0x55,
+    0x00, 0x00, 0x4b, 0x4c, 0x4d, 0x53, 0x00, 0x4f, 0x00, 0x51, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x58, 0x5f, 0x56, 0x57, 0x5c, 0x00, 0x00, 0x59, 0x5d, 0x00, 0x60, 0x00,
+    0x5b, 0x00, 0x00, 0x61, 0x5a, 0x00, 0x00, 0x00, 0x00, 0x5e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x63, 0x00, 0x00, 0x62, 0x64, 0x00, 0x00, 0x65, 0x00, 0x00, 0x00, 0x00, 0x6a, 0x69, 0x67,
+    0x00, 0x00, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x6b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x73, 0x6f, 0x00, 0x6d, 0x70,
+    0x72, 0x00, 0x00, 0x71, 0x6e, 0x00, 0x00, 0x00, 0x00, 0x74, 0x6c, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x7e, 0x00, 0x00, 0x7c, 0x00, 0x7b, 0x00, 0x7d, 0x00, 0x79, 0x00, 0x00, 0x7a, 0x76,
+    0x75, 0x00, 0x00, 0x78, 0x77, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x80, 0x7f, 0x00, 0x89, 0x8a, 0x82, 0x8d, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x86, 0x88,
+    0x85, 0x00, 0x84, 0x83, 0x87, 0x8b, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x95, 0x91, 0x00, 0x00, 0x90, 0x00, 0x00, 0x98, 0x00, 0x00, 0x8e, 0x92,
+    0x00, 0x00, 0x00, 0x97, 0x96, 0x93, 0x00, 0x94, 0x00, 0x8f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0xa0, 0x00, 0x9b, 0x9f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x99, 0x00, 0x9e, 0x00,
+    0x00, 0x00, 0x00, 0x9c, 0x9d, 0x00, 0x00, 0x00, 0x00, 0x9a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xa2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa6, 0x00, 0xa5, 0x00,
+    0x00, 0x00, 0x00, 0xa7, 0xa3, 0x00, 0x00, 0x00, 0xa4, 0xa1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xb1, 0x00, 0x00, 0xa8, 0xaf, 0xb0, 0x00, 0x00, 0x00, 0x00, 0xaa, 0xae, 0xad, 0x00, 0x00,
+    0x00, 0x00, 0xb2, 0xac, 0xa9, 0x00, 0x00, 0x00, 0x00, 0xab, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xb3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xb4, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xba, 0xb5, 0xbc, 0x00, 0xb9, 0x00, 0x00, 0xbb, 0xb7, 0x00, 0xbe, 0xb8,
+    0xb6, 0x00, 0x00, 0xbf, 0xc0, 0x00, 0x00, 0x00, 0x00, 0xbd, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xc2, 0xcb, 0x00, 0x00, 0xc1, 0xcc, 0xca, 0x00, 0x00, 0x00, 0xc5, 0x00, 0x00, 0xcd, 0xc9,
+    0xc8, 0x00, 0xc3, 0xc4, 0xc7, 0x00, 0x00, 0xc6, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xd9, 0xd6, 0x00, 0xd2, 0xd3, 0x00, 0x00, 0x00, 0xd0, 0x00, 0xcf, 0xd5, 0x00, 0xda, 0xce,
+    0xd8, 0x00, 0x00, 0xd7, 0xd1, 0x00, 0x00, 0x00, 0x00, 0xd4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0xde, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xdc,
+    0x00, 0x00, 0xdf, 0x00, 0xdd, 0x00, 0x00, 0x00, 0x00, 0xdb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xe6, 0x00, 0x00, 0xe7, 0xe4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe3, 0x00, 0x00, 0xe2,
+    0x00, 0x00, 0x00, 0xe8, 0xe0, 0x00, 0x00, 0xe5, 0x00, 0xe1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xea, 0xed, 0xf3, 0x00, 0x00, 0x00, 0x00, 0xf4, 0xe9, 0xeb, 0xf1, 0x00,
+    0xec, 0x00, 0x00, 0xef, 0xf0, 0x00, 0x00, 0x00, 0x00, 0xee, 0xf2, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf5, 0xf7, 0x00, 0xf6, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0xf9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0xfd, 0x00, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00, 0xfb,
+    0x00, 0x00, 0x00, 0xfa, 0xfc, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 };
 
 const static uint16_t BW_ENCODE_LUT[] = {
@@ -83,42 +105,46 @@ const static uint16_t BW_ENCODE_LUT[] = {
     0x4159, 0x5459, 0x535a, 0x4f5a, 0x545a, 0x435a, 0x455a, 0x4d5a,
 };
 
+// Letters have the same low 5 bits in both cases, any other byte still lands in the table
 static inline uint16_t bytewords_decode_hash(uint8_t i, uint8_t j) {
-  i = toupper(i) - 'A';
-  j = toupper(j) - 'A';
-  return (i*26) + j;
+  return ((i & 0x1f) << 5) | (j & 0x1f);
 }
 
-
-size_t bytewords_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out) {
-  in_len /= 2;
-  size_t outlen = in_len - 4;
-
-  if (outlen > max_out) {
-    return 0;
-  }
-
-  crc32_ctx_t crc32;
-  crc32_init(&crc32);
-
-  while(in_len-- > 4) {
+void bytewords_decode_part(const uint8_t* in, uint8_t* out, size_t out_len, crc32_ctx_t* crc) {
+  while(out_len--) {
     *out = BW_DECODE_LUT[bytewords_decode_hash(in[0], in[1])];
-    crc32_update_one(&crc32, *(out++));
+    crc32_update_one(crc, *(out++));
     in += 2;
   }
+}
 
+bool bytewords_decode_check(const uint8_t* in, crc32_ctx_t* crc) {
   uint32_t checksum;
-  crc32_finish(&crc32, &checksum);
+  crc32_finish(crc, &checksum);
 
   uint32_t expectedChecksum;
   uint8_t* _chk = (uint8_t *)&expectedChecksum;
 
-  while(in_len-- < SIZE_MAX) {
+  for (int i = 0; i < 4; i++) {
     *(_chk++) = BW_DECODE_LUT[bytewords_decode_hash(in[0], in[1])];
     in += 2;
   }
 
-  return checksum == rev32(expectedChecksum) ? outlen : 0;
+  return checksum == rev32(expectedChecksum);
+}
+
+size_t bytewords_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out) {
+  size_t outlen = bytewords_decoded_len(in_len);
+
+  if (!outlen || (outlen > max_out)) {
+    return 0;
+  }
+
+  crc32_ctx_t crc32;
+  crc32_init(&crc32);
+  bytewords_decode_part(in, out, outlen, &crc32);
+
+  return bytewords_decode_check(&in[outlen * 2], &crc32) ? outlen : 0;
 }
 
 size_t bytewords_encode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out) {
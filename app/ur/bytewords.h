@@ -1,8 +1,21 @@
 #ifndef _BYTEWORDS_
 #define _BYTEWORDS_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include "crypto/crc32.h"
+
+// Minimal bytewords: two letters per byte, followed by the 4 bytes CRC32 of the data
+static inline size_t bytewords_decoded_len(size_t in_len) {
+  return in_len >= 10 ? ((in_len / 2) - 4) : 0;
+}
+
+// Incremental decoding, for callers placing the decoded data in more than one buffer. The
+// CRC32 context must be initialized before the first call and is checked against the 4
+// trailing bytes, starting at in, by bytewords_decode_check.
+void bytewords_decode_part(const uint8_t* in, uint8_t* out, size_t out_len, crc32_ctx_t* crc);
+bool bytewords_decode_check(const uint8_t* in, crc32_ctx_t* crc);
 
 size_t bytewords_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out);
 size_t bytewords_encode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out);
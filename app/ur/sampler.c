@@ -2,6 +2,8 @@
 #include "crypto/sha2.h"
 #include "common.h"
 
+#define SAMPLER_ONE 18446744073709551616.
+
 const double RANDOM_SAMPLER_PROBS[] = {
     1., 1./2., 1./3., 1./4., 1./5., 1./6., 1./7., 1./8.,
     1./9., 1./10., 1./11., 1./12., 1./13., 1./14., 1./15., 1./16.,
@@ -21,7 +23,89 @@ const double RANDOM_SAMPLER_PROBS[] = {
     1./121., 1./122., 1./123., 1./124., 1./125., 1./126., 1./127., 1./128.,
 };
 
-void random_sampler_init(int len, double* out_probs, int* out_aliases) {
+typedef struct {
+  uint32_t seq;
+  uint32_t crc;
+  uint8_t len;
+  ur_desc_t indexes;
+} fountain_cache_entry_t;
+
+static fountain_cache_entry_t g_fountain_cache[FOUNTAIN_CACHE_SIZE];
+
+/*
+ * The reference implementation draws doubles as (double) r / 2^64 and scales
+ * them by the table size. The same results are obtained here with integers
+ * only, so that no double arithmetic is needed per draw: the conversion of r
+ * and the product are both rounded to 53 significant bits, ties to even.
+ */
+static inline uint64_t sampler_round(uint64_t x, int* exp) {
+  int shift = 11 - __builtin_clzll(x | 1);
+
+  if (shift <= 0) {
+    *exp = 0;
+    return x;
+  }
+
+  uint64_t m = x >> shift;
+  uint64_t rem = x & ((1ULL << shift) - 1);
+  uint64_t half = 1ULL << (shift - 1);
+
+  if ((rem > half) || ((rem == half) && (m & 1))) {
+    m++;
+  }
+
+  *exp = shift;
+  return m;
+}
+
+// Equal to (int) (((double) r / 2^64) * n) for n <= UR_MAX_PART_COUNT. The few r rounding to 1.0
+// would give n, which is out of range in the reference too, and are kept in range instead.
+static inline int sampler_scale(uint64_t r, int n) {
+  int e1, e2;
+  uint64_t m = sampler_round(r, &e1);
+  m = sampler_round(m * n, &e2);
+  int shift = 64 - e1 - e2;
+  int i = shift < 64 ? (int) (m >> shift) : 0;
+  return i < n ? i : (n - 1);
+}
+
+// Smallest r such that (double) r / 2^64 >= p, so that r2 < p becomes an integer comparison
+static uint64_t sampler_threshold(double p) {
+  double target = p * SAMPLER_ONE;
+
+  if (target >= SAMPLER_ONE) {
+    // values in the last half ulp below 2^64 round up to 1.0
+    return UINT64_MAX - 1023;
+  }
+
+  uint64_t hi = (uint64_t) target;
+
+  if ((double) hi < target) {
+    hi++;
+  }
+
+  // only values within one ulp of the target can be rounded up to it
+  uint64_t lo = hi > 2048 ? hi - 2048 : 0;
+
+  while (lo < hi) {
+    uint64_t mid = lo + ((hi - lo) >> 1);
+
+    if ((double) mid >= target) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return hi;
+}
+
+void random_sampler_init(random_sampler_t* sampler, int len) {
+  if (sampler->len == len) {
+    return;
+  }
+
+  // the alias table is built exactly like the reference, only the draws are done in fixed point
   double sum = 0;
 
   for (int i = 0; i < len; i++) {
@@ -37,6 +121,7 @@ void random_sampler_init(int len, double* out_probs, int* out_aliases) {
 
   for (int i = 0; i < len; i++) {
     P[i] = (RANDOM_SAMPLER_PROBS[i] * (double)(len)) / sum;
+    sampler->aliases[i] = 0;
   }
 
   for (int i = (len - 1); i >= 0; i--) {
@@ -50,8 +135,8 @@ void random_sampler_init(int len, double* out_probs, int* out_aliases) {
   while(s_len && l_len) {
     int a = S[--s_len];
     int g = L[--l_len];
-    out_probs[a] = P[a];
-    out_aliases[a] = g;
+    sampler->thresholds[a] = sampler_threshold(P[a]);
+    sampler->aliases[a] = g;
     P[g] += P[a] - 1;
 
     if(P[g] < 1.0) {
@@ -62,22 +147,51 @@ void random_sampler_init(int len, double* out_probs, int* out_aliases) {
   }
 
   while(l_len--) {
-    out_probs[L[l_len]] = 1.0;
+    sampler->thresholds[L[l_len]] = sampler_threshold(1.0);
   }
 
   while(s_len--) {
-    out_probs[S[s_len]] = 1.0;
+    sampler->thresholds[S[s_len]] = sampler_threshold(1.0);
   }
+
+  sampler->len = len;
 }
 
-int random_sampler_next(xoshiro_ctx_t* rng_ctx, int len, double* probs, int* aliases) {
-  double r1 = xoshiro256_next_double(rng_ctx);
-  double r2 = xoshiro256_next_double(rng_ctx);
-  int i = (int) (r1 * ((double) len));
-  return r2 < probs[i] ? i : aliases[i];
+int random_sampler_next(xoshiro_ctx_t* rng_ctx, const random_sampler_t* sampler) {
+  uint64_t r1 = xoshiro256_next(rng_ctx);
+  uint64_t r2 = xoshiro256_next(rng_ctx);
+  int i = sampler_scale(r1, sampler->len);
+  return r2 < sampler->thresholds[i] ? i : sampler->aliases[i];
 }
 
-void fountain_part_indexes(uint32_t seq, uint32_t crc, int len, double* probs, int* aliases, ur_desc_t* out) {
+// Index of the n-th (from 0) clear bit, this is how the reference shuffle picks the next part
+static int fountain_nth_free(const ur_desc_t* x, int n) {
+  int w = 0;
+  uint32_t free = ~x->w[0];
+  int free_count = __builtin_popcount(free);
+
+  while (n >= free_count) {
+    n -= free_count;
+    free = ~x->w[++w];
+    free_count = __builtin_popcount(free);
+  }
+
+  while (n--) {
+    free &= free - 1;
+  }
+
+  return (w << 5) + __builtin_ctz(free);
+}
+
+void fountain_part_indexes(uint32_t seq, uint32_t crc, const random_sampler_t* sampler, ur_desc_t* out) {
+  int len = sampler->len;
+  fountain_cache_entry_t* entry = &g_fountain_cache[seq % FOUNTAIN_CACHE_SIZE];
+
+  if ((entry->seq == seq) && (entry->crc == crc) && (entry->len == len)) {
+    ur_desc_assign(out, &entry->indexes);
+    return;
+  }
+
   uint32_t tmp[2];
   tmp[0] = rev32(seq);
   tmp[1] = rev32(crc);
@@ -88,21 +202,16 @@ void fountain_part_indexes(uint32_t seq, uint32_t crc, int len, double* probs, i
   xoshiro_ctx_t xsr;
   xoshiro256_seed(&xsr, seed);
 
-  int degree = random_sampler_next(&xsr, len, probs, aliases) + 1;
+  int degree = random_sampler_next(&xsr, sampler) + 1;
   ur_desc_zero(out);
 
   while(degree--) {
-    int count = xoshiro256_next_int(&xsr, 1, len--);
-    int i = 0;
-
-    while(count) {
-      if (!ur_desc_get_bit(out, i)) {
-        count--;
-      }
-
-      i++;
-    }
-
-    ur_desc_set_bit(out, i - 1);
+    int count = sampler_scale(xoshiro256_next(&xsr), len--);
+    ur_desc_set_bit(out, fountain_nth_free(out, count));
   }
+
+  entry->seq = seq;
+  entry->crc = crc;
+  entry->len = sampler->len;
+  ur_desc_assign(&entry->indexes, out);
 }
@@ -3,9 +3,11 @@
 #include "crypto/xoshiro256.h"
 #include "ur.h"
 
-void random_sampler_init(int len, double* out_probs, int* out_aliases);
-int random_sampler_next(xoshiro_ctx_t* rng_ctx, int len, double* probs, int* aliases);
+#define FOUNTAIN_CACHE_SIZE 8
 
-void fountain_part_indexes(uint32_t seq, uint32_t crc, int len, double* probs, int* aliases, ur_desc_t* out);
+void random_sampler_init(random_sampler_t* sampler, int len);
+int random_sampler_next(xoshiro_ctx_t* rng_ctx, const random_sampler_t* sampler);
+
+void fountain_part_indexes(uint32_t seq, uint32_t crc, const random_sampler_t* sampler, ur_desc_t* out);
 
 #endif
@@ -33,21 +33,161 @@ const char *const ur_type_string[] = {
   "CRYPTO-OUTPUT",
 };
 
-static app_err_t ur_process_simple(ur_t* ur, uint8_t* parts, uint8_t* part_data, size_t part_len, uint32_t desc_idx, struct ur_part* part) {
-  if (!ur_desc_is_zero(&ur->part_desc[desc_idx])) {
-    return ERR_NEED_MORE_DATA;
+// Reads a CBOR head of the given major type with an argument of at most 32 bits
+static const uint8_t* ur_cbor_head(const uint8_t* p, const uint8_t* end, uint8_t major, uint32_t* val) {
+  if ((p >= end) || ((*p >> 5) != major)) {
+    return NULL;
+  }
+
+  uint8_t info = *(p++) & 0x1f;
+
+  if (info < 24) {
+    *val = info;
+    return p;
+  } else if (info > 26) {
+    return NULL;
+  }
+
+  int len = 1 << (info - 24);
+
+  if ((end - p) < len) {
+    return NULL;
+  }
+
+  *val = 0;
+
+  while (len--) {
+    *val = (*val << 8) | *(p++);
+  }
+
+  return p;
+}
+
+// Parses the ur-part fields preceding the payload. The payload is the last item of the array, so it
+// ends with the frame and only the first bytes of the frame are needed.
+static app_err_t ur_parse_part_header(const uint8_t* head, size_t head_len, size_t frame_len, struct ur_part* part, size_t* payload_off) {
+  const uint8_t* p = head;
+  const uint8_t* end = &head[head_len];
+  uint32_t len;
+
+  if (!(p = ur_cbor_head(p, end, 4, &len)) || (len != 5) ||
+      !(p = ur_cbor_head(p, end, 0, &part->ur_part_seqNum)) ||
+      !(p = ur_cbor_head(p, end, 0, &part->ur_part_seqLen)) ||
+      !(p = ur_cbor_head(p, end, 0, &part->ur_part_messageLen)) ||
+      !(p = ur_cbor_head(p, end, 0, &part->ur_part_checksum)) ||
+      !(p = ur_cbor_head(p, end, 2, &len))) {
+    return ERR_DATA;
+  }
+
+  *payload_off = p - head;
+
+  if ((*payload_off + len) != frame_len) {
+    return ERR_DATA;
+  }
+
+  part->ur_part_data.value = NULL;
+  part->ur_part_data.len = len;
+
+  return ERR_OK;
+}
+
+// Checks the CRC of a frame without storing it, the header has already been fed to the context
+static bool ur_check_frame(const uint8_t* bw, size_t head_len, size_t frame_len, crc32_ctx_t* crc) {
+  uint8_t chunk[MAX_CBOR_HEADER_LEN];
+  size_t off = head_len;
+
+  while (off < frame_len) {
+    size_t len = APP_MIN(sizeof(chunk), (frame_len - off));
+    bytewords_decode_part(&bw[off * 2], chunk, len, crc);
+    off += len;
   }
 
-  memcpy(&parts[desc_idx * part_len], part_data, part_len);
-  ur_desc_set_bit(&ur->part_desc[desc_idx], desc_idx);
-  ur_desc_or_assign(&ur->part_mask, &ur->part_desc[desc_idx]);
+  return bytewords_decode_check(&bw[frame_len * 2], crc);
+}
+
+// The received parts are kept in reduced row echelon form over GF(2). The row with pivot i, its lowest
+// set bit, is stored in slot i and has no other pivot bit set. Once all slots are filled the system is
+// solved and each slot holds the corresponding part, so the message is already in place.
+//
+// Reduction works on the masks alone: it returns the pivot of the new row or -1 if the part is redundant,
+// and in used the rows whose payloads must be XORed in.
+static int ur_fountain_reduce(ur_t* ur, const ur_desc_t* indexes, ur_desc_t* row, ur_desc_t* used) {
+  ur_desc_t pending;
+
+  // each stored row clears its own pivot and touches no other one, so it is applied at most once
+  ur_desc_assign(row, indexes);
+  ur_desc_and(used, indexes, &ur->part_mask);
+  ur_desc_assign(&pending, used);
+
+  while (!ur_desc_is_zero(&pending)) {
+    int idx = ur_desc_ctz(&pending);
+    ur_desc_clear_bit(&pending, idx);
+    ur_desc_xor(row, row, &ur->part_desc[idx]);
+  }
+
+  return ur_desc_is_zero(row) ? -1 : ur_desc_ctz(row);
+}
+
+// The CRC32 of the message is accumulated as parts are solved, so that it is known as soon as the last one
+// is. Each part adds its CRC without the initial and final inversion, advanced over the message bytes
+// following it. The inversions only depend on the message length and are applied at the end.
+static void ur_crc_add_part(ur_t* ur, const uint8_t* parts, size_t part_len, int idx, size_t msg_len) {
+  size_t off = idx * part_len;
+
+  if (off >= msg_len) {
+    return;
+  }
+
+  size_t len = APP_MIN(part_len, (msg_len - off));
+  uint32_t raw = crc32(&parts[off], len) ^ crc32_shift(UINT32_MAX, len) ^ UINT32_MAX;
+  ur->data_crc ^= crc32_shift(raw, (msg_len - off - len));
+}
+
+// The payload of the new row has already been decoded in the slot of its pivot
+static app_err_t ur_fountain_store(ur_t* ur, uint8_t* parts, size_t part_len, int pivot, const ur_desc_t* row, ur_desc_t* used, struct ur_part* part) {
+  uint8_t* slot = &parts[pivot * part_len];
+
+  while (!ur_desc_is_zero(used)) {
+    int idx = ur_desc_ctz(used);
+    ur_desc_clear_bit(used, idx);
+    memxor(slot, &parts[idx * part_len], part_len);
+  }
 
-  uint32_t part_count = ur_desc_popcount(&ur->part_mask);
-  ur->percent_done = (part_count * 100) / part->ur_part_seqLen;
+  // eliminate the new pivot from the stored rows, only those with more than one bit can have it
+  ur_desc_t pending;
+  ur_desc_assign(&pending, &ur->part_mixed);
 
-  if (part->ur_part_seqLen == part_count) {
+  while (!ur_desc_is_zero(&pending)) {
+    int idx = ur_desc_ctz(&pending);
+    ur_desc_clear_bit(&pending, idx);
+
+    if (ur_desc_get_bit(&ur->part_desc[idx], pivot)) {
+      ur_desc_xor(&ur->part_desc[idx], &ur->part_desc[idx], row);
+      memxor(&parts[idx * part_len], slot, part_len);
+
+      if (ur_desc_popcount(&ur->part_desc[idx]) == 1) {
+        ur_desc_clear_bit(&ur->part_mixed, idx);
+        ur_crc_add_part(ur, parts, part_len, idx, part->ur_part_messageLen);
+      }
+    }
+  }
+
+  ur_desc_assign(&ur->part_desc[pivot], row);
+  ur_desc_set_bit(&ur->part_mask, pivot);
+
+  if (ur_desc_popcount(row) > 1) {
+    ur_desc_set_bit(&ur->part_mixed, pivot);
+  } else {
+    ur_crc_add_part(ur, parts, part_len, pivot, part->ur_part_messageLen);
+  }
+
+  uint32_t rank = ur_desc_popcount(&ur->part_mask);
+  ur->percent_done = (rank * 100) / part->ur_part_seqLen;
+
+  if (rank == part->ur_part_seqLen) {
     ur->data = parts;
     ur->data_len = part->ur_part_messageLen;
+    ur->data_crc ^= crc32_shift(UINT32_MAX, ur->data_len) ^ UINT32_MAX;
     return ERR_OK;
   }
 
@@ -82,156 +222,98 @@ app_err_t ur_process_part(ur_t* ur, const uint8_t* in, size_t in_len) {
   // case where we are not to actual payload validation
   ur->type = UR_TYPE(tmp);
 
-  if (isdigit(in[++offset])) {
-    while((offset < in_len) && in[offset++] != '/') { /*we don't need this*/}
-    if (offset == in_len) {
+  if (!isdigit(in[++offset])) {
+    uint32_t data_len = bytewords_decode(&in[offset], (in_len - offset), ur->data, ur->data_max_len);
+
+    if (!data_len) {
       return ERR_DATA;
     }
 
-    tmp = 0;
-  } else {
-    tmp = 1;
+    ur->crc = 0;
+    ur->data_len = data_len;
+    return ERR_OK;
   }
 
-  uint32_t part_len = bytewords_decode(&in[offset], (in_len - offset), ur->data, ur->data_max_len);
-
-  if (!part_len) {
+  while((offset < in_len) && in[offset++] != '/') { /*we don't need this*/}
+  if (offset == in_len) {
     return ERR_DATA;
   }
 
-  if (tmp == 1) {
-    ur->crc = 0;
-    ur->data_len = part_len;
-    return ERR_OK;
-  }
-
+  // Only the header is decoded here. The payload is decoded straight into the slot of its
+  // pivot once the part is known not to be redundant.
+  const uint8_t* bw = &in[offset];
+  size_t frame_len = bytewords_decoded_len(in_len - offset);
+  size_t head_len = APP_MIN(frame_len, MAX_CBOR_HEADER_LEN);
+  uint8_t head[MAX_CBOR_HEADER_LEN];
+  size_t payload_off;
   struct ur_part part;
-  if ((cbor_decode_ur_part(ur->data, part_len, &part, NULL) != ZCBOR_SUCCESS) ||
+
+  crc32_ctx_t crc;
+  crc32_init(&crc);
+  bytewords_decode_part(bw, head, head_len, &crc);
+
+  if ((ur_parse_part_header(head, head_len, frame_len, &part, &payload_off) != ERR_OK) ||
       (part.ur_part_seqLen > UR_MAX_PART_COUNT) ||
       (part.ur_part_seqNum == 0) ||
-      ((part.ur_part_seqLen * part_len) >= ur->data_max_len) ||
-      (part.ur_part_messageLen > (ur->data_max_len - part_len))) {
+      (part.ur_part_data.len == 0) ||
+      ((part.ur_part_seqLen * part.ur_part_data.len) > ur->data_max_len) ||
+      (part.ur_part_messageLen > (part.ur_part_seqLen * part.ur_part_data.len))) {
     ur->crc = 0;
     return ERR_DATA;
   }
 
-  if (part.ur_part_checksum != ur->crc) {
-    ur->crc = part.ur_part_checksum;
-    ur_desc_zero(&ur->part_mask);
-    for (int i = 0; i < UR_PART_DESC_COUNT; i++) {
-      ur_desc_zero(&ur->part_desc[i]);
+  size_t part_len = part.ur_part_data.len;
+
+  if ((part.ur_part_checksum != ur->crc) || (part_len != ur->part_len)) {
+    // a new message starts, make sure this is not a corrupted frame before dropping the current one
+    if (!ur_check_frame(bw, head_len, frame_len, &crc)) {
+      return ERR_DATA;
     }
 
-    random_sampler_init(part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases);
-  }
+    // the rows are only read through the pivot mask
+    ur->crc = part.ur_part_checksum;
+    ur->part_len = part_len;
+    ur_desc_zero(&ur->part_mask);
+    ur_desc_zero(&ur->part_mixed);
+    ur->data_crc = 0;
+    ur->percent_done = 0;
 
-  part_len = part.ur_part_data.len;
-  uint8_t* parts = &ur->data[part_len + MAX_CBOR_HEADER_LEN];
-  uint8_t* part_data = (uint8_t*) part.ur_part_data.value;
+    random_sampler_init(&ur->sampler, part.ur_part_seqLen);
 
-  if (part.ur_part_seqNum <= part.ur_part_seqLen) {
-    return ur_process_simple(ur, parts, part_data, part_len, part.ur_part_seqNum - 1, &part);
+    crc32_init(&crc);
+    crc32_update(&crc, head, head_len);
   }
 
   ur_desc_t indexes;
-  fountain_part_indexes(part.ur_part_seqNum, ur->crc, part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases, &indexes);
-  if (ur_desc_is_subset(&indexes, &ur->part_mask)) {
-    return ERR_NEED_MORE_DATA;
-  }
-
-  int desc_idx = 0;
-  int store_idx = -1;
-
-  // reduce new part by existing
-  while(desc_idx < UR_PART_DESC_COUNT) {
-    if (ur_desc_popcount(&indexes) == 1) {
-      int target_idx = ur_desc_ctz(&indexes);
-      if (ur_process_simple(ur, parts, part_data, part_len, target_idx, &part) == ERR_OK) {
-        return ERR_OK;
-      } else {
-        store_idx = target_idx;
-        break;
-      }
-    }
-
-    if (ur_desc_is_zero(&ur->part_desc[desc_idx])) {
-      if (desc_idx >= part.ur_part_seqLen) {
-        store_idx = desc_idx;
-      }
-    } else if (ur_desc_is_subset(&ur->part_desc[desc_idx], &indexes)) {
-      ur_desc_xor(&indexes, &indexes, &ur->part_desc[desc_idx]);
-      if (ur_desc_is_zero(&indexes)) {
-        return ERR_NEED_MORE_DATA;
-      }
 
-      uint8_t* xorpart = &parts[desc_idx * part_len];
-      for (int i = 0; i < part_len; i++) {
-        part_data[i] ^= xorpart[i];
-      }
-    }
-
-    desc_idx++;
+  if (part.ur_part_seqNum <= part.ur_part_seqLen) {
+    ur_desc_zero(&indexes);
+    ur_desc_set_bit(&indexes, part.ur_part_seqNum - 1);
+  } else {
+    fountain_part_indexes(part.ur_part_seqNum, ur->crc, &ur->sampler, &indexes);
   }
 
-  // all buffers are full, but we don't give up yet. If one of the buffered parts is more mixed
-  // then the current part, we overwrite it since parts easier to reduce are better for us
-  if (store_idx == -1) {
-    int worst_count = ur_desc_popcount(&indexes);
-
-    desc_idx = part.ur_part_seqLen;
-
-    while(desc_idx < UR_PART_DESC_COUNT) {
-      int count = ur_desc_popcount(&ur->part_desc[desc_idx]);
-
-      if (count > worst_count) {
-        store_idx = desc_idx;
-        worst_count = count;
-      }
-
-      desc_idx++;
-    }
-
-    if (store_idx == -1) {
-      return ERR_NEED_MORE_DATA;
-    }
-  }
+  ur_desc_t row;
+  ur_desc_t used;
+  int pivot = ur_fountain_reduce(ur, &indexes, &row, &used);
 
-  if (store_idx >= part.ur_part_seqLen) {
-    memcpy(&parts[store_idx * part_len], part_data, part_len);
-    ur_desc_assign(&ur->part_desc[store_idx], &indexes);
+  if (pivot < 0) {
+    return ERR_NEED_MORE_DATA;
   }
 
-  //reduce existing parts by new part
-  desc_idx = part.ur_part_seqLen;
+  // the slot of a new pivot is free, so it can be written before the frame is validated
+  uint8_t* parts = ur->data;
+  uint8_t* slot = &parts[pivot * part_len];
+  size_t in_head = head_len - payload_off;
 
-  while(desc_idx < UR_PART_DESC_COUNT) {
-    if ((desc_idx != store_idx) && ur_desc_is_subset(&indexes, &ur->part_desc[desc_idx])) {
-      ur_desc_xor(&ur->part_desc[desc_idx], &indexes, &ur->part_desc[desc_idx]);
-
-      if (ur_desc_is_zero(&ur->part_desc[desc_idx])) {
-        desc_idx++;
-        continue;
-      }
+  memcpy(slot, &head[payload_off], in_head);
+  bytewords_decode_part(&bw[head_len * 2], &slot[in_head], (part_len - in_head), &crc);
 
-      uint8_t* target_part = &parts[desc_idx * part_len];
-      for (int i = 0; i < part_len; i++) {
-        target_part[i] ^= part_data[i];
-      }
-
-      if (ur_desc_popcount(&ur->part_desc[desc_idx]) == 1) {
-        int target_idx = ur_desc_ctz(&ur->part_desc[desc_idx]);
-        if (ur_process_simple(ur, parts, target_part, part_len, target_idx, &part) == ERR_OK) {
-          return ERR_OK;
-        }
-
-        ur_desc_zero(&ur->part_desc[desc_idx]);
-      }
-    }
-
-    desc_idx++;
+  if (!bytewords_decode_check(&bw[frame_len * 2], &crc)) {
+    return ERR_DATA;
   }
 
-  return ERR_NEED_MORE_DATA;
+  return ur_fountain_store(ur, parts, part_len, pivot, &row, &used, &part);
 }
 
 void ur_out_init(ur_out_t* ur, ur_type_t type, const uint8_t* data, size_t len, size_t segment_len) {
@@ -245,7 +327,7 @@ void ur_out_init(ur_out_t* ur, ur_type_t type, const uint8_t* data, size_t len,
     ur->part.ur_part_checksum = crc32(ur->data, len);
     ur->part.ur_part_seqLen = (len + (segment_len - 1)) / segment_len;
     ur->part.ur_part_data.len = segment_len;
-    random_sampler_init(ur->part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases);
+    random_sampler_init(&ur->sampler, ur->part.ur_part_seqLen);
   }
 }
 
@@ -310,7 +392,7 @@ app_err_t ur_encode_next(ur_out_t* ur, char* out, size_t max_len) {
   } else {
     ur->part.ur_part_seqNum++;
     ur_desc_t indexes;
-    fountain_part_indexes(ur->part.ur_part_seqNum, ur->part.ur_part_checksum, ur->part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases, &indexes);
+    fountain_part_indexes(ur->part.ur_part_seqNum, ur->part.ur_part_checksum, &ur->sampler, &indexes);
 
     for (int part_num = 0; part_num < ur->part.ur_part_seqLen; part_num++) {
       if (ur_desc_get_bit(&indexes, part_num)) {
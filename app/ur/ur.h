@@ -7,7 +7,6 @@
 #include "ur_types.h"
 
 #define UR_MAX_PART_COUNT 128
-#define UR_PART_DESC_COUNT (UR_MAX_PART_COUNT + 16)
 
 typedef struct {
   uint32_t w[4];
@@ -25,6 +24,17 @@ static inline int ur_desc_get_bit(const ur_desc_t* x, uint32_t idx) {
   return (x->w[idx >> 5] >> (idx & 31)) & 1;
 }
 
+static inline void ur_desc_clear_bit(ur_desc_t* x, uint32_t idx) {
+  x->w[idx >> 5] &= ~(1u << (idx & 31));
+}
+
+static inline void ur_desc_and(ur_desc_t* result, const ur_desc_t* x, const ur_desc_t* y) {
+  result->w[0] = x->w[0] & y->w[0];
+  result->w[1] = x->w[1] & y->w[1];
+  result->w[2] = x->w[2] & y->w[2];
+  result->w[3] = x->w[3] & y->w[3];
+}
+
 static inline void ur_desc_or_assign(ur_desc_t* x, const ur_desc_t* y) {
   x->w[0] |= y->w[0];
   x->w[1] |= y->w[1];
@@ -86,13 +96,21 @@ typedef enum {
   NO_UR = 255,
 } ur_type_t;
 
+typedef struct {
+  uint64_t thresholds[UR_MAX_PART_COUNT];
+  uint8_t aliases[UR_MAX_PART_COUNT];
+  uint8_t len;
+} random_sampler_t;
+
 typedef struct {
   ur_type_t type;
   uint32_t crc;
-  ur_desc_t part_desc[UR_PART_DESC_COUNT];
+  uint32_t data_crc;
+  size_t part_len;
+  ur_desc_t part_desc[UR_MAX_PART_COUNT];
   ur_desc_t part_mask;
-  double sampler_probs[UR_MAX_PART_COUNT];
-  int sampler_aliases[UR_MAX_PART_COUNT];
+  ur_desc_t part_mixed;
+  random_sampler_t sampler;
   size_t data_max_len;
   size_t data_len;
   uint8_t* data;
@@ -102,8 +120,7 @@ typedef struct {
 typedef struct {
   ur_type_t type;
   struct ur_part part;
-  double sampler_probs[UR_MAX_PART_COUNT];
-  int sampler_aliases[UR_MAX_PART_COUNT];
+  random_sampler_t sampler;
   const uint8_t* data;
 } ur_out_t;
 
@@ -0,0 +1,346 @@
+/*
+ * Calldata recognition latency against the number of ABIs in the database,
+ * with ABI tables keyed by the selector alone and with the function shape
+ * (argument words, dynamic and payable flags) kept after it, which lets
+ * eth_db_lookup_abi() skip candidates without reading their arguments.
+ *
+ * Usage: abi-recognize-bench [-n lookups] [-s seed] [-c collisions] [-a abis,...]
+ *
+ * Every selector is shared by collisions functions of different shapes, as
+ * happens with overloaded functions and proxies. Each lookup builds valid
+ * calldata for a random function and checks that eth_data_recognize() returns
+ * it. Besides the time, the function records read for each lookup are
+ * reported: on the host locating the table dominates, while on the device each
+ * record read is a flash access and each argument walk more so.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "db_stage.h"
+#include "linux_internal.h"
+#include "mem.h"
+#include "crypto/sha2.h"
+#include "ethereum/eth_data.h"
+#include "ethereum/eth_db.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_LOOKUPS 20000
+#define BENCH_DEFAULT_COLLISIONS 4
+#define BENCH_MAX_COLLISIONS 8
+#define BENCH_MAX_LIST 16
+#define BENCH_KEY_LEN 8
+#define BENCH_SHAPED_KEY_LEN (BENCH_KEY_LEN + 2)
+#define BENCH_RECORD_MAX_LEN 128
+#define BENCH_CALLDATA_MAX_LEN (4 + ((BENCH_MAX_COLLISIONS * 2) + 3) * ETH_ABI_WORD_LEN)
+#define BENCH_TABLE_MAX_LEN (HAL_FLASH_BLOCK_SIZE / 4)
+#define BENCH_TABLE_SPLIT_LEN (BENCH_TABLE_MAX_LEN / 2)
+#define BENCH_DB_MAX_LEN (HAL_FLASH_DATA_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)
+
+typedef struct {
+  uint32_t selector;
+  uint32_t ext_selector;
+  uint8_t words;
+  bool dynamic;
+  bool payable;
+} bench_abi_t;
+
+typedef struct {
+  uint8_t key[BENCH_SHAPED_KEY_LEN];
+  uint8_t record[BENCH_RECORD_MAX_LEN];
+  uint16_t record_len;
+} bench_row_t;
+
+// eth_data.c formats into the camera buffers, which camera.c only provides to the RTOS build
+uint8_t g_camera_fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE];
+
+static bench_abi_t* g_abis;
+static int g_abi_count;
+static uint8_t* g_db;
+static size_t g_db_len;
+static int g_table_key_len;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static uint8_t* bench_entry(uint16_t magic, uint16_t len) {
+  fs_entry_t* entry = (fs_entry_t*) &g_db[g_db_len];
+  entry->magic = magic;
+  entry->len = len;
+  g_db_len += sizeof(fs_entry_t) + len;
+  return FS_ENTRY_DATA(uint8_t*, entry);
+}
+
+// Member i of a selector group takes i + 1 words, the last one a bytes argument when dynamic. The dynamic
+// calldata is longer than any static member, so exactly one function of the group accepts each call
+static void bench_generate(int abis, int collisions) {
+  g_abi_count = 0;
+
+  while (g_abi_count < abis) {
+    uint32_t selector = bench_rand();
+
+    for (int i = 0; (i < collisions) && (g_abi_count < abis); i++) {
+      bench_abi_t* abi = &g_abis[g_abi_count++];
+      abi->selector = selector;
+      abi->ext_selector = bench_rand();
+      abi->words = i + 1;
+      abi->dynamic = (i & 1);
+      abi->payable = (bench_rand() & 1);
+    }
+  }
+}
+
+// Same layout as serialize_abi() in abi.py, with a flat argument list
+static uint16_t bench_abi_record(const bench_abi_t* abi, uint8_t* out) {
+  eth_abi_function_t* func = (eth_abi_function_t*) out;
+  func->selector = abi->selector;
+  func->ext_selector = abi->ext_selector;
+  func->name = sizeof(eth_abi_function_t);
+  func->first_arg = sizeof(eth_abi_function_t) + 2;
+  func->attrs = abi->payable ? ETH_FUNC_PAYABLE : 0;
+  memcpy(&out[func->name], "f", 2);
+
+  eth_abi_argument_t* arg = (eth_abi_argument_t*) &out[func->first_arg];
+
+  for (int i = 0; i < abi->words; i++) {
+    bool last = i == (abi->words - 1);
+    arg[i].type = (last && abi->dynamic) ? ETH_ABI_VARBYTES : ETH_ABI_SIZED_TYPE(ETH_ABI_UINT, 32);
+    arg[i].next = last ? 0 : sizeof(eth_abi_argument_t);
+    arg[i].child = 0;
+  }
+
+  return func->first_arg + (abi->words * sizeof(eth_abi_argument_t));
+}
+
+static uint16_t bench_abi_shape(const bench_abi_t* abi) {
+  return abi->words | (abi->dynamic ? ETH_DB_ABI_SHAPE_DYNAMIC : 0) | (abi->payable ? ETH_DB_ABI_SHAPE_PAYABLE : 0);
+}
+
+static int bench_row_cmp(const void* a, const void* b) {
+  return memcmp(((const bench_row_t*) a)->key, ((const bench_row_t*) b)->key, g_table_key_len);
+}
+
+static bool bench_table_boundary(const bench_row_t* row, int row_len) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  sha256_Raw(row->key, g_table_key_len, digest);
+  uint32_t h = digest[0] | (digest[1] << 8) | (digest[2] << 16) | ((uint32_t) digest[3] << 24);
+  return (h % BENCH_TABLE_SPLIT_LEN) < (uint32_t) (row_len + row->record_len);
+}
+
+// Same packing as serialize_table() in shell-db.py, without sharing identical records
+static void bench_build(bench_row_t* rows, int key_len) {
+  g_db_len = 0;
+  uint32_t version = 20250101;
+  memcpy(bench_entry(FS_VERSION_MAGIC, 4), &version, 4);
+
+  for (int i = 0; i < g_abi_count; i++) {
+    uint16_t shape = bench_abi_shape(&g_abis[i]);
+    memcpy(rows[i].key, &g_abis[i].selector, 4);
+    memcpy(&rows[i].key[4], &g_abis[i].ext_selector, 4);
+    memcpy(&rows[i].key[BENCH_KEY_LEN], &shape, 2);
+    rows[i].record_len = bench_abi_record(&g_abis[i], rows[i].record);
+  }
+
+  g_table_key_len = key_len;
+  qsort(rows, g_abi_count, sizeof(bench_row_t), bench_row_cmp);
+
+  int row_len = key_len + 2;
+  int i = 0;
+
+  while (i < g_abi_count) {
+    int n = 0;
+    size_t records_len = 0;
+
+    while (((i + n) < g_abi_count) && ((n == 0) || ((3 + ((n + 1) * row_len) + records_len + rows[i + n].record_len) <= BENCH_TABLE_MAX_LEN))) {
+      records_len += rows[i + n].record_len;
+
+      if (bench_table_boundary(&rows[i + n++], row_len)) {
+        break;
+      }
+    }
+
+    size_t rows_len = n * row_len;
+    uint8_t* data = bench_entry(FS_ABI_TABLE_MAGIC, 3 + rows_len + records_len);
+    uint16_t off = rows_len;
+
+    data[0] = n & 0xff;
+    data[1] = n >> 8;
+    data[2] = key_len;
+    data += 3;
+
+    for (int j = 0; j < n; j++) {
+      memcpy(&data[j * row_len], rows[i + j].key, key_len);
+      data[(j * row_len) + key_len] = off & 0xff;
+      data[(j * row_len) + key_len + 1] = off >> 8;
+      memcpy(&data[off], rows[i + j].record, rows[i + j].record_len);
+      off += rows[i + j].record_len;
+    }
+
+    i += n;
+  }
+}
+
+// Static words are all ones so that their low 16 bits are never a valid offset for a dynamic candidate
+static size_t bench_calldata(const bench_abi_t* abi, int collisions, uint8_t* out) {
+  memcpy(out, &abi->selector, 4);
+  uint8_t* args = &out[4];
+  size_t head_len = abi->words * ETH_ABI_WORD_LEN;
+  memset(args, 0xff, head_len);
+
+  if (!abi->dynamic) {
+    return 4 + head_len;
+  }
+
+  size_t content_len = collisions * ETH_ABI_WORD_LEN;
+  uint8_t* offset = &args[head_len - ETH_ABI_WORD_LEN];
+  memset(offset, 0, ETH_ABI_WORD_LEN);
+  offset[30] = head_len >> 8;
+  offset[31] = head_len & 0xff;
+
+  uint8_t* len = &args[head_len];
+  memset(len, 0, ETH_ABI_WORD_LEN);
+  len[30] = content_len >> 8;
+  len[31] = content_len & 0xff;
+
+  memset(&len[ETH_ABI_WORD_LEN], 0x42, content_len);
+
+  return 4 + head_len + ETH_ABI_WORD_LEN + content_len;
+}
+
+typedef struct {
+  uint32_t ext_selector;
+  uint32_t records;
+} bench_count_ctx_t;
+
+static bool bench_count_match(void* ctx, const uint8_t* func) {
+  bench_count_ctx_t* count_ctx = (bench_count_ctx_t*) ctx;
+  count_ctx->records++;
+  return ((const eth_abi_function_t*) func)->ext_selector == count_ctx->ext_selector;
+}
+
+// Returns the function records read, counted by looking up the same calls with a match stopping at the expected one
+static uint32_t bench_lookups(int lookups, int collisions, bench_stats_t* stats) {
+  uint8_t calldata[BENCH_CALLDATA_MAX_LEN];
+  bench_count_ctx_t count_ctx = { .records = 0 };
+
+  for (int i = 0; i < lookups; i++) {
+    const bench_abi_t* abi = &g_abis[bench_rand() % g_abi_count];
+    size_t len = bench_calldata(abi, collisions, calldata);
+    bool has_value = abi->payable && (bench_rand() & 1);
+
+    uint64_t start = bench_now_ns();
+    const eth_abi_function_t* func = eth_data_recognize(calldata, len, has_value);
+    bench_stats_add(stats, bench_now_ns() - start);
+
+    if (!func || (func->ext_selector != abi->ext_selector)) {
+      fprintf(stderr, "lookup %d recognized the wrong function\n", i);
+      exit(1);
+    }
+
+    eth_db_abi_call_t call = { .args_len = len - 4, .has_value = has_value };
+    count_ctx.ext_selector = abi->ext_selector;
+    eth_db_lookup_abi(abi->selector, &call, bench_count_match, &count_ctx);
+  }
+
+  return count_ctx.records;
+}
+
+static double bench_mean_us(bench_stats_t* stats) {
+  return (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+  int lookups = BENCH_DEFAULT_LOOKUPS;
+  int collisions = BENCH_DEFAULT_COLLISIONS;
+  int sizes[BENCH_MAX_LIST] = { 256, 1024, 4096 };
+  int size_count = 3;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:c:a:")) != -1) {
+    switch (opt) {
+    case 'n':
+      lookups = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'c':
+      collisions = atoi(optarg);
+      break;
+    case 'a':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n lookups] [-s seed] [-c collisions] [-a abis,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((lookups <= 0) || (collisions < 1) || (collisions > BENCH_MAX_COLLISIONS)) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  fs_init();
+  g_db = malloc(BENCH_DB_MAX_LEN);
+
+  printf("%d functions per selector\n", collisions);
+  printf("%6s %9s | %-21s | %-29s\n", "ABIs", "db bytes", "selector keys", "shaped keys");
+
+  for (int s = 0; s < size_count; s++) {
+    if (sizes[s] < 1) {
+      fprintf(stderr, "at least one ABI is needed\n");
+      return 1;
+    }
+
+    g_abis = malloc(sizeof(bench_abi_t) * sizes[s]);
+    bench_row_t* rows = malloc(sizeof(bench_row_t) * sizes[s]);
+    bench_generate(sizes[s], collisions);
+
+    double plain_us = 0;
+
+    for (int shaped = 0; shaped <= 1; shaped++) {
+      bench_build(rows, shaped ? BENCH_SHAPED_KEY_LEN : BENCH_KEY_LEN);
+
+      if (g_db_len > BENCH_DB_MAX_LEN || bench_db_update(g_db, g_db_len) != ERR_OK) {
+        fprintf(stderr, "database of %zu bytes does not fit\n", g_db_len);
+        return 1;
+      }
+
+      bench_stats_t stats;
+      bench_stats_init(&stats, shaped ? "shaped keys" : "selector keys");
+      double records = bench_lookups(lookups, collisions, &stats) / (double) lookups;
+      double us = bench_mean_us(&stats);
+
+      if (!shaped) {
+        plain_us = us;
+        printf("%6d %9zu | %6.2fus %4.2f records", sizes[s], g_db_len, us, records);
+      } else {
+        printf(" | %6.2fus (%4.1fx) %4.2f records\n", us, plain_us / us, records);
+      }
+
+      bench_stats_free(&stats);
+    }
+
+    free(rows);
+    free(g_abis);
+  }
+
+  free(g_db);
+
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_HIST_WIDTH 40
+#define BENCH_DEFAULT_SEED 0x12345678
+
+static uint32_t g_rand_state = BENCH_DEFAULT_SEED;
+
+uint64_t bench_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+void bench_seed(uint32_t seed) {
+  g_rand_state = seed ? seed : BENCH_DEFAULT_SEED;
+}
+
+uint32_t bench_rand() {
+  g_rand_state ^= g_rand_state << 13;
+  g_rand_state ^= g_rand_state >> 17;
+  g_rand_state ^= g_rand_state << 5;
+  return g_rand_state;
+}
+
+void bench_stats_init(bench_stats_t* stats, const char* name) {
+  stats->name = name;
+  stats->samples = NULL;
+  stats->count = 0;
+  stats->capacity = 0;
+}
+
+void bench_stats_add(bench_stats_t* stats, uint64_t ns) {
+  if (stats->count == stats->capacity) {
+    stats->capacity = stats->capacity ? (stats->capacity * 2) : 256;
+    stats->samples = realloc(stats->samples, stats->capacity * sizeof(uint64_t));
+
+    if (!stats->samples) {
+      abort();
+    }
+  }
+
+  stats->samples[stats->count++] = ns;
+}
+
+void bench_stats_reset(bench_stats_t* stats) {
+  stats->count = 0;
+}
+
+void bench_stats_free(bench_stats_t* stats) {
+  free(stats->samples);
+  bench_stats_init(stats, stats->name);
+}
+
+uint64_t bench_stats_total(const bench_stats_t* stats) {
+  uint64_t total = 0;
+
+  for (size_t i = 0; i < stats->count; i++) {
+    total += stats->samples[i];
+  }
+
+  return total;
+}
+
+static int _bench_cmp(const void* a, const void* b) {
+  uint64_t x = *((const uint64_t*) a);
+  uint64_t y = *((const uint64_t*) b);
+  return (x > y) - (x < y);
+}
+
+static inline double _bench_percentile(const bench_stats_t* stats, unsigned int pct) {
+  size_t idx = ((stats->count - 1) * pct) / 100;
+  return stats->samples[idx] / 1000.0;
+}
+
+void bench_stats_report(bench_stats_t* stats) {
+  if (!stats->count) {
+    printf("  %-18s no samples\n", stats->name);
+    return;
+  }
+
+  qsort(stats->samples, stats->count, sizeof(uint64_t), _bench_cmp);
+
+  double mean = (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+
+  printf("  %-18s n=%-6zu mean=%9.2fus min=%9.2fus p50=%9.2fus p90=%9.2fus p99=%9.2fus max=%9.2fus\n",
+      stats->name, stats->count, mean, _bench_percentile(stats, 0), _bench_percentile(stats, 50),
+      _bench_percentile(stats, 90), _bench_percentile(stats, 99), _bench_percentile(stats, 100));
+}
+
+void bench_stats_histogram(bench_stats_t* stats) {
+  bench_stats_report(stats);
+
+  if (!stats->count) {
+    return;
+  }
+
+  // bucket i holds samples in [2^i, 2^(i+1)) microseconds, bucket 0 everything below 2us
+  size_t buckets[BENCH_HIST_BUCKETS];
+  memset(buckets, 0, sizeof(buckets));
+
+  size_t max_bucket = 0;
+  size_t min_idx = BENCH_HIST_BUCKETS;
+  size_t max_idx = 0;
+
+  for (size_t i = 0; i < stats->count; i++) {
+    uint64_t us = stats->samples[i] / 1000;
+    size_t idx = us ? (63 - __builtin_clzll(us)) : 0;
+
+    if (idx >= BENCH_HIST_BUCKETS) {
+      idx = BENCH_HIST_BUCKETS - 1;
+    }
+
+    buckets[idx]++;
+
+    if (buckets[idx] > max_bucket) {
+      max_bucket = buckets[idx];
+    }
+
+    if (idx < min_idx) {
+      min_idx = idx;
+    }
+
+    if (idx > max_idx) {
+      max_idx = idx;
+    }
+  }
+
+  for (size_t i = min_idx; i <= max_idx; i++) {
+    char bar[BENCH_HIST_WIDTH + 1];
+    size_t len = (buckets[i] * BENCH_HIST_WIDTH) / max_bucket;
+    memset(bar, '#', len);
+    bar[len] = '\0';
+    printf("    [%8lluus, %8lluus) %6zu %s\n", i ? (1ull << i) : 0ull, 1ull << (i + 1), buckets[i], bar);
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BENCH_HIST_BUCKETS 24
+
+typedef struct {
+  const char* name;
+  uint64_t* samples;
+  size_t count;
+  size_t capacity;
+} bench_stats_t;
+
+uint64_t bench_now_ns();
+
+// Deterministic xorshift generator, so that runs are reproducible
+void bench_seed(uint32_t seed);
+uint32_t bench_rand();
+
+void bench_stats_init(bench_stats_t* stats, const char* name);
+void bench_stats_add(bench_stats_t* stats, uint64_t ns);
+void bench_stats_reset(bench_stats_t* stats);
+void bench_stats_free(bench_stats_t* stats);
+uint64_t bench_stats_total(const bench_stats_t* stats);
+
+// Prints a single line summary (count, mean and percentiles in microseconds)
+void bench_stats_report(bench_stats_t* stats);
+
+// Prints the summary followed by a log2 histogram of the samples
+void bench_stats_histogram(bench_stats_t* stats);
+
+#endif
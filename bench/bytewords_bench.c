@@ -0,0 +1,231 @@
+/*
+ * Timing of the bytewords decoder against the previous one, which folded case
+ * with toupper() into a 26x26 table, and of the final UR message CRC check
+ * against the CRC accumulated as parts are solved.
+ *
+ * Usage: bytewords-bench [-n iterations]
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "common.h"
+#include "ur/bytewords.h"
+
+#define BENCH_DEFAULT_ITERATIONS 20000
+#define BENCH_MAX_LEN 1000
+#define BENCH_MSG_PARTS 128
+#define BENCH_PART_LEN 200
+
+static const uint8_t REF_DECODE_LUT[] = {
+    0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x02, 0x00,
+    0x00, 0x00, 0x09, 0x07, 0x00, 0x00, 0x00, 0x03, 0x08, 0x00, 0x0e, 0x14, 0x00, 0x0b, 0x10, 0x00,
+    0x12, 0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x0f, 0x0d, 0x00, 0x00,
+    0x13, 0x00, 0x11, 0x15, 0x1d, 0x00, 0x00, 0x00, 0x1c, 0x19, 0x00, 0x17, 0x00, 0x00, 0x1e, 0x21,
+    0x16, 0x23, 0x00, 0x22, 0x00, 0x00, 0x18, 0x1f, 0x00, 0x00, 0x1b, 0x20, 0x1a, 0x00, 0x25, 0x00,
+    0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x27, 0x00, 0x24, 0x2f, 0x2e, 0x2b, 0x00, 0x2d, 0x00, 0x2a,
+    0x26, 0x29, 0x00, 0x00, 0x2c, 0x00, 0x30, 0x00, 0x00, 0x00, 0x35, 0x00, 0x34, 0x00, 0x00, 0x31,
+    0x00, 0x00, 0x00, 0x00, 0x37, 0x36, 0x33, 0x00, 0x00, 0x00, 0x39, 0x38, 0x00, 0x00, 0x00, 0x00,
+    0x32, 0x00, 0x00, 0x00, 0x00, 0x48, 0x45, 0x00, 0x46, 0x3f, 0x00, 0x00, 0x00, 0x47, 0x3e, 0x3c,
+    0x00, 0x41, 0x00, 0x3b, 0x3d, 0x3a, 0x00, 0x00, 0x42, 0x43, 0x44, 0x40, 0x49, 0x00, 0x00, 0x50,
+    0x4a, 0x00, 0x00, 0x54, 0x00, 0x00, 0x00, 0x4e, 0x52, 0x00, 0x55, 0x00, 0x00, 0x4b, 0x4c, 0x4d,
+    0x53, 0x00, 0x4f, 0x00, 0x51, 0x00, 0x00, 0x00, 0x00, 0x58, 0x5f, 0x56, 0x57, 0x5c, 0x00, 0x00,
+    0x59, 0x5d, 0x00, 0x60, 0x00, 0x5b, 0x00, 0x00, 0x61, 0x5a, 0x00, 0x00, 0x00, 0x00, 0x5e, 0x00,
+    0x63, 0x00, 0x00, 0x62, 0x64, 0x00, 0x00, 0x65, 0x00, 0x00, 0x00, 0x00, 0x6a, 0x69, 0x67, 0x00,
+    0x00, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x00, 0x00, 0x00, 0x00, 0x00, 0x6b, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x73, 0x6f, 0x00, 0x6d, 0x70, 0x72, 0x00, 0x00, 0x71, 0x6e, 0x00, 0x00,
+    0x00, 0x00, 0x74, 0x6c, 0x00, 0x7e, 0x00, 0x00, 0x7c, 0x00, 0x7b, 0x00, 0x7d, 0x00, 0x79, 0x00,
+    0x00, 0x7a, 0x76, 0x75, 0x00, 0x00, 0x78, 0x77, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x7f,
+    0x00, 0x89, 0x8a, 0x82, 0x8d, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x86, 0x88, 0x85, 0x00, 0x84,
+    0x83, 0x87, 0x8b, 0x00, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00, 0x00, 0x95, 0x91, 0x00, 0x00, 0x90,
+    0x00, 0x00, 0x98, 0x00, 0x00, 0x8e, 0x92, 0x00, 0x00, 0x00, 0x97, 0x96, 0x93, 0x00, 0x94, 0x00,
+    0x8f, 0x00, 0x00, 0xa0, 0x00, 0x9b, 0x9f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x99, 0x00, 0x9e,
+    0x00, 0x00, 0x00, 0x00, 0x9c, 0x9d, 0x00, 0x00, 0x00, 0x00, 0x9a, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xa2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa6, 0x00, 0xa5, 0x00, 0x00, 0x00, 0x00, 0xa7, 0xa3,
+    0x00, 0x00, 0x00, 0xa4, 0xa1, 0x00, 0xb1, 0x00, 0x00, 0xa8, 0xaf, 0xb0, 0x00, 0x00, 0x00, 0x00,
+    0xaa, 0xae, 0xad, 0x00, 0x00, 0x00, 0x00, 0xb2, 0xac, 0xa9, 0x00, 0x00, 0x00, 0x00, 0xab, 0x00,
+    0x00, 0x00, 0x00, 0xb3, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xb4, 0x00, 0x00, 0x00, 0xba, 0xb5, 0xbc,
+    0x00, 0xb9, 0x00, 0x00, 0xbb, 0xb7, 0x00, 0xbe, 0xb8, 0xb6, 0x00, 0x00, 0xbf, 0xc0, 0x00, 0x00,
+    0x00, 0x00, 0xbd, 0x00, 0xc2, 0xcb, 0x00, 0x00, 0xc1, 0xcc, 0xca, 0x00, 0x00, 0x00, 0xc5, 0x00,
+    0x00, 0xcd, 0xc9, 0xc8, 0x00, 0xc3, 0xc4, 0xc7, 0x00, 0x00, 0xc6, 0x00, 0x00, 0x00, 0xd9, 0xd6,
+    0x00, 0xd2, 0xd3, 0x00, 0x00, 0x00, 0xd0, 0x00, 0xcf, 0xd5, 0x00, 0xda, 0xce, 0xd8, 0x00, 0x00,
+    0xd7, 0xd1, 0x00, 0x00, 0x00, 0x00, 0xd4, 0x00, 0x00, 0x00, 0x00, 0x00, 0xde, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xdc, 0x00, 0x00, 0xdf, 0x00, 0xdd, 0x00, 0x00, 0x00, 0x00,
+    0xdb, 0x00, 0xe6, 0x00, 0x00, 0xe7, 0xe4, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xe3, 0x00, 0x00,
+    0xe2, 0x00, 0x00, 0x00, 0xe8, 0xe0, 0x00, 0x00, 0xe5, 0x00, 0xe1, 0x00, 0x00, 0x00, 0x00, 0xea,
+    0xed, 0xf3, 0x00, 0x00, 0x00, 0x00, 0xf4, 0xe9, 0xeb, 0xf1, 0x00, 0xec, 0x00, 0x00, 0xef, 0xf0,
+    0x00, 0x00, 0x00, 0x00, 0xee, 0xf2, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xf5, 0xf7, 0x00, 0xf6, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0xf9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xfd, 0x00, 0xfe, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x00, 0xfb, 0x00, 0x00, 0x00, 0xfa, 0xfc, 0x00, 0x00,
+};
+
+static inline uint16_t ref_decode_hash(uint8_t i, uint8_t j) {
+  i = toupper(i) - 'A';
+  j = toupper(j) - 'A';
+  return (i*26) + j;
+}
+
+static size_t ref_decode(const uint8_t* in, size_t in_len, uint8_t* out, size_t max_out) {
+  size_t outlen = bytewords_decoded_len(in_len);
+
+  if (!outlen || (outlen > max_out)) {
+    return 0;
+  }
+
+  crc32_ctx_t crc;
+  crc32_init(&crc);
+
+  for (size_t i = 0; i < outlen; i++) {
+    out[i] = REF_DECODE_LUT[ref_decode_hash(in[0], in[1])];
+    crc32_update_one(&crc, out[i]);
+    in += 2;
+  }
+
+  uint32_t checksum;
+  crc32_finish(&crc, &checksum);
+
+  uint32_t expected;
+  uint8_t* chk = (uint8_t*) &expected;
+
+  for (int i = 0; i < 4; i++) {
+    chk[i] = REF_DECODE_LUT[ref_decode_hash(in[0], in[1])];
+    in += 2;
+  }
+
+  return checksum == rev32(expected) ? outlen : 0;
+}
+
+static void bench_decode(int iterations, size_t len, bool lower) {
+  uint8_t data[BENCH_MAX_LEN];
+  uint8_t bw[(BENCH_MAX_LEN + 4) * 2];
+  uint8_t out[BENCH_MAX_LEN];
+
+  for (size_t i = 0; i < len; i++) {
+    data[i] = bench_rand();
+  }
+
+  size_t bw_len = bytewords_encode(data, len, bw, sizeof(bw));
+
+  if (lower) {
+    for (size_t i = 0; i < bw_len; i++) {
+      bw[i] = tolower(bw[i]);
+    }
+  }
+
+  size_t (*const decoders[])(const uint8_t*, size_t, uint8_t*, size_t) = { ref_decode, bytewords_decode };
+  double ns[2];
+
+  for (int d = 0; d < 2; d++) {
+    memset(out, 0, sizeof(out));
+
+    if ((decoders[d](bw, bw_len, out, sizeof(out)) != len) || memcmp(out, data, len)) {
+      fprintf(stderr, "decoder %d: wrong output\n", d);
+      exit(1);
+    }
+
+    uint64_t t = bench_now_ns();
+
+    for (int i = 0; i < iterations; i++) {
+      decoders[d](bw, bw_len, out, sizeof(out));
+      __asm__ volatile("" : : "r"(out) : "memory");
+    }
+
+    ns[d] = (bench_now_ns() - t) / (double) iterations;
+  }
+
+  printf("%4zu bytes %s: previous %8.1fns, table %8.1fns (%.2fx)\n", len, lower ? "lower" : "upper", ns[0], ns[1], ns[0] / ns[1]);
+}
+
+static uint32_t bench_crc_part(const uint8_t* msg, size_t off, size_t len, size_t msg_len) {
+  uint32_t raw = crc32(&msg[off], len) ^ crc32_shift(UINT32_MAX, len) ^ UINT32_MAX;
+  return crc32_shift(raw, (msg_len - off - len));
+}
+
+static void bench_message_crc(int iterations) {
+  size_t msg_len = (BENCH_MSG_PARTS * BENCH_PART_LEN) - (BENCH_PART_LEN / 2);
+  uint8_t* msg = malloc(msg_len);
+
+  for (size_t i = 0; i < msg_len; i++) {
+    msg[i] = bench_rand();
+  }
+
+  uint32_t expected = crc32(msg, msg_len);
+  int rounds = APP_MAX(1, iterations / 100);
+
+  uint64_t t = bench_now_ns();
+  for (int i = 0; i < rounds; i++) {
+    expected ^= crc32(msg, msg_len) ^ expected;
+  }
+  double whole = (bench_now_ns() - t) / (double) rounds;
+
+  uint32_t acc = 0;
+  t = bench_now_ns();
+  for (int i = 0; i < rounds; i++) {
+    acc = 0;
+
+    // parts are solved in any order
+    for (int p = BENCH_MSG_PARTS - 1; p >= 0; p--) {
+      size_t off = p * BENCH_PART_LEN;
+      acc ^= bench_crc_part(msg, off, APP_MIN(BENCH_PART_LEN, (msg_len - off)), msg_len);
+    }
+  }
+  double parts = (bench_now_ns() - t) / (double) rounds;
+
+  t = bench_now_ns();
+  uint32_t final = 0;
+  for (int i = 0; i < iterations; i++) {
+    final = acc ^ crc32_shift(UINT32_MAX, msg_len) ^ UINT32_MAX;
+    __asm__ volatile("" : : "r"(final) : "memory");
+  }
+  double finish = (bench_now_ns() - t) / (double) iterations;
+
+  if (final != expected) {
+    fprintf(stderr, "incremental CRC %08x, expected %08x\n", final, expected);
+    exit(1);
+  }
+
+  printf("\nmessage CRC, %d parts of %d bytes:\n", BENCH_MSG_PARTS, BENCH_PART_LEN);
+  printf("  whole message at the end: %8.1fus\n", whole / 1000.0);
+  printf("  per solved part:          %8.1fus (%.1fus in total)\n", parts / (BENCH_MSG_PARTS * 1000.0), parts / 1000.0);
+  printf("  final check:              %8.1fus\n", finish / 1000.0);
+  free(msg);
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = BENCH_DEFAULT_ITERATIONS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (iterations <= 0) {
+    fprintf(stderr, "invalid iteration count\n");
+    return 1;
+  }
+
+  const size_t lens[] = { 50, 200, 1000 };
+
+  for (int i = 0; i < 3; i++) {
+    bench_decode(iterations, lens[i], false);
+    bench_decode(iterations, lens[i], true);
+  }
+
+  bench_message_crc(iterations);
+  return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Database updates for the benches, applied the way the updater applies them
+ * since the whole image is no longer buffered in RAM: staged chunk by chunk,
+ * then activated once the signature would have been checked.
+ */
+
+#include "db_stage.h"
+#include "mem.h"
+#include "ethereum/eth_db.h"
+
+app_err_t bench_db_update(const uint8_t* data, size_t len) {
+  static const uint8_t sig[ETH_DB_SIG_LEN];
+  eth_db_stage_t stage;
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint32_t version;
+  app_err_t err;
+
+  if (((err = eth_db_stage_begin(&stage, len + ETH_DB_SIG_LEN, g_mem_heap)) != ERR_OK) ||
+      ((err = eth_db_stage_write(&stage, data, len)) != ERR_OK) ||
+      ((err = eth_db_stage_write(&stage, sig, ETH_DB_SIG_LEN)) != ERR_OK) ||
+      ((err = eth_db_stage_finish(&stage, digest, &version)) != ERR_OK)) {
+    eth_db_stage_discard();
+    return err;
+  }
+
+  return eth_db_stage_activate(&stage);
+}
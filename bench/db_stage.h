@@ -0,0 +1,12 @@
+#ifndef __DB_STAGE_H__
+#define __DB_STAGE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "error.h"
+
+// Writes an unsigned database image or delta through the staging calls of the updater, with a blank signature
+app_err_t bench_db_update(const uint8_t* data, size_t len);
+
+#endif
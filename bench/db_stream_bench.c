@@ -0,0 +1,480 @@
+/*
+ * Ethereum database updates streamed to flash as they arrive: sends signed
+ * database images in USB segments through the staging calls used by the
+ * updater, on a file backed flash, and reports the throughput of staging and
+ * of activation.
+ *
+ * Usage: db-stream-bench [-s seed] [-k sizes_kb,...] [-p power_cuts] [-f flash_file]
+ *
+ * Every update is checked by its digest and by looking up all its tokens.
+ * Updates which cannot be applied while their staged chunks are still in
+ * flash must be refused before staging, leaving the database in place.
+ * The power cuts then stop a child process at evenly spread flash
+ * operations of a staged update, after which the boot path must leave
+ * either the old or the new database complete and nothing staged.
+ *
+ * Erasing and programming the host flash are writes to the mapped file, so
+ * the throughput only shows the processing cost of each path.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "mem.h"
+#include "crypto/sha2.h"
+#include "ethereum/eth_db.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_POWER_CUTS 24
+#define BENCH_MAX_LIST 16
+#define BENCH_CHAINS 13
+#define BENCH_ABIS 64
+#define BENCH_MAX_NETS 8
+#define BENCH_NET_LEN 24
+#define BENCH_ABI_LEN 48
+#define BENCH_SEGMENT_LEN 240
+#define BENCH_DB_MAX_LEN (HAL_FLASH_DATA_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)
+
+typedef struct {
+  uint8_t nets;
+  uint8_t key[BENCH_MAX_NETS][BENCH_NET_LEN];
+  uint8_t decimals;
+  char ticker[16];
+} bench_token_t;
+
+typedef struct {
+  uint8_t* image;
+  size_t len;
+  uint32_t version;
+  bench_token_t* tokens;
+  int token_count;
+} bench_db_t;
+
+static uint32_t g_chains[BENCH_CHAINS];
+static uint8_t* g_snapshot;
+static eth_db_stage_t g_stage;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static uint8_t* bench_entry(uint8_t* p, uint16_t magic, uint16_t len) {
+  fs_entry_t* entry = (fs_entry_t*) p;
+  entry->magic = magic;
+  entry->len = len;
+  return p + sizeof(fs_entry_t);
+}
+
+static uint8_t* bench_write_token(uint8_t* p, bench_token_t* token, int idx) {
+  token->nets = 1 + (bench_rand() % (((bench_rand() % 4) == 0) ? BENCH_MAX_NETS : 2));
+  token->decimals = 6 + (bench_rand() % 13);
+  snprintf(token->ticker, sizeof(token->ticker), "TK%d", idx);
+
+  size_t ticker_len = strlen(token->ticker) + 1;
+  uint8_t* data = bench_entry(p, FS_ERC20_MAGIC, 1 + (token->nets * BENCH_NET_LEN) + 1 + ticker_len);
+
+  *(data++) = token->nets;
+
+  for (int n = 0; n < token->nets; n++) {
+    memcpy(token->key[n], &g_chains[n], 4);
+
+    for (int j = 4; j < BENCH_NET_LEN; j++) {
+      token->key[n][j] = bench_rand();
+    }
+
+    memcpy(data, token->key[n], BENCH_NET_LEN);
+    data += BENCH_NET_LEN;
+  }
+
+  *(data++) = token->decimals;
+  memcpy(data, token->ticker, ticker_len);
+
+  return data + ticker_len;
+}
+
+// Signed full database in the same order as shell-db.py, with as many tokens as needed to reach the size
+static void bench_database(bench_db_t* db, size_t size, uint32_t version) {
+  size_t max_tokens = size / 64;
+  db->image = malloc(size + (2 * HAL_FLASH_BLOCK_SIZE));
+  db->tokens = malloc(sizeof(bench_token_t) * max_tokens);
+  db->token_count = 0;
+  db->version = version;
+
+  uint8_t* p = bench_entry(db->image, FS_VERSION_MAGIC, 4);
+  memcpy(p, &version, 4);
+  p += 4;
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    static const char chain_strings[] = "ETH\0Chain\0chain";
+    uint8_t* data = bench_entry(p, FS_CHAIN_MAGIC, 4 + sizeof(chain_strings));
+    memcpy(data, &g_chains[i], 4);
+    memcpy(&data[4], chain_strings, sizeof(chain_strings));
+    p = data + 4 + sizeof(chain_strings);
+  }
+
+  size_t abis_len = BENCH_ABIS * (sizeof(fs_entry_t) + BENCH_ABI_LEN);
+
+  while ((db->token_count < max_tokens) && (((p - db->image) + abis_len) < size)) {
+    p = bench_write_token(p, &db->tokens[db->token_count], db->token_count);
+    db->token_count++;
+  }
+
+  for (int i = 0; i < BENCH_ABIS; i++) {
+    uint8_t* data = bench_entry(p, FS_ABI_MAGIC, BENCH_ABI_LEN);
+
+    for (int j = 0; j < BENCH_ABI_LEN; j++) {
+      data[j] = bench_rand();
+    }
+
+    p = data + BENCH_ABI_LEN;
+  }
+
+  for (int i = 0; i < ETH_DB_SIG_LEN; i++) {
+    *(p++) = bench_rand();
+  }
+
+  db->len = p - db->image;
+}
+
+static void bench_database_free(bench_db_t* db) {
+  free(db->tokens);
+  free(db->image);
+}
+
+static bool bench_check(const bench_db_t* db) {
+  uint32_t version;
+
+  if ((eth_db_lookup_version(&version) != ERR_OK) || (version != db->version)) {
+    return false;
+  }
+
+  for (int i = 0; i < db->token_count; i++) {
+    const bench_token_t* token = &db->tokens[i];
+    erc20_desc_t erc20;
+    memcpy(&erc20.chain, token->key[token->nets - 1], 4);
+    erc20.addr = &token->key[token->nets - 1][4];
+
+    if ((eth_db_lookup_erc20(&erc20) != ERR_OK) || (erc20.decimals != token->decimals) || strcmp(erc20.ticker, token->ticker)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void bench_verify(const char* what, const bench_db_t* db) {
+  if (!bench_check(db)) {
+    fprintf(stderr, "%s: database %u is wrong\n", what, db->version);
+    exit(1);
+  }
+}
+
+static fs_action_t bench_match_staged(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_STAGE_MAGIC ? FS_ACCEPT : FS_REJECT;
+}
+
+static void bench_flash_reset() {
+  g_linux_flash_stats.erased_blocks = 0;
+  g_linux_flash_stats.programmed_bytes = 0;
+}
+
+// Receives the image as the updater does, one USB segment at a time
+static void bench_stream(const bench_db_t* db) {
+  if (eth_db_stage_begin(&g_stage, db->len, g_mem_heap) != ERR_OK) {
+    fprintf(stderr, "cannot stage %zu bytes\n", db->len);
+    exit(1);
+  }
+
+  for (size_t off = 0; off < db->len; off += BENCH_SEGMENT_LEN) {
+    if (eth_db_stage_write(&g_stage, &db->image[off], APP_MIN(BENCH_SEGMENT_LEN, (db->len - off))) != ERR_OK) {
+      fprintf(stderr, "cannot stage segment at %zu\n", off);
+      exit(1);
+    }
+  }
+}
+
+static void bench_report(const char* name, size_t len, uint64_t ns) {
+  printf("  %-24s %10.3fms %10.0f KB/s %7u erased %9zu programmed\n", name, ns / 1e6, (len / 1024.0) / (ns / 1e9),
+      g_linux_flash_stats.erased_blocks, g_linux_flash_stats.programmed_bytes);
+}
+
+// Returns false when staging is refused, after checking that the current database is still complete
+static bool bench_update(const bench_db_t* db, const bench_db_t* current) {
+  size_t db_len = db->len - ETH_DB_SIG_LEN;
+  printf("%zu KB database, %d tokens\n", db_len / 1024, db->token_count);
+
+  if (eth_db_stage_begin(&g_stage, db->len, g_mem_heap) == ERR_FULL) {
+    printf("  %-24s refused, the update does not fit next to its staged chunks\n", "staging");
+
+    if (current) {
+      bench_verify("refused update", current);
+    }
+
+    return false;
+  }
+
+  bench_flash_reset();
+  uint64_t start = bench_now_ns();
+  bench_stream(db);
+
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint8_t expected[SHA256_DIGEST_LENGTH];
+  uint32_t version;
+
+  if (eth_db_stage_finish(&g_stage, digest, &version) != ERR_OK) {
+    fprintf(stderr, "cannot finish staging\n");
+    exit(1);
+  }
+
+  uint64_t staged_ns = bench_now_ns() - start;
+  bench_report("staging", db->len, staged_ns);
+
+  sha256_Raw(db->image, db_len, expected);
+
+  if (memcmp(digest, expected, SHA256_DIGEST_LENGTH) || (version != db->version) ||
+      memcmp(g_stage.sig, &db->image[db_len], ETH_DB_SIG_LEN)) {
+    fprintf(stderr, "staged database does not match\n");
+    exit(1);
+  }
+
+  bench_flash_reset();
+  start = bench_now_ns();
+
+  if (eth_db_stage_activate(&g_stage) != ERR_OK) {
+    fprintf(stderr, "cannot activate staged database\n");
+    exit(1);
+  }
+
+  uint64_t activate_ns = bench_now_ns() - start;
+  bench_report("activation", db->len, activate_ns);
+  printf("  %-24s %10.3fms %10.0f KB/s\n", "staged total", (staged_ns + activate_ns) / 1e6,
+      (db->len / 1024.0) / ((staged_ns + activate_ns) / 1e9));
+
+  bench_verify("staged update", db);
+
+  if (fs_find(bench_match_staged, NULL)) {
+    fprintf(stderr, "staged entries left after activation\n");
+    exit(1);
+  }
+
+  return true;
+}
+
+static void bench_staged_update(const bench_db_t* db) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint32_t version;
+
+  bench_stream(db);
+
+  if ((eth_db_stage_finish(&g_stage, digest, &version) != ERR_OK) || (eth_db_stage_activate(&g_stage) != ERR_OK)) {
+    fprintf(stderr, "cannot apply staged database\n");
+    exit(1);
+  }
+}
+
+// Cuts power at the given flash operation of a staged update and boots again, returning the database found
+static const bench_db_t* bench_power_cut(const bench_db_t* old_db, const bench_db_t* new_db, uint32_t op) {
+  memcpy((void*) HAL_FLASH_ADDR, g_snapshot, HAL_FLASH_SIZE);
+  linux_flash_scan();
+  fs_init();
+  fflush(stdout);
+
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  } else if (pid == 0) {
+    g_linux_flash_stats.power_loss_at = g_linux_flash_stats.ops + op;
+    bench_staged_update(new_db);
+    _exit(0);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+
+  if (!WIFEXITED(status) || ((WEXITSTATUS(status) != 0) && (WEXITSTATUS(status) != LINUX_POWER_LOSS_EXIT))) {
+    fprintf(stderr, "power cut at operation %u: child failed\n", op);
+    exit(1);
+  }
+
+  fs_init();
+  eth_db_stage_resume();
+
+  if (fs_find(bench_match_staged, NULL)) {
+    fprintf(stderr, "power cut at operation %u: staged entries left after boot\n", op);
+    exit(1);
+  }
+
+  if (bench_check(new_db)) {
+    return new_db;
+  } else if (bench_check(old_db)) {
+    return old_db;
+  }
+
+  fprintf(stderr, "power cut at operation %u: neither database is complete\n", op);
+  exit(1);
+}
+
+// Half of the cuts fall while staging and half while activating, which takes far more flash operations
+static void bench_power_cuts(const bench_db_t* old_db, const bench_db_t* new_db, int cuts) {
+  memcpy(g_snapshot, (void*) HAL_FLASH_ADDR, HAL_FLASH_SIZE);
+
+  uint32_t ops = g_linux_flash_stats.ops;
+  bench_stream(new_db);
+  uint32_t staging_ops = g_linux_flash_stats.ops - ops;
+
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint32_t version;
+  eth_db_stage_finish(&g_stage, digest, &version);
+  eth_db_stage_activate(&g_stage);
+  uint32_t activation_ops = g_linux_flash_stats.ops - ops - staging_ops;
+  bench_verify("staged update", new_db);
+
+  int kept = 0;
+  int replaced = 0;
+
+  for (int i = 0; i < cuts; i++) {
+    uint32_t op;
+
+    if (i < (cuts / 2)) {
+      op = 1 + (((uint64_t) staging_ops * i) / (cuts / 2));
+    } else {
+      op = 1 + staging_ops + (((uint64_t) activation_ops * (i - (cuts / 2))) / (cuts - (cuts / 2)));
+    }
+
+    if (bench_power_cut(old_db, new_db, op) == old_db) {
+      kept++;
+    } else {
+      replaced++;
+    }
+  }
+
+  printf("%d power cuts over %u staging and %u activation flash operations: %d kept the old database, %d booted with the new one\n",
+      cuts, staging_ops, activation_ops, kept, replaced);
+}
+
+int main(int argc, char* argv[]) {
+  int sizes[BENCH_MAX_LIST] = { 64, 120, 256, 384 };
+  int size_count = 4;
+  int cuts = BENCH_DEFAULT_POWER_CUTS;
+  const char* flash_file = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:k:p:f:")) != -1) {
+    switch (opt) {
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'k':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    case 'p':
+      cuts = atoi(optarg);
+      break;
+    case 'f':
+      flash_file = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-k sizes_kb,...] [-p power_cuts] [-f flash_file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((size_count <= 0) || (cuts < 0)) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  for (int k = 0; k < size_count; k++) {
+    if ((sizes[k] <= 0) || ((sizes[k] * 1024) > BENCH_DB_MAX_LEN)) {
+      fprintf(stderr, "size must be between 1 and %d KB\n", BENCH_DB_MAX_LEN / 1024);
+      return 1;
+    }
+  }
+
+  char tmp_file[] = "/tmp/db-stream-bench-XXXXXX";
+
+  if (!flash_file) {
+    int fd = mkstemp(tmp_file);
+
+    if (fd < 0) {
+      perror("mkstemp");
+      return 1;
+    }
+
+    close(fd);
+    flash_file = tmp_file;
+  }
+
+  // the staging calls must survive the process like the flash of the device does, so it is always a file
+  setenv(HAL_LINUX_ENV_FLASH, flash_file, 1);
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  fs_init();
+  fs_set_mode(FS_MODE_LOG);
+
+  if (eth_db_stage_resume() != ERR_OK) {
+    fprintf(stderr, "staged update left in %s could not be applied\n", flash_file);
+  }
+
+  g_snapshot = malloc(HAL_FLASH_SIZE);
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    g_chains[i] = (i == 0) ? 1 : (1 + (bench_rand() % 100000));
+  }
+
+  bench_db_t old_db;
+  bench_database(&old_db, sizes[0] * 1024, 20250101);
+
+  bench_db_t dbs[BENCH_MAX_LIST];
+  const bench_db_t* current = NULL;
+
+  for (int k = 0; k < size_count; k++) {
+    bench_database(&dbs[k], sizes[k] * 1024, 20250102 + k);
+
+    if (bench_update(&dbs[k], current)) {
+      current = &dbs[k];
+    }
+  }
+
+  if (cuts) {
+    bench_db_t new_db;
+    bench_database(&new_db, sizes[0] * 1024, 20250100);
+
+    if (!bench_update(&old_db, current)) {
+      fprintf(stderr, "cannot stage the %d KB database\n", sizes[0]);
+      return 1;
+    }
+
+    bench_power_cuts(&old_db, &new_db, cuts);
+    bench_database_free(&new_db);
+  }
+
+  for (int k = 0; k < size_count; k++) {
+    bench_database_free(&dbs[k]);
+  }
+
+  bench_database_free(&old_db);
+  free(g_snapshot);
+
+  if (flash_file == tmp_file) {
+    unlink(tmp_file);
+  }
+
+  return 0;
+}
@@ -0,0 +1,361 @@
+/*
+ * Ethereum database updates: applies the same new database as a full rewrite
+ * and as a delta, both starting from the same flash contents, and compares
+ * the bytes to transfer, the flash pages erased, the bytes programmed and
+ * the time taken.
+ *
+ * Usage: db-update-bench [-s seed] [-t tokens] [-c change_percent,...]
+ *
+ * The databases use the single entry layout. The changed share of the tokens
+ * is split among removed, modified and added tokens, and one ABI is replaced.
+ * Every token is looked up after each update to check it.
+ *
+ * Both go through the staging calls used by the updater, so the pages
+ * erased and the bytes programmed include the staged chunks. Erasing and
+ * programming the host flash are memory copies, so the time only shows the
+ * processing cost. On the device the erased pages dominate it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "db_stage.h"
+#include "linux_internal.h"
+#include "ethereum/eth_db.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_TOKENS 1000
+#define BENCH_MAX_LIST 16
+#define BENCH_CHAINS 13
+#define BENCH_ABIS 64
+#define BENCH_MAX_NETS 8
+#define BENCH_NET_LEN 24
+#define BENCH_ABI_LEN 48
+#define BENCH_DELTA_MAGIC 0x444c
+#define BENCH_DB_MAX_LEN (HAL_FLASH_DATA_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)
+
+typedef struct {
+  uint8_t nets;
+  uint8_t key[BENCH_MAX_NETS][BENCH_NET_LEN];
+  uint8_t decimals;
+  uint8_t changed;
+  char ticker[12];
+} bench_token_t;
+
+typedef struct {
+  const char* name;
+  size_t len;
+  uint32_t erased;
+  size_t programmed;
+  uint64_t ns;
+} bench_update_t;
+
+static uint32_t g_chains[BENCH_CHAINS];
+static uint8_t g_abis[BENCH_ABIS + 1][BENCH_ABI_LEN];
+static bench_token_t* g_tokens;
+static int g_token_count;
+static uint8_t* g_full;
+static uint8_t* g_delta;
+static uint8_t* g_snapshot;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_token(bench_token_t* token, int idx) {
+  token->nets = 1 + (bench_rand() % (((bench_rand() % 4) == 0) ? BENCH_MAX_NETS : 2));
+  token->decimals = 6 + (bench_rand() % 13);
+  token->changed = 0;
+  snprintf(token->ticker, sizeof(token->ticker), "TK%d", idx);
+
+  for (int n = 0; n < token->nets; n++) {
+    memcpy(token->key[n], &g_chains[n], 4);
+
+    for (int j = 4; j < BENCH_NET_LEN; j++) {
+      token->key[n][j] = bench_rand();
+    }
+  }
+}
+
+static uint8_t* bench_entry(uint8_t* p, uint16_t magic, uint16_t len) {
+  fs_entry_t* entry = (fs_entry_t*) p;
+  entry->magic = magic;
+  entry->len = len;
+  return p + sizeof(fs_entry_t);
+}
+
+static uint8_t* bench_version(uint8_t* p, uint32_t version) {
+  uint8_t* data = bench_entry(p, FS_VERSION_MAGIC, 4);
+  memcpy(data, &version, 4);
+  return data + 4;
+}
+
+static uint8_t* bench_write_token(uint8_t* p, const bench_token_t* token) {
+  size_t ticker_len = strlen(token->ticker) + 1;
+  uint8_t* data = bench_entry(p, FS_ERC20_MAGIC, 1 + (token->nets * BENCH_NET_LEN) + 1 + ticker_len);
+
+  *(data++) = token->nets;
+
+  for (int n = 0; n < token->nets; n++) {
+    memcpy(data, token->key[n], BENCH_NET_LEN);
+    data += BENCH_NET_LEN;
+  }
+
+  *(data++) = token->decimals;
+  memcpy(data, token->ticker, ticker_len);
+
+  return data + ticker_len;
+}
+
+static uint8_t* bench_write_abi(uint8_t* p, const uint8_t* abi) {
+  uint8_t* data = bench_entry(p, FS_ABI_MAGIC, BENCH_ABI_LEN);
+  memcpy(data, abi, BENCH_ABI_LEN);
+  return data + BENCH_ABI_LEN;
+}
+
+// Full database in the same order as shell-db.py
+static size_t bench_full(uint32_t version, int first_abi) {
+  uint8_t* p = bench_version(g_full, version);
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    static const char chain_strings[] = "ETH\0Chain\0chain";
+    uint8_t* data = bench_entry(p, FS_CHAIN_MAGIC, 4 + sizeof(chain_strings));
+    memcpy(data, &g_chains[i], 4);
+    memcpy(&data[4], chain_strings, sizeof(chain_strings));
+    p = data + 4 + sizeof(chain_strings);
+  }
+
+  for (int i = 0; i < g_token_count; i++) {
+    if (g_tokens[i].nets) {
+      p = bench_write_token(p, &g_tokens[i]);
+    }
+  }
+
+  for (int i = first_abi; i < (first_abi + BENCH_ABIS); i++) {
+    p = bench_write_abi(p, g_abis[i]);
+  }
+
+  return p - g_full;
+}
+
+// Changes the tokens and the last ABI, writing the delta from the previous database to the new one
+static size_t bench_change(int percent, uint32_t old_version) {
+  int changes = (g_token_count * percent) / 300;
+  int base_count = g_token_count;
+  uint8_t tickers[4096];
+  size_t tickers_len = 0;
+  uint8_t* entries = &g_delta[BENCH_DB_MAX_LEN / 2];
+  uint8_t* p = bench_version(entries, old_version + 1);
+
+  for (int i = 0; i < (changes * 2); i++) {
+    bench_token_t* token = &g_tokens[bench_rand() % base_count];
+
+    if (token->changed || ((tickers_len + sizeof(token->ticker)) > sizeof(tickers))) {
+      continue;
+    }
+
+    token->changed = 1;
+
+    size_t ticker_len = strlen(token->ticker) + 1;
+    memcpy(&tickers[tickers_len], token->ticker, ticker_len);
+    tickers_len += ticker_len;
+
+    if (i < changes) {
+      token->nets = 0;
+    } else {
+      token->decimals++;
+      p = bench_write_token(p, token);
+    }
+  }
+
+  for (int i = 0; i < changes; i++) {
+    bench_token_t* token = &g_tokens[g_token_count];
+    bench_token(token, g_token_count++);
+    p = bench_write_token(p, token);
+  }
+
+  for (int j = 0; j < BENCH_ABI_LEN; j++) {
+    g_abis[BENCH_ABIS][j] = bench_rand();
+  }
+
+  p = bench_write_abi(p, g_abis[BENCH_ABIS]);
+
+  size_t entries_len = p - entries;
+  uint16_t header[6] = { BENCH_DELTA_MAGIC, old_version & 0xffff, old_version >> 16, 0, tickers_len, 8 };
+  memcpy(g_delta, header, sizeof(header));
+  p = &g_delta[sizeof(header)];
+  memcpy(p, tickers, tickers_len);
+  p += tickers_len;
+  memcpy(p, g_abis[0], 8);
+  p += 8;
+  memmove(p, entries, entries_len);
+
+  return (p + entries_len) - g_delta;
+}
+
+static void bench_flash_save() {
+  memcpy(g_snapshot, (void*) HAL_FLASH_ADDR, HAL_FLASH_SIZE);
+}
+
+static void bench_flash_restore() {
+  memcpy((void*) HAL_FLASH_ADDR, g_snapshot, HAL_FLASH_SIZE);
+  linux_flash_scan();
+  fs_init();
+}
+
+static void bench_verify(const char* what, uint32_t version) {
+  uint32_t db_version;
+
+  if ((eth_db_lookup_version(&db_version) != ERR_OK) || (db_version != version)) {
+    fprintf(stderr, "%s: wrong version\n", what);
+    exit(1);
+  }
+
+  for (int i = 0; i < g_token_count; i++) {
+    const bench_token_t* token = &g_tokens[i];
+    erc20_desc_t erc20;
+    memcpy(&erc20.chain, token->key[0], 4);
+    erc20.addr = &token->key[0][4];
+
+    app_err_t err = eth_db_lookup_erc20(&erc20);
+
+    if (token->nets ? ((err != ERR_OK) || (erc20.decimals != token->decimals) || strcmp(erc20.ticker, token->ticker)) : (err == ERR_OK)) {
+      fprintf(stderr, "%s: token %d is wrong\n", what, i);
+      exit(1);
+    }
+  }
+}
+
+static void bench_apply(bench_update_t* update, uint8_t* data, size_t len, uint32_t version) {
+  update->len = len;
+  g_linux_flash_stats.erased_blocks = 0;
+  g_linux_flash_stats.programmed_bytes = 0;
+
+  uint64_t start = bench_now_ns();
+  app_err_t err = bench_db_update(data, len);
+  update->ns = bench_now_ns() - start;
+
+  if (err != ERR_OK) {
+    fprintf(stderr, "%s update failed with %d\n", update->name, err);
+    exit(1);
+  }
+
+  update->erased = g_linux_flash_stats.erased_blocks;
+  update->programmed = g_linux_flash_stats.programmed_bytes;
+  bench_verify(update->name, version);
+}
+
+static void bench_report(int percent, const bench_update_t* update, const bench_update_t* full) {
+  printf("%6d%% %-6s %9zu %7u %11zu %10.3fms", percent, update->name, update->len, update->erased, update->programmed, update->ns / 1e6);
+
+  if (update != full) {
+    printf("   %.1fx fewer bytes, %.1fx fewer erases, %.1fx fewer bytes programmed", full->len / (double) update->len,
+        full->erased / (double) APP_MAX(update->erased, 1), full->programmed / (double) APP_MAX(update->programmed, 1));
+  }
+
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  int tokens = BENCH_DEFAULT_TOKENS;
+  int changes[BENCH_MAX_LIST] = { 1, 5, 20 };
+  int change_count = 3;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:t:c:")) != -1) {
+    switch (opt) {
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 't':
+      tokens = atoi(optarg);
+      break;
+    case 'c':
+      change_count = bench_parse_list(optarg, changes);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-t tokens] [-c change_percent,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (tokens <= 0) {
+    fprintf(stderr, "invalid token count\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  fs_init();
+
+  g_full = malloc(BENCH_DB_MAX_LEN);
+  g_delta = malloc(BENCH_DB_MAX_LEN);
+  g_snapshot = malloc(HAL_FLASH_SIZE);
+  g_tokens = malloc(sizeof(bench_token_t) * tokens * 2);
+
+  printf("%7s %-6s %9s %7s %11s %12s\n", "change", "update", "bytes", "erased", "programmed", "time");
+
+  for (int c = 0; c < change_count; c++) {
+    if ((changes[c] < 0) || (changes[c] > 100)) {
+      fprintf(stderr, "change must be between 0 and 100%%\n");
+      return 1;
+    }
+
+    for (int i = 0; i < BENCH_CHAINS; i++) {
+      g_chains[i] = (i == 0) ? 1 : (1 + (bench_rand() % 100000));
+    }
+
+    for (int i = 0; i <= BENCH_ABIS; i++) {
+      for (int j = 0; j < BENCH_ABI_LEN; j++) {
+        g_abis[i][j] = bench_rand();
+      }
+    }
+
+    g_token_count = 0;
+
+    for (int i = 0; i < tokens; i++) {
+      bench_token(&g_tokens[g_token_count], g_token_count);
+      g_token_count++;
+    }
+
+    uint32_t version = 20250101 + c;
+
+    if (bench_db_update(g_full, bench_full(version, 0)) != ERR_OK) {
+      fprintf(stderr, "the database does not fit\n");
+      return 1;
+    }
+
+    bench_flash_save();
+
+    size_t delta_len = bench_change(changes[c], version);
+    size_t full_len = bench_full(version + 1, 1);
+
+    bench_update_t full = { .name = "full" };
+    bench_update_t delta = { .name = "delta" };
+
+    bench_apply(&full, g_full, full_len, version + 1);
+    bench_flash_restore();
+    bench_apply(&delta, g_delta, delta_len, version + 1);
+
+    bench_report(changes[c], &full, &full);
+    bench_report(changes[c], &delta, &full);
+  }
+
+  free(g_tokens);
+  free(g_snapshot);
+  free(g_delta);
+  free(g_full);
+
+  return 0;
+}
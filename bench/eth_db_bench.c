@@ -0,0 +1,547 @@
+/*
+ * Lookup latency of the Ethereum database against its size, with the v1
+ * layout (one entry per chain, token and ABI) and the v2 layout (sorted key
+ * tables searched in place), both staged and activated as the updater does.
+ *
+ * Usage: eth-db-bench [-n lookups] [-s seed] [-t tokens,...]
+ *
+ * The v2 layout is also written with the Bloom filters over token and ABI
+ * keys, which answer most lookups of missing tokens without searching.
+ *
+ * The databases are synthetic and shaped like the one shell-db.py builds from
+ * the bundled token list. Every lookup is checked against the generated data.
+ * The lookup cache is flushed before each of them, so that the layouts are
+ * compared. Confirmation flows, which look the chain up again each time its
+ * page is shown, are then timed on the v2 layout with and without the cache.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "db_stage.h"
+#include "linux_internal.h"
+#include "crypto/sha2.h"
+#include "ethereum/eth_db.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_LOOKUPS 20000
+#define BENCH_MAX_LIST 16
+#define BENCH_CHAINS 13
+#define BENCH_MAX_NETS 8
+#define BENCH_NET_LEN 24
+#define BENCH_ABI_KEY_LEN 8
+#define BENCH_TICKER_LEN 8
+#define BENCH_TABLE_MAX_LEN (HAL_FLASH_BLOCK_SIZE / 4)
+#define BENCH_TABLE_SPLIT_LEN (BENCH_TABLE_MAX_LEN / 2)
+#define BENCH_DB_MAX_LEN (HAL_FLASH_DATA_BLOCK_COUNT * HAL_FLASH_BLOCK_SIZE)
+#define BENCH_FLOW_PAGE_VISITS 4
+#define BENCH_FILTER_BITS_PER_KEY 10
+#define BENCH_FILTER_MAX_LEN (FS_PAGE_DATA_SIZE - sizeof(fs_entry_t) - 8)
+
+typedef struct {
+  uint8_t key[BENCH_NET_LEN];
+  uint8_t decimals;
+  char ticker[BENCH_TICKER_LEN];
+} bench_token_t;
+
+typedef struct {
+  uint8_t key[BENCH_NET_LEN];
+  const uint8_t* record;
+  uint16_t record_len;
+} bench_row_t;
+
+static uint32_t g_chains[BENCH_CHAINS];
+static bench_token_t* g_tokens;
+static int g_token_count;
+static uint8_t (*g_abis)[BENCH_ABI_KEY_LEN];
+static int g_abi_count;
+static uint8_t* g_db;
+static size_t g_db_len;
+static int g_table_key_len;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static uint8_t* bench_entry(uint16_t magic, uint16_t len) {
+  fs_entry_t* entry = (fs_entry_t*) &g_db[g_db_len];
+  entry->magic = magic;
+  entry->len = len;
+  g_db_len += sizeof(fs_entry_t) + len;
+  return FS_ENTRY_DATA(uint8_t*, entry);
+}
+
+static size_t bench_chain_record(uint8_t* out) {
+  static const char chain_strings[] = "ETH\0Chain\0chain";
+  memcpy(out, chain_strings, sizeof(chain_strings));
+  return sizeof(chain_strings);
+}
+
+static size_t bench_token_record(const bench_token_t* token, uint8_t* out) {
+  size_t len = strlen(token->ticker) + 1;
+  out[0] = token->decimals;
+  memcpy(&out[1], token->ticker, len);
+  return len + 1;
+}
+
+static void bench_generate(int tokens) {
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    g_chains[i] = (i == 0) ? 1 : (1 + (bench_rand() % 100000));
+  }
+
+  g_token_count = 0;
+
+  for (int i = 0; i < tokens; i++) {
+    int nets = 1 + (bench_rand() % (((bench_rand() % 4) == 0) ? BENCH_MAX_NETS : 2));
+    int ticker_len = 3 + (bench_rand() % (BENCH_TICKER_LEN - 4));
+    bench_token_t token;
+
+    token.decimals = 6 + (bench_rand() % 13);
+
+    for (int j = 0; j < ticker_len; j++) {
+      token.ticker[j] = 'A' + (bench_rand() % 26);
+    }
+
+    token.ticker[ticker_len] = '\0';
+
+    for (int n = 0; n < nets; n++) {
+      memcpy(token.key, &g_chains[n], 4);
+
+      for (int j = 4; j < BENCH_NET_LEN; j++) {
+        token.key[j] = bench_rand();
+      }
+
+      g_tokens[g_token_count++] = token;
+    }
+  }
+
+  g_abi_count = tokens / 4;
+
+  for (int i = 0; i < g_abi_count; i++) {
+    for (int j = 0; j < BENCH_ABI_KEY_LEN; j++) {
+      g_abis[i][j] = bench_rand();
+    }
+  }
+}
+
+static void bench_version() {
+  uint32_t version = 20250101;
+  memcpy(bench_entry(FS_VERSION_MAGIC, 4), &version, 4);
+}
+
+static size_t bench_abi_record(const uint8_t* key, uint8_t* out) {
+  static const uint8_t header[] = { 13, 0, 0, 0, 0 };
+  memcpy(out, key, BENCH_ABI_KEY_LEN);
+  memcpy(&out[BENCH_ABI_KEY_LEN], header, sizeof(header));
+  memcpy(&out[BENCH_ABI_KEY_LEN + sizeof(header)], "f", 2);
+  return BENCH_ABI_KEY_LEN + sizeof(header) + 2;
+}
+
+static void bench_build_v1() {
+  g_db_len = 0;
+  bench_version();
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    uint8_t record[64];
+    size_t len = bench_chain_record(record);
+    uint8_t* data = bench_entry(FS_CHAIN_MAGIC, 4 + len);
+    memcpy(data, &g_chains[i], 4);
+    memcpy(&data[4], record, len);
+  }
+
+  for (int i = 0; i < g_token_count;) {
+    int nets = 1;
+
+    while (((i + nets) < g_token_count) && !strcmp(g_tokens[i + nets].ticker, g_tokens[i].ticker) && (nets < BENCH_MAX_NETS)) {
+      nets++;
+    }
+
+    uint8_t record[BENCH_TICKER_LEN + 1];
+    size_t len = bench_token_record(&g_tokens[i], record);
+    uint8_t* data = bench_entry(FS_ERC20_MAGIC, 1 + (nets * BENCH_NET_LEN) + len);
+    *(data++) = nets;
+
+    for (int n = 0; n < nets; n++) {
+      memcpy(data, g_tokens[i + n].key, BENCH_NET_LEN);
+      data += BENCH_NET_LEN;
+    }
+
+    memcpy(data, record, len);
+    i += nets;
+  }
+
+  for (int i = 0; i < g_abi_count; i++) {
+    uint8_t record[64];
+    size_t len = bench_abi_record(g_abis[i], record);
+    memcpy(bench_entry(FS_ABI_MAGIC, len), record, len);
+  }
+}
+
+static int bench_row_cmp(const void* a, const void* b) {
+  return memcmp(((const bench_row_t*) a)->key, ((const bench_row_t*) b)->key, g_table_key_len);
+}
+
+static bool bench_table_boundary(const bench_row_t* row, int row_len) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  sha256_Raw(row->key, g_table_key_len, digest);
+  uint32_t h = digest[0] | (digest[1] << 8) | (digest[2] << 16) | ((uint32_t) digest[3] << 24);
+  return (h % BENCH_TABLE_SPLIT_LEN) < (uint32_t) (row_len + row->record_len);
+}
+
+// Same packing as serialize_table() in shell-db.py, without sharing identical records
+static void bench_tables(uint16_t magic, bench_row_t* rows, int count, int key_len) {
+  g_table_key_len = key_len;
+  qsort(rows, count, sizeof(bench_row_t), bench_row_cmp);
+
+  int row_len = key_len + 2;
+  int i = 0;
+
+  while (i < count) {
+    int n = 0;
+    size_t records_len = 0;
+
+    while (((i + n) < count) && ((n == 0) || ((3 + ((n + 1) * row_len) + records_len + rows[i + n].record_len) <= BENCH_TABLE_MAX_LEN))) {
+      records_len += rows[i + n].record_len;
+
+      if (bench_table_boundary(&rows[i + n++], row_len)) {
+        break;
+      }
+    }
+
+    size_t rows_len = n * row_len;
+    uint8_t* data = bench_entry(magic, 3 + rows_len + records_len);
+    uint16_t off = rows_len;
+
+    data[0] = n & 0xff;
+    data[1] = n >> 8;
+    data[2] = key_len;
+    data += 3;
+
+    for (int j = 0; j < n; j++) {
+      memcpy(&data[j * row_len], rows[i + j].key, key_len);
+      data[(j * row_len) + key_len] = off & 0xff;
+      data[(j * row_len) + key_len + 1] = off >> 8;
+      memcpy(&data[off], rows[i + j].record, rows[i + j].record_len);
+      off += rows[i + j].record_len;
+    }
+
+    i += n;
+  }
+}
+
+static uint32_t bench_filter_hash(uint32_t hash, const uint8_t* key, size_t len) {
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ key[i]) * 0x01000193;
+  }
+
+  return hash;
+}
+
+// Same filter as serialize_filter() in shell-db.py
+static void bench_filter(uint16_t section, const bench_row_t* rows, int count, int key_len) {
+  size_t bits_len = APP_MIN(APP_MAX((count * BENCH_FILTER_BITS_PER_KEY + 7) / 8, 8), BENCH_FILTER_MAX_LEN);
+  uint32_t m = bits_len * 8;
+  int hashes = APP_MAX(1, APP_MIN(16, (int) lround(((double) m / count) * M_LN2)));
+  uint32_t version = 20250101;
+
+  uint8_t* data = bench_entry(FS_FILTER_MAGIC, 8 + bits_len);
+  memcpy(data, &section, 2);
+  data[2] = hashes;
+  data[3] = 0;
+  memcpy(&data[4], &version, 4);
+  uint8_t* bits = &data[8];
+  memset(bits, 0, bits_len);
+
+  for (int i = 0; i < count; i++) {
+    uint32_t h = bench_filter_hash(0x811c9dc5, rows[i].key, key_len);
+    uint32_t step = bench_filter_hash(0x050c5d1f, rows[i].key, key_len) | 1;
+
+    for (int j = 0; j < hashes; j++) {
+      uint32_t bit = h % m;
+      bits[bit >> 3] |= 1 << (bit & 7);
+      h += step;
+    }
+  }
+}
+
+static void bench_build_v2(bool filters) {
+  int max_rows = APP_MAX(g_token_count, APP_MAX(g_abi_count, BENCH_CHAINS));
+  bench_row_t* rows = malloc(sizeof(bench_row_t) * max_rows);
+  uint8_t* records = malloc(max_rows * 64);
+
+  g_db_len = 0;
+  bench_version();
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    memcpy(rows[i].key, &g_chains[i], 4);
+    rows[i].record = &records[i * 64];
+    rows[i].record_len = bench_chain_record(&records[i * 64]);
+  }
+
+  bench_tables(FS_CHAIN_TABLE_MAGIC, rows, BENCH_CHAINS, 4);
+
+  for (int i = 0; i < g_token_count; i++) {
+    memcpy(rows[i].key, g_tokens[i].key, BENCH_NET_LEN);
+    rows[i].record = &records[i * 64];
+    rows[i].record_len = bench_token_record(&g_tokens[i], &records[i * 64]);
+  }
+
+  bench_tables(FS_ERC20_TABLE_MAGIC, rows, g_token_count, BENCH_NET_LEN);
+
+  if (filters) {
+    bench_filter(FS_ERC20_TABLE_MAGIC, rows, g_token_count, BENCH_NET_LEN);
+  }
+
+  for (int i = 0; i < g_abi_count; i++) {
+    memcpy(rows[i].key, g_abis[i], BENCH_ABI_KEY_LEN);
+    rows[i].record = &records[i * 64];
+    rows[i].record_len = bench_abi_record(g_abis[i], &records[i * 64]);
+  }
+
+  bench_tables(FS_ABI_TABLE_MAGIC, rows, g_abi_count, BENCH_ABI_KEY_LEN);
+
+  if (filters) {
+    bench_filter(FS_ABI_TABLE_MAGIC, rows, g_abi_count, 4);
+  }
+
+  free(records);
+  free(rows);
+}
+
+static bool bench_match_abi(void* ctx, const uint8_t* func) {
+  return !memcmp(&func[4], ctx, 4);
+}
+
+static void bench_fail(const char* what, int idx) {
+  fprintf(stderr, "%s lookup %d returned wrong data\n", what, idx);
+  exit(1);
+}
+
+static void bench_lookups(int lookups, bench_stats_t* stats) {
+  for (int i = 0; i < lookups; i++) {
+    const bench_token_t* token = &g_tokens[bench_rand() % g_token_count];
+    uint8_t addr[20];
+    memcpy(addr, &token->key[4], 20);
+
+    erc20_desc_t erc20;
+    memcpy(&erc20.chain, token->key, 4);
+    erc20.addr = addr;
+
+    eth_db_cache_flush();
+    uint64_t start = bench_now_ns();
+    app_err_t err = eth_db_lookup_erc20(&erc20);
+    bench_stats_add(&stats[0], bench_now_ns() - start);
+
+    if ((err != ERR_OK) || (erc20.decimals != token->decimals) || strcmp(erc20.ticker, token->ticker)) {
+      bench_fail("token", i);
+    }
+
+    addr[19] ^= 0x5a;
+    eth_db_cache_flush();
+    start = bench_now_ns();
+    err = eth_db_lookup_erc20(&erc20);
+    bench_stats_add(&stats[1], bench_now_ns() - start);
+
+    if (err == ERR_OK) {
+      bench_fail("missing token", i);
+    }
+
+    chain_desc_t chain = { .chain_id = g_chains[bench_rand() % BENCH_CHAINS] };
+    eth_db_cache_flush();
+    start = bench_now_ns();
+    err = eth_db_lookup_chain(&chain);
+    bench_stats_add(&stats[2], bench_now_ns() - start);
+
+    if ((err != ERR_OK) || strcmp(chain.short_name, "chain")) {
+      bench_fail("chain", i);
+    }
+
+    const uint8_t* key = g_abis[bench_rand() % g_abi_count];
+    uint32_t selector;
+    memcpy(&selector, key, 4);
+    start = bench_now_ns();
+    const uint8_t* func = eth_db_lookup_abi(selector, NULL, bench_match_abi, (void*) &key[4]);
+    bench_stats_add(&stats[3], bench_now_ns() - start);
+
+    if (!func || memcmp(func, key, BENCH_ABI_KEY_LEN)) {
+      bench_fail("ABI", i);
+    }
+  }
+}
+
+// A flow looks up the chain and token of a transaction when extracting it, then the chain each time its page is shown
+static void bench_flows(int flows, bool cached, bench_stats_t* stats) {
+  for (int i = 0; i < flows; i++) {
+    const bench_token_t* token = &g_tokens[bench_rand() % g_token_count];
+    chain_desc_t chain;
+    memcpy(&chain.chain_id, token->key, 4);
+
+    erc20_desc_t erc20 = { .chain = chain.chain_id, .addr = &token->key[4] };
+
+    uint64_t start = bench_now_ns();
+
+    for (int v = 0; v <= BENCH_FLOW_PAGE_VISITS; v++) {
+      if (!cached) {
+        eth_db_cache_flush();
+      }
+
+      if (eth_db_lookup_chain(&chain) != ERR_OK) {
+        bench_fail("flow chain", i);
+      }
+
+      if (v > 0) {
+        continue;
+      }
+
+      if (!cached) {
+        eth_db_cache_flush();
+      }
+
+      if ((eth_db_lookup_erc20(&erc20) != ERR_OK) || strcmp(erc20.ticker, token->ticker)) {
+        bench_fail("flow token", i);
+      }
+    }
+
+    bench_stats_add(stats, bench_now_ns() - start);
+  }
+}
+
+static double bench_mean_us(bench_stats_t* stats) {
+  return (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+  int lookups = BENCH_DEFAULT_LOOKUPS;
+  int sizes[BENCH_MAX_LIST] = { 100, 250, 1000, 2500 };
+  int size_count = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:t:")) != -1) {
+    switch (opt) {
+    case 'n':
+      lookups = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 't':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n lookups] [-s seed] [-t tokens,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (lookups <= 0) {
+    fprintf(stderr, "invalid lookup count\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  fs_init();
+  g_db = malloc(BENCH_DB_MAX_LEN);
+
+  static const char* const names[] = { "token", "missing token", "chain", "ABI" };
+  double flow_us[BENCH_MAX_LIST][2];
+  eth_db_cache_stats_t cache_stats[BENCH_MAX_LIST];
+  eth_db_cache_stats_t cache_base;
+
+  printf("%6s %7s %6s %9s | %-22s | %-22s | %-22s | %-22s\n", "tokens", "keys", "layout", "db bytes", names[0], names[1], names[2], names[3]);
+
+  for (int s = 0; s < size_count; s++) {
+    if (sizes[s] < 4) {
+      fprintf(stderr, "at least 4 tokens are needed\n");
+      return 1;
+    }
+
+    g_tokens = malloc(sizeof(bench_token_t) * sizes[s] * BENCH_MAX_NETS);
+    g_abis = malloc(BENCH_ABI_KEY_LEN * sizes[s]);
+    bench_generate(sizes[s]);
+
+    double v1_us[4];
+
+    static const char* const layouts[] = { "v1", "v2", "v2+bf" };
+
+    for (int layout = 1; layout <= 3; layout++) {
+      if (layout == 1) {
+        bench_build_v1();
+      } else {
+        bench_build_v2(layout == 3);
+      }
+
+      if (bench_db_update(g_db, g_db_len) != ERR_OK) {
+        fprintf(stderr, "database of %zu bytes does not fit\n", g_db_len);
+        return 1;
+      }
+
+      bench_stats_t stats[4];
+
+      for (int i = 0; i < 4; i++) {
+        bench_stats_init(&stats[i], names[i]);
+      }
+
+      bench_lookups(lookups, stats);
+
+      printf("%6d %7d %6s %9zu", sizes[s], g_token_count, layouts[layout - 1], g_db_len);
+
+      for (int i = 0; i < 4; i++) {
+        double us = bench_mean_us(&stats[i]);
+
+        if (layout == 1) {
+          v1_us[i] = us;
+          printf(" | %8.2fus             ", us);
+        } else {
+          printf(" | %8.2fus (%5.1fx)    ", us, v1_us[i] / us);
+        }
+
+        bench_stats_free(&stats[i]);
+      }
+
+      printf("\n");
+    }
+
+    // the v2 database with filters is still in flash
+    for (int cached = 0; cached <= 1; cached++) {
+      bench_stats_t flow;
+      bench_stats_init(&flow, "flow");
+      eth_db_cache_flush();
+      eth_db_get_cache_stats(&cache_base);
+      bench_flows(APP_MAX(lookups / (BENCH_FLOW_PAGE_VISITS + 2), 1), cached, &flow);
+      flow_us[s][cached] = bench_mean_us(&flow);
+      eth_db_get_cache_stats(&cache_stats[s]);
+      bench_stats_free(&flow);
+    }
+
+    cache_stats[s].hits -= cache_base.hits;
+    cache_stats[s].misses -= cache_base.misses;
+
+    free(g_abis);
+    free(g_tokens);
+  }
+
+  printf("\nconfirmation flows, %d chain and 1 token lookups each\n", BENCH_FLOW_PAGE_VISITS + 1);
+  printf("%6s | %-10s | %-18s | %s\n", "tokens", "uncached", "cached", "hit rate");
+
+  for (int s = 0; s < size_count; s++) {
+    uint32_t total = cache_stats[s].hits + cache_stats[s].misses;
+    printf("%6d | %8.2fus | %8.2fus (%5.1fx) | %5.1f%%\n", sizes[s], flow_us[s][0], flow_us[s][1], flow_us[s][0] / flow_us[s][1],
+        (100.0 * cache_stats[s].hits) / APP_MAX(total, 1));
+  }
+
+  free(g_db);
+  return 0;
+}
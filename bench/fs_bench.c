@@ -0,0 +1,320 @@
+/*
+ * Lookups in the flash filesystem through the RAM index against the linear
+ * scan, on a synthetic database shaped like the one built by shell-db.py
+ * from the bundled token list.
+ *
+ * Usage: fs-bench [-n rounds] [-s seed] [-t tokens] [-a abis]
+ *
+ * Only chain and ABI lookups are timed, tokens are not indexed. After the
+ * full database write it erases part of the tokens, appends new ones and
+ * erases single entries, checking after each step that every key resolves
+ * to the same entry with and without the index.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_ROUNDS 20
+#define BENCH_DEFAULT_TOKENS 250
+#define BENCH_DEFAULT_ABIS 64
+#define BENCH_CHAINS 13
+#define BENCH_MAX_NETS 8
+#define BENCH_NET_LEN 24
+#define BENCH_DB_LEN (256 * 1024)
+
+typedef struct {
+  uint32_t chain_id;
+  uint8_t addr[20];
+} bench_token_key_t;
+
+typedef struct {
+  uint16_t magic;
+  const uint8_t* key;
+  size_t key_len;
+} bench_match_ctx_t;
+
+static uint32_t g_chains[BENCH_CHAINS];
+static bench_token_key_t* g_token_keys;
+static int g_token_key_count;
+static uint32_t* g_abi_keys;
+static int g_abi_key_count;
+
+static fs_action_t bench_match(void* ctx, fs_entry_t* entry) {
+  bench_match_ctx_t* match = (bench_match_ctx_t*) ctx;
+
+  if (entry->magic != match->magic) {
+    return FS_REJECT;
+  }
+
+  uint8_t* data = FS_ENTRY_DATA(uint8_t*, entry);
+
+  if (entry->magic != FS_ERC20_MAGIC) {
+    return memcmp(data, match->key, match->key_len) ? FS_REJECT : FS_ACCEPT;
+  }
+
+  for (int i = 0; i < data[0]; i++) {
+    if (!memcmp(&data[1 + (i * BENCH_NET_LEN)], match->key, BENCH_NET_LEN)) {
+      return FS_ACCEPT;
+    }
+  }
+
+  return FS_REJECT;
+}
+
+static fs_action_t bench_match_erase(void* ctx, fs_entry_t* entry) {
+  int* keep = (int*) ctx;
+  return ((entry->magic == FS_ERC20_MAGIC) && ((bench_rand() % 100) >= *keep)) ? FS_REJECT : FS_ACCEPT;
+}
+
+static uint8_t* bench_entry(uint8_t* p, uint16_t magic, uint16_t len) {
+  fs_entry_t* entry = (fs_entry_t*) p;
+  entry->magic = magic;
+  entry->len = len;
+  return p + sizeof(fs_entry_t);
+}
+
+static size_t bench_tokens(uint8_t* p, int count) {
+  uint8_t* start = p;
+
+  for (int i = 0; i < count; i++) {
+    int nets = 1 + (bench_rand() % (((bench_rand() % 4) == 0) ? BENCH_MAX_NETS : 2));
+    int ticker_len = 3 + (bench_rand() % 6);
+    uint8_t* data = bench_entry(p, FS_ERC20_MAGIC, 1 + (nets * BENCH_NET_LEN) + 1 + ticker_len + 1);
+
+    *(data++) = nets;
+
+    for (int n = 0; n < nets; n++) {
+      bench_token_key_t* key = &g_token_keys[g_token_key_count++];
+      key->chain_id = g_chains[n];
+
+      for (int j = 0; j < 20; j++) {
+        key->addr[j] = bench_rand();
+      }
+
+      memcpy(data, key, BENCH_NET_LEN);
+      data += BENCH_NET_LEN;
+    }
+
+    *(data++) = 18;
+
+    for (int j = 0; j < ticker_len; j++) {
+      *(data++) = 'A' + (bench_rand() % 26);
+    }
+
+    *(data++) = '\0';
+    p = data;
+  }
+
+  return p - start;
+}
+
+static size_t bench_database(uint8_t* db, int tokens, int abis) {
+  uint8_t* p = db;
+
+  uint8_t* data = bench_entry(p, FS_VERSION_MAGIC, 4);
+  uint32_t version = 20250101;
+  memcpy(data, &version, 4);
+  p = data + 4;
+
+  for (int i = 0; i < BENCH_CHAINS; i++) {
+    static const char chain_strings[] = "ETH\0Chain\0chain";
+    g_chains[i] = (i == 0) ? 1 : (bench_rand() % 100000);
+    data = bench_entry(p, FS_CHAIN_MAGIC, 4 + sizeof(chain_strings));
+    memcpy(data, &g_chains[i], 4);
+    memcpy(&data[4], chain_strings, sizeof(chain_strings));
+    p = data + 4 + sizeof(chain_strings);
+  }
+
+  p += bench_tokens(p, tokens);
+
+  for (int i = 0; i < abis; i++) {
+    uint16_t len = 16 + (bench_rand() % 200);
+    data = bench_entry(p, FS_ABI_MAGIC, len);
+
+    for (int j = 0; j < len; j++) {
+      data[j] = bench_rand();
+    }
+
+    memcpy(&g_abi_keys[g_abi_key_count++], data, 4);
+    p = data + len;
+  }
+
+  return p - db;
+}
+
+static fs_entry_t* bench_lookup(bool indexed, uint16_t magic, const void* key, size_t key_len) {
+  bench_match_ctx_t ctx = { .magic = magic, .key = key, .key_len = key_len };
+  return indexed ? fs_find_key(magic, key, bench_match, &ctx) : fs_find(bench_match, &ctx);
+}
+
+// Resolves every key with both lookups, also timing those of chains and ABIs, and returns the number of keys found.
+// Tokens are not indexed, their lookups are only checked
+static int bench_check(int rounds, bench_stats_t* scan, bench_stats_t* index) {
+  int found = 0;
+  int keys = BENCH_CHAINS + g_token_key_count + g_abi_key_count;
+
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < keys; i++) {
+      uint16_t magic;
+      const void* key;
+      size_t key_len;
+
+      if (i < BENCH_CHAINS) {
+        magic = FS_CHAIN_MAGIC;
+        key = &g_chains[i];
+        key_len = 4;
+      } else if (i < (BENCH_CHAINS + g_token_key_count)) {
+        magic = FS_ERC20_MAGIC;
+        key = &g_token_keys[i - BENCH_CHAINS];
+        key_len = BENCH_NET_LEN;
+      } else {
+        magic = FS_ABI_MAGIC;
+        key = &g_abi_keys[i - BENCH_CHAINS - g_token_key_count];
+        key_len = 4;
+      }
+
+      uint64_t start = bench_now_ns();
+      fs_entry_t* expected = bench_lookup(false, magic, key, key_len);
+      uint64_t mid = bench_now_ns();
+      fs_entry_t* entry = bench_lookup(true, magic, key, key_len);
+      uint64_t end = bench_now_ns();
+
+      if (entry != expected) {
+        fprintf(stderr, "key %d of magic %04x: index gives %p, scan gives %p\n", i, magic, (void*) entry, (void*) expected);
+        exit(1);
+      }
+
+      if (r == 0) {
+        found += entry != NULL;
+      }
+
+      if (scan && (magic != FS_ERC20_MAGIC)) {
+        bench_stats_add(scan, mid - start);
+        bench_stats_add(index, end - mid);
+      }
+    }
+  }
+
+  return found;
+}
+
+static void bench_step(const char* name, uint64_t ns) {
+  int keys = BENCH_CHAINS + g_token_key_count + g_abi_key_count;
+  int found = bench_check(1, NULL, NULL);
+  printf("%-24s %9.2fms, %d/%d keys found, index and scan agree\n", name, ns / 1e6, found, keys);
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = BENCH_DEFAULT_ROUNDS;
+  int tokens = BENCH_DEFAULT_TOKENS;
+  int abis = BENCH_DEFAULT_ABIS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:t:a:")) != -1) {
+    switch (opt) {
+    case 'n':
+      rounds = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 't':
+      tokens = atoi(optarg);
+      break;
+    case 'a':
+      abis = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n rounds] [-s seed] [-t tokens] [-a abis]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((rounds <= 0) || (tokens < 0) || (abis < 0)) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  uint8_t* db = malloc(BENCH_DB_LEN + (tokens * 256) + (abis * 256));
+  g_token_keys = malloc(sizeof(bench_token_key_t) * (tokens * 2) * BENCH_MAX_NETS);
+  g_abi_keys = malloc(sizeof(uint32_t) * abis);
+
+  uint64_t start = bench_now_ns();
+  fs_init();
+  bench_step("index empty area", bench_now_ns() - start);
+
+  size_t db_len = bench_database(db, tokens, abis);
+  start = bench_now_ns();
+
+  if (fs_write((fs_entry_t*) db, db_len) != ERR_OK) {
+    fprintf(stderr, "database of %zu bytes does not fit\n", db_len);
+    return 1;
+  }
+
+  printf("database: %zu bytes, %d chains, %d tokens on %d chain/address pairs, %d ABIs\n", db_len, BENCH_CHAINS, tokens,
+      g_token_key_count, abis);
+  bench_step("write database", bench_now_ns() - start);
+
+  start = bench_now_ns();
+  fs_init();
+  bench_step("index at boot", bench_now_ns() - start);
+
+  bench_stats_t scan, index;
+  bench_stats_init(&scan, "fs_find");
+  bench_stats_init(&index, "fs_find_key");
+  bench_check(rounds, &scan, &index);
+  bench_stats_report(&scan);
+  bench_stats_report(&index);
+  printf("chain and ABI lookup speedup: %.1fx\n", bench_stats_total(&scan) / (double) bench_stats_total(&index));
+  bench_stats_free(&scan);
+  bench_stats_free(&index);
+
+  int keep = 70;
+  start = bench_now_ns();
+  fs_erase_all(bench_match_erase, &keep);
+  uint64_t erase_ns = bench_now_ns() - start;
+
+  // the erased keys stay in the list and must now be missed by both lookups
+  bench_step("erase 30% of tokens", erase_ns);
+
+  size_t append_len = bench_tokens(db, tokens / 4);
+  start = bench_now_ns();
+
+  if (fs_write((fs_entry_t*) db, append_len) != ERR_OK) {
+    fprintf(stderr, "appended tokens do not fit\n");
+    return 1;
+  }
+
+  bench_step("append 25% more tokens", bench_now_ns() - start);
+
+  uint64_t single_ns = 0;
+
+  for (int i = 0; i < 8; i++) {
+    bench_token_key_t* key = &g_token_keys[bench_rand() % g_token_key_count];
+    fs_entry_t* entry = bench_lookup(true, FS_ERC20_MAGIC, key, BENCH_NET_LEN);
+
+    if (entry) {
+      start = bench_now_ns();
+      fs_erase(entry);
+      single_ns += bench_now_ns() - start;
+    }
+  }
+
+  bench_step("erase 8 single entries", single_ns);
+
+  free(g_abi_keys);
+  free(g_token_keys);
+  free(db);
+
+  return 0;
+}
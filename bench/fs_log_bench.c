@@ -0,0 +1,295 @@
+/*
+ * Small writes in the flash filesystem with deletions rewriting their page
+ * and with the log mode, where they append tombstones reclaimed by idle
+ * compaction. Each session saves the settings and replaces the pairing of
+ * one of a few cards, as the device does, on top of a synthetic database.
+ *
+ * Usage: fs-log-bench [-s seed] [-n sessions] [-i idle_steps] [-d db_kb]
+ *
+ * Between sessions up to idle_steps compaction steps run, as the core task
+ * does while the main menu is shown. The flash pages erased while the
+ * callers wait are reported apart from those erased when idle, along with
+ * the write amplification (bytes programmed for each byte written) and the
+ * highest erase count of a page. The latest settings and pairings are then
+ * checked, also after rebuilding the filesystem state as done at boot.
+ *
+ * Erasing and programming the host flash are memory copies, so the time only
+ * shows the processing cost. On the device the erased pages dominate it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_SESSIONS 2000
+#define BENCH_DEFAULT_IDLE_STEPS 2
+#define BENCH_DEFAULT_DB_KB 512
+#define BENCH_CARDS 4
+#define BENCH_UID_LEN 16
+#define BENCH_PAIRING_LEN (BENCH_UID_LEN + 32 + 1)
+#define BENCH_SETTINGS_LEN 7
+#define BENCH_MAX_DB_ENTRY 512
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint8_t uid[BENCH_UID_LEN];
+  uint8_t key[32];
+  uint8_t idx;
+} bench_pairing_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint32_t counter;
+  uint8_t flags[BENCH_SETTINGS_LEN - 4];
+} bench_settings_t;
+
+typedef struct {
+  const char* name;
+  fs_mode_t mode;
+  uint32_t caller_erased;
+  uint32_t idle_erased;
+  uint64_t idle_ns;
+  fs_stats_t stats;
+} bench_run_t;
+
+static uint8_t g_uids[BENCH_CARDS][BENCH_UID_LEN];
+static uint8_t g_keys[BENCH_CARDS][32];
+static uint32_t g_counter;
+
+static fs_action_t bench_match_settings(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_SETTINGS_MAGIC ? FS_ACCEPT : FS_REJECT;
+}
+
+static fs_action_t bench_match_pairing(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_PAIRING_MAGIC) {
+    return FS_REJECT;
+  }
+
+  return memcmp(((bench_pairing_t*) entry)->uid, ctx, BENCH_UID_LEN) ? FS_REJECT : FS_ACCEPT;
+}
+
+// As pairing_erase(): the matching entry is erased, the others kept
+static fs_action_t bench_erase_pairing(void* ctx, fs_entry_t* entry) {
+  return bench_match_pairing(ctx, entry) == FS_ACCEPT ? FS_STOP : FS_ACCEPT;
+}
+
+static void bench_wipe() {
+  const hal_flash_data_segment_t* map = hal_flash_get_data_segments();
+  int pages = 0;
+
+  for (int i = 0; pages < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    for (int j = 0; j < map[i].count; j++) {
+      hal_flash_erase(HAL_FLASH_ADDR_TO_BLOCK(map[i].addr) + j);
+    }
+
+    pages += map[i].count;
+  }
+}
+
+static void bench_database(size_t len) {
+  uint8_t* db = malloc(len + BENCH_MAX_DB_ENTRY);
+  size_t off = 0;
+
+  while (off < len) {
+    fs_entry_t* entry = (fs_entry_t*) &db[off];
+    entry->magic = FS_ABI_MAGIC;
+    entry->len = 16 + (bench_rand() % (BENCH_MAX_DB_ENTRY - 20));
+    uint8_t* data = FS_ENTRY_DATA(uint8_t*, entry);
+
+    for (int i = 0; i < entry->len; i++) {
+      data[i] = bench_rand();
+    }
+
+    off += entry->len + sizeof(fs_entry_t);
+  }
+
+  if (fs_write((fs_entry_t*) db, off) != ERR_OK) {
+    fprintf(stderr, "database of %zu bytes does not fit\n", off);
+    exit(1);
+  }
+
+  free(db);
+}
+
+static void bench_save_settings() {
+  fs_entry_t* old = fs_find_key(FS_SETTINGS_MAGIC, NULL, bench_match_settings, NULL);
+
+  if (old && (fs_erase(old) != ERR_OK)) {
+    fprintf(stderr, "cannot erase the settings\n");
+    exit(1);
+  }
+
+  bench_settings_t settings = { ._entry = { .magic = FS_SETTINGS_MAGIC, .len = BENCH_SETTINGS_LEN }, .counter = ++g_counter };
+  memset(settings.flags, 0x01, sizeof(settings.flags));
+
+  if (fs_write(&settings._entry, sizeof(settings)) != ERR_OK) {
+    fprintf(stderr, "cannot write the settings\n");
+    exit(1);
+  }
+}
+
+static void bench_replace_pairing(int card) {
+  fs_erase_all(bench_erase_pairing, g_uids[card]);
+
+  bench_pairing_t pairing = { ._entry = { .magic = FS_PAIRING_MAGIC, .len = BENCH_PAIRING_LEN }, .idx = card };
+  memcpy(pairing.uid, g_uids[card], BENCH_UID_LEN);
+
+  for (int i = 0; i < 32; i++) {
+    g_keys[card][i] = pairing.key[i] = bench_rand();
+  }
+
+  if (fs_write(&pairing._entry, sizeof(pairing)) != ERR_OK) {
+    fprintf(stderr, "cannot write the pairing\n");
+    exit(1);
+  }
+}
+
+static void bench_verify(const char* what) {
+  bench_settings_t* settings = (bench_settings_t*) fs_find_key(FS_SETTINGS_MAGIC, NULL, bench_match_settings, NULL);
+
+  if (!settings || (settings->counter != g_counter)) {
+    fprintf(stderr, "%s: wrong settings\n", what);
+    exit(1);
+  }
+
+  for (int i = 0; i < BENCH_CARDS; i++) {
+    bench_pairing_t* pairing = (bench_pairing_t*) fs_find_key(FS_PAIRING_MAGIC, g_uids[i], bench_match_pairing, g_uids[i]);
+
+    if (!pairing || memcmp(pairing->key, g_keys[i], 32)) {
+      fprintf(stderr, "%s: wrong pairing for card %d\n", what, i);
+      exit(1);
+    }
+
+    if (fs_find(bench_match_pairing, g_uids[i]) != (fs_entry_t*) pairing) {
+      fprintf(stderr, "%s: index and scan disagree for card %d\n", what, i);
+      exit(1);
+    }
+  }
+}
+
+static void bench_run(bench_run_t* run, int sessions, int idle_steps, size_t db_len) {
+  bench_wipe();
+  fs_init();
+  fs_set_mode(run->mode);
+  bench_database(db_len);
+
+  fs_stats_t base;
+  fs_get_stats(&base);
+
+  bench_stats_t caller;
+  bench_stats_init(&caller, run->name);
+  run->caller_erased = 0;
+  run->idle_erased = 0;
+  run->idle_ns = 0;
+
+  for (int s = 0; s < sessions; s++) {
+    uint32_t erased = g_linux_flash_stats.erased_blocks;
+    uint64_t start = bench_now_ns();
+    bench_save_settings();
+    bench_replace_pairing(bench_rand() % BENCH_CARDS);
+    bench_stats_add(&caller, bench_now_ns() - start);
+    run->caller_erased += g_linux_flash_stats.erased_blocks - erased;
+
+    erased = g_linux_flash_stats.erased_blocks;
+    start = bench_now_ns();
+
+    for (int i = 0; (i < idle_steps) && (fs_compact_step() == ERR_OK); i++) {
+      ;
+    }
+
+    run->idle_ns += bench_now_ns() - start;
+    run->idle_erased += g_linux_flash_stats.erased_blocks - erased;
+  }
+
+  bench_stats_report(&caller);
+  bench_stats_free(&caller);
+
+  fs_get_stats(&run->stats);
+  run->stats.requested -= base.requested;
+  run->stats.programmed -= base.programmed;
+
+  bench_verify(run->name);
+  fs_init();
+  fs_set_mode(run->mode);
+  bench_verify(run->name);
+}
+
+static uint32_t bench_max_erases(const fs_stats_t* stats) {
+  uint32_t max = 0;
+
+  for (int i = 0; i < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    max = APP_MAX(max, stats->page_erases[i]);
+  }
+
+  return max;
+}
+
+int main(int argc, char* argv[]) {
+  int sessions = BENCH_DEFAULT_SESSIONS;
+  int idle_steps = BENCH_DEFAULT_IDLE_STEPS;
+  int db_kb = BENCH_DEFAULT_DB_KB;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:n:i:d:")) != -1) {
+    switch (opt) {
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'n':
+      sessions = atoi(optarg);
+      break;
+    case 'i':
+      idle_steps = atoi(optarg);
+      break;
+    case 'd':
+      db_kb = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-n sessions] [-i idle_steps] [-d db_kb]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((sessions <= 0) || (idle_steps < 0) || (db_kb < 0) || ((db_kb * 1024) >= (HAL_FLASH_DATA_BLOCK_COUNT * FS_PAGE_DATA_SIZE))) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  for (int i = 0; i < BENCH_CARDS; i++) {
+    for (int j = 0; j < BENCH_UID_LEN; j++) {
+      g_uids[i][j] = bench_rand();
+    }
+  }
+
+  bench_run_t runs[] = {
+    { .name = "in place", .mode = FS_MODE_IN_PLACE },
+    { .name = "log", .mode = FS_MODE_LOG },
+  };
+
+  printf("%d sessions on a %d KB database, up to %d compaction steps when idle\n", sessions, db_kb, idle_steps);
+
+  for (int i = 0; i < (sizeof(runs) / sizeof(bench_run_t)); i++) {
+    bench_run(&runs[i], sessions, idle_steps, db_kb * 1024);
+  }
+
+  printf("%-9s %14s %12s %10s %16s %16s %10s\n", "mode", "caller erases", "idle erases", "idle time", "write amplif.", "max page erases", "tombstones");
+
+  for (int i = 0; i < (sizeof(runs) / sizeof(bench_run_t)); i++) {
+    bench_run_t* run = &runs[i];
+    printf("%-9s %14u %12u %8.2fms %15.1fx %16u %10u\n", run->name, run->caller_erased, run->idle_erased, run->idle_ns / 1e6,
+        run->stats.programmed / (double) APP_MAX(run->stats.requested, 1), bench_max_erases(&run->stats), run->stats.tombstones);
+  }
+
+  printf("caller erases: %.1fx fewer in the log mode\n", runs[0].caller_erased / (double) APP_MAX(runs[1].caller_erased, 1));
+
+  return 0;
+}
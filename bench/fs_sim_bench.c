@@ -0,0 +1,699 @@
+/*
+ * Flash filesystem under churn: replays a long randomised workload of
+ * settings saves, pairing replacements, whitelist changes, lookups and full
+ * database rewrites on the host flash, which like the device is programmed in
+ * 16 byte words written once after each 8 KB erase, and cuts power at random
+ * byte offsets of the flash operations.
+ *
+ * Usage: fs-sim-bench [-s seed] [-n ops] [-p power_cuts] [-d db_kb] [-f flash_file]
+ *
+ * Lookups stand for the main menu being shown, so in the log mode they are
+ * followed by a compaction step as done by the core task. After each
+ * power cut the filesystem boots again and the settings, pairings, whitelist
+ * keys and database tokens are looked up. Those touched by the interrupted
+ * operation may hold their old or new value, the others should be unchanged.
+ * Entries lost and those holding any other data are reported. The index
+ * disagreeing with the scan and writes breaking the flash word rules before
+ * the first power cut fail the run.
+ *
+ * Both filesystem modes run the same workload and report the lookup latency,
+ * the bytes programmed for each byte written and the erase counts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "storage/fs.h"
+
+#define BENCH_DEFAULT_OPS 20000
+#define BENCH_DEFAULT_POWER_CUTS 200
+#define BENCH_DEFAULT_DB_KB 128
+#define BENCH_CARDS 8
+#define BENCH_PUBKEYS 16
+#define BENCH_UID_LEN 16
+#define BENCH_PAIRING_LEN (BENCH_UID_LEN + 32 + 1)
+#define BENCH_PUBKEY_LEN 33
+#define BENCH_TOKEN_KEY_LEN 24
+#define BENCH_TOKEN_LEN 48
+#define BENCH_CHECKED_SCANS 32
+#define BENCH_NONE 0
+#define BENCH_DAMAGED UINT32_MAX
+
+typedef enum {
+  BENCH_OP_SETTINGS,
+  BENCH_OP_PAIRING,
+  BENCH_OP_WHITELIST_ADD,
+  BENCH_OP_WHITELIST_REMOVE,
+  BENCH_OP_LOOKUP,
+  BENCH_OP_DATABASE,
+  BENCH_OP_COUNT
+} bench_op_type_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t target;
+  uint32_t value;
+} bench_op_t;
+
+// what the filesystem must hold, values are BENCH_NONE when the entry is missing and BENCH_DAMAGED when anything goes
+typedef struct {
+  uint32_t settings;
+  uint32_t pairings[BENCH_CARDS];
+  uint32_t whitelist[BENCH_PUBKEYS];
+  uint32_t version;
+  uint32_t* tokens;
+} bench_model_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint32_t counter;
+  uint32_t check;
+} bench_settings_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint8_t uid[BENCH_UID_LEN];
+  uint8_t key[32];
+  uint8_t idx;
+} bench_pairing_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint8_t pubkey[BENCH_PUBKEY_LEN];
+} bench_whitelist_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint8_t count;
+  uint8_t key[BENCH_TOKEN_KEY_LEN];
+  uint8_t payload[BENCH_TOKEN_LEN - BENCH_TOKEN_KEY_LEN - 5];
+  uint32_t version;
+} bench_token_t;
+
+typedef struct __attribute__((packed)) {
+  fs_entry_t _entry;
+  uint32_t version;
+} bench_version_t;
+
+typedef struct {
+  const char* name;
+  fs_mode_t mode;
+  uint64_t logical;
+  uint32_t cuts;
+  uint32_t missed;
+  uint32_t lost_touched;
+  uint32_t lost_untouched;
+  uint32_t damaged;
+  uint32_t healthy_violations;
+  uint32_t erased_blocks;
+  uint32_t max_block_erases;
+  uint32_t programmed_words;
+  uint32_t violations;
+  bench_stats_t lookups;
+} bench_run_t;
+
+static bench_op_t* g_ops;
+static int g_op_count;
+static int g_token_count;
+static uint8_t g_uids[BENCH_CARDS][BENCH_UID_LEN];
+static uint8_t g_pubkeys[BENCH_PUBKEYS][BENCH_PUBKEY_LEN];
+static uint8_t (*g_token_keys)[BENCH_TOKEN_KEY_LEN];
+static bench_model_t g_model;
+static bench_run_t* g_run;
+static jmp_buf g_power_loss;
+
+// The data of each entry derives from its value, so that a lookup tells which value it found
+static void bench_fill(uint8_t* out, size_t len, uint32_t seed) {
+  uint32_t x = seed * 2654435761U + 0x9e3779b9;
+
+  for (size_t i = 0; i < len; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    out[i] = x;
+  }
+}
+
+static void bench_power_loss() {
+  longjmp(g_power_loss, 1);
+}
+
+static fs_action_t bench_match_settings(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_SETTINGS_MAGIC ? FS_ACCEPT : FS_REJECT;
+}
+
+static fs_action_t bench_match_pairing(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_PAIRING_MAGIC) {
+    return FS_REJECT;
+  }
+
+  return memcmp(((bench_pairing_t*) entry)->uid, ctx, BENCH_UID_LEN) ? FS_REJECT : FS_ACCEPT;
+}
+
+static fs_action_t bench_erase_pairing(void* ctx, fs_entry_t* entry) {
+  return bench_match_pairing(ctx, entry) == FS_ACCEPT ? FS_STOP : FS_ACCEPT;
+}
+
+static fs_action_t bench_match_whitelist(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_SCV2_WHITELIST_MAGIC) {
+    return FS_REJECT;
+  }
+
+  return memcmp(((bench_whitelist_t*) entry)->pubkey, ctx, BENCH_PUBKEY_LEN) ? FS_REJECT : FS_ACCEPT;
+}
+
+static fs_action_t bench_erase_whitelist(void* ctx, fs_entry_t* entry) {
+  return bench_match_whitelist(ctx, entry) == FS_ACCEPT ? FS_STOP : FS_ACCEPT;
+}
+
+static fs_action_t bench_match_token(void* ctx, fs_entry_t* entry) {
+  if (entry->magic != FS_ERC20_MAGIC) {
+    return FS_REJECT;
+  }
+
+  return memcmp(((bench_token_t*) entry)->key, ctx, BENCH_TOKEN_KEY_LEN) ? FS_REJECT : FS_ACCEPT;
+}
+
+static fs_action_t bench_match_version(void* ctx, fs_entry_t* entry) {
+  return entry->magic == FS_VERSION_MAGIC ? FS_ACCEPT : FS_REJECT;
+}
+
+static fs_action_t bench_erase_database(void* ctx, fs_entry_t* entry) {
+  return ((entry->magic == FS_ERC20_MAGIC) || (entry->magic == FS_VERSION_MAGIC)) ? FS_REJECT : FS_ACCEPT;
+}
+
+static void bench_write(fs_entry_t* entry, size_t len) {
+  if (fs_write(entry, len) != ERR_OK) {
+    fprintf(stderr, "%s: cannot write %zu bytes\n", g_run->name, len);
+    exit(1);
+  }
+
+  g_run->logical += len;
+}
+
+static void bench_settings_entry(bench_settings_t* settings, uint32_t counter) {
+  settings->_entry.magic = FS_SETTINGS_MAGIC;
+  settings->_entry.len = sizeof(bench_settings_t) - sizeof(fs_entry_t);
+  settings->counter = counter;
+  bench_fill((uint8_t*) &settings->check, sizeof(settings->check), counter);
+}
+
+static void bench_pairing_entry(bench_pairing_t* pairing, int card, uint32_t value) {
+  pairing->_entry.magic = FS_PAIRING_MAGIC;
+  pairing->_entry.len = BENCH_PAIRING_LEN;
+  memcpy(pairing->uid, g_uids[card], BENCH_UID_LEN);
+  bench_fill(pairing->key, sizeof(pairing->key), value);
+  pairing->idx = card;
+}
+
+static void bench_token_entry(bench_token_t* token, int i, uint32_t version) {
+  token->_entry.magic = FS_ERC20_MAGIC;
+  token->_entry.len = BENCH_TOKEN_LEN;
+  token->count = 1;
+  memcpy(token->key, g_token_keys[i], BENCH_TOKEN_KEY_LEN);
+  bench_fill(token->payload, sizeof(token->payload), (version * 7919) + i);
+  token->version = version;
+}
+
+// As settings_commit(): the stored entry is erased before the new one is written
+static void bench_save_settings(uint32_t counter) {
+  fs_entry_t* old = fs_find_key(FS_SETTINGS_MAGIC, NULL, bench_match_settings, NULL);
+
+  if (old && (fs_erase(old) != ERR_OK)) {
+    fprintf(stderr, "%s: cannot erase the settings\n", g_run->name);
+    exit(1);
+  }
+
+  bench_settings_t settings;
+  bench_settings_entry(&settings, counter);
+  bench_write(&settings._entry, sizeof(settings));
+}
+
+static void bench_replace_pairing(int card, uint32_t value) {
+  fs_erase_all(bench_erase_pairing, g_uids[card]);
+
+  bench_pairing_t pairing;
+  bench_pairing_entry(&pairing, card, value);
+  bench_write(&pairing._entry, sizeof(pairing));
+}
+
+static void bench_whitelist_add(int key) {
+  if (fs_find_key(FS_SCV2_WHITELIST_MAGIC, g_pubkeys[key], bench_match_whitelist, g_pubkeys[key])) {
+    return;
+  }
+
+  bench_whitelist_t entry = { ._entry = { .magic = FS_SCV2_WHITELIST_MAGIC, .len = BENCH_PUBKEY_LEN } };
+  memcpy(entry.pubkey, g_pubkeys[key], BENCH_PUBKEY_LEN);
+  bench_write(&entry._entry, sizeof(entry));
+}
+
+static void bench_rewrite_database(uint32_t version) {
+  size_t len = sizeof(bench_version_t) + (g_token_count * sizeof(bench_token_t));
+  uint8_t* db = malloc(len);
+
+  bench_version_t* version_entry = (bench_version_t*) db;
+  version_entry->_entry.magic = FS_VERSION_MAGIC;
+  version_entry->_entry.len = sizeof(uint32_t);
+  version_entry->version = version;
+
+  bench_token_t* tokens = (bench_token_t*) &db[sizeof(bench_version_t)];
+
+  for (int i = 0; i < g_token_count; i++) {
+    bench_token_entry(&tokens[i], i, version);
+  }
+
+  fs_erase_all(bench_erase_database, NULL);
+  bench_write((fs_entry_t*) db, len);
+  free(db);
+}
+
+static void bench_lookup(uint32_t value) {
+  uint32_t kind = value % 10;
+  uint64_t start = bench_now_ns();
+  fs_entry_t* entry;
+
+  if (kind < 7) {
+    const uint8_t* key = g_token_keys[value % g_token_count];
+    entry = fs_find_key(FS_ERC20_MAGIC, key, bench_match_token, (void*) key);
+  } else if (kind < 8) {
+    const uint8_t* uid = g_uids[value % BENCH_CARDS];
+    entry = fs_find_key(FS_PAIRING_MAGIC, uid, bench_match_pairing, (void*) uid);
+  } else if (kind < 9) {
+    const uint8_t* pubkey = g_pubkeys[value % BENCH_PUBKEYS];
+    entry = fs_find_key(FS_SCV2_WHITELIST_MAGIC, pubkey, bench_match_whitelist, (void*) pubkey);
+  } else {
+    entry = fs_find_key(FS_SETTINGS_MAGIC, NULL, bench_match_settings, NULL);
+  }
+
+  bench_stats_add(&g_run->lookups, bench_now_ns() - start);
+  (void) entry;
+
+  if (g_run->mode == FS_MODE_LOG) {
+    fs_compact_step();
+  }
+}
+
+static void bench_run_op(const bench_op_t* op) {
+  switch (op->type) {
+  case BENCH_OP_SETTINGS:
+    bench_save_settings(op->value);
+    break;
+  case BENCH_OP_PAIRING:
+    bench_replace_pairing(op->target, op->value);
+    break;
+  case BENCH_OP_WHITELIST_ADD:
+    bench_whitelist_add(op->target);
+    break;
+  case BENCH_OP_WHITELIST_REMOVE:
+    fs_erase_all(bench_erase_whitelist, g_pubkeys[op->target]);
+    break;
+  case BENCH_OP_LOOKUP:
+    bench_lookup(op->value);
+    break;
+  case BENCH_OP_DATABASE:
+    bench_rewrite_database(op->value);
+    break;
+  }
+}
+
+static void bench_apply(bench_model_t* model, const bench_op_t* op) {
+  switch (op->type) {
+  case BENCH_OP_SETTINGS:
+    model->settings = op->value;
+    break;
+  case BENCH_OP_PAIRING:
+    model->pairings[op->target] = op->value;
+    break;
+  case BENCH_OP_WHITELIST_ADD:
+    model->whitelist[op->target] = 1;
+    break;
+  case BENCH_OP_WHITELIST_REMOVE:
+    model->whitelist[op->target] = BENCH_NONE;
+    break;
+  case BENCH_OP_DATABASE:
+    model->version = op->value;
+
+    for (int i = 0; i < g_token_count; i++) {
+      model->tokens[i] = op->value;
+    }
+    break;
+  }
+}
+
+// Returns false when power was lost while running the operation
+static bool bench_exec(const bench_op_t* op) {
+  if (setjmp(g_power_loss)) {
+    return false;
+  }
+
+  bench_run_op(op);
+  return true;
+}
+
+static fs_entry_t* bench_find(uint16_t magic, const void* key, fs_predicate_t predicate, void* ctx, bool scan, const char* what) {
+  fs_entry_t* entry = fs_find_key(magic, key, predicate, ctx);
+
+  if (scan && (fs_find(predicate, ctx) != entry)) {
+    fprintf(stderr, "%s: index and scan disagree for %s\n", g_run->name, what);
+    exit(1);
+  }
+
+  return entry;
+}
+
+// Checks a value found after a power cut, which becomes the expected one. Entries left holding data of neither value
+// are counted once, then accepted as they are until written again
+static void bench_check(uint32_t* expected, uint32_t after, bool touched, uint32_t found, bool matched) {
+  if (!matched) {
+    g_run->damaged += *expected != BENCH_DAMAGED;
+    *expected = BENCH_DAMAGED;
+  } else if ((found == *expected) || (touched && (found == after)) || (*expected == BENCH_DAMAGED)) {
+    *expected = found;
+  } else if (found != BENCH_NONE) {
+    g_run->damaged++;
+    *expected = found;
+  } else if (touched) {
+    g_run->lost_touched++;
+    *expected = BENCH_NONE;
+  } else {
+    g_run->lost_untouched++;
+    *expected = BENCH_NONE;
+  }
+}
+
+// Which of the two candidate values an entry holds, BENCH_NONE if missing and matched set to false if neither
+static uint32_t bench_candidate(fs_entry_t* entry, uint32_t a, uint32_t b, void (*gen)(void*, int, uint32_t), int i, bool* matched) {
+  union { bench_settings_t settings; bench_pairing_t pairing; bench_token_t token; } buf;
+  *matched = true;
+
+  if (!entry) {
+    return BENCH_NONE;
+  }
+
+  uint32_t candidates[2] = { a, b };
+
+  for (int c = 0; c < 2; c++) {
+    if ((candidates[c] == BENCH_NONE) || (candidates[c] == BENCH_DAMAGED)) {
+      continue;
+    }
+
+    gen(&buf, i, candidates[c]);
+
+    if ((entry->len == buf.settings._entry.len) && !memcmp(FS_ENTRY_DATA(void*, entry), FS_ENTRY_DATA(void*, &buf), entry->len)) {
+      return candidates[c];
+    }
+  }
+
+  *matched = false;
+  return BENCH_NONE;
+}
+
+static void bench_gen_settings(void* out, int i, uint32_t value) {
+  bench_settings_entry(out, value);
+}
+
+static void bench_gen_pairing(void* out, int i, uint32_t value) {
+  bench_pairing_entry(out, i, value);
+}
+
+static void bench_gen_token(void* out, int i, uint32_t value) {
+  bench_token_entry(out, i, value);
+}
+
+// Boots again after a power cut during op and checks the filesystem against the model
+static void bench_boot(const bench_op_t* op) {
+  fs_init();
+  fs_set_mode(g_run->mode);
+
+  bench_model_t after = g_model;
+  after.tokens = NULL;
+
+  if (op->type != BENCH_OP_DATABASE) {
+    bench_apply(&after, op);
+  } else {
+    after.version = op->value;
+  }
+
+  bool matched;
+  fs_entry_t* entry = bench_find(FS_SETTINGS_MAGIC, NULL, bench_match_settings, NULL, true, "settings");
+  uint32_t found = bench_candidate(entry, g_model.settings, after.settings, bench_gen_settings, 0, &matched);
+  bench_check(&g_model.settings, after.settings, op->type == BENCH_OP_SETTINGS, found, matched);
+
+  for (int i = 0; i < BENCH_CARDS; i++) {
+    entry = bench_find(FS_PAIRING_MAGIC, g_uids[i], bench_match_pairing, g_uids[i], true, "pairing");
+    found = bench_candidate(entry, g_model.pairings[i], after.pairings[i], bench_gen_pairing, i, &matched);
+    bench_check(&g_model.pairings[i], after.pairings[i], (op->type == BENCH_OP_PAIRING) && (op->target == i), found, matched);
+  }
+
+  for (int i = 0; i < BENCH_PUBKEYS; i++) {
+    entry = bench_find(FS_SCV2_WHITELIST_MAGIC, g_pubkeys[i], bench_match_whitelist, g_pubkeys[i], true, "whitelist key");
+    bool touched = ((op->type == BENCH_OP_WHITELIST_ADD) || (op->type == BENCH_OP_WHITELIST_REMOVE)) && (op->target == i);
+    bench_check(&g_model.whitelist[i], after.whitelist[i], touched, entry ? 1 : BENCH_NONE, true);
+  }
+
+  bool touched = op->type == BENCH_OP_DATABASE;
+  entry = bench_find(FS_VERSION_MAGIC, NULL, bench_match_version, NULL, true, "database version");
+  found = entry ? ((bench_version_t*) entry)->version : BENCH_NONE;
+  bench_check(&g_model.version, after.version, touched, found, true);
+
+  for (int i = 0; i < g_token_count; i++) {
+    bool scan = i < BENCH_CHECKED_SCANS;
+    uint32_t new_version = touched ? op->value : g_model.tokens[i];
+    entry = bench_find(FS_ERC20_MAGIC, g_token_keys[i], bench_match_token, g_token_keys[i], scan, "token");
+    found = bench_candidate(entry, g_model.tokens[i], new_version, bench_gen_token, i, &matched);
+    bench_check(&g_model.tokens[i], new_version, touched, found, matched);
+  }
+}
+
+static void bench_workload(int op_count, uint32_t db_kb) {
+  g_op_count = op_count;
+  g_ops = malloc(op_count * sizeof(bench_op_t));
+
+  for (int i = 0; i < op_count; i++) {
+    uint32_t r = bench_rand() % 1000;
+    bench_op_t* op = &g_ops[i];
+    op->value = i + 1;
+
+    if (r < 350) {
+      op->type = BENCH_OP_SETTINGS;
+    } else if (r < 550) {
+      op->type = BENCH_OP_PAIRING;
+      op->target = bench_rand() % BENCH_CARDS;
+      op->value = (bench_rand() | 1) & 0x7fffffff;
+    } else if (r < 650) {
+      op->type = BENCH_OP_WHITELIST_ADD;
+      op->target = bench_rand() % BENCH_PUBKEYS;
+    } else if (r < 750) {
+      op->type = BENCH_OP_WHITELIST_REMOVE;
+      op->target = bench_rand() % BENCH_PUBKEYS;
+    } else if (r < 997) {
+      op->type = BENCH_OP_LOOKUP;
+      op->value = bench_rand();
+    } else {
+      op->type = BENCH_OP_DATABASE;
+    }
+  }
+
+  g_token_count = (db_kb * 1024) / sizeof(bench_token_t);
+  g_token_keys = malloc(g_token_count * BENCH_TOKEN_KEY_LEN);
+
+  for (int i = 0; i < g_token_count; i++) {
+    bench_fill(g_token_keys[i], BENCH_TOKEN_KEY_LEN, 0x70000000 + i);
+    memset(g_token_keys[i], 0, 3);
+    g_token_keys[i][3] = 1 + (i % 13);
+  }
+
+  for (int i = 0; i < BENCH_CARDS; i++) {
+    bench_fill(g_uids[i], BENCH_UID_LEN, 0x50000000 + i);
+  }
+
+  for (int i = 0; i < BENCH_PUBKEYS; i++) {
+    bench_fill(g_pubkeys[i], BENCH_PUBKEY_LEN, 0x60000000 + i);
+  }
+}
+
+static void bench_wipe() {
+  const hal_flash_data_segment_t* map = hal_flash_get_data_segments();
+  int pages = 0;
+
+  for (int i = 0; pages < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    for (int j = 0; j < map[i].count; j++) {
+      hal_flash_erase(HAL_FLASH_ADDR_TO_BLOCK(map[i].addr) + j);
+    }
+
+    pages += map[i].count;
+  }
+}
+
+static uint32_t bench_max_block_erases(const struct linux_flash_stats* base) {
+  const hal_flash_data_segment_t* map = hal_flash_get_data_segments();
+  uint32_t max = 0;
+  int pages = 0;
+
+  for (int i = 0; pages < HAL_FLASH_DATA_BLOCK_COUNT; i++) {
+    for (int j = 0; j < map[i].count; j++) {
+      uint32_t block = HAL_FLASH_ADDR_TO_BLOCK(map[i].addr) + j;
+      max = APP_MAX(max, g_linux_flash_stats.block_erases[block] - base->block_erases[block]);
+    }
+
+    pages += map[i].count;
+  }
+
+  return max;
+}
+
+static void bench_run(bench_run_t* run, uint32_t seed, int cuts) {
+  g_run = run;
+  bench_seed(seed);
+  bench_stats_init(&run->lookups, run->name);
+
+  bench_wipe();
+  fs_init();
+  fs_set_mode(run->mode);
+
+  memset(&g_model, 0, offsetof(bench_model_t, tokens));
+  memset(g_model.tokens, 0, g_token_count * sizeof(uint32_t));
+
+  bench_op_t db = { .type = BENCH_OP_DATABASE, .value = 1 };
+  bench_run_op(&db);
+  bench_apply(&g_model, &db);
+
+  struct linux_flash_stats base = g_linux_flash_stats;
+  run->logical = 0;
+
+  uint32_t max_ops[BENCH_OP_COUNT] = { 0 };
+  int next_cut = cuts ? (g_op_count / (cuts + 1)) : g_op_count;
+  int cut = 0;
+
+  for (int i = 0; i < g_op_count; i++) {
+    const bench_op_t* op = &g_ops[i];
+    bool armed = (i >= next_cut) && max_ops[op->type];
+
+    if (armed) {
+      g_linux_flash_stats.power_loss_at = g_linux_flash_stats.ops + 1 + (bench_rand() % max_ops[op->type]);
+      g_linux_flash_stats.power_loss_offset = (bench_rand() & 1) ? (bench_rand() % 64) : (bench_rand() % HAL_FLASH_BLOCK_SIZE);
+      next_cut = ((uint64_t) g_op_count * (++cut + 1)) / (cuts + 1);
+    }
+
+    uint32_t ops = g_linux_flash_stats.ops;
+
+    if (bench_exec(op)) {
+      max_ops[op->type] = APP_MAX(max_ops[op->type], g_linux_flash_stats.ops - ops);
+      bench_apply(&g_model, op);
+      run->missed += armed;
+    } else {
+      if (!run->cuts++) {
+        run->healthy_violations = g_linux_flash_stats.violations - base.violations;
+      }
+
+      bench_boot(op);
+    }
+
+    g_linux_flash_stats.power_loss_at = 0;
+  }
+
+  bench_boot(&(bench_op_t) { .type = BENCH_OP_LOOKUP });
+
+  run->erased_blocks = g_linux_flash_stats.erased_blocks - base.erased_blocks;
+  run->programmed_words = g_linux_flash_stats.programmed_words - base.programmed_words;
+  run->violations = g_linux_flash_stats.violations - base.violations;
+
+  if (!run->cuts) {
+    run->healthy_violations = run->violations;
+  }
+  run->max_block_erases = bench_max_block_erases(&base);
+
+  bench_stats_histogram(&run->lookups);
+  bench_stats_free(&run->lookups);
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t seed = 1;
+  int op_count = BENCH_DEFAULT_OPS;
+  int cuts = BENCH_DEFAULT_POWER_CUTS;
+  int db_kb = BENCH_DEFAULT_DB_KB;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:n:p:d:f:")) != -1) {
+    switch (opt) {
+    case 's':
+      seed = strtoul(optarg, NULL, 0);
+      break;
+    case 'n':
+      op_count = atoi(optarg);
+      break;
+    case 'p':
+      cuts = atoi(optarg);
+      break;
+    case 'd':
+      db_kb = atoi(optarg);
+      break;
+    case 'f':
+      setenv(HAL_LINUX_ENV_FLASH, optarg, 1);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-s seed] [-n ops] [-p power_cuts] [-d db_kb] [-f flash_file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((op_count <= 0) || (cuts < 0) || (cuts >= op_count) || (db_kb <= 0) || ((db_kb * 1024) > ((HAL_FLASH_DATA_BLOCK_COUNT * FS_PAGE_DATA_SIZE) / 3))) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  g_linux_flash_stats.power_loss = bench_power_loss;
+
+  bench_seed(seed);
+  bench_workload(op_count, db_kb);
+  g_model.tokens = malloc(g_token_count * sizeof(uint32_t));
+
+  bench_run_t runs[] = {
+    { .name = "in place", .mode = FS_MODE_IN_PLACE },
+    { .name = "log", .mode = FS_MODE_LOG },
+  };
+
+  printf("%d operations on a %d KB database (%d tokens), %d power cuts\n", op_count, db_kb, g_token_count, cuts);
+
+  for (int i = 0; i < (sizeof(runs) / sizeof(bench_run_t)); i++) {
+    bench_run(&runs[i], seed, cuts);
+  }
+
+  printf("%-9s %10s %11s %8s %8s %11s %11s\n", "mode", "written", "programmed", "amplif.", "erases", "max erases", "word rules");
+
+  for (int i = 0; i < (sizeof(runs) / sizeof(bench_run_t)); i++) {
+    bench_run_t* run = &runs[i];
+    uint64_t programmed = (uint64_t) run->programmed_words * HAL_FLASH_WORD_SIZE;
+    printf("%-9s %8lluKB %9lluKB %7.1fx %8u %11u %11u\n", run->name, (unsigned long long) (run->logical / 1024), (unsigned long long) (programmed / 1024),
+        programmed / (double) APP_MAX(run->logical, 1), run->erased_blocks, run->max_block_erases, run->violations);
+  }
+
+  printf("%-9s %6s %8s %15s %13s %8s\n", "mode", "cuts", "missed", "lost (touched)", "lost (other)", "damaged");
+
+  int failed = 0;
+
+  for (int i = 0; i < (sizeof(runs) / sizeof(bench_run_t)); i++) {
+    bench_run_t* run = &runs[i];
+    printf("%-9s %6u %8u %15u %13u %8u\n", run->name, run->cuts, run->missed, run->lost_touched, run->lost_untouched, run->damaged);
+
+    if (run->healthy_violations) {
+      fprintf(stderr, "%s: flash written against the word rules before any power cut\n", run->name);
+      failed = 1;
+    }
+  }
+
+  free(g_model.tokens);
+  free(g_token_keys);
+  free(g_ops);
+
+  return failed;
+}
@@ -0,0 +1,170 @@
+/*
+ * Firmware upgrades hashed as they are programmed: writes random images to
+ * the upgrade area of a file backed flash in random USB segments, hashing each
+ * segment from flash right after programming it as the updater does, and
+ * checks the digest against the one the bootloader computes over the whole
+ * area.
+ *
+ * Usage: fw-hash-bench [-n images] [-s seed] [-f flash_file]
+ *
+ * Segments are multiples of the flash word up to the 240 bytes of an APDU.
+ * As the signature in the header does not start or end on a word, every image
+ * has segments across both of its edges. Reports the time spent erasing,
+ * programming and hashing the segments, hashing the erased tail at the end
+ * and, for comparison, hashing the whole area as was done before.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "crypto/sha2.h"
+#include "storage/fw.h"
+
+#define BENCH_DEFAULT_IMAGES 300
+#define BENCH_SEGMENT_LEN 240
+#define BENCH_MIN_IMAGE_LEN (HAL_FW_HEADER_OFFSET + FW_SIG_LEN + HAL_FLASH_WORD_SIZE)
+
+static uint8_t g_image[FW_AREA_LEN];
+
+// The digest as checked by the bootloader
+static void bench_area_hash(const uint8_t* area, uint8_t digest[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX sha2;
+  sha256_Init(&sha2);
+  sha256_Update(&sha2, area, HAL_FW_HEADER_OFFSET);
+  sha256_Update(&sha2, &area[HAL_FW_HEADER_OFFSET + FW_SIG_LEN], (FW_AREA_LEN - (HAL_FW_HEADER_OFFSET + FW_SIG_LEN)));
+  sha256_Final(&sha2, digest);
+}
+
+static void bench_erase_area(uint8_t* area) {
+  const int fw_block = HAL_FLASH_ADDR_TO_BLOCK((uintptr_t) area);
+  hal_flash_begin_program();
+
+  for (int i = fw_block; i < (fw_block + HAL_FLASH_FW_BLOCK_COUNT); i++) {
+    hal_flash_erase(i);
+  }
+
+  hal_flash_end_program();
+}
+
+int main(int argc, char* argv[]) {
+  int images = BENCH_DEFAULT_IMAGES;
+  const char* flash_file = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:f:")) != -1) {
+    switch (opt) {
+    case 'n':
+      images = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'f':
+      flash_file = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n images] [-s seed] [-f flash_file]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (images <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  if (flash_file) {
+    setenv(HAL_LINUX_ENV_FLASH, flash_file, 1);
+  }
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    fprintf(stderr, "cannot map flash\n");
+    return 1;
+  }
+
+  uint8_t* const area = (uint8_t*) HAL_FLASH_FW_UPGRADE_AREA;
+
+  bench_stats_t erase;
+  bench_stats_t transfer;
+  bench_stats_t tail;
+  bench_stats_t full;
+  bench_stats_init(&erase, "erase");
+  bench_stats_init(&transfer, "program and hash");
+  bench_stats_init(&tail, "hash tail");
+  bench_stats_init(&full, "hash whole area");
+
+  int mismatches = 0;
+  int crossing = 0;
+  size_t segments = 0;
+
+  for (int n = 0; n < images; n++) {
+    const size_t words = (FW_AREA_LEN - BENCH_MIN_IMAGE_LEN) / HAL_FLASH_WORD_SIZE;
+    const size_t len = BENCH_MIN_IMAGE_LEN + ((bench_rand() % (words + 1)) * HAL_FLASH_WORD_SIZE);
+
+    for (size_t i = 0; i < len; i++) {
+      g_image[i] = bench_rand();
+    }
+
+    uint64_t start = bench_now_ns();
+    bench_erase_area(area);
+    bench_stats_add(&erase, bench_now_ns() - start);
+
+    SHA256_CTX sha2;
+    sha256_Init(&sha2);
+
+    start = bench_now_ns();
+    size_t off = 0;
+
+    while (off < len) {
+      size_t seg_len = APP_MIN((1 + (bench_rand() % (BENCH_SEGMENT_LEN / HAL_FLASH_WORD_SIZE))) * HAL_FLASH_WORD_SIZE, (len - off));
+
+      if (((off < HAL_FW_HEADER_OFFSET) && ((off + seg_len) > HAL_FW_HEADER_OFFSET)) ||
+          ((off < (HAL_FW_HEADER_OFFSET + FW_SIG_LEN)) && ((off + seg_len) > (HAL_FW_HEADER_OFFSET + FW_SIG_LEN)))) {
+        crossing++;
+      }
+
+      hal_flash_begin_program();
+      hal_flash_program(&g_image[off], &area[off], seg_len);
+      hal_flash_end_program();
+
+      fw_hash_update(&sha2, area, off, seg_len);
+      off += seg_len;
+      segments++;
+    }
+
+    bench_stats_add(&transfer, bench_now_ns() - start);
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    start = bench_now_ns();
+    fw_hash_update(&sha2, area, len, (FW_AREA_LEN - len));
+    sha256_Final(&sha2, digest);
+    bench_stats_add(&tail, bench_now_ns() - start);
+
+    uint8_t expected[SHA256_DIGEST_LENGTH];
+    start = bench_now_ns();
+    bench_area_hash(area, expected);
+    bench_stats_add(&full, bench_now_ns() - start);
+
+    if (memcmp(digest, expected, SHA256_DIGEST_LENGTH)) {
+      mismatches++;
+    }
+  }
+
+  printf("%d images, %zu segments, %d across the signature edges\n", images, segments, crossing);
+  bench_stats_report(&erase);
+  bench_stats_report(&transfer);
+  bench_stats_report(&tail);
+  bench_stats_report(&full);
+  printf("%d digests differ from the whole area hash\n", mismatches);
+
+  bench_stats_free(&erase);
+  bench_stats_free(&transfer);
+  bench_stats_free(&tail);
+  bench_stats_free(&full);
+
+  return mismatches ? 1 : 0;
+}
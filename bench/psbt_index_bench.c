@@ -0,0 +1,389 @@
+/*
+ * Time spent turning a received PSBT into the signed one, by parsing it a
+ * second time and writing back every record (the previous signing pass) and
+ * by copying it in spans driven by the record index built while parsing it
+ * the first time.
+ *
+ * Usage: psbt-index-bench [-n runs] [-s seed] [-i inputs,...]
+ *
+ * Each PSBT spends the given number of P2WPKH inputs to two outputs. Every
+ * input has a witness UTXO and a BIP32 derivation, and one in four also has a
+ * non-witness UTXO. Both flows include the first parse and append the same
+ * signature record to every input, so the signing itself, which is done by
+ * the card, is left out. The outputs of both flows are compared before timing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bitcoin/bitcoin.h"
+#include "bitcoin/compactsize.h"
+#include "bitcoin/psbt.h"
+#include "crypto/script.h"
+
+#define BENCH_DEFAULT_RUNS 200
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_INPUTS 2000
+#define BENCH_OUTPUTS 2
+#define BENCH_RECORDS_PER_INPUT 3
+#define BENCH_PSBT_MAX_LEN (BENCH_MAX_INPUTS * 512)
+#define BENCH_PUBKEY_LEN 33
+#define BENCH_SIG_LEN 72
+#define BENCH_PREV_TX_LEN 119
+
+typedef struct {
+  psbt_t out;
+  int32_t index_in;
+  int32_t index_out;
+  size_t input_count;
+  size_t output_count;
+} bench_copy_ctx_t;
+
+static uint8_t g_psbt[BENCH_PSBT_MAX_LEN];
+static uint8_t g_out[2][BENCH_PSBT_MAX_LEN + (BENCH_MAX_INPUTS * 128)];
+static uint8_t g_tx[16 + (BENCH_MAX_INPUTS * BTC_TXIN_LEN) + (BENCH_OUTPUTS * 31)];
+static psbt_record_ref_t g_refs[BENCH_MAX_INPUTS * BENCH_RECORDS_PER_INPUT];
+static size_t g_ref_count;
+static uint8_t g_sig_key[BENCH_PUBKEY_LEN];
+static uint8_t g_sig_val[BENCH_SIG_LEN];
+static psbt_record_t g_sig = {
+  .type = PSBT_IN_PARTIAL_SIG,
+  .key = g_sig_key,
+  .key_size = BENCH_PUBKEY_LEN,
+  .val = g_sig_val,
+  .val_size = BENCH_SIG_LEN,
+  .scope = PSBT_SCOPE_INPUTS,
+};
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_random_bytes(uint8_t* out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = bench_rand();
+  }
+}
+
+static void bench_write(psbt_t* psbt, enum psbt_scope scope, uint8_t type, const uint8_t* key, size_t key_len, const uint8_t* val, size_t val_len) {
+  psbt_record_t rec = {
+    .type = type,
+    .key = (uint8_t*) key,
+    .key_size = key_len,
+    .val = (uint8_t*) val,
+    .val_size = val_len,
+    .scope = scope,
+  };
+
+  switch(scope) {
+  case PSBT_SCOPE_GLOBAL:
+    psbt_write_global_record(psbt, &rec);
+    break;
+  case PSBT_SCOPE_INPUTS:
+    psbt_write_input_record(psbt, &rec);
+    break;
+  case PSBT_SCOPE_OUTPUTS:
+    psbt_write_output_record(psbt, &rec);
+    break;
+  }
+}
+
+static size_t bench_build(int inputs) {
+  uint8_t* p = g_tx;
+  uint32_t version = 2;
+  uint32_t sequence = 0xfffffffd;
+  uint32_t lock_time = 0;
+
+  memcpy(p, &version, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  compactsize_write(p, inputs);
+  p += compactsize_length(inputs);
+
+  for (int i = 0; i < inputs; i++) {
+    uint32_t index = bench_rand() & 3;
+    bench_random_bytes(p, BTC_TXID_LEN);
+    p += BTC_TXID_LEN;
+    memcpy(p, &index, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+    *p++ = 0;
+    memcpy(p, &sequence, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+  }
+
+  *p++ = BENCH_OUTPUTS;
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    uint64_t amount = 10000 + (bench_rand() % 1000000);
+    memcpy(p, &amount, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    *p++ = 22;
+    *p++ = 0x00;
+    *p++ = BTC_PUBKEY_HASH_LEN;
+    bench_random_bytes(p, BTC_PUBKEY_HASH_LEN);
+    p += BTC_PUBKEY_HASH_LEN;
+  }
+
+  memcpy(p, &lock_time, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+
+  psbt_t psbt;
+  psbt_init(&psbt, g_psbt, sizeof(g_psbt));
+  bench_write(&psbt, PSBT_SCOPE_GLOBAL, PSBT_GLOBAL_UNSIGNED_TX, NULL, 0, g_tx, p - g_tx);
+
+  uint8_t pubkey[BENCH_PUBKEY_LEN];
+  uint8_t utxo[31];
+  uint8_t prev_tx[BENCH_PREV_TX_LEN];
+  uint8_t derivation[4 + (5 * sizeof(uint32_t))];
+
+  for (int i = 0; i < inputs; i++) {
+    psbt_new_input_record_set(&psbt);
+
+    if ((i & 3) == 0) {
+      bench_random_bytes(prev_tx, BENCH_PREV_TX_LEN);
+      bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_NON_WITNESS_UTXO, NULL, 0, prev_tx, BENCH_PREV_TX_LEN);
+    }
+
+    bench_random_bytes(utxo, sizeof(utxo));
+    utxo[8] = 22;
+    utxo[9] = 0x00;
+    utxo[10] = BTC_PUBKEY_HASH_LEN;
+    bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_WITNESS_UTXO, NULL, 0, utxo, sizeof(utxo));
+
+    bench_random_bytes(pubkey, BENCH_PUBKEY_LEN);
+    bench_random_bytes(derivation, sizeof(derivation));
+    bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_BIP32_DERIVATION, pubkey, BENCH_PUBKEY_LEN, derivation, sizeof(derivation));
+  }
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    psbt_new_output_record_set(&psbt);
+    bench_random_bytes(pubkey, BENCH_PUBKEY_LEN);
+    bench_random_bytes(derivation, sizeof(derivation));
+    bench_write(&psbt, PSBT_SCOPE_OUTPUTS, PSBT_OUT_BIP32_DERIVATION, pubkey, BENCH_PUBKEY_LEN, derivation, sizeof(derivation));
+  }
+
+  psbt_finalize(&psbt);
+
+  return psbt_size(&psbt);
+}
+
+static void bench_parse_handler(psbt_elem_t* rec) {
+  bench_copy_ctx_t* ctx = rec->user_data;
+
+  if (rec->type != PSBT_ELEM_TXELEM) {
+    return;
+  }
+
+  switch(rec->elem.txelem->elem_type) {
+  case PSBT_TXELEM_TXIN:
+    ctx->input_count++;
+    break;
+  case PSBT_TXELEM_TXOUT:
+    ctx->output_count++;
+    break;
+  default:
+    break;
+  }
+}
+
+static void bench_index_handler(psbt_elem_t* rec) {
+  bench_parse_handler(rec);
+
+  if ((rec->type == PSBT_ELEM_RECORD) && (rec->elem.rec->scope == PSBT_SCOPE_INPUTS)) {
+    psbt_record_ref(rec, &g_refs[g_ref_count++]);
+  }
+}
+
+static void bench_sign_until(bench_copy_ctx_t* ctx, int32_t index) {
+  while (ctx->index_in < index) {
+    if (ctx->index_in >= 0) {
+      psbt_write_input_record(&ctx->out, &g_sig);
+    }
+
+    if (++ctx->index_in < ctx->input_count) {
+      psbt_new_input_record_set(&ctx->out);
+    }
+  }
+}
+
+static void bench_copy_handler(psbt_elem_t* rec) {
+  bench_copy_ctx_t* ctx = rec->user_data;
+
+  if (rec->type == PSBT_ELEM_TXELEM) {
+    return;
+  }
+
+  switch(rec->elem.rec->scope) {
+  case PSBT_SCOPE_GLOBAL:
+    psbt_write_global_record(&ctx->out, rec->elem.rec);
+    break;
+  case PSBT_SCOPE_INPUTS:
+    bench_sign_until(ctx, rec->index);
+    psbt_write_input_record(&ctx->out, rec->elem.rec);
+    break;
+  case PSBT_SCOPE_OUTPUTS:
+    bench_sign_until(ctx, ctx->input_count);
+
+    while (ctx->index_out < rec->index) {
+      psbt_new_output_record_set(&ctx->out);
+      ctx->index_out++;
+    }
+
+    psbt_write_output_record(&ctx->out, rec->elem.rec);
+    break;
+  }
+}
+
+static void bench_ctx_init(bench_copy_ctx_t* ctx, uint8_t* out) {
+  psbt_init(&ctx->out, out, sizeof(g_out[0]));
+  ctx->index_in = -1;
+  ctx->index_out = -1;
+  ctx->input_count = 0;
+  ctx->output_count = 0;
+}
+
+static size_t bench_two_pass(size_t psbt_len) {
+  bench_copy_ctx_t ctx;
+  psbt_t psbt;
+
+  bench_ctx_init(&ctx, g_out[0]);
+  psbt_init(&psbt, g_psbt, psbt_len);
+
+  if (psbt_read(g_psbt, psbt_len, &psbt, bench_parse_handler, &ctx) != PSBT_OK) {
+    return 0;
+  }
+
+  psbt_init(&psbt, g_psbt, psbt_len);
+
+  if (psbt_read(g_psbt, psbt_len, &psbt, bench_copy_handler, &ctx) != PSBT_OK) {
+    return 0;
+  }
+
+  bench_sign_until(&ctx, ctx.input_count);
+
+  while (++ctx.index_out < ctx.output_count) {
+    psbt_new_output_record_set(&ctx.out);
+  }
+
+  psbt_finalize(&ctx.out);
+
+  return psbt_size(&ctx.out);
+}
+
+static size_t bench_indexed(size_t psbt_len) {
+  bench_copy_ctx_t ctx;
+  psbt_t psbt;
+
+  bench_ctx_init(&ctx, g_out[1]);
+  psbt_init(&psbt, g_psbt, psbt_len);
+  g_ref_count = 0;
+
+  if (psbt_read(g_psbt, psbt_len, &psbt, bench_index_handler, &ctx) != PSBT_OK) {
+    return 0;
+  }
+
+  const psbt_record_ref_t* ref = g_refs;
+  const psbt_record_ref_t* refs_end = &g_refs[g_ref_count];
+  size_t copied = 0;
+
+  for (size_t i = 0; i < ctx.input_count; i++) {
+    size_t end = copied;
+    psbt_record_t rec;
+
+    for (; (ref < refs_end) && (ref->index == i); ref++) {
+      psbt_record_deref(g_psbt, ref, &rec);
+      end = ref->offset + ref->len;
+    }
+
+    psbt_write_raw(&ctx.out, &g_psbt[copied], end - copied, PSBT_ST_INPUTS);
+    psbt_write_input_record(&ctx.out, &g_sig);
+    copied = end;
+  }
+
+  psbt_write_raw(&ctx.out, &g_psbt[copied], psbt_size(&psbt) - copied, PSBT_ST_FINALIZED);
+
+  return psbt_size(&ctx.out);
+}
+
+static double bench_mean_us(bench_stats_t* stats) {
+  return (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+  int runs = BENCH_DEFAULT_RUNS;
+  int sizes[BENCH_MAX_LIST] = { 10, 100, 500, 2000 };
+  int size_count = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:i:")) != -1) {
+    switch (opt) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'i':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n runs] [-s seed] [-i inputs,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (runs <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  bench_random_bytes(g_sig_key, BENCH_PUBKEY_LEN);
+  bench_random_bytes(g_sig_val, BENCH_SIG_LEN);
+
+  printf("%6s %8s | %10s | %10s %7s | %s\n", "inputs", "bytes", "two-pass", "indexed", "speedup", "output");
+
+  for (int s = 0; s < size_count; s++) {
+    if ((sizes[s] < 1) || (sizes[s] > BENCH_MAX_INPUTS)) {
+      fprintf(stderr, "inputs must be between 1 and %d\n", BENCH_MAX_INPUTS);
+      return 1;
+    }
+
+    size_t psbt_len = bench_build(sizes[s]);
+    size_t out_len = bench_two_pass(psbt_len);
+    bool match = (out_len != 0) && (bench_indexed(psbt_len) == out_len) && !memcmp(g_out[0], g_out[1], out_len);
+
+    bench_stats_t stats[2];
+    bench_stats_init(&stats[0], "two-pass");
+    bench_stats_init(&stats[1], "indexed");
+
+    for (int r = 0; r < runs; r++) {
+      uint64_t start = bench_now_ns();
+      bench_two_pass(psbt_len);
+      bench_stats_add(&stats[0], bench_now_ns() - start);
+
+      start = bench_now_ns();
+      bench_indexed(psbt_len);
+      bench_stats_add(&stats[1], bench_now_ns() - start);
+    }
+
+    double two_pass_us = bench_mean_us(&stats[0]);
+    double us = bench_mean_us(&stats[1]);
+    printf("%6d %8zu | %8.1fus | %8.1fus %6.2fx | %s\n", sizes[s], psbt_len, two_pass_us, us, two_pass_us / us, match ? "match" : "MISMATCH");
+
+    bench_stats_free(&stats[0]);
+    bench_stats_free(&stats[1]);
+
+    if (!match) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
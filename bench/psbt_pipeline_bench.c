@@ -0,0 +1,769 @@
+/*
+ * Per-input signing latency of core_btc_psbt_run() against a simulated card,
+ * with the card answering while the signer works, as when the UART receives
+ * the response in the background on the device, and with the card answering
+ * before keycard_cmd_sign_async() returns, which is how the core task waited
+ * on the card before the exchange was split.
+ *
+ * Usage: psbt-pipeline-bench [-n runs] [-s seed] [-i inputs,...] [-l latency_us,...]
+ *
+ * core_btc.c is built into the bench and keycard_cmd_sign_async() and
+ * keycard_cmd_wait() are replaced by the simulated card, so the parsing,
+ * sighash and signing loop are those of the firmware. The card thread sleeps
+ * until its deadline, as the card computes while the interrupts move the
+ * bytes, so the latency leaves the CPU to the signer. The latency reported
+ * runs from the confirmation of the transaction to the signed PSBT, divided
+ * by the number of inputs signed.
+ *
+ * For legacy and P2WPKH PSBTs where about one input in five belongs to
+ * another wallet, every run checks that each command is waited for before
+ * the next is submitted, that the k-th command signs the k-th input of the
+ * wallet and that the signed PSBT is the received one with the signature of
+ * each input appended after its records. A card error, a path which cannot
+ * be sent and a signed PSBT too large for its buffer must then stop signing
+ * with every submitted command waited for.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "mem.h"
+#include "bitcoin/bitcoin.h"
+#include "bitcoin/compactsize.h"
+#include "bitcoin/psbt.h"
+#include "bitcoin/txid.h"
+#include "crypto/script.h"
+#include "core/core.h"
+#include "keycard/keycard_cmdset.h"
+#include "ui/i18n.h"
+
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_INPUTS 400
+#define BENCH_OUTPUTS 2
+#define BENCH_PSBT_MAX_LEN (2 * CAMERA_FB_SIZE)
+#define BENCH_MAX_VOUT 2
+#define BENCH_SCRIPT_MAX_LEN 25
+#define BENCH_UTXO_MAX_LEN (sizeof(uint64_t) + 1 + BENCH_SCRIPT_MAX_LEN)
+#define BENCH_PARENT_MAX_LEN (sizeof(uint32_t) + 1 + BTC_TXIN_LEN + 1 + (BENCH_MAX_VOUT * BENCH_UTXO_MAX_LEN) + sizeof(uint32_t))
+#define BENCH_PUBKEY_LEN 33
+#define BENCH_PATH_LEN (5 * sizeof(uint32_t))
+#define BENCH_BAD_PATH_LEN 6
+#define BENCH_DER_SIG_LEN 70
+#define BENCH_CHECK_INPUTS 40
+#define BENCH_CHECK_LATENCY_US 100
+#define BENCH_FAIL_AT 5
+#define BENCH_PAD_KEY 0xfc
+
+typedef struct {
+  const char* name;
+  btc_input_type_t type;
+} bench_input_kind_t;
+
+static const bench_input_kind_t g_kinds[] = {
+  { "legacy", BTC_INPUT_TYPE_LEGACY },
+  { "p2wpkh", BTC_INPUT_TYPE_P2WPKH },
+};
+
+typedef struct {
+  uint8_t txid[BTC_TXID_LEN];
+  uint32_t vout;
+  uint8_t utxo[BENCH_UTXO_MAX_LEN];
+  size_t utxo_len;
+  uint8_t parent[BENCH_PARENT_MAX_LEN];
+  size_t parent_len;
+  uint8_t pubkey[BENCH_PUBKEY_LEN];
+  uint8_t derivation[sizeof(uint32_t) + BENCH_PATH_LEN];
+  size_t derivation_len;
+  bool ours;
+} bench_input_t;
+
+typedef struct {
+  uint8_t hash[SHA256_DIGEST_LENGTH];
+  uint8_t path[BIP44_MAX_PATH_LEN];
+  uint8_t path_len;
+} bench_command_t;
+
+// The simulated card. A command is in flight from its submission until it is waited for
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint64_t latency_ns;
+  bool serial;
+  bool busy;
+  bool in_flight;
+  bool quit;
+  keycard_t* kc;
+  int fail_at;
+  int submitted;
+  int waited;
+  int overlaps;
+  int stray_waits;
+  bench_command_t log[BENCH_MAX_INPUTS];
+} bench_card_t;
+
+APP_ALIGNED(uint8_t g_camera_fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE], 4);
+core_ctx_t g_core;
+
+static uint8_t g_psbt[BENCH_PSBT_MAX_LEN];
+static uint8_t g_expected[CAMERA_FB_SIZE];
+static uint8_t g_tx[16 + (BENCH_MAX_INPUTS * BTC_TXIN_LEN) + (BENCH_OUTPUTS * BENCH_UTXO_MAX_LEN)];
+static size_t g_tx_len;
+static bench_input_t g_inputs[BENCH_MAX_INPUTS];
+static int g_input_count;
+static uint8_t g_pad[CAMERA_FB_SIZE];
+static size_t g_pad_len;
+static uint32_t g_mfp;
+static uint64_t g_confirmed_ns;
+static bench_card_t g_card;
+
+app_err_t core_btc_psbt_run(const uint8_t* psbt_in, size_t psbt_len, uint8_t** psbt_out, size_t* out_len);
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_random_bytes(uint8_t* out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = bench_rand();
+  }
+}
+
+// The answer to a SIGN command: the public key and the signature, both derived from the signed hash. The signature
+// also carries the number of the command
+static void bench_card_answer(bench_card_t* card) {
+  apdu_t* apdu = &card->kc->apdu;
+  uint8_t* data = APDU_RESP(apdu);
+  int n = card->submitted - 1;
+
+  if (n == card->fail_at) {
+    data[0] = 0x69;
+    data[1] = 0x85;
+    apdu->lr = 2;
+    return;
+  }
+
+  const uint8_t* hash = card->log[n].hash;
+  uint8_t* p = data;
+  *p++ = 0xa0;
+  *p++ = 0x81;
+  *p++ = 2 + 65 + BENCH_DER_SIG_LEN;
+  *p++ = 0x80;
+  *p++ = 65;
+  *p++ = 0x04;
+  memcpy(p, hash, SHA256_DIGEST_LENGTH);
+  p += SHA256_DIGEST_LENGTH;
+  memset(p, 0x5a, SHA256_DIGEST_LENGTH);
+  p += SHA256_DIGEST_LENGTH;
+
+  *p++ = 0x30;
+  *p++ = BENCH_DER_SIG_LEN - 2;
+  *p++ = 0x02;
+  *p++ = 0x20;
+  memcpy(p, hash, SHA256_DIGEST_LENGTH);
+  p += SHA256_DIGEST_LENGTH;
+  *p++ = 0x02;
+  *p++ = 0x20;
+  *p++ = n >> 24;
+  *p++ = n >> 16;
+  *p++ = n >> 8;
+  *p++ = n;
+  memset(p, 0x11, SHA256_DIGEST_LENGTH - 4);
+  p += SHA256_DIGEST_LENGTH - 4;
+
+  *p++ = 0x90;
+  *p++ = 0x00;
+  apdu->lr = p - data;
+}
+
+static void bench_card_sleep(bench_card_t* card) {
+  uint64_t deadline = bench_now_ns() + card->latency_ns;
+  struct timespec ts = { .tv_sec = deadline / 1000000000ULL, .tv_nsec = deadline % 1000000000ULL };
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    ;
+  }
+}
+
+static void* bench_card_entry(void* arg) {
+  bench_card_t* card = arg;
+
+  pthread_mutex_lock(&card->lock);
+
+  while (1) {
+    while (!card->busy && !card->quit) {
+      pthread_cond_wait(&card->cond, &card->lock);
+    }
+
+    if (card->quit) {
+      break;
+    }
+
+    pthread_mutex_unlock(&card->lock);
+    bench_card_sleep(card);
+    bench_card_answer(card);
+    pthread_mutex_lock(&card->lock);
+
+    card->busy = false;
+    pthread_cond_broadcast(&card->cond);
+  }
+
+  pthread_mutex_unlock(&card->lock);
+
+  return NULL;
+}
+
+static void bench_card_reset(bench_card_t* card, uint64_t latency_ns, bool serial, int fail_at) {
+  card->latency_ns = latency_ns;
+  card->serial = serial;
+  card->fail_at = fail_at;
+  card->in_flight = false;
+  card->submitted = 0;
+  card->waited = 0;
+  card->overlaps = 0;
+  card->stray_waits = 0;
+}
+
+app_err_t keycard_cmd_sign_async(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash) {
+  bench_card_t* card = &g_card;
+
+  if (card->in_flight) {
+    card->overlaps++;
+  }
+
+  bench_command_t* cmd = &card->log[card->submitted % BENCH_MAX_INPUTS];
+  memcpy(cmd->hash, hash, SHA256_DIGEST_LENGTH);
+  memcpy(cmd->path, path, path_len);
+  cmd->path_len = path_len;
+
+  card->kc = kc;
+  card->in_flight = true;
+  card->submitted++;
+
+  if (card->serial) {
+    bench_card_sleep(card);
+    bench_card_answer(card);
+  } else {
+    pthread_mutex_lock(&card->lock);
+    card->busy = true;
+    pthread_cond_broadcast(&card->cond);
+    pthread_mutex_unlock(&card->lock);
+  }
+
+  return ERR_OK;
+}
+
+app_err_t keycard_cmd_wait(keycard_t* kc) {
+  bench_card_t* card = &g_card;
+
+  // on the device this would block forever
+  if (!card->in_flight) {
+    card->stray_waits++;
+    return ERR_HW;
+  }
+
+  pthread_mutex_lock(&card->lock);
+
+  while (card->busy) {
+    pthread_cond_wait(&card->cond, &card->lock);
+  }
+
+  pthread_mutex_unlock(&card->lock);
+
+  card->in_flight = false;
+  card->waited++;
+
+  return ERR_OK;
+}
+
+// Only used when signing messages
+app_err_t keycard_cmd_sign(keycard_t* kc, keycard_sign_algo_t algo, uint8_t* path, uint8_t path_len, uint8_t* hash) {
+  return ERR_HW;
+}
+
+app_err_t keycard_read_signature(uint8_t* data, uint8_t* digest, uint8_t* out_sig) {
+  return ERR_DATA;
+}
+
+app_err_t core_get_fingerprint(uint8_t* path, size_t len, uint32_t* fingerprint) {
+  *fingerprint = rev32(g_mfp);
+  return ERR_OK;
+}
+
+// The outputs have no derivations, so the change is never looked for
+app_err_t core_export_public(uint8_t* pub, uint8_t* chain, uint32_t* fingerprint, uint32_t* parent_fingerprint) {
+  return ERR_HW;
+}
+
+app_err_t core_set_derivation_path(struct crypto_keypath* derivation_path) {
+  return ERR_DATA;
+}
+
+app_err_t core_usb_get_response(command_t* cmd) {
+  return ERR_DATA;
+}
+
+core_evt_t ui_display_btc_tx(const btc_tx_ctx_t* tx) {
+  g_confirmed_ns = bench_now_ns();
+  return CORE_EVT_UI_OK;
+}
+
+core_evt_t ui_display_msg(addr_type_t addr_type, const uint8_t* address, const uint8_t* msg, uint32_t len) {
+  return CORE_EVT_UI_CANCELLED;
+}
+
+core_evt_t ui_display_ur_qr(const char* title, const uint8_t* data, uint32_t len, ur_type_t type) {
+  return CORE_EVT_UI_OK;
+}
+
+core_evt_t ui_info(info_icon_t icon, const char* msg, const char* subtext, ui_info_opt_t opts) {
+  return CORE_EVT_UI_OK;
+}
+
+void ui_card_transport_error() {
+}
+
+static void bench_write(psbt_t* psbt, enum psbt_scope scope, uint8_t type, const uint8_t* key, size_t key_len, const uint8_t* val, size_t val_len) {
+  psbt_record_t rec = {
+    .type = type,
+    .key = (uint8_t*) key,
+    .key_size = key_len,
+    .val = (uint8_t*) val,
+    .val_size = val_len,
+    .scope = scope,
+  };
+
+  switch(scope) {
+  case PSBT_SCOPE_GLOBAL:
+    psbt_write_global_record(psbt, &rec);
+    break;
+  case PSBT_SCOPE_INPUTS:
+    psbt_write_input_record(psbt, &rec);
+    break;
+  case PSBT_SCOPE_OUTPUTS:
+    psbt_write_output_record(psbt, &rec);
+    break;
+  }
+}
+
+static size_t bench_write_txout(uint8_t* out, btc_input_type_t type) {
+  uint64_t amount = 100000 + (bench_rand() % 1000000);
+  memcpy(out, &amount, sizeof(uint64_t));
+  uint8_t* script = &out[sizeof(uint64_t) + 1];
+
+  if (type == BTC_INPUT_TYPE_LEGACY) {
+    script[0] = 0x76;
+    script[1] = 0xa9;
+    script[2] = BTC_PUBKEY_HASH_LEN;
+    bench_random_bytes(&script[3], BTC_PUBKEY_HASH_LEN);
+    script[23] = 0x88;
+    script[24] = 0xac;
+    out[sizeof(uint64_t)] = 25;
+  } else {
+    script[0] = 0x00;
+    script[1] = BTC_PUBKEY_HASH_LEN;
+    bench_random_bytes(&script[2], BTC_PUBKEY_HASH_LEN);
+    out[sizeof(uint64_t)] = 22;
+  }
+
+  return sizeof(uint64_t) + 1 + out[sizeof(uint64_t)];
+}
+
+// Legacy inputs carry the whole transaction they spend, whose txid is checked against the one they reference
+static void bench_parent(bench_input_t* in, btc_input_type_t type) {
+  uint8_t* p = in->parent;
+  uint32_t version = 2;
+  uint32_t sequence = 0xffffffff;
+  uint32_t lock_time = 0;
+
+  memcpy(p, &version, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  *p++ = 1;
+  bench_random_bytes(p, BTC_TXID_LEN + sizeof(uint32_t));
+  p += BTC_TXID_LEN + sizeof(uint32_t);
+  *p++ = 0;
+  memcpy(p, &sequence, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  *p++ = in->vout + 1;
+
+  for (uint32_t i = 0; i <= in->vout; i++) {
+    size_t len = bench_write_txout(p, type);
+
+    if (i == in->vout) {
+      memcpy(in->utxo, p, len);
+      in->utxo_len = len;
+    }
+
+    p += len;
+  }
+
+  memcpy(p, &lock_time, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+
+  in->parent_len = p - in->parent;
+  btc_txid(in->parent, in->parent_len, in->txid);
+}
+
+static void bench_generate(btc_input_type_t type, int inputs) {
+  g_input_count = inputs;
+
+  for (int i = 0; i < inputs; i++) {
+    bench_input_t* in = &g_inputs[i];
+    in->vout = bench_rand() % BENCH_MAX_VOUT;
+    in->ours = (bench_rand() % 5) != 0;
+
+    if (type == BTC_INPUT_TYPE_LEGACY) {
+      bench_parent(in, type);
+    } else {
+      bench_random_bytes(in->txid, BTC_TXID_LEN);
+      in->utxo_len = bench_write_txout(in->utxo, type);
+      in->parent_len = 0;
+    }
+
+    bench_random_bytes(in->pubkey, BENCH_PUBKEY_LEN);
+    bench_random_bytes(in->derivation, sizeof(in->derivation));
+    in->derivation_len = sizeof(in->derivation);
+
+    if (in->ours) {
+      memcpy(in->derivation, &g_mfp, sizeof(uint32_t));
+    } else if (!memcmp(in->derivation, &g_mfp, sizeof(uint32_t))) {
+      in->derivation[0] ^= 0xff;
+    }
+  }
+
+  // the first input is always ours, so that every PSBT has something to sign
+  if (!g_inputs[0].ours) {
+    g_inputs[0].ours = true;
+    memcpy(g_inputs[0].derivation, &g_mfp, sizeof(uint32_t));
+  }
+
+  uint8_t* p = g_tx;
+  uint32_t version = 2;
+  uint32_t sequence = 0xfffffffd;
+  uint32_t lock_time = 0;
+
+  memcpy(p, &version, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  compactsize_write(p, inputs);
+  p += compactsize_length(inputs);
+
+  for (int i = 0; i < inputs; i++) {
+    memcpy(p, g_inputs[i].txid, BTC_TXID_LEN);
+    p += BTC_TXID_LEN;
+    memcpy(p, &g_inputs[i].vout, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+    *p++ = 0;
+    memcpy(p, &sequence, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+  }
+
+  *p++ = BENCH_OUTPUTS;
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    p += bench_write_txout(p, BTC_INPUT_TYPE_P2WPKH);
+  }
+
+  memcpy(p, &lock_time, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  g_tx_len = p - g_tx;
+}
+
+// The PSBT as received or, with the card log, as it must be once signed
+static size_t bench_serialize(uint8_t* out, size_t out_len, const bench_card_t* card) {
+  psbt_t psbt;
+  psbt_init(&psbt, out, out_len);
+  bench_write(&psbt, PSBT_SCOPE_GLOBAL, PSBT_GLOBAL_UNSIGNED_TX, NULL, 0, g_tx, g_tx_len);
+
+  int signed_count = 0;
+
+  for (int i = 0; i < g_input_count; i++) {
+    bench_input_t* in = &g_inputs[i];
+    psbt_new_input_record_set(&psbt);
+
+    if (in->parent_len) {
+      bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_NON_WITNESS_UTXO, NULL, 0, in->parent, in->parent_len);
+    } else {
+      bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_WITNESS_UTXO, NULL, 0, in->utxo, in->utxo_len);
+    }
+
+    bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_BIP32_DERIVATION, in->pubkey, BENCH_PUBKEY_LEN, in->derivation, in->derivation_len);
+
+    if (g_pad_len) {
+      uint8_t key = i;
+      bench_write(&psbt, PSBT_SCOPE_INPUTS, BENCH_PAD_KEY, &key, 1, g_pad, g_pad_len);
+    }
+
+    if (card && in->ours) {
+      const uint8_t* hash = card->log[signed_count].hash;
+      uint8_t key[BENCH_PUBKEY_LEN];
+      key[0] = 0x02;
+      memcpy(&key[1], hash, SHA256_DIGEST_LENGTH);
+
+      uint8_t sig[BENCH_DER_SIG_LEN + 1] = { 0x30, BENCH_DER_SIG_LEN - 2, 0x02, 0x20 };
+      memcpy(&sig[4], hash, SHA256_DIGEST_LENGTH);
+      sig[36] = 0x02;
+      sig[37] = 0x20;
+      sig[38] = signed_count >> 24;
+      sig[39] = signed_count >> 16;
+      sig[40] = signed_count >> 8;
+      sig[41] = signed_count;
+      memset(&sig[42], 0x11, SHA256_DIGEST_LENGTH - 4);
+      sig[BENCH_DER_SIG_LEN] = SIGHASH_ALL;
+
+      bench_write(&psbt, PSBT_SCOPE_INPUTS, PSBT_IN_PARTIAL_SIG, key, BENCH_PUBKEY_LEN, sig, sizeof(sig));
+      signed_count++;
+    }
+  }
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    psbt_new_output_record_set(&psbt);
+  }
+
+  psbt_finalize(&psbt);
+
+  return psbt_size(&psbt);
+}
+
+static int bench_signable_count() {
+  int count = 0;
+
+  for (int i = 0; i < g_input_count; i++) {
+    count += g_inputs[i].ours;
+  }
+
+  return count;
+}
+
+// The card gets the path of the derivation with each element in big endian
+static bool bench_path_matches(const bench_command_t* cmd, const bench_input_t* in) {
+  size_t path_len = in->derivation_len - sizeof(uint32_t);
+
+  if (cmd->path_len != path_len) {
+    return false;
+  }
+
+  for (size_t i = 0; i < path_len; i += 4) {
+    for (int j = 0; j < 4; j++) {
+      if (cmd->path[i + j] != in->derivation[sizeof(uint32_t) + i + 3 - j]) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Every command must be waited for before the next one is sent and the card must be idle once signing stops
+static bool bench_card_idle(const bench_card_t* card) {
+  return !card->in_flight && !card->overlaps && !card->stray_waits && (card->submitted == card->waited);
+}
+
+static bool bench_check_signed(const uint8_t* out, size_t out_len) {
+  if (!bench_card_idle(&g_card) || (g_card.submitted != bench_signable_count())) {
+    return false;
+  }
+
+  int k = 0;
+
+  for (int i = 0; i < g_input_count; i++) {
+    if (g_inputs[i].ours && !bench_path_matches(&g_card.log[k++], &g_inputs[i])) {
+      return false;
+    }
+  }
+
+  size_t expected_len = bench_serialize(g_expected, sizeof(g_expected), &g_card);
+  return (expected_len == out_len) && !memcmp(g_expected, out, out_len);
+}
+
+static app_err_t bench_run(size_t psbt_len, uint8_t** out, size_t* out_len, uint64_t* sign_ns) {
+  app_err_t err = core_btc_psbt_run(g_psbt, psbt_len, out, out_len);
+  *sign_ns = bench_now_ns() - g_confirmed_ns;
+  return err;
+}
+
+static bool bench_check_failure(const char* name, const char* kind, size_t psbt_len, app_err_t expected, int submitted) {
+  uint8_t* out;
+  size_t out_len;
+  uint64_t ns;
+
+  app_err_t err = bench_run(psbt_len, &out, &out_len, &ns);
+  bool ok = (err == expected) && bench_card_idle(&g_card) && ((submitted < 0) ? (g_card.submitted > 0) : (g_card.submitted == submitted));
+  printf("  %-7s %-14s stopped after %3d commands, %3d waited for: %s\n", kind, name, g_card.submitted, g_card.waited, ok ? "ok" : "FAILED");
+
+  return ok;
+}
+
+// Signing must stop with the card idle whichever step fails
+static bool bench_check_failures(const bench_input_kind_t* kind) {
+  bool ok = true;
+  uint64_t latency_ns = BENCH_CHECK_LATENCY_US * 1000ULL;
+
+  bench_generate(kind->type, BENCH_CHECK_INPUTS);
+  size_t psbt_len = bench_serialize(g_psbt, sizeof(g_psbt), NULL);
+
+  bench_card_reset(&g_card, latency_ns, false, BENCH_FAIL_AT);
+  ok &= bench_check_failure("card error", kind->name, psbt_len, ERR_CRYPTO, BENCH_FAIL_AT + 1);
+
+  int k = 0;
+  bench_input_t* bad = NULL;
+
+  for (int i = 0; i < g_input_count; i++) {
+    if (g_inputs[i].ours && (k++ == BENCH_FAIL_AT)) {
+      bad = &g_inputs[i];
+      break;
+    }
+  }
+
+  bad->derivation_len = sizeof(uint32_t) + BENCH_BAD_PATH_LEN;
+  psbt_len = bench_serialize(g_psbt, sizeof(g_psbt), NULL);
+  bench_card_reset(&g_card, latency_ns, false, -1);
+  ok &= bench_check_failure("bad path", kind->name, psbt_len, ERR_DATA, BENCH_FAIL_AT);
+  bad->derivation_len = sizeof(bad->derivation);
+
+  // the signed PSBT fills its buffer about three quarters through the inputs
+  g_pad_len = CAMERA_FB_SIZE / ((BENCH_CHECK_INPUTS * 3) / 4);
+  psbt_len = bench_serialize(g_psbt, sizeof(g_psbt), NULL);
+  bench_card_reset(&g_card, latency_ns, false, -1);
+  ok &= bench_check_failure("output full", kind->name, psbt_len, ERR_DATA, -1);
+  g_pad_len = 0;
+
+  return ok;
+}
+
+static double bench_per_input_us(bench_stats_t* stats) {
+  return ((bench_stats_total(stats) / (double) stats->count) / bench_signable_count()) / 1000.0;
+}
+
+static bool bench_measure(const bench_input_kind_t* kind, int inputs, int latency_us, int runs) {
+  size_t psbt_len = bench_serialize(g_psbt, sizeof(g_psbt), NULL);
+  bench_stats_t stats[2];
+  bench_stats_init(&stats[0], "serial");
+  bench_stats_init(&stats[1], "pipelined");
+
+  bool ok = true;
+
+  for (int r = 0; (r < runs) && ok; r++) {
+    for (int m = 0; m < 2; m++) {
+      uint8_t* out;
+      size_t out_len;
+      uint64_t ns;
+
+      bench_card_reset(&g_card, latency_us * 1000ULL, (m == 0), -1);
+
+      if ((bench_run(psbt_len, &out, &out_len, &ns) != ERR_OK) || !bench_check_signed(out, out_len)) {
+        ok = false;
+        break;
+      }
+
+      bench_stats_add(&stats[m], ns);
+    }
+  }
+
+  if (ok) {
+    double serial_us = bench_per_input_us(&stats[0]);
+    double us = bench_per_input_us(&stats[1]);
+    printf("%-7s %6d %6dus | %8.1fus | %8.1fus %6.2fx | ok\n", kind->name, inputs, latency_us, serial_us, us, serial_us / us);
+  } else {
+    printf("%-7s %6d %6dus | signing failed or the signed PSBT is wrong\n", kind->name, inputs, latency_us);
+  }
+
+  bench_stats_free(&stats[0]);
+  bench_stats_free(&stats[1]);
+
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  int runs = BENCH_DEFAULT_RUNS;
+  int sizes[BENCH_MAX_LIST] = { 10, 100, 250 };
+  int size_count = 3;
+  int latencies[BENCH_MAX_LIST] = { 0, 100, 1000 };
+  int latency_count = 3;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:i:l:")) != -1) {
+    switch (opt) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'i':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    case 'l':
+      latency_count = bench_parse_list(optarg, latencies);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n runs] [-s seed] [-i inputs,...] [-l latency_us,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (runs <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  for (int s = 0; s < size_count; s++) {
+    if ((sizes[s] < 1) || (sizes[s] > BENCH_MAX_INPUTS)) {
+      fprintf(stderr, "inputs must be between 1 and %d\n", BENCH_MAX_INPUTS);
+      return 1;
+    }
+  }
+
+  // the errors are reported with the strings of the UI
+  i18n_set_strings(i18n_english_strings);
+
+  // the default slack of 50us would be added to every card command
+  prctl(PR_SET_TIMERSLACK, 1);
+  g_mfp = bench_rand();
+
+  pthread_mutex_init(&g_card.lock, NULL);
+  pthread_cond_init(&g_card.cond, NULL);
+  pthread_create(&g_card.thread, NULL, bench_card_entry, &g_card);
+
+  int ret = 0;
+
+  printf("%-7s %6s %8s | %10s | %10s %7s | %s\n", "type", "inputs", "card", "serial", "pipelined", "speedup", "signed PSBT");
+
+  for (int k = 0; (k < (sizeof(g_kinds) / sizeof(bench_input_kind_t))) && !ret; k++) {
+    for (int s = 0; (s < size_count) && !ret; s++) {
+      bench_generate(g_kinds[k].type, sizes[s]);
+
+      for (int l = 0; (l < latency_count) && !ret; l++) {
+        ret = !bench_measure(&g_kinds[k], sizes[s], latencies[l], runs);
+      }
+    }
+  }
+
+  if (!ret) {
+    printf("\nfailures with %d inputs and a %dus card:\n", BENCH_CHECK_INPUTS, BENCH_CHECK_LATENCY_US);
+
+    for (int k = 0; k < (sizeof(g_kinds) / sizeof(bench_input_kind_t)); k++) {
+      ret |= !bench_check_failures(&g_kinds[k]);
+    }
+  }
+
+  pthread_mutex_lock(&g_card.lock);
+  g_card.quit = true;
+  pthread_cond_broadcast(&g_card.cond);
+  pthread_mutex_unlock(&g_card.lock);
+  pthread_join(g_card.thread, NULL);
+
+  return ret;
+}
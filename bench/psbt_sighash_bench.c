@@ -0,0 +1,345 @@
+/*
+ * Time spent computing the signature hashes of every input of a transaction,
+ * with the previous per-input computation (sighash_ref.c) and with the shared
+ * material precomputed once by btc_sighash_init().
+ *
+ * Usage: psbt-sighash-bench [-n runs] [-s seed] [-i inputs,...]
+ *
+ * For each input type (legacy P2PKH, P2WPKH and P2TR key path) a transaction
+ * spending the given number of inputs to two outputs is built and parsed with
+ * psbt_btc_tx_parse(), so that the input and output pointers refer to the raw
+ * unsigned transaction as they do when signing a PSBT. The time reported is
+ * for the whole transaction, including the common hashes. Before timing, the
+ * digests of both implementations are compared for every input and every
+ * sighash type.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "sighash_ref.h"
+#include "bitcoin/compactsize.h"
+#include "bitcoin/sighash.h"
+#include "crypto/script.h"
+#include "crypto/segwit_addr.h"
+
+#define BENCH_DEFAULT_RUNS 2000
+#define BENCH_MAX_LIST 16
+#define BENCH_OUTPUTS 2
+#define BENCH_SCRIPT_MAX_LEN 34
+#define BENCH_MAX_INPUTS REF_MAX_INPUTS
+#define BENCH_TX_MAX_LEN (16 + (BENCH_MAX_INPUTS * BTC_TXIN_LEN) + (BENCH_OUTPUTS * (9 + BENCH_SCRIPT_MAX_LEN)))
+#define BENCH_UTXO_MAX_LEN (sizeof(uint64_t) + 1 + BENCH_SCRIPT_MAX_LEN)
+
+typedef struct {
+  const char* name;
+  btc_input_type_t type;
+  uint8_t script_len;
+  uint32_t sighash_flag;
+} bench_input_kind_t;
+
+static const bench_input_kind_t g_kinds[] = {
+  { "legacy", BTC_INPUT_TYPE_LEGACY, 25, SIGHASH_ALL },
+  { "p2wpkh", BTC_INPUT_TYPE_P2WPKH, 22, SIGHASH_ALL },
+  { "p2tr", BTC_INPUT_TYPE_P2TR, 34, SIGHASH_DEFAULT },
+};
+
+static const uint32_t g_sighash_flags[] = {
+  SIGHASH_ALL, SIGHASH_NONE, SIGHASH_SINGLE,
+  SIGHASH_ALL | SIGHASH_ANYONECANPAY, SIGHASH_NONE | SIGHASH_ANYONECANPAY, SIGHASH_SINGLE | SIGHASH_ANYONECANPAY,
+};
+
+// the unsigned transaction is followed by the spent outputs, like the records of a PSBT
+static uint8_t g_psbt[BENCH_TX_MAX_LEN + (BENCH_MAX_INPUTS * BENCH_UTXO_MAX_LEN)];
+static uint8_t g_internal_keys[BENCH_MAX_INPUTS][BTC_TAPROOT_WITPROG_LEN];
+static ref_tx_ctx_t g_ref_ctx;
+static btc_tx_ctx_t g_tx_ctx;
+static btc_input_t g_inputs[BENCH_MAX_INPUTS];
+static btc_output_t g_outputs[BENCH_OUTPUTS];
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_random_bytes(uint8_t* out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = bench_rand();
+  }
+}
+
+static void bench_txelem_handler(psbt_txelem_t* elem) {
+  ref_tx_ctx_t* tx_ctx = elem->user_data;
+
+  switch(elem->elem_type) {
+  case PSBT_TXELEM_TXIN:
+    tx_ctx->inputs[tx_ctx->input_count++] = *elem->elem.txin;
+    break;
+  case PSBT_TXELEM_TXOUT:
+    tx_ctx->outputs[tx_ctx->output_count++] = *elem->elem.txout;
+    break;
+  case PSBT_TXELEM_TX:
+    tx_ctx->tx = *elem->elem.tx;
+    break;
+  default:
+    break;
+  }
+}
+
+static size_t bench_write_script(uint8_t* out, btc_input_type_t type) {
+  switch(type) {
+  case BTC_INPUT_TYPE_LEGACY:
+    out[0] = 0x76;
+    out[1] = 0xa9;
+    out[2] = BTC_PUBKEY_HASH_LEN;
+    bench_random_bytes(&out[3], BTC_PUBKEY_HASH_LEN);
+    out[23] = 0x88;
+    out[24] = 0xac;
+    return 25;
+  case BTC_INPUT_TYPE_P2TR:
+    out[0] = 0x51;
+    out[1] = BTC_TAPROOT_WITPROG_LEN;
+    bench_random_bytes(&out[2], BTC_TAPROOT_WITPROG_LEN);
+    return 34;
+  default:
+    out[0] = 0x00;
+    out[1] = BTC_PUBKEY_HASH_LEN;
+    bench_random_bytes(&out[2], BTC_PUBKEY_HASH_LEN);
+    return 22;
+  }
+}
+
+static void bench_build(const bench_input_kind_t* kind, int inputs) {
+  uint8_t* p = g_psbt;
+  uint32_t version = 2;
+  uint32_t lock_time = 0;
+
+  memcpy(p, &version, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+  *p++ = inputs;
+
+  for (int i = 0; i < inputs; i++) {
+    uint32_t index = bench_rand() & 3;
+    uint32_t sequence = 0xfffffffd;
+    bench_random_bytes(p, BTC_TXID_LEN);
+    p += BTC_TXID_LEN;
+    memcpy(p, &index, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+    *p++ = 0;
+    memcpy(p, &sequence, sizeof(uint32_t));
+    p += sizeof(uint32_t);
+  }
+
+  *p++ = BENCH_OUTPUTS;
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    uint64_t amount = 10000 + (bench_rand() % 1000000);
+    memcpy(p, &amount, sizeof(uint64_t));
+    p += sizeof(uint64_t);
+    size_t len = bench_write_script(&p[1], BTC_INPUT_TYPE_P2WPKH);
+    p[0] = len;
+    p += len + 1;
+  }
+
+  memcpy(p, &lock_time, sizeof(uint32_t));
+  p += sizeof(uint32_t);
+
+  memset(&g_ref_ctx, 0, sizeof(ref_tx_ctx_t));
+
+  if (psbt_btc_tx_parse(g_psbt, p - g_psbt, &g_ref_ctx, bench_txelem_handler) != PSBT_OK) {
+    fprintf(stderr, "cannot parse the generated transaction\n");
+    exit(1);
+  }
+
+  memset(&g_tx_ctx, 0, sizeof(btc_tx_ctx_t));
+  g_tx_ctx.psbt = g_psbt;
+  g_tx_ctx.tx = g_ref_ctx.tx;
+  g_tx_ctx.txins = g_ref_ctx.inputs[0].txid;
+  g_tx_ctx.txouts = g_ref_ctx.outputs[0].amount;
+  g_tx_ctx.txouts_len = &g_ref_ctx.outputs[BENCH_OUTPUTS - 1].script[g_ref_ctx.outputs[BENCH_OUTPUTS - 1].script_len] - g_tx_ctx.txouts;
+  g_tx_ctx.inputs = g_inputs;
+  g_tx_ctx.outputs = g_outputs;
+  g_tx_ctx.input_count = inputs;
+  g_tx_ctx.output_count = BENCH_OUTPUTS;
+
+  for (int i = 0; i < BENCH_OUTPUTS; i++) {
+    g_outputs[i].txout = g_ref_ctx.outputs[i].amount - g_psbt;
+    g_outputs[i].change = false;
+  }
+
+  for (int i = 0; i < inputs; i++) {
+    psbt_input_data_t* data = &g_ref_ctx.input_data[i];
+    uint64_t amount = 100000 + (bench_rand() % 1000000);
+    memcpy(p, &amount, sizeof(uint64_t));
+    data->amount = p;
+    data->script_pubkey = &p[sizeof(uint64_t) + 1];
+    data->script_pubkey_len = bench_write_script(data->script_pubkey, kind->type);
+    p[sizeof(uint64_t)] = data->script_pubkey_len;
+    p += sizeof(uint64_t) + 1 + data->script_pubkey_len;
+    data->input_type = kind->type;
+    data->sighash_flag = kind->sighash_flag;
+    data->witness = kind->type != BTC_INPUT_TYPE_LEGACY;
+    data->can_sign = true;
+
+    if (kind->type == BTC_INPUT_TYPE_P2TR) {
+      bench_random_bytes(g_internal_keys[i], BTC_TAPROOT_WITPROG_LEN);
+      data->taproot_internal_key = g_internal_keys[i];
+      data->has_taproot_internal_key = true;
+    }
+
+    g_inputs[i].utxo = data->amount - g_psbt;
+    g_inputs[i].sighash_flag = data->sighash_flag;
+    g_inputs[i].input_type = data->input_type;
+    g_inputs[i].can_sign = true;
+  }
+}
+
+static app_err_t bench_sighash(bool ref, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH], uint8_t tweak[SHA256_DIGEST_LENGTH]) {
+  const psbt_input_data_t* input = &g_ref_ctx.input_data[index];
+
+  switch(input->input_type) {
+  case BTC_INPUT_TYPE_LEGACY:
+    return ref ? ref_sighash_legacy(&g_ref_ctx, index, digest) : btc_sighash_legacy(&g_tx_ctx, input, index, digest);
+  case BTC_INPUT_TYPE_P2TR:
+    if (ref) {
+      ref_sighash_taptweak(&g_ref_ctx, index, tweak);
+      return ref_sighash_taproot(&g_ref_ctx, index, digest);
+    } else {
+      btc_sighash_taptweak(&g_tx_ctx, input, tweak);
+      return btc_sighash_taproot(&g_tx_ctx, input, index, digest);
+    }
+  default:
+    return ref ? ref_sighash_segwit(&g_ref_ctx, index, digest) : btc_sighash_segwit(&g_tx_ctx, input, index, digest);
+  }
+}
+
+static void bench_sign_all(bool ref) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint8_t tweak[SHA256_DIGEST_LENGTH];
+
+  if (ref) {
+    ref_sighash_init(&g_ref_ctx);
+  } else {
+    btc_sighash_init(&g_tx_ctx);
+  }
+
+  for (size_t i = 0; i < g_tx_ctx.input_count; i++) {
+    bench_sighash(ref, i, digest, tweak);
+  }
+}
+
+static void bench_set_sighash_flag(uint32_t flag) {
+  for (size_t i = 0; i < g_tx_ctx.input_count; i++) {
+    g_ref_ctx.input_data[i].sighash_flag = flag;
+    g_inputs[i].sighash_flag = flag;
+  }
+}
+
+static int bench_check(const bench_input_kind_t* kind) {
+  int mismatches = 0;
+  uint8_t ref_digest[SHA256_DIGEST_LENGTH];
+  uint8_t ref_tweak[SHA256_DIGEST_LENGTH];
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  uint8_t tweak[SHA256_DIGEST_LENGTH];
+
+  for (int f = 0; f < (sizeof(g_sighash_flags) / sizeof(uint32_t)); f++) {
+    bench_set_sighash_flag(g_sighash_flags[f]);
+    ref_sighash_init(&g_ref_ctx);
+    btc_sighash_init(&g_tx_ctx);
+
+    for (size_t i = 0; i < g_tx_ctx.input_count; i++) {
+      // SIGHASH_SINGLE without a matching output is now rejected, so there is nothing to compare
+      if (bench_sighash(false, i, digest, tweak) != ERR_OK) {
+        continue;
+      }
+
+      if ((bench_sighash(true, i, ref_digest, ref_tweak) != ERR_OK) || memcmp(digest, ref_digest, SHA256_DIGEST_LENGTH) ||
+          ((kind->type == BTC_INPUT_TYPE_P2TR) && memcmp(tweak, ref_tweak, SHA256_DIGEST_LENGTH))) {
+        mismatches++;
+      }
+    }
+  }
+
+  bench_set_sighash_flag(kind->sighash_flag);
+
+  return mismatches;
+}
+
+static double bench_mean_us(bench_stats_t* stats) {
+  return (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+  int runs = BENCH_DEFAULT_RUNS;
+  int sizes[BENCH_MAX_LIST] = { 1, 10, 40 };
+  int size_count = 3;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:i:")) != -1) {
+    switch (opt) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'i':
+      size_count = bench_parse_list(optarg, sizes);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n runs] [-s seed] [-i inputs,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (runs <= 0) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  printf("%-7s %6s | %10s | %10s %7s | %s\n", "type", "inputs", "per-input", "shared", "speedup", "digests");
+
+  for (int k = 0; k < (sizeof(g_kinds) / sizeof(bench_input_kind_t)); k++) {
+    for (int s = 0; s < size_count; s++) {
+      if ((sizes[s] < 1) || (sizes[s] > BENCH_MAX_INPUTS)) {
+        fprintf(stderr, "inputs must be between 1 and %d\n", BENCH_MAX_INPUTS);
+        return 1;
+      }
+
+      bench_build(&g_kinds[k], sizes[s]);
+      int mismatches = bench_check(&g_kinds[k]);
+
+      bench_stats_t stats[2];
+      bench_stats_init(&stats[0], "per-input");
+      bench_stats_init(&stats[1], "shared");
+
+      for (int r = 0; r < runs; r++) {
+        for (int ref = 1; ref >= 0; ref--) {
+          uint64_t start = bench_now_ns();
+          bench_sign_all(ref);
+          bench_stats_add(&stats[!ref], bench_now_ns() - start);
+        }
+      }
+
+      double ref_us = bench_mean_us(&stats[0]);
+      double us = bench_mean_us(&stats[1]);
+      printf("%-7s %6d | %8.2fus | %8.2fus %6.2fx | %s\n", g_kinds[k].name, sizes[s], ref_us, us, ref_us / us, mismatches ? "MISMATCH" : "match");
+
+      bench_stats_free(&stats[0]);
+      bench_stats_free(&stats[1]);
+
+      if (mismatches) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
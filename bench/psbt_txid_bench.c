@@ -0,0 +1,352 @@
+/*
+ * Time spent verifying the txids of the non-witness UTXOs of a PSBT whose
+ * inputs spend outputs of a few parent transactions, hashing every copy of a
+ * parent with the previous per-field updates and with btc_txid_verify(), which
+ * hashes the inputs and outputs in one piece and compares later copies of a
+ * verified parent instead of hashing them again.
+ *
+ * Usage: psbt-txid-bench [-n runs] [-s seed] [-i inputs] [-p parents,...]
+ *
+ * Each parent has one input and enough P2WPKH outputs to reach about 2 KB, and
+ * is tested both with and without witnesses. Inputs pick their parent at
+ * random, so with more parents than cache entries some copies are hashed again. The PSBT is built with the PSBT
+ * writer and parsed with psbt_read() to find the records, as on the device.
+ * Before timing, every input is checked to verify and a copy of a parent with a
+ * single changed byte is checked to be rejected even after the parent is cached.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "bitcoin/bitcoin.h"
+#include "bitcoin/compactsize.h"
+#include "bitcoin/psbt.h"
+#include "bitcoin/txid.h"
+#include "crypto/script.h"
+
+#define BENCH_DEFAULT_RUNS 200
+#define BENCH_DEFAULT_INPUTS 64
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_INPUTS 256
+#define BENCH_PARENT_OUTPUTS 64
+#define BENCH_PARENT_MAX_LEN (256 + (BENCH_PARENT_OUTPUTS * 31))
+#define BENCH_PSBT_MAX_LEN (BENCH_MAX_INPUTS * (BENCH_PARENT_MAX_LEN + 64))
+
+typedef struct {
+  const uint8_t* utxo[BENCH_MAX_INPUTS];
+  size_t utxo_len[BENCH_MAX_INPUTS];
+  const uint8_t* txins;
+  size_t count;
+} bench_inputs_t;
+
+static uint8_t g_parents[BENCH_MAX_INPUTS][BENCH_PARENT_MAX_LEN];
+static size_t g_parent_len[BENCH_MAX_INPUTS];
+static uint8_t g_parent_txid[BENCH_MAX_INPUTS][BTC_TXID_LEN];
+static uint8_t g_tx[16 + (BENCH_MAX_INPUTS * BTC_TXIN_LEN) + 31];
+static uint8_t g_psbt[BENCH_PSBT_MAX_LEN];
+static bench_inputs_t g_inputs;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_random_bytes(uint8_t* out, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = bench_rand();
+  }
+}
+
+// the txid computation used before, with an update for each field of a segwit transaction
+static void ref_txid(uint8_t* tx, size_t tx_len, uint8_t out[SHA256_DIGEST_LENGTH]) {
+  SHA256_CTX ctx;
+  sha256_Init(&ctx);
+
+  if (tx[4] == 0) {
+    uint8_t* p = tx;
+    sha256_Update(&ctx, p, sizeof(uint32_t));
+    p += sizeof(uint32_t) + sizeof(uint16_t);
+
+    uint32_t count = compactsize_read(p, NULL);
+    uint32_t lenlen = compactsize_peek_length(*p);
+    sha256_Update(&ctx, p, lenlen);
+    p += lenlen;
+
+    for(int i = 0; i < count; i++) {
+      sha256_Update(&ctx, p, SHA256_DIGEST_LENGTH + sizeof(uint32_t));
+      p += SHA256_DIGEST_LENGTH + sizeof(uint32_t);
+      uint32_t scriptlen = compactsize_read(p, NULL);
+      lenlen = compactsize_peek_length(*p);
+      sha256_Update(&ctx, p, lenlen + scriptlen + sizeof(uint32_t));
+      p += lenlen + scriptlen + sizeof(uint32_t);
+    }
+
+    count = compactsize_read(p, NULL);
+    lenlen = compactsize_peek_length(*p);
+    sha256_Update(&ctx, p, lenlen);
+    p += lenlen;
+
+    for(int i = 0; i < count; i++) {
+      sha256_Update(&ctx, p, sizeof(uint64_t));
+      p += sizeof(uint64_t);
+      uint32_t scriptlen = compactsize_read(p, NULL);
+      lenlen = compactsize_peek_length(*p);
+      sha256_Update(&ctx, p, lenlen + scriptlen);
+      p += lenlen + scriptlen;
+    }
+
+    sha256_Update(&ctx, &tx[tx_len - 4], sizeof(uint32_t));
+  } else {
+    sha256_Update(&ctx, tx, tx_len);
+  }
+
+  sha256_Final(&ctx, out);
+  sha256_Raw(out, SHA256_DIGEST_LENGTH, out);
+}
+
+static bool ref_txid_verify(uint8_t* tx, size_t tx_len, const uint8_t txid[SHA256_DIGEST_LENGTH]) {
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  ref_txid(tx, tx_len, digest);
+  return memcmp(digest, txid, SHA256_DIGEST_LENGTH) == 0;
+}
+
+static uint8_t* bench_write_u32(uint8_t* p, uint32_t val) {
+  memcpy(p, &val, sizeof(uint32_t));
+  return p + sizeof(uint32_t);
+}
+
+static uint8_t* bench_write_p2wpkh_output(uint8_t* p) {
+  uint64_t amount = 10000 + (bench_rand() % 1000000);
+  memcpy(p, &amount, sizeof(uint64_t));
+  p += sizeof(uint64_t);
+  *p++ = 22;
+  *p++ = 0x00;
+  *p++ = BTC_PUBKEY_HASH_LEN;
+  bench_random_bytes(p, BTC_PUBKEY_HASH_LEN);
+  return p + BTC_PUBKEY_HASH_LEN;
+}
+
+static void bench_build_parent(int index, bool segwit) {
+  uint8_t* p = g_parents[index];
+
+  p = bench_write_u32(p, 2);
+
+  if (segwit) {
+    *p++ = 0x00;
+    *p++ = 0x01;
+  }
+
+  *p++ = 1;
+  bench_random_bytes(p, BTC_TXID_LEN + sizeof(uint32_t));
+  p += BTC_TXID_LEN + sizeof(uint32_t);
+  *p++ = 0;
+  p = bench_write_u32(p, 0xfffffffd);
+
+  *p++ = BENCH_PARENT_OUTPUTS;
+
+  for (int i = 0; i < BENCH_PARENT_OUTPUTS; i++) {
+    p = bench_write_p2wpkh_output(p);
+  }
+
+  if (segwit) {
+    *p++ = 2;
+    *p++ = 72;
+    bench_random_bytes(p, 72);
+    p += 72;
+    *p++ = 33;
+    bench_random_bytes(p, 33);
+    p += 33;
+  }
+
+  p = bench_write_u32(p, 0);
+
+  g_parent_len[index] = p - g_parents[index];
+  ref_txid(g_parents[index], g_parent_len[index], g_parent_txid[index]);
+}
+
+static void bench_read_handler(psbt_elem_t* rec) {
+  bench_inputs_t* inputs = rec->user_data;
+
+  if (rec->type == PSBT_ELEM_TXELEM) {
+    if ((rec->elem.txelem->elem_type == PSBT_TXELEM_TXIN) && (inputs->count++ == 0)) {
+      inputs->txins = rec->elem.txelem->elem.txin->txid;
+    }
+  } else if ((rec->elem.rec->scope == PSBT_SCOPE_INPUTS) && (rec->elem.rec->type == PSBT_IN_NON_WITNESS_UTXO)) {
+    inputs->utxo[rec->index] = rec->elem.rec->val;
+    inputs->utxo_len[rec->index] = rec->elem.rec->val_size;
+  }
+}
+
+// every input spends an output of a parent picked at random, as when consolidating the outputs of a few transactions
+static void bench_build(int inputs, int parents, bool segwit) {
+  int spent[BENCH_MAX_INPUTS];
+
+  for (int i = 0; i < parents; i++) {
+    bench_build_parent(i, segwit);
+  }
+
+  for (int i = 0; i < inputs; i++) {
+    spent[i] = bench_rand() % parents;
+  }
+
+  uint8_t* p = bench_write_u32(g_tx, 2);
+  compactsize_write(p, inputs);
+  p += compactsize_length(inputs);
+
+  for (int i = 0; i < inputs; i++) {
+    memcpy(p, g_parent_txid[spent[i]], BTC_TXID_LEN);
+    p = bench_write_u32(&p[BTC_TXID_LEN], i % BENCH_PARENT_OUTPUTS);
+    *p++ = 0;
+    p = bench_write_u32(p, 0xfffffffd);
+  }
+
+  *p++ = 1;
+  p = bench_write_p2wpkh_output(p);
+  p = bench_write_u32(p, 0);
+
+  psbt_t psbt;
+  psbt_record_t rec = { .type = PSBT_GLOBAL_UNSIGNED_TX, .key = NULL, .key_size = 0, .val = g_tx, .val_size = p - g_tx };
+  psbt_init(&psbt, g_psbt, sizeof(g_psbt));
+  psbt_write_global_record(&psbt, &rec);
+
+  for (int i = 0; i < inputs; i++) {
+    psbt_new_input_record_set(&psbt);
+    rec.type = PSBT_IN_NON_WITNESS_UTXO;
+    rec.val = g_parents[spent[i]];
+    rec.val_size = g_parent_len[spent[i]];
+    psbt_write_input_record(&psbt, &rec);
+  }
+
+  psbt_new_output_record_set(&psbt);
+  psbt_finalize(&psbt);
+
+  size_t psbt_len = psbt_size(&psbt);
+  memset(&g_inputs, 0, sizeof(bench_inputs_t));
+  psbt_init(&psbt, g_psbt, psbt_len);
+
+  if ((psbt_read(g_psbt, psbt_len, &psbt, bench_read_handler, &g_inputs) != PSBT_OK) || (g_inputs.count != inputs)) {
+    fprintf(stderr, "cannot parse the generated PSBT\n");
+    exit(1);
+  }
+}
+
+static int bench_verify_all(bool ref) {
+  btc_txid_cache_t cache;
+  memset(&cache, 0, sizeof(btc_txid_cache_t));
+  int failures = 0;
+
+  for (size_t i = 0; i < g_inputs.count; i++) {
+    const uint8_t* txid = &g_inputs.txins[i * BTC_TXIN_LEN];
+
+    if (ref) {
+      failures += !ref_txid_verify((uint8_t*) g_inputs.utxo[i], g_inputs.utxo_len[i], txid);
+    } else {
+      failures += !btc_txid_verify(&cache, g_inputs.utxo[i], g_inputs.utxo_len[i], txid);
+    }
+  }
+
+  return failures;
+}
+
+// a copy of a cached parent with a changed byte must still be rejected
+static bool bench_check_tampered() {
+  if (g_inputs.count < 2) {
+    return true;
+  }
+
+  btc_txid_cache_t cache;
+  memset(&cache, 0, sizeof(btc_txid_cache_t));
+
+  if (!btc_txid_verify(&cache, g_inputs.utxo[0], g_inputs.utxo_len[0], g_inputs.txins)) {
+    return false;
+  }
+
+  uint8_t* tx = g_parents[BENCH_MAX_INPUTS - 1];
+  memcpy(tx, g_inputs.utxo[0], g_inputs.utxo_len[0]);
+  tx[g_inputs.utxo_len[0] / 2] ^= 1;
+
+  return !btc_txid_verify(&cache, tx, g_inputs.utxo_len[0], g_inputs.txins);
+}
+
+static double bench_mean_us(bench_stats_t* stats) {
+  return (bench_stats_total(stats) / (double) stats->count) / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+  int runs = BENCH_DEFAULT_RUNS;
+  int inputs = BENCH_DEFAULT_INPUTS;
+  int parents[BENCH_MAX_LIST] = { 1, 4, 16, 64 };
+  int parent_count = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:i:p:")) != -1) {
+    switch (opt) {
+    case 'n':
+      runs = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'i':
+      inputs = atoi(optarg);
+      break;
+    case 'p':
+      parent_count = bench_parse_list(optarg, parents);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n runs] [-s seed] [-i inputs] [-p parents,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((runs <= 0) || (inputs < 1) || (inputs > (BENCH_MAX_INPUTS - 1))) {
+    fprintf(stderr, "invalid arguments\n");
+    return 1;
+  }
+
+  printf("%-7s %6s %7s | %10s | %10s %7s | %s\n", "parents", "inputs", "witness", "per-input", "cached", "speedup", "verify");
+
+  for (int w = 0; w < 2; w++) {
+    for (int s = 0; s < parent_count; s++) {
+      if ((parents[s] < 1) || (parents[s] > inputs)) {
+        fprintf(stderr, "parents must be between 1 and the number of inputs\n");
+        return 1;
+      }
+
+      bench_build(inputs, parents[s], w);
+      bool ok = (bench_verify_all(true) == 0) && (bench_verify_all(false) == 0) && bench_check_tampered();
+
+      bench_stats_t stats[2];
+      bench_stats_init(&stats[0], "per-input");
+      bench_stats_init(&stats[1], "cached");
+
+      for (int r = 0; r < runs; r++) {
+        for (int ref = 1; ref >= 0; ref--) {
+          uint64_t start = bench_now_ns();
+          bench_verify_all(ref);
+          bench_stats_add(&stats[!ref], bench_now_ns() - start);
+        }
+      }
+
+      double ref_us = bench_mean_us(&stats[0]);
+      double us = bench_mean_us(&stats[1]);
+      printf("%-7d %6d %7s | %8.1fus | %8.1fus %6.2fx | %s\n", parents[s], inputs, w ? "yes" : "no", ref_us, us, ref_us / us, ok ? "ok" : "FAIL");
+
+      bench_stats_free(&stats[0]);
+      bench_stats_free(&stats[1]);
+
+      if (!ok) {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Production of animated UR frames as done by qrout_display_animated_ur():
+ * times fountain encoding and QR symbol generation with automatic mask
+ * selection and with the fixed mask, checks that every fixed mask symbol of
+ * the cached cycle is read back by quirc and sizes the cycle against the
+ * camera buffers it is stored in.
+ *
+ * Usage: qrout-bench [-n trials] [-s seed] [-p parts,...] [-d drop_percent,...]
+ *
+ * With dropped frames it also compares the frames a scanner needs when the
+ * cached cycle is replayed with those needed when fresh parts keep coming.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "qrcode/qrcode.h"
+#include "qrcode/qrcodegen.h"
+#include "ur/ur.h"
+
+#define BENCH_DEFAULT_TRIALS 50
+#define BENCH_MAX_LIST 16
+#define BENCH_FRAME_LIMIT 20
+#define BENCH_UR_BUF_LEN (128 * 1024)
+
+#define BENCH_QR_MAX_VERSION 21
+#define BENCH_QR_BUF_LEN qrcodegen_BUFFER_LEN_FOR_VERSION(BENCH_QR_MAX_VERSION)
+#define BENCH_QR_SEGMENT_LEN 200
+#define BENCH_QR_QUIET_ZONE 4
+#define BENCH_QR_MASK qrcodegen_Mask_0
+#define BENCH_CACHE_SIZE (CAMERA_FB_COUNT * CAMERA_FB_SIZE)
+#define BENCH_CACHE_CYCLE 4
+
+static uint8_t g_ur_buf[BENCH_UR_BUF_LEN];
+static uint8_t g_work_fb[CAMERA_FB_SIZE];
+static ur_t g_ur;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static inline size_t bench_symbol_len(const uint8_t* qrcode) {
+  int qrsize = qrcodegen_getSize(qrcode);
+  return (((qrsize * qrsize) + 7) / 8) + 1;
+}
+
+static uint8_t* bench_message(int parts, size_t* msg_len) {
+  *msg_len = (parts * BENCH_QR_SEGMENT_LEN) - (bench_rand() % BENCH_QR_SEGMENT_LEN);
+  uint8_t* msg = malloc(*msg_len);
+
+  for (size_t i = 0; i < *msg_len; i++) {
+    msg[i] = bench_rand();
+  }
+
+  return msg;
+}
+
+static void bench_ur_reset() {
+  memset(&g_ur, 0, sizeof(g_ur));
+  g_ur.data = g_ur_buf;
+  g_ur.data_max_len = sizeof(g_ur_buf);
+}
+
+static bool bench_read_back(const uint8_t* qrcode, const char* urstr) {
+  static struct quirc qrctx;
+  static struct quirc_code code;
+  static struct quirc_data data;
+
+  int size = qrcodegen_getSize(qrcode);
+  int scale = CAMERA_WIDTH / (size + (2 * BENCH_QR_QUIET_ZONE));
+  int offset = (CAMERA_WIDTH - (size * scale)) / 2;
+
+  for (int y = 0; y < CAMERA_HEIGHT; y++) {
+    for (int x = 0; x < CAMERA_WIDTH; x++) {
+      int mx = (x - offset) >= 0 ? (x - offset) / scale : -1;
+      int my = (y - offset) >= 0 ? (y - offset) / scale : -1;
+      g_work_fb[(y * CAMERA_WIDTH) + x] = qrcodegen_getModule(qrcode, mx, my) ? 30 : 220;
+    }
+  }
+
+  quirc_track_reset(&qrctx);
+  quirc_set_image(&qrctx, g_work_fb);
+  quirc_begin(&qrctx, NULL, NULL);
+  quirc_threshold(&qrctx);
+  quirc_end(&qrctx);
+
+  if (quirc_count(&qrctx) != 1) {
+    return false;
+  }
+
+  quirc_extract(&qrctx, 0, &code);
+
+  if (quirc_decode(&code, &data) != QUIRC_SUCCESS) {
+    return false;
+  }
+
+  return (data.payload_len == strlen(urstr)) && !memcmp(data.payload, urstr, data.payload_len);
+}
+
+// One cycle of frames, as cached by qrout_display_animated_ur(), with both masks
+static void bench_encode(int parts, int trials) {
+  bench_stats_t fountain, auto_mask, fixed_mask;
+  bench_stats_init(&fountain, "ur_encode_next");
+  bench_stats_init(&auto_mask, "qr auto mask");
+  bench_stats_init(&fixed_mask, "qr fixed mask");
+
+  size_t cache_len = 0;
+  int cycle = 0;
+  int readable = 0;
+  int version = 0;
+
+  for (int t = 0; t < trials; t++) {
+    size_t msg_len;
+    uint8_t* msg = bench_message(parts, &msg_len);
+
+    ur_out_t ur_out;
+    ur_out_init(&ur_out, CRYPTO_PSBT, msg, msg_len, BENCH_QR_SEGMENT_LEN);
+    cycle = ur_out.part.ur_part_seqLen * BENCH_CACHE_CYCLE;
+    cache_len = 0;
+
+    for (int i = 0; i < cycle; i++) {
+      char urstr[BENCH_QR_BUF_LEN / 2];
+      uint8_t tmp[BENCH_QR_BUF_LEN];
+      uint8_t qrcode[BENCH_QR_BUF_LEN];
+
+      uint64_t start = bench_now_ns();
+
+      if (ur_encode_next(&ur_out, urstr, sizeof(urstr)) != ERR_OK) {
+        fprintf(stderr, "cannot encode part\n");
+        exit(1);
+      }
+
+      bench_stats_add(&fountain, bench_now_ns() - start);
+
+      start = bench_now_ns();
+      bool ok = qrcodegen_encodeText(urstr, tmp, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, BENCH_QR_MAX_VERSION, qrcodegen_Mask_AUTO, 1);
+      bench_stats_add(&auto_mask, bench_now_ns() - start);
+
+      start = bench_now_ns();
+      ok &= qrcodegen_encodeText(urstr, tmp, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, BENCH_QR_MAX_VERSION, BENCH_QR_MASK, 1);
+      bench_stats_add(&fixed_mask, bench_now_ns() - start);
+
+      if (!ok) {
+        fprintf(stderr, "cannot encode symbol\n");
+        exit(1);
+      }
+
+      version = (qrcodegen_getSize(qrcode) - 17) / 4;
+      cache_len += bench_symbol_len(qrcode);
+
+      if (t == 0) {
+        readable += bench_read_back(qrcode, urstr);
+      }
+    }
+
+    free(msg);
+  }
+
+  printf("%d parts of %d bytes: version %d, cycle of %d frames, %zu bytes cached (%.1f%% of the camera buffers)\n", parts,
+      BENCH_QR_SEGMENT_LEN, version, cycle, cache_len, (cache_len * 100.0) / BENCH_CACHE_SIZE);
+  printf("  fixed mask symbols read back by quirc: %d/%d\n", readable, cycle);
+
+  bench_stats_report(&fountain);
+  bench_stats_report(&auto_mask);
+  bench_stats_report(&fixed_mask);
+
+  double auto_us = (bench_stats_total(&auto_mask) / (double) auto_mask.count) / 1000.0;
+  double fixed_us = (bench_stats_total(&fixed_mask) / (double) fixed_mask.count) / 1000.0;
+  printf("  fixed mask speedup: %.1fx, replayed frames cost no encoding\n", auto_us / fixed_us);
+
+  bench_stats_free(&fountain);
+  bench_stats_free(&auto_mask);
+  bench_stats_free(&fixed_mask);
+}
+
+// Frames shown until the scanner completes the message, replaying the first cycle or producing new parts
+static int bench_scan(int parts, int drop, bool replay) {
+  size_t msg_len;
+  uint8_t* msg = bench_message(parts, &msg_len);
+
+  ur_out_t ur_out;
+  ur_out_init(&ur_out, CRYPTO_PSBT, msg, msg_len, BENCH_QR_SEGMENT_LEN);
+
+  int cycle = ur_out.part.ur_part_seqLen * BENCH_CACHE_CYCLE;
+  size_t out_len = BENCH_QR_BUF_LEN / 2;
+  char* frames = malloc(cycle * out_len);
+
+  bench_ur_reset();
+
+  int shown = 0;
+
+  while (shown < (parts * BENCH_FRAME_LIMIT)) {
+    char* out = &frames[(replay ? (shown % cycle) : 0) * out_len];
+
+    if (!replay || (shown < cycle)) {
+      if (ur_encode_next(&ur_out, out, out_len) != ERR_OK) {
+        fprintf(stderr, "cannot encode part\n");
+        exit(1);
+      }
+    }
+
+    shown++;
+
+    if ((int) (bench_rand() % 100) < drop) {
+      continue;
+    }
+
+    if (ur_process_part(&g_ur, (uint8_t*) out, strlen(out)) == ERR_OK) {
+      if ((g_ur.data_len != msg_len) || memcmp(g_ur.data, msg, msg_len)) {
+        fprintf(stderr, "reassembled message does not match\n");
+        exit(1);
+      }
+
+      break;
+    }
+  }
+
+  free(frames);
+  free(msg);
+
+  return shown;
+}
+
+static void bench_scan_report(int parts, int drop, int trials) {
+  uint64_t shown[2] = { 0, 0 };
+  int worst[2] = { 0, 0 };
+
+  for (int t = 0; t < trials; t++) {
+    for (int r = 0; r < 2; r++) {
+      int n = bench_scan(parts, drop, r);
+      shown[r] += n;
+      worst[r] = APP_MAX(worst[r], n);
+    }
+  }
+
+  printf("  %2d%% dropped: fresh parts %7.1f frames (worst %d), cached cycle %7.1f frames (worst %d)\n", drop,
+      shown[0] / (double) trials, worst[0], shown[1] / (double) trials, worst[1]);
+}
+
+int main(int argc, char* argv[]) {
+  int trials = BENCH_DEFAULT_TRIALS;
+  int parts[BENCH_MAX_LIST] = { 10, 25, 64, 128 };
+  int part_count = 4;
+  int drops[BENCH_MAX_LIST] = { 0, 10, 25, 50 };
+  int drop_count = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:p:d:")) != -1) {
+    switch (opt) {
+    case 'n':
+      trials = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'p':
+      part_count = bench_parse_list(optarg, parts);
+      break;
+    case 'd':
+      drop_count = bench_parse_list(optarg, drops);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n trials] [-s seed] [-p parts,...] [-d drop_percent,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (trials <= 0) {
+    fprintf(stderr, "invalid trial count\n");
+    return 1;
+  }
+
+  for (int p = 0; p < part_count; p++) {
+    if ((parts[p] < 2) || (parts[p] > UR_MAX_PART_COUNT)) {
+      fprintf(stderr, "part count must be between 2 and %d\n", UR_MAX_PART_COUNT);
+      return 1;
+    }
+
+    bench_encode(parts[p], trials);
+
+    for (int d = 0; d < drop_count; d++) {
+      bench_scan_report(parts[p], drops[d], trials);
+    }
+
+    printf("\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * Replays camera frames through the QR scanning pipeline used by qrscan_scan()
+ * and reports per-stage timings and decode success rates.
+ *
+ * Usage: qrscan-bench [-n passes] [-f] [frame_dir ...]
+ *
+ * Each frame directory (480x480 PGM or raw luma files, see linux_image_load)
+ * is a scenario. Without directories a synthetic corpus is rendered instead,
+ * covering static, animated, blurred, low-light and tilted codes.
+ *
+ * With -f the code tracker is reset before every frame, so that each frame is
+ * scanned entirely as it was before tracking was introduced.
+ */
+
+#include <dirent.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "linux_internal.h"
+#include "qrcode/qrcode.h"
+#include "qrcode/qrcodegen.h"
+#include "ur/ur.h"
+
+#define BENCH_DEFAULT_PASSES 3
+#define BENCH_MAX_FRAMES 512
+#define BENCH_PATH_LEN 512
+
+#define BENCH_QR_MAX_VERSION 21
+#define BENCH_QR_BUF_LEN qrcodegen_BUFFER_LEN_FOR_VERSION(BENCH_QR_MAX_VERSION)
+#define BENCH_QR_SEGMENT_LEN 200
+#define BENCH_QR_QUIET_ZONE 4
+#define BENCH_QR_SIDE 320
+
+#define BENCH_UR_BUF_LEN (64 * 1024)
+
+typedef enum {
+  STAGE_THRESHOLD = 0,
+  STAGE_END,
+  STAGE_EXTRACT,
+  STAGE_DECODE,
+  STAGE_UR,
+  STAGE_TOTAL,
+  STAGE_COUNT
+} bench_stage_t;
+
+static const char* const stage_names[STAGE_COUNT] = {
+  "quirc_threshold",
+  "quirc_end",
+  "quirc_extract",
+  "quirc_decode",
+  "ur_process_part",
+  "frame",
+};
+
+typedef struct {
+  const char* name;
+  int frames;
+  size_t payload_len;
+  float angle;
+  float tilt;
+  int blur;
+  uint8_t dark;
+  uint8_t light;
+  uint8_t noise;
+} bench_synth_t;
+
+static const bench_synth_t synth_scenarios[] = {
+  { .name = "single", .frames = 30, .payload_len = 120, .angle = 0.0f, .tilt = 0.0f, .blur = 0, .dark = 30, .light = 220, .noise = 4 },
+  { .name = "animated", .frames = 60, .payload_len = 2000, .angle = 3.0f, .tilt = 0.0f, .blur = 0, .dark = 30, .light = 220, .noise = 4 },
+  { .name = "blurred", .frames = 60, .payload_len = 2000, .angle = 3.0f, .tilt = 0.0f, .blur = 3, .dark = 30, .light = 220, .noise = 4 },
+  { .name = "low-light", .frames = 60, .payload_len = 2000, .angle = 3.0f, .tilt = 0.0f, .blur = 1, .dark = 8, .light = 48, .noise = 6 },
+  { .name = "tilted", .frames = 60, .payload_len = 2000, .angle = 20.0f, .tilt = 0.0006f, .blur = 1, .dark = 30, .light = 220, .noise = 4 },
+};
+
+typedef struct {
+  const char* name;
+  uint8_t* frames;
+  int frame_count;
+} bench_corpus_t;
+
+typedef struct {
+  int frames;
+  int detected;
+  int decoded;
+  int completed;
+  int tracked;
+  int first_complete_frame;
+  uint64_t first_complete_ns;
+} bench_result_t;
+
+static uint8_t g_work_fb[CAMERA_FB_SIZE];
+static uint8_t g_ur_buf[BENCH_UR_BUF_LEN];
+static bench_stats_t g_stage_stats[STAGE_COUNT];
+static bool g_full_frame = false;
+
+static void bench_blur(uint8_t* fb) {
+  static uint8_t tmp[CAMERA_FB_SIZE];
+
+  for (int y = 0; y < CAMERA_HEIGHT; y++) {
+    for (int x = 0; x < CAMERA_WIDTH; x++) {
+      int x0 = x ? x - 1 : x;
+      int x1 = (x < (CAMERA_WIDTH - 1)) ? x + 1 : x;
+      uint8_t* row = &fb[y * CAMERA_WIDTH];
+      tmp[(y * CAMERA_WIDTH) + x] = (row[x0] + (row[x] * 2) + row[x1]) / 4;
+    }
+  }
+
+  for (int y = 0; y < CAMERA_HEIGHT; y++) {
+    int y0 = y ? y - 1 : y;
+    int y1 = (y < (CAMERA_HEIGHT - 1)) ? y + 1 : y;
+
+    for (int x = 0; x < CAMERA_WIDTH; x++) {
+      fb[(y * CAMERA_WIDTH) + x] = (tmp[(y0 * CAMERA_WIDTH) + x] + (tmp[(y * CAMERA_WIDTH) + x] * 2) + tmp[(y1 * CAMERA_WIDTH) + x]) / 4;
+    }
+  }
+}
+
+static void bench_render(const bench_synth_t* s, const uint8_t* qrcode, uint8_t* fb) {
+  int size = qrcodegen_getSize(qrcode);
+  float modules = size + (2 * BENCH_QR_QUIET_ZONE);
+  float scale = BENCH_QR_SIDE / modules;
+  float rad = s->angle * (float) M_PI / 180.0f;
+  float c = cosf(rad);
+  float sn = sinf(rad);
+
+  for (int y = 0; y < CAMERA_HEIGHT; y++) {
+    for (int x = 0; x < CAMERA_WIDTH; x++) {
+      float dx = x - (CAMERA_WIDTH / 2);
+      float dy = y - (CAMERA_HEIGHT / 2);
+      float w = 1.0f + (s->tilt * dx);
+      float u = ((c * dx) + (sn * dy)) / w;
+      float v = ((c * dy) - (sn * dx)) / w;
+
+      int mx = (int) floorf((u / scale) + (modules / 2)) - BENCH_QR_QUIET_ZONE;
+      int my = (int) floorf((v / scale) + (modules / 2)) - BENCH_QR_QUIET_ZONE;
+
+      int val = qrcodegen_getModule(qrcode, mx, my) ? s->dark : s->light;
+
+      if (s->noise) {
+        val += (int) (bench_rand() % ((s->noise * 2) + 1)) - s->noise;
+      }
+
+      fb[(y * CAMERA_WIDTH) + x] = APP_MIN(APP_MAX(val, 0), 255);
+    }
+  }
+
+  for (int i = 0; i < s->blur; i++) {
+    bench_blur(fb);
+  }
+}
+
+static int bench_synthesize(const bench_synth_t* s, bench_corpus_t* corpus) {
+  uint8_t* data = malloc(s->payload_len);
+
+  for (size_t i = 0; i < s->payload_len; i++) {
+    data[i] = bench_rand();
+  }
+
+  ur_out_t ur;
+  ur_out_init(&ur, BYTES, data, s->payload_len, BENCH_QR_SEGMENT_LEN);
+
+  corpus->name = s->name;
+  corpus->frame_count = s->frames;
+  corpus->frames = malloc((size_t) s->frames * CAMERA_FB_SIZE);
+
+  for (int i = 0; i < s->frames; i++) {
+    char urstr[BENCH_QR_BUF_LEN / 2];
+    uint8_t tmp[BENCH_QR_BUF_LEN];
+    uint8_t qrcode[BENCH_QR_BUF_LEN];
+    app_err_t err = ur.part.ur_part_seqLen > 1 ? ur_encode_next(&ur, urstr, sizeof(urstr)) : ur_encode(&ur, urstr, sizeof(urstr));
+
+    if ((err != ERR_OK) || !qrcodegen_encodeText(urstr, tmp, qrcode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, BENCH_QR_MAX_VERSION, qrcodegen_Mask_AUTO, 1)) {
+      free(data);
+      return -1;
+    }
+
+    bench_render(s, qrcode, &corpus->frames[(size_t) i * CAMERA_FB_SIZE]);
+  }
+
+  free(data);
+  return 0;
+}
+
+static int bench_filter(const struct dirent* d) {
+  return d->d_name[0] != '.';
+}
+
+static int bench_load_dir(const char* path, bench_corpus_t* corpus) {
+  struct dirent** entries;
+  int n = scandir(path, &entries, bench_filter, alphasort);
+
+  if (n < 0) {
+    return -1;
+  }
+
+  corpus->name = path;
+  corpus->frame_count = 0;
+  corpus->frames = malloc((size_t) APP_MIN(n, BENCH_MAX_FRAMES) * CAMERA_FB_SIZE);
+
+  for (int i = 0; i < n; i++) {
+    char buf[BENCH_PATH_LEN];
+    snprintf(buf, sizeof(buf), "%s/%s", path, entries[i]->d_name);
+
+    if ((corpus->frame_count < BENCH_MAX_FRAMES) && (linux_image_load(buf, &corpus->frames[(size_t) corpus->frame_count * CAMERA_FB_SIZE]) == HAL_SUCCESS)) {
+      corpus->frame_count++;
+    } else {
+      fprintf(stderr, "skipping %s\n", buf);
+    }
+
+    free(entries[i]);
+  }
+
+  free(entries);
+  return corpus->frame_count ? 0 : -1;
+}
+
+static inline uint64_t bench_stage(bench_stats_t* local, bench_stage_t stage, uint64_t start) {
+  uint64_t now = bench_now_ns();
+  bench_stats_add(&local[stage], now - start);
+  bench_stats_add(&g_stage_stats[stage], now - start);
+  return now;
+}
+
+static void bench_run_pass(const bench_corpus_t* corpus, bench_stats_t* local, bench_result_t* res) {
+  static struct quirc qrctx;
+  static struct quirc_code qrcode;
+  static struct quirc_data qrdata;
+
+  ur_t ur = { .data_max_len = sizeof(g_ur_buf), .data = g_ur_buf, .percent_done = 0, .crc = 0};
+  uint64_t elapsed = 0;
+  bool complete = false;
+
+  quirc_track_reset(&qrctx);
+
+  for (int i = 0; i < corpus->frame_count; i++) {
+    memcpy(g_work_fb, &corpus->frames[(size_t) i * CAMERA_FB_SIZE], CAMERA_FB_SIZE);
+    res->frames++;
+
+    uint64_t frame_start = bench_now_ns();
+    uint64_t t = frame_start;
+
+    if (g_full_frame) {
+      quirc_track_reset(&qrctx);
+    }
+
+    quirc_set_image(&qrctx, g_work_fb);
+    quirc_begin(&qrctx, NULL, NULL);
+    quirc_threshold(&qrctx);
+    t = bench_stage(local, STAGE_THRESHOLD, t);
+
+    if (qrctx.roi.x1 - qrctx.roi.x0 < QUIRC_WIDTH || qrctx.roi.y1 - qrctx.roi.y0 < QUIRC_HEIGHT) {
+      res->tracked++;
+    }
+
+    quirc_end(&qrctx);
+    t = bench_stage(local, STAGE_END, t);
+
+    if (quirc_count(&qrctx) == 1) {
+      res->detected++;
+
+      quirc_extract(&qrctx, 0, &qrcode);
+      t = bench_stage(local, STAGE_EXTRACT, t);
+
+      quirc_decode_error_t err = quirc_decode(&qrcode, &qrdata);
+      t = bench_stage(local, STAGE_DECODE, t);
+
+      if (err == QUIRC_SUCCESS) {
+        res->decoded++;
+
+        app_err_t urerr = ur_process_part(&ur, qrdata.payload, qrdata.payload_len);
+        t = bench_stage(local, STAGE_UR, t);
+
+        if (urerr == ERR_OK) {
+          res->completed++;
+
+          if (!complete) {
+            complete = true;
+            res->first_complete_frame += i + 1;
+            res->first_complete_ns += elapsed + (t - frame_start);
+          }
+
+          ur.data = g_ur_buf;
+          ur.crc = 0;
+          ur.percent_done = 0;
+        }
+      }
+    }
+
+    uint64_t frame_ns = bench_now_ns() - frame_start;
+    elapsed += frame_ns;
+    bench_stats_add(&local[STAGE_TOTAL], frame_ns);
+    bench_stats_add(&g_stage_stats[STAGE_TOTAL], frame_ns);
+  }
+}
+
+static void bench_corpus(const bench_corpus_t* corpus, int passes) {
+  bench_stats_t local[STAGE_COUNT];
+  bench_result_t res;
+  memset(&res, 0, sizeof(res));
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bench_stats_init(&local[i], stage_names[i]);
+  }
+
+  for (int i = 0; i < passes; i++) {
+    bench_run_pass(corpus, local, &res);
+  }
+
+  double fps = 1e9 / (bench_stats_total(&local[STAGE_TOTAL]) / (double) local[STAGE_TOTAL].count);
+
+  printf("%s: %d frames, detected %.1f%%, decoded %.1f%%, %d complete messages, %.1f fps\n", corpus->name, res.frames,
+      (res.detected * 100.0) / res.frames, (res.decoded * 100.0) / res.frames, res.completed, fps);
+  printf("  scanned within tracked region: %.1f%% of frames\n", (res.tracked * 100.0) / res.frames);
+
+  if (res.completed) {
+    printf("  time to first decode: %.1f frames, %.2fms of processing\n", (res.first_complete_frame / (double) passes),
+        (res.first_complete_ns / (double) passes) / 1e6);
+  } else {
+    printf("  no complete message decoded\n");
+  }
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bench_stats_report(&local[i]);
+    bench_stats_free(&local[i]);
+  }
+
+  printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  int passes = BENCH_DEFAULT_PASSES;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:f")) != -1) {
+    switch (opt) {
+    case 'n':
+      passes = atoi(optarg);
+      break;
+    case 'f':
+      g_full_frame = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n passes] [-f] [frame_dir ...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (passes <= 0) {
+    passes = 1;
+  }
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bench_stats_init(&g_stage_stats[i], stage_names[i]);
+  }
+
+  if (optind < argc) {
+    for (int i = optind; i < argc; i++) {
+      bench_corpus_t corpus;
+
+      if (bench_load_dir(argv[i], &corpus)) {
+        fprintf(stderr, "no frames in %s\n", argv[i]);
+        return 1;
+      }
+
+      bench_corpus(&corpus, passes);
+      free(corpus.frames);
+    }
+  } else {
+    for (int i = 0; i < (sizeof(synth_scenarios) / sizeof(bench_synth_t)); i++) {
+      bench_corpus_t corpus;
+
+      if (bench_synthesize(&synth_scenarios[i], &corpus)) {
+        fprintf(stderr, "cannot render scenario %s\n", synth_scenarios[i].name);
+        return 1;
+      }
+
+      bench_corpus(&corpus, passes);
+      free(corpus.frames);
+    }
+  }
+
+  printf("all scenarios:\n");
+
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    bench_stats_histogram(&g_stage_stats[i]);
+    bench_stats_free(&g_stage_stats[i]);
+  }
+
+  return 0;
+}
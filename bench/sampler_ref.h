@@ -0,0 +1,12 @@
+#ifndef __SAMPLER_REF_H__
+#define __SAMPLER_REF_H__
+
+#include "crypto/xoshiro256.h"
+#include "ur/ur.h"
+
+void ref_sampler_init(int len, double* out_probs, int* out_aliases);
+int ref_sampler_next(xoshiro_ctx_t* rng_ctx, int len, double* probs, int* aliases);
+
+void ref_fountain_part_indexes(uint32_t seq, uint32_t crc, int len, double* probs, int* aliases, ur_desc_t* out);
+
+#endif
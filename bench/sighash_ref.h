@@ -0,0 +1,33 @@
+#ifndef __SIGHASH_REF_H__
+#define __SIGHASH_REF_H__
+
+#include "bitcoin/bitcoin.h"
+#include "error.h"
+
+#define REF_MAX_INPUTS 40
+#define REF_MAX_OUTPUTS 40
+
+// The transaction context as it was before the compact input and output summaries
+typedef struct {
+  psbt_tx_t tx;
+  psbt_txin_t inputs[REF_MAX_INPUTS];
+  psbt_txout_t outputs[REF_MAX_OUTPUTS];
+  psbt_input_data_t input_data[REF_MAX_INPUTS];
+  psbt_output_data_t output_data[REF_MAX_OUTPUTS];
+  size_t input_count;
+  size_t output_count;
+
+  uint8_t hash_prevouts[SHA256_DIGEST_LENGTH];
+  uint8_t hash_sequence[SHA256_DIGEST_LENGTH];
+  uint8_t hash_outputs[SHA256_DIGEST_LENGTH];
+  uint8_t hash_amounts[SHA256_DIGEST_LENGTH];
+  uint8_t hash_scriptpubkeys[SHA256_DIGEST_LENGTH];
+} ref_tx_ctx_t;
+
+void ref_sighash_init(ref_tx_ctx_t* tx_ctx);
+app_err_t ref_sighash_legacy(ref_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+app_err_t ref_sighash_segwit(ref_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+app_err_t ref_sighash_taproot(ref_tx_ctx_t* tx_ctx, size_t index, uint8_t digest[SHA256_DIGEST_LENGTH]);
+void ref_sighash_taptweak(ref_tx_ctx_t* tx_ctx, size_t index, uint8_t tweak[SHA256_DIGEST_LENGTH]);
+
+#endif
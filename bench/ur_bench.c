@@ -0,0 +1,214 @@
+/*
+ * Simulates the scanning of animated URs: fountain encoded parts are produced
+ * with ur_encode_next(), randomly dropped to model missed frames and fed both
+ * to ur_process_part() and to the previous peeling reducer (ur_legacy.c).
+ *
+ * Usage: ur-bench [-n trials] [-l segment_len] [-s seed] [-p parts,...] [-d drop_percent,...]
+ *
+ * For each combination of part count and drop rate it reports the frames
+ * shown and received until the message is reassembled, the overhead over the
+ * theoretical minimum (the part count) and the time spent per received part.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "ur_legacy.h"
+#include "ur/ur.h"
+
+#define BENCH_DEFAULT_TRIALS 50
+#define BENCH_DEFAULT_SEGMENT 200
+#define BENCH_MAX_LIST 16
+#define BENCH_FRAME_LIMIT 20
+#define BENCH_UR_BUF_LEN (128 * 1024)
+
+typedef struct {
+  const char* name;
+  int completed;
+  int failed;
+  uint64_t shown;
+  uint64_t received;
+  bench_stats_t time;
+} bench_decoder_t;
+
+static uint8_t g_ur_buf[BENCH_UR_BUF_LEN];
+static uint8_t g_legacy_buf[BENCH_UR_BUF_LEN];
+static ur_t g_ur;
+static ur_legacy_t g_legacy;
+
+static int bench_parse_list(char* arg, int* out) {
+  int count = 0;
+
+  for (char* tok = strtok(arg, ","); tok && count < BENCH_MAX_LIST; tok = strtok(NULL, ",")) {
+    out[count++] = atoi(tok);
+  }
+
+  return count;
+}
+
+static void bench_decoder_done(bench_decoder_t* dec, const uint8_t* data, size_t data_len, const uint8_t* msg, size_t msg_len, int shown, int received) {
+  if ((data_len != msg_len) || memcmp(data, msg, msg_len)) {
+    fprintf(stderr, "%s: reassembled message does not match\n", dec->name);
+    exit(1);
+  }
+
+  dec->completed++;
+  dec->shown += shown;
+  dec->received += received;
+}
+
+static void bench_trial(int parts, int drop, int segment, bench_decoder_t* dec, bench_decoder_t* legacy) {
+  size_t msg_len = (parts * segment) - (bench_rand() % segment);
+  uint8_t* msg = malloc(msg_len);
+  size_t out_len = ((segment + 64) * 2) + 64;
+  char* out = malloc(out_len);
+
+  for (size_t i = 0; i < msg_len; i++) {
+    msg[i] = bench_rand();
+  }
+
+  ur_out_t ur_out;
+  ur_out_init(&ur_out, CRYPTO_PSBT, msg, msg_len, segment);
+
+  memset(&g_ur, 0, sizeof(g_ur));
+  g_ur.data = g_ur_buf;
+  g_ur.data_max_len = sizeof(g_ur_buf);
+
+  memset(&g_legacy, 0, sizeof(g_legacy));
+  g_legacy.data = g_legacy_buf;
+  g_legacy.data_max_len = sizeof(g_legacy_buf);
+
+  bool dec_done = false;
+  bool legacy_done = false;
+  int received = 0;
+  int shown = 0;
+
+  while ((!dec_done || !legacy_done) && (shown < (parts * BENCH_FRAME_LIMIT))) {
+    if (ur_encode_next(&ur_out, out, out_len) != ERR_OK) {
+      fprintf(stderr, "cannot encode part\n");
+      exit(1);
+    }
+
+    shown++;
+
+    if ((int) (bench_rand() % 100) < drop) {
+      continue;
+    }
+
+    received++;
+
+    if (!dec_done) {
+      uint64_t t = bench_now_ns();
+      app_err_t err = ur_process_part(&g_ur, (uint8_t*) out, strlen(out));
+      bench_stats_add(&dec->time, bench_now_ns() - t);
+
+      if (err == ERR_OK) {
+        if (g_ur.data_crc != g_ur.crc) {
+          fprintf(stderr, "%s: message CRC %08x, expected %08x\n", dec->name, g_ur.data_crc, g_ur.crc);
+          exit(1);
+        }
+
+        dec_done = true;
+        bench_decoder_done(dec, g_ur.data, g_ur.data_len, msg, msg_len, shown, received);
+      }
+    }
+
+    if (!legacy_done) {
+      uint64_t t = bench_now_ns();
+      app_err_t err = ur_legacy_process_part(&g_legacy, (uint8_t*) out, strlen(out));
+      bench_stats_add(&legacy->time, bench_now_ns() - t);
+
+      if (err == ERR_OK) {
+        legacy_done = true;
+        bench_decoder_done(legacy, g_legacy.data, g_legacy.data_len, msg, msg_len, shown, received);
+      }
+    }
+  }
+
+  dec->failed += !dec_done;
+  legacy->failed += !legacy_done;
+
+  free(out);
+  free(msg);
+}
+
+static void bench_report(const bench_decoder_t* dec, int parts) {
+  if (!dec->completed) {
+    printf("  %-8s never completed\n", dec->name);
+    return;
+  }
+
+  double shown = dec->shown / (double) dec->completed;
+  double received = dec->received / (double) dec->completed;
+  double per_part = (bench_stats_total(&dec->time) / (double) dec->time.count) / 1000.0;
+
+  printf("  %-8s shown %7.1f  received %7.1f  overhead %5.1f%%  failed %d  %.2fus/part\n", dec->name, shown, received,
+      ((received - parts) * 100.0) / parts, dec->failed, per_part);
+}
+
+int main(int argc, char* argv[]) {
+  int trials = BENCH_DEFAULT_TRIALS;
+  int segment = BENCH_DEFAULT_SEGMENT;
+  int parts[BENCH_MAX_LIST] = { 10, 32, 64, 128 };
+  int part_count = 4;
+  int drops[BENCH_MAX_LIST] = { 0, 10, 25, 50 };
+  int drop_count = 4;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:l:s:p:d:")) != -1) {
+    switch (opt) {
+    case 'n':
+      trials = atoi(optarg);
+      break;
+    case 'l':
+      segment = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    case 'p':
+      part_count = bench_parse_list(optarg, parts);
+      break;
+    case 'd':
+      drop_count = bench_parse_list(optarg, drops);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n trials] [-l segment_len] [-s seed] [-p parts,...] [-d drop_percent,...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((trials <= 0) || (segment <= 0)) {
+    fprintf(stderr, "invalid trial count or segment length\n");
+    return 1;
+  }
+
+  for (int p = 0; p < part_count; p++) {
+    if ((parts[p] < 2) || (parts[p] > UR_MAX_PART_COUNT)) {
+      fprintf(stderr, "part count must be between 2 and %d\n", UR_MAX_PART_COUNT);
+      return 1;
+    }
+
+    for (int d = 0; d < drop_count; d++) {
+      bench_decoder_t dec = { .name = "gf2" };
+      bench_decoder_t legacy = { .name = "peeling" };
+      bench_stats_init(&dec.time, "gf2");
+      bench_stats_init(&legacy.time, "peeling");
+
+      for (int t = 0; t < trials; t++) {
+        bench_trial(parts[p], drops[d], segment, &dec, &legacy);
+      }
+
+      printf("%d parts of %d bytes, %d%% dropped, %d trials\n", parts[p], segment, drops[d], trials);
+      bench_report(&dec, parts[p]);
+      bench_report(&legacy, parts[p]);
+
+      bench_stats_free(&dec.time);
+      bench_stats_free(&legacy.time);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Copy of the peeling reducer ur_process_part() used before the GF(2)
+ * elimination decoder, kept as a reference for ur-bench. It also uses the
+ * previous double precision sampler (sampler_ref.c).
+ */
+
+#include <ctype.h>
+#include "sampler_ref.h"
+#include "ur_legacy.h"
+#include "ur/bytewords.h"
+#include "ur/ur_decode.h"
+
+#define MAX_CBOR_HEADER_LEN 32
+
+static app_err_t ur_legacy_process_simple(ur_legacy_t* ur, uint8_t* parts, uint8_t* part_data, size_t part_len, uint32_t desc_idx, struct ur_part* part) {
+  if (!ur_desc_is_zero(&ur->part_desc[desc_idx])) {
+    return ERR_NEED_MORE_DATA;
+  }
+
+  memcpy(&parts[desc_idx * part_len], part_data, part_len);
+  ur_desc_set_bit(&ur->part_desc[desc_idx], desc_idx);
+  ur_desc_or_assign(&ur->part_mask, &ur->part_desc[desc_idx]);
+
+  uint32_t part_count = ur_desc_popcount(&ur->part_mask);
+  ur->percent_done = (part_count * 100) / part->ur_part_seqLen;
+
+  if (part->ur_part_seqLen == part_count) {
+    ur->data = parts;
+    ur->data_len = part->ur_part_messageLen;
+    return ERR_OK;
+  }
+
+  return ERR_NEED_MORE_DATA;
+}
+
+app_err_t ur_legacy_process_part(ur_legacy_t* ur, const uint8_t* in, size_t in_len) {
+  if (in_len < 10) {
+    return ERR_DATA;
+  }
+
+  if (!(toupper(in[0]) == 'U' && toupper(in[1]) == 'R' && in[2] == ':')) {
+    return ERR_DATA;
+  }
+
+  size_t offset;
+  uint32_t tmp = 0;
+
+  for (offset = 3; offset < in_len; offset++) {
+    if (in[offset] == '/') {
+      break;
+    }
+  }
+
+  if (offset == in_len) {
+    return ERR_DATA;
+  }
+
+  // we assume we are dealing with a supported type and moving the
+  // case where we are not to actual payload validation
+
+  if (isdigit(in[++offset])) {
+    while((offset < in_len) && in[offset++] != '/') { /*we don't need this*/}
+    if (offset == in_len) {
+      return ERR_DATA;
+    }
+
+    tmp = 0;
+  } else {
+    tmp = 1;
+  }
+
+  uint32_t part_len = bytewords_decode(&in[offset], (in_len - offset), ur->data, ur->data_max_len);
+
+  if (!part_len) {
+    return ERR_DATA;
+  }
+
+  if (tmp == 1) {
+    ur->crc = 0;
+    ur->data_len = part_len;
+    return ERR_OK;
+  }
+
+  struct ur_part part;
+  if ((cbor_decode_ur_part(ur->data, part_len, &part, NULL) != ZCBOR_SUCCESS) ||
+      (part.ur_part_seqLen > UR_MAX_PART_COUNT) ||
+      (part.ur_part_seqNum == 0) ||
+      ((part.ur_part_seqLen * part_len) >= ur->data_max_len) ||
+      (part.ur_part_messageLen > (ur->data_max_len - part_len))) {
+    ur->crc = 0;
+    return ERR_DATA;
+  }
+
+  if (part.ur_part_checksum != ur->crc) {
+    ur->crc = part.ur_part_checksum;
+    ur_desc_zero(&ur->part_mask);
+    for (int i = 0; i < UR_LEGACY_DESC_COUNT; i++) {
+      ur_desc_zero(&ur->part_desc[i]);
+    }
+
+    ref_sampler_init(part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases);
+  }
+
+  part_len = part.ur_part_data.len;
+  uint8_t* parts = &ur->data[part_len + MAX_CBOR_HEADER_LEN];
+  uint8_t* part_data = (uint8_t*) part.ur_part_data.value;
+
+  if (part.ur_part_seqNum <= part.ur_part_seqLen) {
+    return ur_legacy_process_simple(ur, parts, part_data, part_len, part.ur_part_seqNum - 1, &part);
+  }
+
+  ur_desc_t indexes;
+  ref_fountain_part_indexes(part.ur_part_seqNum, ur->crc, part.ur_part_seqLen, ur->sampler_probs, ur->sampler_aliases, &indexes);
+  if (ur_desc_is_subset(&indexes, &ur->part_mask)) {
+    return ERR_NEED_MORE_DATA;
+  }
+
+  int desc_idx = 0;
+  int store_idx = -1;
+
+  // reduce new part by existing
+  while(desc_idx < UR_LEGACY_DESC_COUNT) {
+    if (ur_desc_popcount(&indexes) == 1) {
+      int target_idx = ur_desc_ctz(&indexes);
+      if (ur_legacy_process_simple(ur, parts, part_data, part_len, target_idx, &part) == ERR_OK) {
+        return ERR_OK;
+      } else {
+        store_idx = target_idx;
+        break;
+      }
+    }
+
+    if (ur_desc_is_zero(&ur->part_desc[desc_idx])) {
+      if (desc_idx >= part.ur_part_seqLen) {
+        store_idx = desc_idx;
+      }
+    } else if (ur_desc_is_subset(&ur->part_desc[desc_idx], &indexes)) {
+      ur_desc_xor(&indexes, &indexes, &ur->part_desc[desc_idx]);
+      if (ur_desc_is_zero(&indexes)) {
+        return ERR_NEED_MORE_DATA;
+      }
+
+      uint8_t* xorpart = &parts[desc_idx * part_len];
+      for (int i = 0; i < part_len; i++) {
+        part_data[i] ^= xorpart[i];
+      }
+    }
+
+    desc_idx++;
+  }
+
+  // all buffers are full, but we don't give up yet. If one of the buffered parts is more mixed
+  // then the current part, we overwrite it since parts easier to reduce are better for us
+  if (store_idx == -1) {
+    int worst_count = ur_desc_popcount(&indexes);
+
+    desc_idx = part.ur_part_seqLen;
+
+    while(desc_idx < UR_LEGACY_DESC_COUNT) {
+      int count = ur_desc_popcount(&ur->part_desc[desc_idx]);
+
+      if (count > worst_count) {
+        store_idx = desc_idx;
+        worst_count = count;
+      }
+
+      desc_idx++;
+    }
+
+    if (store_idx == -1) {
+      return ERR_NEED_MORE_DATA;
+    }
+  }
+
+  if (store_idx >= part.ur_part_seqLen) {
+    memcpy(&parts[store_idx * part_len], part_data, part_len);
+    ur_desc_assign(&ur->part_desc[store_idx], &indexes);
+  }
+
+  //reduce existing parts by new part
+  desc_idx = part.ur_part_seqLen;
+
+  while(desc_idx < UR_LEGACY_DESC_COUNT) {
+    if ((desc_idx != store_idx) && ur_desc_is_subset(&indexes, &ur->part_desc[desc_idx])) {
+      ur_desc_xor(&ur->part_desc[desc_idx], &indexes, &ur->part_desc[desc_idx]);
+
+      if (ur_desc_is_zero(&ur->part_desc[desc_idx])) {
+        desc_idx++;
+        continue;
+      }
+
+      uint8_t* target_part = &parts[desc_idx * part_len];
+      for (int i = 0; i < part_len; i++) {
+        target_part[i] ^= part_data[i];
+      }
+
+      if (ur_desc_popcount(&ur->part_desc[desc_idx]) == 1) {
+        int target_idx = ur_desc_ctz(&ur->part_desc[desc_idx]);
+        if (ur_legacy_process_simple(ur, parts, target_part, part_len, target_idx, &part) == ERR_OK) {
+          return ERR_OK;
+        }
+
+        ur_desc_zero(&ur->part_desc[desc_idx]);
+      }
+    }
+
+    desc_idx++;
+  }
+
+  return ERR_NEED_MORE_DATA;
+}
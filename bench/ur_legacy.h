@@ -0,0 +1,22 @@
+#ifndef __UR_LEGACY_H__
+#define __UR_LEGACY_H__
+
+#include "ur/ur.h"
+
+#define UR_LEGACY_DESC_COUNT (UR_MAX_PART_COUNT + 16)
+
+typedef struct {
+  uint32_t crc;
+  ur_desc_t part_desc[UR_LEGACY_DESC_COUNT];
+  ur_desc_t part_mask;
+  double sampler_probs[UR_MAX_PART_COUNT];
+  int sampler_aliases[UR_MAX_PART_COUNT];
+  size_t data_max_len;
+  size_t data_len;
+  uint8_t* data;
+  uint8_t percent_done;
+} ur_legacy_t;
+
+app_err_t ur_legacy_process_part(ur_legacy_t* ur, const uint8_t* in, size_t in_len);
+
+#endif
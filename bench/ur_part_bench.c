@@ -0,0 +1,181 @@
+/*
+ * Microbenchmark of the per-frame work of the UR multi-part decoder: the
+ * payload XOR kernel against a byte loop, and a whole ur_process_part() call
+ * against the previous reducer (ur_legacy.c) on the same frames.
+ *
+ * Usage: ur-part-bench [-n rounds] [-p parts] [-l segment_len] [-d drop_percent]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "crypto/util.h"
+#include "ur_legacy.h"
+#include "ur/ur.h"
+
+#define BENCH_DEFAULT_ROUNDS 20
+#define BENCH_DEFAULT_PARTS 128
+#define BENCH_DEFAULT_SEGMENT 200
+#define BENCH_DEFAULT_DROP 25
+#define BENCH_XOR_ITERATIONS 100000
+#define BENCH_UR_BUF_LEN (128 * 1024)
+
+static uint8_t g_ur_buf[BENCH_UR_BUF_LEN];
+static ur_t g_ur;
+static ur_legacy_t g_legacy;
+
+static void bench_xor_bytes(uint8_t* dst, const uint8_t* src, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    dst[i] ^= src[i];
+  }
+}
+
+static void bench_xor(size_t len) {
+  uint8_t* a = malloc(len + 1);
+  uint8_t* b = malloc(len + 1);
+
+  for (size_t i = 0; i <= len; i++) {
+    a[i] = bench_rand();
+    b[i] = bench_rand();
+  }
+
+  // the part slots have no particular alignment
+  void (*const kernels[])(uint8_t*, const uint8_t*, size_t) = { bench_xor_bytes, memxor };
+  const char* names[] = { "xor bytes", "memxor" };
+
+  for (int k = 0; k < 2; k++) {
+    uint64_t t = bench_now_ns();
+
+    for (int i = 0; i < BENCH_XOR_ITERATIONS; i++) {
+      kernels[k](&a[1], b, len);
+      __asm__ volatile("" : : "r"(a) : "memory");
+    }
+
+    double ns = (bench_now_ns() - t) / (double) BENCH_XOR_ITERATIONS;
+    printf("%-10s %5zu bytes: %8.1fns, %6.2f bytes/ns\n", names[k], len, ns, len / ns);
+  }
+
+  free(a);
+  free(b);
+}
+
+static size_t bench_frames(int parts, int segment, int drop, char** frames) {
+  size_t msg_len = (parts * segment) - (segment / 2);
+  uint8_t* msg = malloc(msg_len);
+  size_t out_len = ((segment + 64) * 2) + 64;
+  size_t count = 0;
+
+  for (size_t i = 0; i < msg_len; i++) {
+    msg[i] = bench_rand();
+  }
+
+  ur_out_t ur_out;
+  ur_out_init(&ur_out, CRYPTO_PSBT, msg, msg_len, segment);
+
+  // enough frames for both decoders to complete at any sensible drop rate
+  for (int i = 0; i < (parts * 8); i++) {
+    char* out = malloc(out_len);
+    ur_encode_next(&ur_out, out, out_len);
+
+    if ((int) (bench_rand() % 100) < drop) {
+      free(out);
+      continue;
+    }
+
+    frames[count++] = out;
+  }
+
+  free(msg);
+  return count;
+}
+
+int main(int argc, char* argv[]) {
+  int rounds = BENCH_DEFAULT_ROUNDS;
+  int parts = BENCH_DEFAULT_PARTS;
+  int segment = BENCH_DEFAULT_SEGMENT;
+  int drop = BENCH_DEFAULT_DROP;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:p:l:d:")) != -1) {
+    switch (opt) {
+    case 'n':
+      rounds = atoi(optarg);
+      break;
+    case 'p':
+      parts = atoi(optarg);
+      break;
+    case 'l':
+      segment = atoi(optarg);
+      break;
+    case 'd':
+      drop = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n rounds] [-p parts] [-l segment_len] [-d drop_percent]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ((rounds <= 0) || (parts < 2) || (parts > UR_MAX_PART_COUNT) || (segment <= 0) || (drop < 0) || (drop > 90)) {
+    fprintf(stderr, "invalid parameters\n");
+    return 1;
+  }
+
+  bench_xor(segment);
+  bench_xor(1000);
+  printf("\n");
+
+  char** frames = malloc(parts * 8 * sizeof(char*));
+  size_t frame_count = bench_frames(parts, segment, drop, frames);
+
+  bench_stats_t dec_stats;
+  bench_stats_t legacy_stats;
+  bench_stats_init(&dec_stats, "ur_process_part");
+  bench_stats_init(&legacy_stats, "legacy");
+
+  for (int r = 0; r < rounds; r++) {
+    memset(&g_ur, 0, sizeof(g_ur));
+    g_ur.data = g_ur_buf;
+    g_ur.data_max_len = sizeof(g_ur_buf);
+
+    for (size_t i = 0; i < frame_count; i++) {
+      uint64_t t = bench_now_ns();
+      app_err_t err = ur_process_part(&g_ur, (uint8_t*) frames[i], strlen(frames[i]));
+      bench_stats_add(&dec_stats, bench_now_ns() - t);
+
+      if (err == ERR_OK) {
+        break;
+      }
+    }
+
+    memset(&g_legacy, 0, sizeof(g_legacy));
+    g_legacy.data = g_ur_buf;
+    g_legacy.data_max_len = sizeof(g_ur_buf);
+
+    for (size_t i = 0; i < frame_count; i++) {
+      uint64_t t = bench_now_ns();
+      app_err_t err = ur_legacy_process_part(&g_legacy, (uint8_t*) frames[i], strlen(frames[i]));
+      bench_stats_add(&legacy_stats, bench_now_ns() - t);
+
+      if (err == ERR_OK) {
+        break;
+      }
+    }
+  }
+
+  printf("%d parts of %d bytes, %d%% dropped, per received frame:\n", parts, segment, drop);
+  bench_stats_report(&dec_stats);
+  bench_stats_report(&legacy_stats);
+
+  bench_stats_free(&dec_stats);
+  bench_stats_free(&legacy_stats);
+
+  for (size_t i = 0; i < frame_count; i++) {
+    free(frames[i]);
+  }
+
+  free(frames);
+  return 0;
+}
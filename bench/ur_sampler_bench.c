@@ -0,0 +1,300 @@
+/*
+ * Conformance and timing of the fixed-point fountain sampler (ur/sampler.c)
+ * against the double precision one it replaced (sampler_ref.c).
+ *
+ * Usage: ur-sampler-bench [-n count] [-s seed]
+ *
+ * Conformance checks the fragment indexes of the BC-UR reference test vectors,
+ * then compares both samplers on random sequences and on draws crafted to land
+ * next to the rounding boundaries of the double arithmetic. Timing covers the
+ * alias table setup, single draws and whole index selections, with the index
+ * cache missing and hitting.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "crypto/crc32.h"
+#include "crypto/sha2.h"
+#include "sampler_ref.h"
+#include "ur/sampler.h"
+
+#define BENCH_DEFAULT_COUNT 200000
+#define BENCH_DRAW_COUNT 1000000
+#define BENCH_EDGE_SPAN 4096
+#define BENCH_EDGE_STEP 61
+
+// 1024 byte message generated from the seed "Wolf" in 11 fragments, as in test_choose_fragments of the BC-UR reference
+#define BENCH_VECTOR_MSG_LEN 1024
+#define BENCH_VECTOR_SEQ_LEN 11
+#define BENCH_VECTOR_CHECKSUM 0x2f19f3bb
+
+static const struct {
+  uint32_t seq;
+  uint32_t indexes;
+} bench_vectors[] = {
+  { 12, 0x200 }, { 13, 0x764 }, { 14, 0x100 }, { 15, 0x022 }, { 16, 0x002 },
+  { 17, 0x535 }, { 18, 0x020 }, { 19, 0x004 }, { 20, 0x004 }, { 21, 0x6bb },
+  { 22, 0x76f }, { 23, 0x7b5 }, { 24, 0x028 }, { 25, 0x010 }, { 26, 0x7ff },
+  { 27, 0x6fb }, { 28, 0x040 }, { 29, 0x060 }, { 30, 0x080 },
+};
+
+static random_sampler_t g_sampler;
+static double g_ref_probs[UR_MAX_PART_COUNT];
+static int g_ref_aliases[UR_MAX_PART_COUNT];
+
+static void bench_sampler_init(int len) {
+  random_sampler_init(&g_sampler, len);
+  ref_sampler_init(len, g_ref_probs, g_ref_aliases);
+}
+
+static uint64_t bench_inverse(uint64_t a) {
+  uint64_t x = a;
+
+  for (int i = 0; i < 6; i++) {
+    x *= 2 - (a * x);
+  }
+
+  return x;
+}
+
+// Sets the generator state so that the next two outputs are r1 and r2
+static void bench_craft(xoshiro_ctx_t* ctx, uint64_t r1, uint64_t r2) {
+  static uint64_t inv5, inv9;
+
+  if (!inv5) {
+    inv5 = bench_inverse(5);
+    inv9 = bench_inverse(9);
+  }
+
+  uint64_t s1 = r1 * inv9;
+  s1 = ((s1 >> 7) | (s1 << 57)) * inv5;
+  uint64_t next_s1 = r2 * inv9;
+  next_s1 = ((next_s1 >> 7) | (next_s1 << 57)) * inv5;
+
+  ctx->s[0] = 0;
+  ctx->s[1] = s1;
+  ctx->s[2] = s1 ^ next_s1;
+  ctx->s[3] = bench_rand();
+}
+
+static uint64_t bench_rand64() {
+  return ((uint64_t) bench_rand() << 32) | bench_rand();
+}
+
+static uint64_t bench_to_u64(double x) {
+  return x >= 18446744073709551616. ? UINT64_MAX : (uint64_t) x;
+}
+
+static int bench_vectors_check() {
+  uint8_t seed[SHA256_DIGEST_LENGTH];
+  sha256_Raw((const uint8_t*) "Wolf", 4, seed);
+
+  xoshiro_ctx_t rng;
+  xoshiro256_seed(&rng, seed);
+
+  uint8_t msg[BENCH_VECTOR_MSG_LEN];
+
+  for (int i = 0; i < BENCH_VECTOR_MSG_LEN; i++) {
+    msg[i] = xoshiro256_next_byte(&rng);
+  }
+
+  uint32_t checksum = crc32(msg, BENCH_VECTOR_MSG_LEN);
+  int failed = checksum != BENCH_VECTOR_CHECKSUM;
+
+  bench_sampler_init(BENCH_VECTOR_SEQ_LEN);
+
+  for (size_t v = 0; v < (sizeof(bench_vectors) / sizeof(bench_vectors[0])); v++) {
+    ur_desc_t indexes;
+    fountain_part_indexes(bench_vectors[v].seq, checksum, &g_sampler, &indexes);
+
+    if ((indexes.w[0] != bench_vectors[v].indexes) || indexes.w[1] || indexes.w[2] || indexes.w[3]) {
+      fprintf(stderr, "vector %u: got %08x expected %08x\n", bench_vectors[v].seq, indexes.w[0], bench_vectors[v].indexes);
+      failed++;
+    }
+  }
+
+  printf("reference vectors: %s\n", failed ? "FAILED" : "ok");
+  return failed;
+}
+
+static int bench_random_check(int count) {
+  int failed = 0;
+
+  for (int i = 0; i < count; i++) {
+    int len = 2 + (bench_rand() % (UR_MAX_PART_COUNT - 1));
+    uint32_t seq = len + 1 + (bench_rand() % 100000);
+    uint32_t crc = bench_rand();
+    bench_sampler_init(len);
+
+    ur_desc_t a, b;
+    fountain_part_indexes(seq, crc, &g_sampler, &a);
+    ref_fountain_part_indexes(seq, crc, len, g_ref_probs, g_ref_aliases, &b);
+
+    if (memcmp(&a, &b, sizeof(ur_desc_t))) {
+      fprintf(stderr, "mismatch: len %d seq %u crc %08x\n", len, seq, crc);
+      failed++;
+    }
+  }
+
+  printf("random sequences: %d compared, %d mismatches\n", count, failed);
+  return failed;
+}
+
+static int bench_draw(xoshiro_ctx_t* ctx, int len, uint64_t r1, uint64_t r2) {
+  // r1 rounding to 1.0 indexes past the table in the reference, r2 rounding to 1.0 picks
+  // the alias of an entry that has none, left uninitialised in the reference and 0 in BC-UR
+  if ((((double) r1 / 18446744073709551616.) >= 1.0) || (((double) r2 / 18446744073709551616.) >= 1.0)) {
+    return 0;
+  }
+
+  xoshiro_ctx_t ref;
+  bench_craft(ctx, r1, r2);
+  memcpy(&ref, ctx, sizeof(ref));
+
+  int a = random_sampler_next(ctx, &g_sampler);
+  int b = ref_sampler_next(&ref, len, g_ref_probs, g_ref_aliases);
+
+  if (a != b) {
+    fprintf(stderr, "draw mismatch: len %d r1 %016llx r2 %016llx: %d != %d\n", len, (unsigned long long) r1, (unsigned long long) r2, a, b);
+    return 1;
+  }
+
+  return 0;
+}
+
+static int bench_edge_check() {
+  int failed = 0;
+  int draws = 0;
+  xoshiro_ctx_t ctx;
+
+  for (int len = 2; len <= UR_MAX_PART_COUNT; len++) {
+    bench_sampler_init(len);
+
+    for (int i = 0; i < len; i++) {
+      // r1 around the boundaries between table entries, r2 random
+      uint64_t bound = bench_to_u64(ldexp((double) i, 64) / len);
+
+      for (int64_t d = -BENCH_EDGE_SPAN; d <= BENCH_EDGE_SPAN; d += BENCH_EDGE_STEP) {
+        failed += bench_draw(&ctx, len, bound + d, bench_rand64());
+        draws++;
+      }
+
+      // r1 inside entry i, r2 around its alias probability
+      uint64_t r1 = bench_to_u64(ldexp(i + 0.5, 64) / len);
+      uint64_t p = bench_to_u64(ldexp(g_ref_probs[i], 64));
+
+      for (int64_t d = -BENCH_EDGE_SPAN; d <= BENCH_EDGE_SPAN; d++) {
+        failed += bench_draw(&ctx, len, r1, p + d);
+        draws++;
+      }
+    }
+  }
+
+  printf("boundary draws: %d compared, %d mismatches\n", draws, failed);
+  return failed;
+}
+
+static void bench_timing(int count) {
+  bench_stats_t stats;
+  volatile int sink = 0;
+  int len = UR_MAX_PART_COUNT;
+
+  uint64_t t = bench_now_ns();
+  for (int i = 0; i < 1000; i++) {
+    ref_sampler_init(len - (i & 1), g_ref_probs, g_ref_aliases);
+  }
+  double ref_init = (bench_now_ns() - t) / 1000.0;
+
+  t = bench_now_ns();
+  for (int i = 0; i < 1000; i++) {
+    random_sampler_init(&g_sampler, len - (i & 1));
+  }
+  double init = (bench_now_ns() - t) / 1000.0;
+  printf("\nsampler init, %d parts: double %.0fns, fixed point %.0fns\n", len, ref_init, init);
+
+  bench_sampler_init(len);
+  xoshiro_ctx_t rng;
+  memset(&rng, 0x5a, sizeof(rng));
+
+  t = bench_now_ns();
+  for (int i = 0; i < BENCH_DRAW_COUNT; i++) {
+    sink += ref_sampler_next(&rng, len, g_ref_probs, g_ref_aliases);
+  }
+  double ref_draw = (bench_now_ns() - t) / (double) BENCH_DRAW_COUNT;
+
+  t = bench_now_ns();
+  for (int i = 0; i < BENCH_DRAW_COUNT; i++) {
+    sink += random_sampler_next(&rng, &g_sampler);
+  }
+  double draw = (bench_now_ns() - t) / (double) BENCH_DRAW_COUNT;
+  printf("sampler draw: double %.1fns, fixed point %.1fns\n\n", ref_draw, draw);
+
+  printf("fountain_part_indexes, %d parts:\n", len);
+  ur_desc_t indexes;
+  uint32_t crc = bench_rand();
+
+  bench_stats_init(&stats, "double");
+  for (int i = 0; i < count; i++) {
+    t = bench_now_ns();
+    ref_fountain_part_indexes(len + 1 + i, crc, len, g_ref_probs, g_ref_aliases, &indexes);
+    bench_stats_add(&stats, bench_now_ns() - t);
+  }
+  bench_stats_report(&stats);
+  bench_stats_free(&stats);
+
+  // every sequence number is new, so the cache always misses
+  bench_stats_init(&stats, "fixed miss");
+  for (int i = 0; i < count; i++) {
+    t = bench_now_ns();
+    fountain_part_indexes(len + 1 + i, crc, &g_sampler, &indexes);
+    bench_stats_add(&stats, bench_now_ns() - t);
+  }
+  bench_stats_report(&stats);
+  bench_stats_free(&stats);
+
+  // frames seen again, as when the camera is faster than the animation
+  bench_stats_init(&stats, "fixed hit");
+  for (int i = 0; i < count; i++) {
+    t = bench_now_ns();
+    fountain_part_indexes(len + 1 + (i % FOUNTAIN_CACHE_SIZE), crc, &g_sampler, &indexes);
+    bench_stats_add(&stats, bench_now_ns() - t);
+  }
+  bench_stats_report(&stats);
+  bench_stats_free(&stats);
+}
+
+int main(int argc, char* argv[]) {
+  int count = BENCH_DEFAULT_COUNT;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+    switch (opt) {
+    case 'n':
+      count = atoi(optarg);
+      break;
+    case 's':
+      bench_seed(strtoul(optarg, NULL, 0));
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n count] [-s seed]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (count <= 0) {
+    fprintf(stderr, "invalid count\n");
+    return 1;
+  }
+
+  int failed = bench_vectors_check();
+  failed += bench_random_check(count);
+  failed += bench_edge_check();
+
+  bench_timing(count);
+
+  return failed ? 1 : 0;
+}
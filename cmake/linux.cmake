@@ -0,0 +1,113 @@
+# Host build against the Linux HAL
+#
+# Produces a static library with every module which does not depend on the
+# scheduler, used by the host tools and benchmarks, and the full application as a
+# native executable running on the FreeRTOS POSIX port.
+#
+
+set(FREERTOS_POSIX_PORT_DIR "${CMAKE_SOURCE_DIR}/freertos/freertos_kernel/portable/ThirdParty/GCC/Posix")
+
+find_package(Threads REQUIRED)
+
+# Source files - Linux HAL
+set(LINUX_HAL_SOURCES
+    linux/Src/linux.c
+    linux/Src/linux_crypto.c
+    linux/Src/linux_flash.c
+    linux/Src/linux_image.c
+)
+
+set(LINUX_RTOS_SOURCES
+    linux/Src/linux_camera.c
+    linux/Src/linux_smartcard.c
+    linux/Src/linux_usb.c
+)
+
+# Application modules which need the scheduler
+set(APP_RTOS_SOURCES
+    app/usb/usb.c
+    app/ui/dialog.c
+    app/ui/input.c
+    app/ui/menu.c
+    app/ui/settings_ui.c
+    app/ui/ui.c
+    app/tasks/core_task.c
+    app/tasks/ui_task.c
+    app/tasks/usb_task.c
+    app/screen/screen.c
+    app/screen/st7789.c
+    app/qrcode/qrout.c
+    app/qrcode/qrscan.c
+    app/keypad/keypad.c
+    app/iso7816/smartcard.c
+    app/core/auth.c
+    app/core/card.c
+    app/core/core.c
+    app/core/core_btc.c
+    app/core/core_eth.c
+    app/core/updater.c
+    app/camera/camera.c
+    app/freertos_support.c
+    app/main.c
+    app/pwr.c
+)
+
+set(APP_HOST_SOURCES ${APP_SOURCES})
+list(REMOVE_ITEM APP_HOST_SOURCES ${APP_RTOS_SOURCES})
+
+add_library(shellos-host STATIC
+    ${ZCBOR_SOURCES}
+    ${APP_HOST_SOURCES}
+    ${LINUX_HAL_SOURCES}
+)
+
+target_link_libraries(shellos-host PUBLIC m)
+
+add_executable(shellos
+    ${FREERTOS_SOURCES}
+    ${FREERTOS_POSIX_PORT_DIR}/port.c
+    ${FREERTOS_POSIX_PORT_DIR}/utils/wait_for_event.c
+    ${APP_RTOS_SOURCES}
+    ${LINUX_RTOS_SOURCES}
+)
+
+target_include_directories(shellos PRIVATE
+    ${FREERTOS_POSIX_PORT_DIR}
+    ${FREERTOS_POSIX_PORT_DIR}/utils
+)
+
+target_link_libraries(shellos PRIVATE shellos-host Threads::Threads)
+
+message(STATUS "Build type: ${CMAKE_BUILD_TYPE}")
+message(STATUS "C Compiler: ${CMAKE_C_COMPILER}")
+message(STATUS "Platform: linux")
+
+# Benchmarks, run manually on the host
+function(shell_add_bench name)
+    add_executable(${name} bench/bench.c ${ARGN})
+    target_include_directories(${name} PRIVATE ${CMAKE_SOURCE_DIR}/bench)
+    target_link_libraries(${name} PRIVATE shellos-host)
+endfunction()
+
+shell_add_bench(qrscan-bench bench/qrscan_bench.c)
+shell_add_bench(ur-bench bench/ur_bench.c bench/ur_legacy.c bench/sampler_ref.c)
+shell_add_bench(ur-part-bench bench/ur_part_bench.c bench/ur_legacy.c bench/sampler_ref.c)
+shell_add_bench(ur-sampler-bench bench/ur_sampler_bench.c bench/sampler_ref.c)
+shell_add_bench(bytewords-bench bench/bytewords_bench.c)
+shell_add_bench(qrout-bench bench/qrout_bench.c)
+shell_add_bench(fs-bench bench/fs_bench.c)
+shell_add_bench(eth-db-bench bench/eth_db_bench.c bench/db_stage.c)
+shell_add_bench(db-update-bench bench/db_update_bench.c bench/db_stage.c)
+shell_add_bench(db-stream-bench bench/db_stream_bench.c)
+shell_add_bench(fw-hash-bench bench/fw_hash_bench.c)
+shell_add_bench(fs-log-bench bench/fs_log_bench.c)
+shell_add_bench(fs-sim-bench bench/fs_sim_bench.c)
+shell_add_bench(abi-recognize-bench bench/abi_recognize_bench.c bench/db_stage.c)
+shell_add_bench(psbt-sighash-bench bench/psbt_sighash_bench.c bench/sighash_ref.c)
+shell_add_bench(psbt-index-bench bench/psbt_index_bench.c)
+shell_add_bench(psbt-txid-bench bench/psbt_txid_bench.c)
+# core_btc.c is built into the bench, which replaces the card commands. It only needs the FreeRTOS types
+shell_add_bench(psbt-pipeline-bench bench/psbt_pipeline_bench.c app/core/core_btc.c)
+target_compile_definitions(psbt-pipeline-bench PRIVATE TEST_APP)
+target_include_directories(psbt-pipeline-bench PRIVATE ${FREERTOS_POSIX_PORT_DIR})
+target_link_libraries(psbt-pipeline-bench PRIVATE Threads::Threads)
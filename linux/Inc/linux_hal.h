@@ -0,0 +1,53 @@
+#ifndef __HAL_LINUX__
+#define __HAL_LINUX__
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include "common.h"
+#include "crypto/sha2_soft.h"
+
+typedef SOFT_SHA256_CTX hal_sha256_ctx_t;
+typedef uint32_t hal_crc32_ctx_t;
+
+#define APP_NOCACHE APP_ALIGNED
+#define APP_RAMFUNC
+#define CAMERA_BUFFER_ALIGN 4
+
+#define VBAT_MIN 3100
+#define VBAT_MAX 4100
+
+// Same geometry as the STM32H573. The emulated flash is mapped at the same address
+// so that code storing flash addresses in 32-bit integers works unchanged.
+#define HAL_FLASH_SIZE (2 * 1024 * 1024)
+#define HAL_FLASH_BLOCK_SIZE 0x2000
+#define HAL_FLASH_WORD_SIZE 16
+#define HAL_FLASH_BLOCK_COUNT (HAL_FLASH_SIZE / HAL_FLASH_BLOCK_SIZE)
+#define HAL_FLASH_ADDR 0x08000000
+
+#define HAL_FLASH_BL_BLOCK_COUNT 4
+
+#define HAL_FLASH_DATA_BLOCK_COUNT 96
+
+#define HAL_FLASH_FW_START_ADDR (HAL_FLASH_ADDR + ((HAL_FLASH_BLOCK_SIZE * HAL_FLASH_BL_BLOCK_COUNT)))
+
+#define HAL_FLASH_FW_UPGRADE_AREA (HAL_FLASH_ADDR + (HAL_FLASH_BLOCK_SIZE * HAL_FLASH_BL_BLOCK_COUNT) + (HAL_FLASH_SIZE / 2))
+#define HAL_FLASH_FW_BLOCK_COUNT 76
+
+#define HAL_FW_HEADER_OFFSET 588
+
+// Environment variables used to attach the emulated peripherals
+#define HAL_LINUX_ENV_FLASH "SHELL_FLASH"
+#define HAL_LINUX_ENV_CAMERA "SHELL_CAMERA"
+#define HAL_LINUX_ENV_CAMERA_FPS "SHELL_CAMERA_FPS"
+#define HAL_LINUX_ENV_SCREEN "SHELL_SCREEN"
+#define HAL_LINUX_ENV_SMARTCARD "SHELL_SMARTCARD"
+
+static inline void hal_reboot() {
+  exit(0);
+}
+
+static inline bool hal_flash_busy() {
+  return false;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#include <string.h>
+#include <assert.h>
+
+#include "hal.h"
+#include "pwr.h"
+
+#define LINUX_SCREEN_FB_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint16_t))
+
+#define LINUX_POWER_LOSS_EXIT 75
+
+#define ST7789_CASET 0x2a
+#define ST7789_RASET 0x2b
+#define ST7789_RAMWR 0x2c
+
+struct linux_screen {
+  uint16_t* fb;
+  uint8_t cmd;
+  uint8_t params[4];
+  uint8_t param_count;
+  uint16_t x0;
+  uint16_t x1;
+  uint16_t y0;
+  uint16_t y1;
+  uint16_t x;
+  uint16_t y;
+  uint8_t pending_byte;
+  bool has_pending_byte;
+};
+
+// counts flash operations, so that benchmarks can report the wear caused by what they run. When power_loss_at is set
+// power is lost at that operation once its first power_loss_offset bytes are handled, keeping only the complete words:
+// power_loss is called if set and must not return, otherwise the process exits leaving a file backed flash as it was.
+// Like the device, the flash is programmed in words which must be written once after each erase, in order and without
+// gaps. Writes breaking this are counted in violations, the first at violation_addr
+struct linux_flash_stats {
+  uint32_t erased_blocks;
+  size_t programmed_bytes;
+  uint32_t programmed_words;
+  uint32_t ops;
+  uint32_t power_loss_at;
+  uint32_t power_loss_offset;
+  void (*power_loss)();
+  uint32_t violations;
+  uintptr_t violation_addr;
+  uint32_t block_erases[HAL_FLASH_BLOCK_COUNT];
+};
+
+extern struct linux_flash_stats g_linux_flash_stats;
+
+void* linux_map_file(const char* env, void* addr, size_t len, uint8_t fill);
+hal_err_t linux_flash_init();
+void linux_flash_scan();
+hal_err_t linux_image_load(const char* path, uint8_t fb[CAMERA_FB_SIZE]);
@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "linux_internal.h"
+
+uint32_t SystemCoreClock = 1000000000;
+
+static hal_gpio_state_t g_gpio_state[GPIO_PWR_KILL + 1];
+static struct linux_screen g_screen;
+static void (*g_spi_callback)();
+static bool g_spi_in_callback;
+
+void* linux_map_file(const char* env, void* addr, size_t len, uint8_t fill) {
+  const char* path = getenv(env);
+  int flags = addr ? MAP_FIXED_NOREPLACE : 0;
+  void* mem;
+
+  if (!path) {
+    mem = mmap(addr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+
+    if (mem == MAP_FAILED) {
+      return NULL;
+    }
+
+    memset(mem, fill, len);
+    return mem;
+  }
+
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+  if (fd < 0) {
+    return NULL;
+  }
+
+  off_t size = lseek(fd, 0, SEEK_END);
+
+  if (size < (off_t) len) {
+    uint8_t buf[HAL_FLASH_BLOCK_SIZE];
+    memset(buf, fill, sizeof(buf));
+
+    while (size < (off_t) len) {
+      size_t chunk = APP_MIN(sizeof(buf), (len - size));
+
+      if (write(fd, buf, chunk) != chunk) {
+        close(fd);
+        return NULL;
+      }
+
+      size += chunk;
+    }
+  }
+
+  mem = mmap(addr, len, PROT_READ | PROT_WRITE, MAP_SHARED | flags, fd, 0);
+  close(fd);
+
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+hal_err_t hal_init() {
+  g_gpio_state[GPIO_KEYPAD_COL_0] = GPIO_SET;
+  g_gpio_state[GPIO_KEYPAD_COL_1] = GPIO_SET;
+  g_gpio_state[GPIO_KEYPAD_COL_2] = GPIO_SET;
+  g_gpio_state[GPIO_VUSB_OK] = GPIO_SET;
+
+  if (linux_flash_init() != HAL_SUCCESS) {
+    return HAL_FAIL;
+  }
+
+  g_screen.fb = linux_map_file(HAL_LINUX_ENV_SCREEN, NULL, LINUX_SCREEN_FB_SIZE, 0);
+
+  if (!g_screen.fb) {
+    return HAL_FAIL;
+  }
+
+  if (getenv(HAL_LINUX_ENV_SMARTCARD)) {
+    g_gpio_state[GPIO_SMARTCARD_PRESENT] = GPIO_SET;
+  }
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_init_bootloader() {
+  return linux_flash_init();
+}
+
+hal_err_t hal_teardown_bootloader() {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_check_hardened() {
+  return HAL_FAIL;
+}
+
+hal_err_t hal_device_uid(uint8_t out[HAL_DEVICE_UID_LEN]) {
+  memset(out, 0x5a, HAL_DEVICE_UID_LEN);
+  return HAL_SUCCESS;
+}
+
+hal_boot_t hal_boot_type() {
+  return BOOT_COLD;
+}
+
+void hal_gpio_set(hal_gpio_pin_t pin, hal_gpio_state_t state) {
+  g_gpio_state[pin] = state;
+
+  if (pin == GPIO_PWR_KILL && state == GPIO_SET) {
+    exit(0);
+  }
+}
+
+hal_gpio_state_t hal_gpio_get(hal_gpio_pin_t pin) {
+  return g_gpio_state[pin];
+}
+
+hal_err_t hal_i2c_send(hal_i2c_port_t port, uint8_t addr, const uint8_t* data, size_t len) {
+  assert(port == I2C_CAMERA);
+  return HAL_SUCCESS;
+}
+
+static void _hal_screen_param(uint8_t b) {
+  if (g_screen.param_count < sizeof(g_screen.params)) {
+    g_screen.params[g_screen.param_count++] = b;
+  }
+
+  if (g_screen.param_count != sizeof(g_screen.params)) {
+    return;
+  }
+
+  uint16_t start = (g_screen.params[0] << 8) | g_screen.params[1];
+  uint16_t end = (g_screen.params[2] << 8) | g_screen.params[3];
+
+  if (g_screen.cmd == ST7789_CASET) {
+    g_screen.x0 = start;
+    g_screen.x1 = APP_MIN(end, SCREEN_WIDTH - 1);
+  } else {
+    g_screen.y0 = start;
+    g_screen.y1 = APP_MIN(end, SCREEN_HEIGHT - 1);
+  }
+}
+
+static void _hal_screen_pixel(uint16_t pixel) {
+  if (g_screen.y > g_screen.y1) {
+    return;
+  }
+
+  g_screen.fb[(g_screen.y * SCREEN_WIDTH) + g_screen.x] = pixel;
+
+  if (++g_screen.x > g_screen.x1) {
+    g_screen.x = g_screen.x0;
+    g_screen.y++;
+  }
+}
+
+static void _hal_screen_data(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    switch(g_screen.cmd) {
+    case ST7789_CASET:
+    case ST7789_RASET:
+      _hal_screen_param(data[i]);
+      break;
+    case ST7789_RAMWR:
+      if (g_screen.has_pending_byte) {
+        // the panel receives RGB565 MSB first, the framebuffer stores it in the same order
+        _hal_screen_pixel(g_screen.pending_byte | (data[i] << 8));
+        g_screen.has_pending_byte = false;
+      } else {
+        g_screen.pending_byte = data[i];
+        g_screen.has_pending_byte = true;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+hal_err_t hal_spi_send(hal_spi_port_t port, const uint8_t* data, size_t len) {
+  assert(port == SPI_LCD);
+
+  if (g_gpio_state[GPIO_LCD_CMD_DATA] == GPIO_RESET) {
+    g_screen.cmd = data[len - 1];
+    g_screen.param_count = 0;
+    g_screen.has_pending_byte = false;
+
+    if (g_screen.cmd == ST7789_RAMWR) {
+      g_screen.x = g_screen.x0;
+      g_screen.y = g_screen.y0;
+    }
+  } else {
+    _hal_screen_data(data, len);
+  }
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_spi_send_dma(hal_spi_port_t port, const uint8_t* data, size_t len, void (*cb)()) {
+  hal_spi_send(port, data, len);
+
+  // The transfer completes immediately. Callbacks chaining further transfers are
+  // run iteratively from the outermost call instead of recursing.
+  g_spi_callback = cb;
+
+  if (g_spi_in_callback) {
+    return HAL_SUCCESS;
+  }
+
+  g_spi_in_callback = true;
+
+  while (g_spi_callback) {
+    void (*next)() = g_spi_callback;
+    g_spi_callback = NULL;
+    next();
+  }
+
+  g_spi_in_callback = false;
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_delay_us(uint32_t usec) {
+  struct timespec ts = { .tv_sec = usec / 1000000, .tv_nsec = (usec % 1000000) * 1000 };
+  while (nanosleep(&ts, &ts) && (errno == EINTR)) {
+  }
+
+  return HAL_SUCCESS;
+}
+
+uint32_t hal_get_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+void hal_tick() {
+}
+
+hal_err_t hal_pwm_set_dutycycle(hal_pwm_output_t out, uint8_t cycle) {
+  assert(out == PWM_BACKLIGHT);
+  assert(cycle <= 100);
+  return HAL_SUCCESS;
+}
+
+void hal_inactivity_timer_set(uint32_t delay_ms) {
+}
+
+void hal_inactivity_timer_reset() {
+}
+
+hal_err_t hal_adc_read(hal_adc_channel_t ch, uint32_t* val) {
+  assert(ch == ADC_VBAT);
+  *val = VBAT_MAX;
+  return HAL_SUCCESS;
+}
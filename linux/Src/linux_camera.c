@@ -0,0 +1,172 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "linux_internal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define LINUX_CAMERA_MAX_FRAMES 1024
+#define LINUX_CAMERA_PATH_LEN 512
+
+static TaskHandle_t g_camera_task = NULL;
+static uint8_t* g_camera_fb[CAMERA_FB_COUNT];
+static bool g_camera_busy[CAMERA_FB_COUNT];
+static char* g_camera_frames[LINUX_CAMERA_MAX_FRAMES];
+static int g_camera_frame_count;
+static int g_camera_frame_idx;
+static uint32_t g_camera_fps;
+static uint64_t g_camera_start_ns;
+static int64_t g_camera_last_frame;
+static uint32_t g_camera_dropped;
+static uint32_t g_camera_delivered;
+
+static int _linux_camera_filter(const struct dirent* d) {
+  return d->d_name[0] != '.';
+}
+
+static hal_err_t _linux_camera_list(const char* path) {
+  struct dirent** entries;
+  int n = scandir(path, &entries, _linux_camera_filter, alphasort);
+
+  if (n < 0) {
+    g_camera_frames[0] = strdup(path);
+    g_camera_frame_count = 1;
+    return HAL_SUCCESS;
+  }
+
+  g_camera_frame_count = 0;
+
+  for (int i = 0; i < n; i++) {
+    if (g_camera_frame_count < LINUX_CAMERA_MAX_FRAMES) {
+      char buf[LINUX_CAMERA_PATH_LEN];
+      snprintf(buf, sizeof(buf), "%s/%s", path, entries[i]->d_name);
+      g_camera_frames[g_camera_frame_count++] = strdup(buf);
+    }
+
+    free(entries[i]);
+  }
+
+  free(entries);
+
+  return g_camera_frame_count ? HAL_SUCCESS : HAL_FAIL;
+}
+
+static uint64_t _linux_camera_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+// With a frame rate set, the sensor is emulated in real time: the newest
+// frame of the sequence is returned and the ones in between are dropped.
+static int _linux_camera_advance() {
+  if (!g_camera_fps) {
+    int idx = g_camera_frame_idx;
+    g_camera_frame_idx = (idx + 1) % g_camera_frame_count;
+    return idx;
+  }
+
+  uint64_t period = 1000000000ull / g_camera_fps;
+  uint64_t now = _linux_camera_now() - g_camera_start_ns;
+  int64_t frame = now / period;
+
+  if (frame <= g_camera_last_frame) {
+    frame = g_camera_last_frame + 1;
+    hal_delay_us(((frame * period) - now) / 1000);
+  } else {
+    g_camera_dropped += frame - g_camera_last_frame - 1;
+  }
+
+  g_camera_last_frame = frame;
+  return frame % g_camera_frame_count;
+}
+
+static void _linux_camera_signal() {
+  if (g_camera_task) {
+    xTaskNotifyGiveIndexed(g_camera_task, CAMERA_TASK_NOTIFICATION_IDX);
+  }
+}
+
+hal_err_t hal_camera_init() {
+  if (g_camera_frame_count) {
+    return HAL_SUCCESS;
+  }
+
+  const char* path = getenv(HAL_LINUX_ENV_CAMERA);
+  const char* fps = getenv(HAL_LINUX_ENV_CAMERA_FPS);
+
+  if (!path) {
+    return HAL_FAIL;
+  }
+
+  g_camera_fps = fps ? strtoul(fps, NULL, 10) : 0;
+
+  return _linux_camera_list(path);
+}
+
+hal_err_t hal_camera_start(uint8_t fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE]) {
+  configASSERT(g_camera_task == NULL);
+  g_camera_task = xTaskGetCurrentTaskHandle();
+
+  for (int i = 0; i < CAMERA_FB_COUNT; i++) {
+    g_camera_fb[i] = fb[i];
+    g_camera_busy[i] = false;
+  }
+
+  g_camera_start_ns = _linux_camera_now();
+  g_camera_last_frame = -1;
+  g_camera_dropped = 0;
+  g_camera_delivered = 0;
+
+  _linux_camera_signal();
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_camera_stop() {
+  if (g_camera_task) {
+    fprintf(stderr, "camera: %u frames processed, %u dropped\n", g_camera_delivered, g_camera_dropped);
+  }
+
+  g_camera_task = NULL;
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_camera_next_frame(uint8_t** fb) {
+  for (int i = 0; i < CAMERA_FB_COUNT; i++) {
+    if (g_camera_busy[i]) {
+      continue;
+    }
+
+    // frames are "captured" on demand, looping over the recorded sequence
+    const char* path = g_camera_frames[_linux_camera_advance()];
+
+    if (linux_image_load(path, g_camera_fb[i]) != HAL_SUCCESS) {
+      return HAL_FAIL;
+    }
+
+    g_camera_busy[i] = true;
+    g_camera_delivered++;
+    *fb = g_camera_fb[i];
+    return HAL_SUCCESS;
+  }
+
+  return HAL_FAIL;
+}
+
+uint32_t hal_camera_dropped_frames() {
+  return g_camera_dropped;
+}
+
+hal_err_t hal_camera_submit(uint8_t* fb) {
+  for (int i = 0; i < CAMERA_FB_COUNT; i++) {
+    if (g_camera_fb[i] == fb) {
+      g_camera_busy[i] = false;
+      _linux_camera_signal();
+      return HAL_SUCCESS;
+    }
+  }
+
+  return HAL_FAIL;
+}
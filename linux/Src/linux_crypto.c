@@ -0,0 +1,785 @@
+#include <sys/random.h>
+
+#include "linux_internal.h"
+#include "crypto/bignum.h"
+#include "crypto/memzero.h"
+
+#define AES_MAX_ROUNDS 14
+#define AES_128_ROUNDS 10
+#define AES_256_ROUNDS 14
+
+#define CCM_COUNTER_FLAGS 0x01
+
+typedef struct {
+  bignum256 x;
+  bignum256 y;
+  bool infinity;
+} linux_ec_point_t;
+
+struct linux_aes_ctx {
+  uint8_t round_key[(AES_MAX_ROUNDS + 1) * AES_BLOCK_SIZE];
+  uint8_t rounds;
+  hal_aes_mode_t mode;
+  uint8_t iv[AES_BLOCK_SIZE];
+  uint8_t mac[AES_BLOCK_SIZE];
+  uint8_t ctr[AES_BLOCK_SIZE];
+  uint8_t s0[AES_BLOCK_SIZE];
+};
+
+static uint8_t g_aes_sbox[256];
+static uint8_t g_aes_inv_sbox[256];
+static struct linux_aes_ctx g_aes;
+
+static const uint32_t CRC32_NIBBLE_LUT[16] = {
+  0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+  0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+hal_err_t hal_rng_next(uint8_t *buf, size_t len) {
+  while (len) {
+    ssize_t r = getrandom(buf, len, 0);
+
+    if (r < 0) {
+      return HAL_FAIL;
+    }
+
+    buf += r;
+    len -= r;
+  }
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_crc32_init(hal_crc32_ctx_t* ctx) {
+  *ctx = UINT32_MAX;
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_crc32_update(hal_crc32_ctx_t* ctx, uint8_t b) {
+  uint32_t crc = *ctx ^ b;
+  crc = (crc >> 4) ^ CRC32_NIBBLE_LUT[crc & 0xf];
+  *ctx = (crc >> 4) ^ CRC32_NIBBLE_LUT[crc & 0xf];
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_crc32_finish(hal_crc32_ctx_t* ctx, uint32_t *out) {
+  *out = ~(*ctx);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_sha256_init(hal_sha256_ctx_t* ctx) {
+  soft_sha256_Init(ctx);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_sha256_update(hal_sha256_ctx_t* ctx, const uint8_t* data, size_t len) {
+  soft_sha256_Update(ctx, data, len);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_sha256_finish(hal_sha256_ctx_t* ctx, uint8_t out[SHA256_DIGEST_LENGTH]) {
+  soft_sha256_Final(ctx, out);
+  return HAL_SUCCESS;
+}
+
+static inline uint8_t _aes_xtime(uint8_t x) {
+  return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00);
+}
+
+static uint8_t _aes_gmul(uint8_t a, uint8_t b) {
+  uint8_t r = 0;
+
+  while (b) {
+    if (b & 1) {
+      r ^= a;
+    }
+
+    a = _aes_xtime(a);
+    b >>= 1;
+  }
+
+  return r;
+}
+
+static void _aes_init_sbox() {
+  if (g_aes_sbox[0] == 0x63) {
+    return;
+  }
+
+  uint8_t p = 1;
+  uint8_t q = 1;
+
+  do {
+    p = p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0);
+
+    q ^= q << 1;
+    q ^= q << 2;
+    q ^= q << 4;
+    q ^= (q & 0x80) ? 0x09 : 0;
+
+    uint8_t x = q ^ ((q << 1) | (q >> 7)) ^ ((q << 2) | (q >> 6)) ^ ((q << 3) | (q >> 5)) ^ ((q << 4) | (q >> 4)) ^ 0x63;
+    g_aes_sbox[p] = x;
+    g_aes_inv_sbox[x] = p;
+  } while (p != 1);
+
+  g_aes_sbox[0] = 0x63;
+  g_aes_inv_sbox[0x63] = 0;
+}
+
+static void _aes_key_expand(const uint8_t* key, size_t key_len) {
+  _aes_init_sbox();
+
+  size_t nk = key_len / 4;
+  g_aes.rounds = nk + 6;
+  size_t total = (g_aes.rounds + 1) * 4;
+  uint8_t rcon = 1;
+
+  memcpy(g_aes.round_key, key, key_len);
+
+  for (size_t i = nk; i < total; i++) {
+    uint8_t t[4];
+    memcpy(t, &g_aes.round_key[(i - 1) * 4], 4);
+
+    if ((i % nk) == 0) {
+      uint8_t tmp = t[0];
+      t[0] = g_aes_sbox[t[1]] ^ rcon;
+      t[1] = g_aes_sbox[t[2]];
+      t[2] = g_aes_sbox[t[3]];
+      t[3] = g_aes_sbox[tmp];
+      rcon = _aes_xtime(rcon);
+    } else if ((nk > 6) && ((i % nk) == 4)) {
+      for (int j = 0; j < 4; j++) {
+        t[j] = g_aes_sbox[t[j]];
+      }
+    }
+
+    for (int j = 0; j < 4; j++) {
+      g_aes.round_key[(i * 4) + j] = g_aes.round_key[((i - nk) * 4) + j] ^ t[j];
+    }
+  }
+}
+
+static void _aes_encrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) {
+  uint8_t s[AES_BLOCK_SIZE];
+  uint8_t t[AES_BLOCK_SIZE];
+
+  for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+    s[i] = in[i] ^ g_aes.round_key[i];
+  }
+
+  for (int r = 1; r <= g_aes.rounds; r++) {
+    for (int c = 0; c < 4; c++) {
+      for (int row = 0; row < 4; row++) {
+        t[(c * 4) + row] = g_aes_sbox[s[(((c + row) & 3) * 4) + row]];
+      }
+    }
+
+    if (r != g_aes.rounds) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t* col = &t[c * 4];
+        uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+        uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+        col[0] ^= all ^ _aes_xtime(a0 ^ a1);
+        col[1] ^= all ^ _aes_xtime(a1 ^ a2);
+        col[2] ^= all ^ _aes_xtime(a2 ^ a3);
+        col[3] ^= all ^ _aes_xtime(a3 ^ a0);
+      }
+    }
+
+    for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+      s[i] = t[i] ^ g_aes.round_key[(r * AES_BLOCK_SIZE) + i];
+    }
+  }
+
+  memcpy(out, s, AES_BLOCK_SIZE);
+  memzero(t, sizeof(t));
+  memzero(s, sizeof(s));
+}
+
+static void _aes_decrypt_block(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) {
+  uint8_t s[AES_BLOCK_SIZE];
+  uint8_t t[AES_BLOCK_SIZE];
+
+  for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+    s[i] = in[i] ^ g_aes.round_key[(g_aes.rounds * AES_BLOCK_SIZE) + i];
+  }
+
+  for (int r = g_aes.rounds - 1; r >= 0; r--) {
+    for (int c = 0; c < 4; c++) {
+      for (int row = 0; row < 4; row++) {
+        t[(((c + row) & 3) * 4) + row] = g_aes_inv_sbox[s[(c * 4) + row]];
+      }
+    }
+
+    for (int i = 0; i < AES_BLOCK_SIZE; i++) {
+      s[i] = t[i] ^ g_aes.round_key[(r * AES_BLOCK_SIZE) + i];
+    }
+
+    if (r != 0) {
+      for (int c = 0; c < 4; c++) {
+        uint8_t* col = &s[c * 4];
+        uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+        col[0] = _aes_gmul(a0, 14) ^ _aes_gmul(a1, 11) ^ _aes_gmul(a2, 13) ^ _aes_gmul(a3, 9);
+        col[1] = _aes_gmul(a0, 9) ^ _aes_gmul(a1, 14) ^ _aes_gmul(a2, 11) ^ _aes_gmul(a3, 13);
+        col[2] = _aes_gmul(a0, 13) ^ _aes_gmul(a1, 9) ^ _aes_gmul(a2, 14) ^ _aes_gmul(a3, 11);
+        col[3] = _aes_gmul(a0, 11) ^ _aes_gmul(a1, 13) ^ _aes_gmul(a2, 9) ^ _aes_gmul(a3, 14);
+      }
+    }
+  }
+
+  memcpy(out, s, AES_BLOCK_SIZE);
+  memzero(t, sizeof(t));
+  memzero(s, sizeof(s));
+}
+
+static inline void _aes_xor_block(uint8_t* out, const uint8_t* a, const uint8_t* b, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    out[i] = a[i] ^ b[i];
+  }
+}
+
+hal_err_t hal_aes256_init(hal_aes_mode_t mode, hal_aes_chaining_t chaining, const uint8_t key[AES_256_KEY_SIZE], const uint8_t iv[AES_IV_SIZE]) {
+  assert(chaining == AES_CBC);
+  _aes_key_expand(key, AES_256_KEY_SIZE);
+  g_aes.mode = mode;
+  memcpy(g_aes.iv, iv, AES_IV_SIZE);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_aes256_block_process(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) {
+  uint8_t tmp[AES_BLOCK_SIZE];
+
+  if (g_aes.mode == AES_ENCRYPT) {
+    _aes_xor_block(tmp, in, g_aes.iv, AES_BLOCK_SIZE);
+    _aes_encrypt_block(tmp, out);
+    memcpy(g_aes.iv, out, AES_BLOCK_SIZE);
+  } else {
+    memcpy(tmp, in, AES_BLOCK_SIZE);
+    _aes_decrypt_block(tmp, out);
+    _aes_xor_block(out, out, g_aes.iv, AES_BLOCK_SIZE);
+    memcpy(g_aes.iv, tmp, AES_BLOCK_SIZE);
+  }
+
+  memzero(tmp, sizeof(tmp));
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_aes256_finalize() {
+  memzero(&g_aes, sizeof(g_aes));
+  return HAL_SUCCESS;
+}
+
+static inline void _aes_ccm_next_counter() {
+  for (int i = (AES_BLOCK_SIZE - 1); i > CCM_NONCE_SIZE; i--) {
+    if (++g_aes.ctr[i]) {
+      break;
+    }
+  }
+}
+
+hal_err_t hal_aes128_ccm_init(hal_aes_mode_t mode, const uint8_t key[AES_128_KEY_SIZE], const uint8_t b0[AES_BLOCK_SIZE]) {
+  _aes_key_expand(key, AES_128_KEY_SIZE);
+  g_aes.mode = mode;
+
+  _aes_encrypt_block(b0, g_aes.mac);
+
+  g_aes.ctr[0] = CCM_COUNTER_FLAGS;
+  memcpy(&g_aes.ctr[1], &b0[1], CCM_NONCE_SIZE);
+  g_aes.ctr[AES_BLOCK_SIZE - 2] = 0;
+  g_aes.ctr[AES_BLOCK_SIZE - 1] = 0;
+
+  _aes_encrypt_block(g_aes.ctr, g_aes.s0);
+
+  return HAL_SUCCESS;
+}
+
+static void _aes_ccm_process(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE], size_t len) {
+  uint8_t pad[AES_BLOCK_SIZE];
+  uint8_t stream[AES_BLOCK_SIZE];
+
+  _aes_ccm_next_counter();
+  _aes_encrypt_block(g_aes.ctr, stream);
+
+  memset(pad, 0, AES_BLOCK_SIZE);
+
+  if (g_aes.mode == AES_ENCRYPT) {
+    memcpy(pad, in, len);
+    _aes_xor_block(out, in, stream, len);
+  } else {
+    _aes_xor_block(pad, in, stream, len);
+    memcpy(out, pad, len);
+  }
+
+  _aes_xor_block(g_aes.mac, g_aes.mac, pad, AES_BLOCK_SIZE);
+  _aes_encrypt_block(g_aes.mac, g_aes.mac);
+
+  memzero(pad, sizeof(pad));
+  memzero(stream, sizeof(stream));
+}
+
+hal_err_t hal_aes128_ccm_block_process(const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE]) {
+  _aes_ccm_process(in, out, AES_BLOCK_SIZE);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_aes128_ccm_block_process_last(hal_aes_mode_t mode, const uint8_t in[AES_BLOCK_SIZE], uint8_t out[AES_BLOCK_SIZE], size_t len) {
+  _aes_ccm_process(in, out, len);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_aes128_ccm_finish(uint8_t tag[CCM_TAG_SIZE]) {
+  _aes_xor_block(tag, g_aes.mac, g_aes.s0, CCM_TAG_SIZE);
+  memzero(&g_aes, sizeof(g_aes));
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_derive_device_unique_secret(const uint8_t salt[32], uint8_t out[32]) {
+  uint8_t uid[HAL_DEVICE_UID_LEN];
+  hal_device_uid(uid);
+
+  hal_sha256_ctx_t sha;
+  hal_sha256_init(&sha);
+  hal_sha256_update(&sha, uid, HAL_DEVICE_UID_LEN);
+  hal_sha256_update(&sha, salt, 32);
+  return hal_sha256_finish(&sha, out);
+}
+
+static inline void _bn_read_mod(const uint8_t in[BN_SIZE], const bignum256* mod, bignum256* out) {
+  bn_read_be(in, out);
+  bn_fast_mod(out, mod);
+  bn_mod(out, mod);
+}
+
+static inline void _bn_reduce(bignum256* x, const bignum256* mod) {
+  bn_fast_mod(x, mod);
+  bn_mod(x, mod);
+}
+
+static void _ec_load_curve(const ecdsa_curve* curve, bignum256* prime, bignum256* a, bignum256* b) {
+  bn_read_be(curve->prime, prime);
+  bn_read_be(curve->b, b);
+
+  if (curve->a_sign == A_SIGN_NEGATIVE) {
+    bignum256 tmp;
+    bn_read_be(curve->a, &tmp);
+    bn_subtract(prime, &tmp, a);
+  } else {
+    bn_read_be(curve->a, a);
+  }
+}
+
+static void _ec_load_point(const uint8_t* in, linux_ec_point_t* p) {
+  bn_read_be(in, &p->x);
+  bn_read_be(&in[ECC256_ELEMENT_SIZE], &p->y);
+  p->infinity = false;
+}
+
+static void _ec_write_point(const linux_ec_point_t* p, uint8_t* out) {
+  bn_write_be(&p->x, out);
+  bn_write_be(&p->y, &out[ECC256_ELEMENT_SIZE]);
+}
+
+static void _ec_point_double(const bignum256* prime, const bignum256* a, linux_ec_point_t* p) {
+  if (p->infinity || bn_is_zero(&p->y)) {
+    p->infinity = true;
+    return;
+  }
+
+  bignum256 lambda, inv, xr, yr;
+
+  // lambda = (3 * x^2 + a) / (2 * y)
+  inv = p->y;
+  bn_mult_k(&inv, 2, prime);
+  bn_mod(&inv, prime);
+  bn_inverse(&inv, prime);
+
+  lambda = p->x;
+  bn_multiply(&p->x, &lambda, prime);
+  bn_mult_k(&lambda, 3, prime);
+  bn_addmod(&lambda, a, prime);
+  bn_multiply(&inv, &lambda, prime);
+  _bn_reduce(&lambda, prime);
+
+  // xr = lambda^2 - 2 * x
+  xr = lambda;
+  bn_multiply(&lambda, &xr, prime);
+  _bn_reduce(&xr, prime);
+  yr = p->x;
+  bn_mult_k(&yr, 2, prime);
+  _bn_reduce(&yr, prime);
+  bn_subtractmod(&xr, &yr, &xr, prime);
+  _bn_reduce(&xr, prime);
+
+  // yr = lambda * (x - xr) - y
+  bn_subtractmod(&p->x, &xr, &yr, prime);
+  _bn_reduce(&yr, prime);
+  bn_multiply(&lambda, &yr, prime);
+  _bn_reduce(&yr, prime);
+  bn_subtractmod(&yr, &p->y, &yr, prime);
+  _bn_reduce(&yr, prime);
+
+  p->x = xr;
+  p->y = yr;
+}
+
+static void _ec_point_add(const bignum256* prime, const bignum256* a, const linux_ec_point_t* q, linux_ec_point_t* p) {
+  if (q->infinity) {
+    return;
+  }
+
+  if (p->infinity) {
+    *p = *q;
+    return;
+  }
+
+  if (bn_is_equal(&p->x, &q->x)) {
+    if (bn_is_equal(&p->y, &q->y)) {
+      _ec_point_double(prime, a, p);
+    } else {
+      p->infinity = true;
+    }
+
+    return;
+  }
+
+  bignum256 lambda, inv, xr, yr;
+
+  // lambda = (qy - py) / (qx - px)
+  bn_subtractmod(&q->x, &p->x, &inv, prime);
+  _bn_reduce(&inv, prime);
+  bn_inverse(&inv, prime);
+  bn_subtractmod(&q->y, &p->y, &lambda, prime);
+  _bn_reduce(&lambda, prime);
+  bn_multiply(&inv, &lambda, prime);
+  _bn_reduce(&lambda, prime);
+
+  // xr = lambda^2 - px - qx
+  xr = lambda;
+  bn_multiply(&lambda, &xr, prime);
+  _bn_reduce(&xr, prime);
+  bn_subtractmod(&xr, &p->x, &xr, prime);
+  _bn_reduce(&xr, prime);
+  bn_subtractmod(&xr, &q->x, &xr, prime);
+  _bn_reduce(&xr, prime);
+
+  // yr = lambda * (px - xr) - py
+  bn_subtractmod(&p->x, &xr, &yr, prime);
+  _bn_reduce(&yr, prime);
+  bn_multiply(&lambda, &yr, prime);
+  _bn_reduce(&yr, prime);
+  bn_subtractmod(&yr, &p->y, &yr, prime);
+  _bn_reduce(&yr, prime);
+
+  p->x = xr;
+  p->y = yr;
+}
+
+static void _ec_point_multiply(const bignum256* prime, const bignum256* a, const uint8_t scalar[ECC256_ELEMENT_SIZE], const linux_ec_point_t* p, linux_ec_point_t* out) {
+  linux_ec_point_t r = { .infinity = true };
+
+  for (int i = 0; i < (ECC256_ELEMENT_SIZE * 8); i++) {
+    _ec_point_double(prime, a, &r);
+
+    if (scalar[i >> 3] & (0x80 >> (i & 7))) {
+      _ec_point_add(prime, a, p, &r);
+    }
+  }
+
+  *out = r;
+  memzero(&r, sizeof(r));
+}
+
+hal_err_t hal_ec_point_multiply(const ecdsa_curve* curve, const uint8_t* scalar, const uint8_t* point, uint8_t* point_out) {
+  bignum256 prime, a, b;
+  linux_ec_point_t p;
+
+  _ec_load_curve(curve, &prime, &a, &b);
+  _ec_load_point(point, &p);
+  _ec_point_multiply(&prime, &a, scalar, &p, &p);
+
+  if (p.infinity) {
+    return HAL_FAIL;
+  }
+
+  _ec_write_point(&p, point_out);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_ec_double_ladder(const ecdsa_curve* curve, const uint8_t* s1, const uint8_t* p1, const uint8_t* s2, const uint8_t* p2, uint8_t* point_out) {
+  bignum256 prime, a, b;
+  linux_ec_point_t p, q;
+
+  _ec_load_curve(curve, &prime, &a, &b);
+  _ec_load_point(p1, &p);
+  _ec_load_point(p2, &q);
+  _ec_point_multiply(&prime, &a, s1, &p, &p);
+  _ec_point_multiply(&prime, &a, s2, &q, &q);
+  _ec_point_add(&prime, &a, &q, &p);
+
+  if (p.infinity) {
+    return HAL_FAIL;
+  }
+
+  _ec_write_point(&p, point_out);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_ec_point_check(const ecdsa_curve* curve, const uint8_t* point) {
+  bignum256 prime, a, b, lhs, rhs;
+  linux_ec_point_t p;
+
+  _ec_load_curve(curve, &prime, &a, &b);
+  _ec_load_point(point, &p);
+
+  if (!bn_is_less(&p.x, &prime) || !bn_is_less(&p.y, &prime)) {
+    return HAL_FAIL;
+  }
+
+  // y^2 == x^3 + a * x + b
+  lhs = p.y;
+  bn_multiply(&p.y, &lhs, &prime);
+  _bn_reduce(&lhs, &prime);
+
+  rhs = p.x;
+  bn_multiply(&p.x, &rhs, &prime);
+  bn_addmod(&rhs, &a, &prime);
+  bn_multiply(&p.x, &rhs, &prime);
+  bn_addmod(&rhs, &b, &prime);
+  _bn_reduce(&rhs, &prime);
+
+  return bn_is_equal(&lhs, &rhs) ? HAL_SUCCESS : HAL_FAIL;
+}
+
+hal_err_t hal_ecdsa_sign(const ecdsa_curve* curve, const uint8_t* priv_key, const uint8_t* digest, const uint8_t* k, uint8_t* sig_out) {
+  bignum256 prime, a, b, order, r, s, z, d, kinv;
+  linux_ec_point_t p;
+
+  _ec_load_curve(curve, &prime, &a, &b);
+  bn_read_be(curve->order, &order);
+  _ec_load_point(curve->G, &p);
+  _ec_point_multiply(&prime, &a, k, &p, &p);
+
+  if (p.infinity) {
+    return HAL_FAIL;
+  }
+
+  r = p.x;
+  _bn_reduce(&r, &order);
+
+  if (bn_is_zero(&r)) {
+    return HAL_FAIL;
+  }
+
+  // s = k^-1 * (z + r * d)
+  _bn_read_mod(digest, &order, &z);
+  _bn_read_mod(priv_key, &order, &d);
+  _bn_read_mod(k, &order, &kinv);
+  bn_inverse(&kinv, &order);
+
+  s = r;
+  bn_multiply(&d, &s, &order);
+  bn_addmod(&s, &z, &order);
+  bn_multiply(&kinv, &s, &order);
+  _bn_reduce(&s, &order);
+
+  memzero(&d, sizeof(d));
+  memzero(&kinv, sizeof(kinv));
+
+  if (bn_is_zero(&s)) {
+    return HAL_FAIL;
+  }
+
+  bn_write_be(&r, sig_out);
+  bn_write_be(&s, &sig_out[ECC256_ELEMENT_SIZE]);
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_ecdsa_verify(const ecdsa_curve* curve, const uint8_t* pub_key, const uint8_t* sig, const uint8_t* digest) {
+  bignum256 prime, a, b, order, r, s, z, u1, u2;
+  linux_ec_point_t p, q;
+  uint8_t u[ECC256_ELEMENT_SIZE];
+
+  _ec_load_curve(curve, &prime, &a, &b);
+  bn_read_be(curve->order, &order);
+  bn_read_be(sig, &r);
+  bn_read_be(&sig[ECC256_ELEMENT_SIZE], &s);
+
+  if (bn_is_zero(&r) || bn_is_zero(&s) || !bn_is_less(&r, &order) || !bn_is_less(&s, &order)) {
+    return HAL_FAIL;
+  }
+
+  // u1 = z / s, u2 = r / s
+  _bn_read_mod(digest, &order, &z);
+  bn_inverse(&s, &order);
+  u1 = z;
+  bn_multiply(&s, &u1, &order);
+  _bn_reduce(&u1, &order);
+  u2 = r;
+  bn_multiply(&s, &u2, &order);
+  _bn_reduce(&u2, &order);
+
+  _ec_load_point(curve->G, &p);
+  bn_write_be(&u1, u);
+  _ec_point_multiply(&prime, &a, u, &p, &p);
+
+  _ec_load_point(pub_key, &q);
+  bn_write_be(&u2, u);
+  _ec_point_multiply(&prime, &a, u, &q, &q);
+
+  _ec_point_add(&prime, &a, &q, &p);
+
+  if (p.infinity) {
+    return HAL_FAIL;
+  }
+
+  _bn_reduce(&p.x, &order);
+  return bn_is_equal(&p.x, &r) ? HAL_SUCCESS : HAL_FAIL;
+}
+
+static void _bn_r_mod(const bignum256* mod, bignum256* r) {
+  // 2^256 mod m == 2^256 - m, since all supported moduli are larger than 2^255
+  uint8_t buf[BN_SIZE];
+  bn_write_be(mod, buf);
+
+  uint16_t borrow = 0;
+  for (int i = (BN_SIZE - 1); i >= 0; i--) {
+    uint16_t d = 0 - buf[i] - borrow;
+    buf[i] = d & 0xff;
+    borrow = (d >> 8) & 1;
+  }
+
+  bn_read_be(buf, r);
+}
+
+hal_err_t hal_bn_mul_r2(const uint8_t a[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, rm;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  _bn_r_mod(&m, &rm);
+  bn_multiply(&rm, &x, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_mul_mont(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, y, rinv;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  _bn_read_mod(b, &m, &y);
+  _bn_r_mod(&m, &rinv);
+  bn_inverse(&rinv, &m);
+  bn_multiply(&y, &x, &m);
+  bn_multiply(&rinv, &x, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_mul_mod(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, y;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  _bn_read_mod(b, &m, &y);
+  bn_multiply(&y, &x, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_add_mod(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, y;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  _bn_read_mod(b, &m, &y);
+  bn_addmod(&x, &y, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_sub_mod(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, y;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  _bn_read_mod(b, &m, &y);
+  bn_subtractmod(&x, &y, &x, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_exp_mod(const uint8_t a[BN_SIZE], const uint8_t e[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x, exp;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  bn_read_be(e, &exp);
+  bn_power_mod(&x, &exp, &m, &x);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_inv_mod(const uint8_t a[BN_SIZE], const uint8_t mod[BN_SIZE], uint8_t r[BN_SIZE]) {
+  bignum256 m, x;
+  bn_read_be(mod, &m);
+  _bn_read_mod(a, &m, &x);
+  bn_inverse(&x, &m);
+  _bn_reduce(&x, &m);
+  bn_write_be(&x, r);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_mul(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], uint8_t r[BN_SIZE]) {
+  uint32_t acc[BN_SIZE] = {0};
+
+  for (int i = 0; i < BN_SIZE; i++) {
+    for (int j = 0; j < (BN_SIZE - i); j++) {
+      acc[i + j] += a[BN_SIZE - 1 - i] * b[BN_SIZE - 1 - j];
+    }
+  }
+
+  uint32_t carry = 0;
+  for (int i = 0; i < BN_SIZE; i++) {
+    carry += acc[i];
+    r[BN_SIZE - 1 - i] = carry & 0xff;
+    carry >>= 8;
+  }
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_add(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], uint8_t r[BN_SIZE]) {
+  uint16_t carry = 0;
+
+  for (int i = (BN_SIZE - 1); i >= 0; i--) {
+    carry += a[i] + b[i];
+    r[i] = carry & 0xff;
+    carry >>= 8;
+  }
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_bn_sub(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE], uint8_t r[BN_SIZE]) {
+  uint16_t borrow = 0;
+
+  for (int i = (BN_SIZE - 1); i >= 0; i--) {
+    uint16_t d = a[i] - b[i] - borrow;
+    r[i] = d & 0xff;
+    borrow = (d >> 8) & 1;
+  }
+
+  return HAL_SUCCESS;
+}
+
+int hal_bn_cmp(const uint8_t a[BN_SIZE], const uint8_t b[BN_SIZE]) {
+  for (int i = 0; i < BN_SIZE; i++) {
+    if (a[i] != b[i]) {
+      return a[i] < b[i] ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+#include <unistd.h>
+#include "linux_internal.h"
+
+const hal_flash_data_segment_t hal_flash_data_map[] = {
+    { .addr = HAL_FLASH_BLOCK_ADDR(80), .count = 48},
+    { .addr = HAL_FLASH_BLOCK_ADDR(208), .count = 48},
+};
+
+#define LINUX_FLASH_WORD_COUNT (HAL_FLASH_SIZE / HAL_FLASH_WORD_SIZE)
+#define LINUX_FLASH_NO_WORD UINT32_MAX
+
+struct linux_flash_stats g_linux_flash_stats;
+
+// bytes written to each flash word since its erase and the word left partially written by the last program
+static uint8_t g_linux_flash_fill[LINUX_FLASH_WORD_COUNT];
+static uint32_t g_linux_flash_open = LINUX_FLASH_NO_WORD;
+
+static void linux_flash_violation(uintptr_t off) {
+  if (!g_linux_flash_stats.violations++) {
+    g_linux_flash_stats.violation_addr = HAL_FLASH_ADDR + off;
+  }
+}
+
+static bool linux_flash_op() {
+  return ++g_linux_flash_stats.ops == g_linux_flash_stats.power_loss_at;
+}
+
+// words are only programmed once complete, so the one being written when power is lost stays erased
+static void linux_flash_power_loss() {
+  if (g_linux_flash_open != LINUX_FLASH_NO_WORD) {
+    memset((uint8_t*) (HAL_FLASH_ADDR + (g_linux_flash_open * HAL_FLASH_WORD_SIZE)), 0xff, HAL_FLASH_WORD_SIZE);
+    g_linux_flash_fill[g_linux_flash_open] = 0;
+    g_linux_flash_open = LINUX_FLASH_NO_WORD;
+  }
+
+  if (g_linux_flash_stats.power_loss) {
+    g_linux_flash_stats.power_loss();
+  }
+
+  _exit(LINUX_POWER_LOSS_EXIT);
+}
+
+// a partially written word is only programmed once completed by the next write
+static void linux_flash_close(uint32_t word) {
+  if ((g_linux_flash_open != LINUX_FLASH_NO_WORD) && (g_linux_flash_open != word)) {
+    linux_flash_violation(g_linux_flash_open * HAL_FLASH_WORD_SIZE);
+  }
+
+  g_linux_flash_open = LINUX_FLASH_NO_WORD;
+}
+
+static void linux_flash_fill(uintptr_t off, size_t len) {
+  if (!len) {
+    return;
+  }
+
+  linux_flash_close(off / HAL_FLASH_WORD_SIZE);
+
+  while (len) {
+    uint32_t word = off / HAL_FLASH_WORD_SIZE;
+    size_t start = off % HAL_FLASH_WORD_SIZE;
+    size_t n = APP_MIN(len, (HAL_FLASH_WORD_SIZE - start));
+
+    if (g_linux_flash_fill[word] != start) {
+      linux_flash_violation(off);
+    } else if (!start) {
+      g_linux_flash_stats.programmed_words++;
+    }
+
+    g_linux_flash_fill[word] = start + n;
+    off += n;
+    len -= n;
+  }
+
+  uint32_t last = (off - 1) / HAL_FLASH_WORD_SIZE;
+
+  if (g_linux_flash_fill[last] < HAL_FLASH_WORD_SIZE) {
+    g_linux_flash_open = last;
+  }
+}
+
+void linux_flash_scan() {
+  const uint8_t* flash = (const uint8_t*) HAL_FLASH_ADDR;
+
+  for (uint32_t i = 0; i < LINUX_FLASH_WORD_COUNT; i++) {
+    g_linux_flash_fill[i] = 0;
+
+    for (int j = 0; j < HAL_FLASH_WORD_SIZE; j++) {
+      if (flash[(i * HAL_FLASH_WORD_SIZE) + j] != 0xff) {
+        g_linux_flash_fill[i] = HAL_FLASH_WORD_SIZE;
+        break;
+      }
+    }
+  }
+
+  g_linux_flash_open = LINUX_FLASH_NO_WORD;
+}
+
+hal_err_t linux_flash_init() {
+  if (linux_map_file(HAL_LINUX_ENV_FLASH, (void*) HAL_FLASH_ADDR, HAL_FLASH_SIZE, 0xff) != (void*) HAL_FLASH_ADDR) {
+    return HAL_FAIL;
+  }
+
+  linux_flash_scan();
+  return HAL_SUCCESS;
+}
+
+const hal_flash_data_segment_t* hal_flash_get_data_segments() {
+  return hal_flash_data_map;
+}
+
+hal_err_t hal_flash_begin_program() {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_flash_program(const uint8_t* data, uint8_t* addr, size_t len) {
+  assert((((uintptr_t) addr) >= HAL_FLASH_ADDR) && ((((uintptr_t) addr) + len) <= (HAL_FLASH_ADDR + HAL_FLASH_SIZE)));
+  bool lost = linux_flash_op();
+  size_t done = lost ? APP_MIN(len, g_linux_flash_stats.power_loss_offset) : len;
+
+  linux_flash_fill(((uintptr_t) addr) - HAL_FLASH_ADDR, done);
+  memcpy(addr, data, done);
+  g_linux_flash_stats.programmed_bytes += done;
+
+  if (lost) {
+    linux_flash_power_loss();
+  }
+
+  return HAL_SUCCESS;
+}
+
+// an interrupted erase leaves the block erased only up to the word where power was lost
+hal_err_t hal_flash_erase(uint32_t block) {
+  assert(block < HAL_FLASH_BLOCK_COUNT);
+  bool lost = linux_flash_op();
+  size_t done = lost ? (APP_MIN(HAL_FLASH_BLOCK_SIZE, g_linux_flash_stats.power_loss_offset) & ~(HAL_FLASH_WORD_SIZE - 1)) : HAL_FLASH_BLOCK_SIZE;
+
+  linux_flash_close(LINUX_FLASH_NO_WORD);
+  memset((uint8_t*) HAL_FLASH_BLOCK_ADDR(block), 0xff, done);
+  memset(&g_linux_flash_fill[(block * HAL_FLASH_BLOCK_SIZE) / HAL_FLASH_WORD_SIZE], 0, done / HAL_FLASH_WORD_SIZE);
+
+  if (lost) {
+    linux_flash_power_loss();
+  }
+
+  g_linux_flash_stats.erased_blocks++;
+  g_linux_flash_stats.block_erases[block]++;
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_flash_end_program() {
+  linux_flash_close(LINUX_FLASH_NO_WORD);
+  return HAL_SUCCESS;
+}
+
+void hal_flash_switch_firmware() {
+  hal_reboot();
+}
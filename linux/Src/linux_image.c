@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+#include "linux_internal.h"
+
+static int _linux_pgm_skip(FILE* f) {
+  int c;
+
+  do {
+    c = fgetc(f);
+
+    if (c == '#') {
+      while (c != '\n' && c != EOF) {
+        c = fgetc(f);
+      }
+    }
+  } while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#');
+
+  return c;
+}
+
+static int _linux_pgm_int(FILE* f) {
+  int c = _linux_pgm_skip(f);
+  int val = 0;
+
+  while (c >= '0' && c <= '9') {
+    val = (val * 10) + (c - '0');
+    c = fgetc(f);
+  }
+
+  return val;
+}
+
+hal_err_t linux_image_load(const char* path, uint8_t fb[CAMERA_FB_SIZE]) {
+  FILE* f = fopen(path, "rb");
+
+  if (!f) {
+    return HAL_FAIL;
+  }
+
+  hal_err_t err = HAL_FAIL;
+  size_t off = 0;
+
+  if (fread(fb, 1, 2, f) != 2) {
+    goto done;
+  }
+
+  if (fb[0] == 'P' && fb[1] == '5') {
+    int width = _linux_pgm_int(f);
+    int height = _linux_pgm_int(f);
+    int maxval = _linux_pgm_int(f);
+
+    if (width != CAMERA_WIDTH || height != CAMERA_HEIGHT || maxval != 255) {
+      goto done;
+    }
+  } else {
+    // raw 8-bit luma frame, the bytes read so far are pixels
+    off = 2;
+  }
+
+  size_t len = CAMERA_FB_SIZE - off;
+  err = fread(&fb[off], 1, len, f) == len ? HAL_SUCCESS : HAL_FAIL;
+
+done:
+  fclose(f);
+  return err;
+}
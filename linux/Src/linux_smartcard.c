@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "linux_internal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define LINUX_SMARTCARD_TIMEOUT_MS 500
+
+// The card is an external process attached through a pair of pipes, exchanging
+// the raw bytes which would travel on the ISO7816 I/O line.
+static pid_t g_smartcard_pid = -1;
+static int g_smartcard_in = -1;
+static int g_smartcard_out = -1;
+
+static void _linux_smartcard_complete(uint32_t err) {
+  xTaskNotifyIndexed(xTaskGetCurrentTaskHandle(), SMARTCARD_TASK_NOTIFICATION_IDX, err, eSetValueWithOverwrite);
+}
+
+hal_err_t hal_smartcard_start() {
+  const char* cmd = getenv(HAL_LINUX_ENV_SMARTCARD);
+
+  if (!cmd || g_smartcard_pid != -1) {
+    return cmd ? HAL_SUCCESS : HAL_FAIL;
+  }
+
+  int to_card[2];
+  int from_card[2];
+
+  if (pipe(to_card) || pipe(from_card)) {
+    return HAL_FAIL;
+  }
+
+  g_smartcard_pid = fork();
+
+  if (g_smartcard_pid == 0) {
+    dup2(to_card[0], STDIN_FILENO);
+    dup2(from_card[1], STDOUT_FILENO);
+    close(to_card[1]);
+    close(from_card[0]);
+    execl("/bin/sh", "sh", "-c", cmd, NULL);
+    _exit(127);
+  }
+
+  close(to_card[0]);
+  close(from_card[1]);
+
+  if (g_smartcard_pid < 0) {
+    close(to_card[1]);
+    close(from_card[0]);
+    return HAL_FAIL;
+  }
+
+  g_smartcard_out = to_card[1];
+  g_smartcard_in = from_card[0];
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smartcard_stop() {
+  if (g_smartcard_pid == -1) {
+    return HAL_SUCCESS;
+  }
+
+  close(g_smartcard_out);
+  close(g_smartcard_in);
+  kill(g_smartcard_pid, SIGTERM);
+  waitpid(g_smartcard_pid, NULL, 0);
+
+  g_smartcard_pid = -1;
+  g_smartcard_in = -1;
+  g_smartcard_out = -1;
+
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smartcard_pps(smartcard_protocol_t protocol, uint32_t baud, uint32_t freq, uint8_t guard, uint32_t timeout) {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smartcard_set_timeout(uint32_t timeout) {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smartcard_set_blocklen(uint32_t len) {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smartcard_send(const uint8_t* data, size_t len) {
+  while (len) {
+    ssize_t w = write(g_smartcard_out, data, len);
+
+    if ((w < 0) && (errno == EINTR)) {
+      continue;
+    }
+
+    if (w <= 0) {
+      return HAL_FAIL;
+    }
+
+    data += w;
+    len -= w;
+  }
+
+  _linux_smartcard_complete(HAL_SUCCESS);
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_smarcard_recv(uint8_t* data, size_t len) {
+  struct pollfd pfd = { .fd = g_smartcard_in, .events = POLLIN };
+
+  while (len) {
+    // the scheduler tick is a signal, so blocking calls can return EINTR
+    int ready = poll(&pfd, 1, LINUX_SMARTCARD_TIMEOUT_MS);
+
+    if ((ready < 0) && (errno == EINTR)) {
+      continue;
+    }
+
+    if (ready <= 0) {
+      _linux_smartcard_complete(HAL_FAIL);
+      return HAL_SUCCESS;
+    }
+
+    ssize_t r = read(g_smartcard_in, data, len);
+
+    if ((r < 0) && (errno == EINTR)) {
+      continue;
+    }
+
+    if (r <= 0) {
+      _linux_smartcard_complete(HAL_FAIL);
+      return HAL_SUCCESS;
+    }
+
+    data += r;
+    len -= r;
+  }
+
+  _linux_smartcard_complete(HAL_SUCCESS);
+  return HAL_SUCCESS;
+}
+
+void hal_smartcard_abort() {
+}
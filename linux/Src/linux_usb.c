@@ -0,0 +1,32 @@
+#include "linux_internal.h"
+
+// No USB device controller on the host. The stack is kept linked but never sees
+// a host connection, since GPIO_VUSB_OK reports no cable.
+
+hal_err_t hal_usb_start() {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_usb_stop() {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_usb_send(uint8_t epaddr, const uint8_t* data, size_t len) {
+  return HAL_FAIL;
+}
+
+hal_err_t hal_usb_set_stall(uint8_t epaddr, uint8_t stall) {
+  return HAL_SUCCESS;
+}
+
+uint8_t hal_usb_get_stall(uint8_t epaddr) {
+  return 0;
+}
+
+hal_err_t hal_usb_set_address(uint8_t addr) {
+  return HAL_SUCCESS;
+}
+
+hal_err_t hal_usb_next_recv(uint8_t epaddr, uint8_t* data, size_t len) {
+  return HAL_SUCCESS;
+}
@@ -71,7 +71,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
   if (htim == &htim2) {
     keypad_scan_tick();
   } else if (htim == &htim3) {
-    pwr_shutdown();
+    pwr_shutdown_from_isr();
   } else if (htim == &htim5) {
     pwr_inactivity_timer_elapsed();
   }
@@ -226,6 +226,10 @@ hal_err_t hal_delay_us(uint32_t usec) {
   return HAL_FAIL;
 }
 
+uint32_t hal_get_ms() {
+  return HAL_GetTick();
+}
+
 void hal_tick() {
   HAL_IncTick();
 }
@@ -3,6 +3,7 @@
 static TaskHandle_t g_dcmi_task = NULL;
 static int8_t g_acquiring;
 static struct dcmi_buf g_dcmi_bufs[CAMERA_FB_COUNT];
+static uint32_t g_dcmi_dropped;
 
 static void inline _hal_acquire(int8_t idx) {
   g_acquiring = idx;
@@ -46,6 +47,13 @@ void HAL_DCMI_FrameEventCallback(DCMI_HandleTypeDef *hdcmi) {
   portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+void HAL_DCMI_VsyncEventCallback(DCMI_HandleTypeDef *hdcmi) {
+  // a frame starts while all buffers are taken, so it is not captured
+  if (g_acquiring == -1) {
+    g_dcmi_dropped++;
+  }
+}
+
 hal_err_t hal_camera_init() {
   mco_on();
   vTaskDelay(pdMS_TO_TICKS(CLOCK_STABLE_DELAY));
@@ -65,11 +73,15 @@ hal_err_t hal_camera_start(uint8_t fb[CAMERA_FB_COUNT][CAMERA_FB_SIZE]) {
     g_dcmi_bufs[i].addr = fb[i];
   }
 
+  g_dcmi_dropped = 0;
+  __HAL_DCMI_ENABLE_IT(&hdcmi, DCMI_IT_VSYNC);
+
   return HAL_DCMI_Start_DMA(&hdcmi, DCMI_MODE_CONTINUOUS, (uint32_t) g_dcmi_bufs[0].addr, (CAMERA_FB_SIZE/4));
 }
 
 hal_err_t hal_camera_stop() {
   g_dcmi_task = NULL;
+  __HAL_DCMI_DISABLE_IT(&hdcmi, DCMI_IT_VSYNC);
   HAL_DCMI_Stop(&hdcmi);
   mco_off();
   return HAL_SUCCESS;
@@ -95,6 +107,10 @@ hal_err_t hal_camera_next_frame(uint8_t** fb) {
   return HAL_FAIL;
 }
 
+uint32_t hal_camera_dropped_frames() {
+  return g_dcmi_dropped;
+}
+
 hal_err_t hal_camera_submit(uint8_t* fb) {
   for (int i = 0; i < CAMERA_FB_COUNT; i++) {
     if (g_dcmi_bufs[i].addr == fb) {
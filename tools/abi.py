@@ -33,6 +33,10 @@ ETH_ABI_VARARRAY = (ETH_ABI_COMPOSITE | ETH_ABI_COMP_VARLEN)
 ETH_ARG_HEADER_LEN = 6
 ETH_FUNC_HEADER_LEN = 13
 
+ABI_SHAPE_WORDS = 0x0fff
+ABI_SHAPE_DYNAMIC = 0x4000
+ABI_SHAPE_PAYABLE = 0x8000
+
 def serialize_argument(arg, rest):
     next = b''
     next_off = 0
@@ -62,6 +66,19 @@ def serialize_abi(abi):
     data = abi["selector"] + abi["ext_selector"] + struct.pack("<HHB", ETH_FUNC_HEADER_LEN, args_off, abi["attrs"]) + encoded_name + args
     return struct.pack("<HH", ABI_MAGIC, len(data)) + data
 
+# The shape kept next to the selector in v2 tables: the number of argument words, whether any argument is dynamic,
+# making that a minimum, and whether the function is payable
+def abi_shape(abi):
+    shape = len(abi["arguments"]) & ABI_SHAPE_WORDS
+
+    if any((arg["type"] & (ETH_ABI_DYNAMIC | ETH_ABI_COMPOSITE)) != 0 for arg in abi["arguments"]):
+        shape = shape | ABI_SHAPE_DYNAMIC
+
+    if abi["attrs"] & 1:
+        shape = shape | ABI_SHAPE_PAYABLE
+
+    return struct.pack("<H", shape)
+
 def bitsize(size_str):
     if size_str == "":
         return 32
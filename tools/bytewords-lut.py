@@ -1,4 +1,47 @@
-words = ['BTC-SIGN-REQUEST', 'BTC-SIGNATURE', 'BYTES', 'CRYPTO-ACCOUNT', 'CRYPTO-HDKEY', 'CRYPTO-MULTI-ACCOUNTS', 'CRYPTO-OUTPUT', 'CRYPTO-PSBT', 'DEV-AUTH', 'ETH-SIGN-REQUEST', 'ETH-SIGNATURE', 'FS-DATA', 'FW-UPDATE']
+import argparse
+
+BYTEWORDS = (
+    "able acid also apex aqua arch atom aunt away axis back bald barn belt beta bias "
+    "blue body brag brew bulb buzz calm cash cats chef city claw code cola cook cost "
+    "crux curl cusp cyan dark data days deli dice diet door down draw drop drum dull "
+    "duty each easy echo edge epic even exam exit eyes fact fair fern figs film fish "
+    "fizz flap flew flux foxy free frog fuel fund gala game gear gems gift girl glow "
+    "good gray grim guru gush gyro half hang hard hawk heat help high hill holy hope "
+    "horn huts iced idea idle inch inky into iris iron item jade jazz join jolt jowl "
+    "judo jugs jump junk jury keep keno kept keys kick kiln king kite kiwi knob lamb "
+    "lava lazy leaf legs liar limp lion list logo loud love luau luck lung main many "
+    "math maze memo menu meow mild mint miss monk nail navy need news next noon note "
+    "numb obey oboe omit onyx open oval owls paid part peck play plus poem pool pose "
+    "puff puma purr quad quiz race ramp real redo rich road rock roof ruby ruin runs "
+    "rust safe saga scar sets silk skew slot soap solo song stub surf swan taco task "
+    "taxi tent tied time tiny toil tomb toys trip tuna twin ugly undo unit urge user "
+    "vast very veto vial vibe view visa void vows wall wand warm wasp wave waxy webs "
+    "what when whiz wolf work yank yawn yell yoga yurt zaps zero zest zinc zone zoom "
+).split()
+
+UR_TYPES = ['BTC-SIGN-REQUEST', 'BTC-SIGNATURE', 'BYTES', 'CRYPTO-ACCOUNT', 'CRYPTO-HDKEY', 'CRYPTO-MULTI-ACCOUNTS', 'CRYPTO-OUTPUT', 'CRYPTO-PSBT', 'DEV-AUTH', 'ETH-SIGN-REQUEST', 'ETH-SIGNATURE', 'FS-DATA', 'FW-UPDATE']
+
+def print_table(decl, values, fmt, per_line):
+    print(f"{decl} = {{")
+    for i in range(0, len(values), per_line):
+        print("    " + " ".join(f"{fmt.format(v)}," for v in values[i:i + per_line]))
+    print("};\n")
+
+# Minimal bytewords use the first and last letter of each word. The decoding table is indexed
+# by the low 5 bits of both letters, which are the same for upper and lower case.
+def bytewords_tables():
+    assert len(BYTEWORDS) == 256
+    decode = [0] * 1024
+    encode = []
+
+    for i, w in enumerate(BYTEWORDS):
+        first = ord(w[0].upper())
+        last = ord(w[-1].upper())
+        decode[((first & 0x1f) << 5) | (last & 0x1f)] = i
+        encode.append((last << 8) | first)
+
+    print_table("const static uint8_t BW_DECODE_LUT[]", decode, "0x{:02x}", 16)
+    print_table("const static uint16_t BW_ENCODE_LUT[]", encode, "0x{:04x}", 8)
 
 def hf(w, m):
     sum = 0
@@ -6,36 +49,49 @@ def hf(w, m):
         sum += ord(c)
     return ((sum * m) >> 28) & 0x0f
 
-mult = 1
-repeat = True
-lut = {}
-
-while repeat:
-    repeat = False
+def ur_types():
+    mult = 1
+    repeat = True
     lut = {}
-    for w in words:
-        h = hf(w, mult)
-        if h in lut:
-            mult = mult + 1
-            repeat = True
-            break
+
+    while repeat:
+        repeat = False
+        lut = {}
+        for w in UR_TYPES:
+            h = hf(w, mult)
+            if h in lut:
+                mult = mult + 1
+                repeat = True
+                break
+            else:
+                lut[h] = w
+
+    print("const char *const ur_type_string[] = {")
+    for i in range(16):
+        if i in lut:
+            print(f"  \"{lut[i]}\",")
         else:
-            lut[h] = w
+            print("  NULL,")
+    print("};\n")
 
+    print("typedef enum {")
+    for i in range(16):
+        if i in lut:
+            print(f"  {lut[i].replace('-', '_')} = {i},")
+    print(f"  UR_ANY_TX = 255")
+    print("} ur_type_t;\n")
 
-print("const char *const ur_type_string[] = {")
-for i in range(16):
-    if i in lut:
-        print(f"  \"{lut[i]}\",")
-    else:
-        print("  NULL,")
-print("};\n")
+    print(f"Multiplier: {mult}")
+
+def main():
+    parser = argparse.ArgumentParser(description='Output the bytewords lookup tables of app/ur/bytewords.c or the UR type hash of app/ur/ur.c')
+    parser.add_argument('-t', '--types', action='store_true', help="output the UR type table instead")
+    args = parser.parse_args()
 
-print("typedef enum {")
-for i in range(16):
-    if i in lut:
-        print(f"  {lut[i].replace("-", "_")} = {i},")
-print(f"  UR_ANY_TX = 255")
-print("} ur_type_t;\n")
+    if args.types:
+        ur_types()
+    else:
+        bytewords_tables()
 
-print(f"Multiplier: {mult}")
+if __name__ == "__main__":
+    main()
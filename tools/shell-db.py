@@ -6,6 +6,7 @@ import struct
 import requests
 import json
 import hashlib
+import math
 
 from common import PAGE_SIZE, WORD_SIZE, sign
 from tokens import *
@@ -13,6 +14,28 @@ from abi import *
 from keycardsign import *
 
 VERSION_MAGIC = 0x4532
+DELTA_MAGIC = 0x444c
+CHAIN_TABLE_MAGIC = 0x4354
+ERC20_TABLE_MAGIC = 0x5454
+ABI_TABLE_MAGIC = 0x4154
+FILTER_MAGIC = 0x4642
+
+# v2 tables are kept well below the page size so that they pack in pages without wasting much space
+TABLE_MAX_LEN = PAGE_SIZE // 4
+TABLE_HEADER_LEN = 3
+TABLE_SPLIT_LEN = TABLE_MAX_LEN // 2
+
+# Bloom filters over the token and ABI keys let the firmware answer most lookups of unknown keys without searching.
+# A filter is a single entry, so it must fit a page with its header and the filesystem page header
+FILTER_HEADER_LEN = 8
+FILTER_MAX_LEN = PAGE_SIZE - 16 - 4 - FILTER_HEADER_LEN
+FILTER_BITS_PER_KEY = 10
+FILTER_MAX_HASHES = 16
+FILTER_HASH_BASIS = 0x811c9dc5
+FILTER_HASH_STEP_BASIS = 0x050c5d1f
+FILTER_HASH_PRIME = 0x01000193
+
+DB_MAGICS = [VERSION_MAGIC, CHAIN_MAGIC, ERC20_MAGIC, ABI_MAGIC, CHAIN_TABLE_MAGIC, ERC20_TABLE_MAGIC, ABI_TABLE_MAGIC, FILTER_MAGIC]
 
 def pad_write(f, buf):
     f.write(buf)
@@ -41,23 +64,228 @@ def db_write(f, m, buf, entry):
         pad_write(f, buf)
         return entry
 
-def serialize_db(f, m, chains, tokens, abis, version):
-    buf = db_write(f, m, b'', struct.pack("<HHI", VERSION_MAGIC, 4, version))
+def write_db(f, m, entries):
+    buf = b''
+
+    for entry in entries:
+        buf = db_write(f, m, buf, entry)
+
+    if len(buf) > 0:
+        pad_write(f, buf)
+
+def serialize_db(chains, tokens, abis, version):
+    entries = [struct.pack("<HHI", VERSION_MAGIC, 4, version)]
+
+    for chain in chains.values():
+        entries.append(serialize_chain(chain))
+
+    for token in tokens.values():
+        entries.append(serialize_token(token))
+
+    for abi in abis.values():
+        entries.append(serialize_abi(abi))
+
+    return entries
+
+# Tables end after rows picked by a hash of their key, with a chance proportional to the row size, so that adding or
+# removing a row only changes the table holding it and deltas stay small
+def table_boundary(key, row_len):
+    h = int.from_bytes(hashlib.sha256(key).digest()[:4], "little")
+    return (h % TABLE_SPLIT_LEN) < row_len
+
+def serialize_table(magic, rows):
+    rows = sorted(rows, key=lambda row: row[0])
+    key_len = len(rows[0][0])
+    row_len = key_len + 2
+    tables = []
+    i = 0
+
+    while i < len(rows):
+        keys = []
+        records = {}
+        records_len = 0
+
+        while i < len(rows):
+            key, record = rows[i]
+            new_len = 0 if record in records else len(record)
+            table_len = TABLE_HEADER_LEN + ((len(keys) + 1) * row_len) + records_len + new_len
+
+            if len(keys) > 0 and table_len > TABLE_MAX_LEN:
+                break
+
+            if record not in records:
+                records[record] = records_len
+                records_len = records_len + len(record)
+
+            keys.append((key, records[record]))
+            i = i + 1
+
+            if table_boundary(key, row_len + len(record)):
+                break
+
+        rows_len = len(keys) * row_len
+        data = struct.pack("<HB", len(keys), key_len)
+
+        for key, off in keys:
+            data = data + key + struct.pack("<H", rows_len + off)
+
+        for record in records.keys():
+            data = data + record
+
+        tables.append(struct.pack("<HH", magic, len(data)) + data)
+
+    return tables
+
+def filter_hash(basis, key):
+    h = basis
+
+    for b in key:
+        h = ((h ^ b) * FILTER_HASH_PRIME) & 0xffffffff
+
+    return h
+
+# Returns the filter entry and its expected false positive rate
+def serialize_filter(section, keys, version):
+    keys = set(keys)
+    bits_len = min(max(math.ceil(len(keys) * FILTER_BITS_PER_KEY / 8), 8), FILTER_MAX_LEN)
+    m = bits_len * 8
+    hashes = max(1, min(FILTER_MAX_HASHES, round((m / len(keys)) * math.log(2))))
+    bits = bytearray(bits_len)
+
+    for key in keys:
+        h = filter_hash(FILTER_HASH_BASIS, key)
+        step = filter_hash(FILTER_HASH_STEP_BASIS, key) | 1
+
+        for i in range(hashes):
+            bit = h % m
+            bits[bit >> 3] |= 1 << (bit & 7)
+            h = (h + step) & 0xffffffff
+
+    fp_rate = (1 - math.exp(-hashes * len(keys) / m)) ** hashes
+    data = struct.pack("<HBBI", section, hashes, 0, version) + bits
+    return struct.pack("<HH", FILTER_MAGIC, len(data)) + data, fp_rate
+
+def serialize_db_v2(chains, tokens, abis, version):
+    chain_rows = []
+    token_rows = []
+    abi_rows = []
 
     for chain in chains.values():
-        serialized_chain = serialize_chain(chain)
-        buf = db_write(f, m, buf, serialized_chain)
+        chain_rows.append((struct.pack("<I", chain["id"]), serialize_chain(chain)[8:]))
 
     for token in tokens.values():
         serialized_token = serialize_token(token)
-        buf = db_write(f, m, buf, serialized_token)
+        record = serialized_token[(5 + (len(token["addresses"]) * 24)):]
+
+        for id, address in token["addresses"].items():
+            token_rows.append((struct.pack("<I20s", id, bytes.fromhex(address[2:])), record))
 
     for abi in abis.values():
         serialized_abi = serialize_abi(abi)
-        buf = db_write(f, m, buf, serialized_abi)
-        
-    if len(buf) > 0:
-        pad_write(f, buf)
+        abi_rows.append((serialized_abi[4:12] + abi_shape(abi), serialized_abi[4:]))
+
+    entries = [struct.pack("<HHI", VERSION_MAGIC, 4, version)]
+
+    for magic, rows in [(CHAIN_TABLE_MAGIC, chain_rows), (ERC20_TABLE_MAGIC, token_rows), (ABI_TABLE_MAGIC, abi_rows)]:
+        if len(rows) > 0:
+            entries.extend(serialize_table(magic, rows))
+
+    for name, magic, keys in [("erc-20", ERC20_TABLE_MAGIC, [key for key, _ in token_rows]), ("ABI", ABI_TABLE_MAGIC, [key[:4] for key, _ in abi_rows])]:
+        if len(keys) > 0:
+            entry, fp_rate = serialize_filter(magic, keys, version)
+            entries.append(entry)
+            print(f"{name} filter: {len(set(keys))} keys, {len(entry) - 4 - FILTER_HEADER_LEN} bytes, false positive rate {fp_rate * 100:.3f}%")
+
+    return entries
+
+# Reads the entries of a database image written by this tool, with or without padding and signature
+def parse_db(data):
+    entries = []
+    off = 0
+
+    while off + 4 <= len(data):
+        if (data[off] & 0xc0) == 0x80:
+            off = off + (data[off] & 0x3f)
+            continue
+
+        magic, entry_len = struct.unpack_from("<HH", data, off)
+
+        if magic == 0xffff:
+            off = ((off // PAGE_SIZE) + 1) * PAGE_SIZE
+            continue
+
+        if magic not in DB_MAGICS or off + 4 + entry_len > len(data):
+            break
+
+        entries.append(data[off:(off + 4 + entry_len)])
+        off = off + 4 + entry_len
+
+    return entries
+
+def table_rows(entry):
+    count, key_len = struct.unpack_from("<HB", entry, 4)
+    rows = entry[(4 + TABLE_HEADER_LEN):]
+    row_len = key_len + 2
+
+    for i in range(count):
+        key = rows[(i * row_len):(i * row_len + key_len)]
+        off, = struct.unpack_from("<H", rows, i * row_len + key_len)
+        yield key, rows[off:]
+
+def c_string(data):
+    return data[:(data.index(0) + 1)]
+
+def is_filter(entry):
+    return struct.unpack_from("<H", entry)[0] == FILTER_MAGIC
+
+# The keys the firmware matches an entry with when applying a delta, as (list index, key) pairs. An entry is erased
+# when any of its keys is listed
+def erase_keys(entry):
+    magic, _ = struct.unpack_from("<HH", entry)
+    data = entry[4:]
+
+    if magic == CHAIN_MAGIC:
+        return [(0, data[:4])]
+    elif magic == ERC20_MAGIC:
+        return [(1, c_string(data[(2 + (data[0] * 24)):]))]
+    elif magic == ABI_MAGIC:
+        return [(2, data[:8])]
+    elif magic == CHAIN_TABLE_MAGIC:
+        return [(0, key) for key, _ in table_rows(entry)]
+    elif magic == ERC20_TABLE_MAGIC:
+        return list(dict.fromkeys((1, c_string(record[1:])) for _, record in table_rows(entry)))
+    elif magic == ABI_TABLE_MAGIC:
+        return [(2, key[:8]) for key, _ in table_rows(entry)]
+
+    return []
+
+def serialize_delta(base_entries, entries):
+    base_version, = struct.unpack_from("<I", base_entries[0], 4)
+    new_entries = set(entries)
+    users = {}
+
+    for entry in base_entries[1:]:
+        for key in erase_keys(entry):
+            users.setdefault(key, []).append(entry)
+
+    # for each entry which is gone pick the key which takes the fewest other entries along. Filters are always erased
+    # by the firmware, so the new ones are always sent
+    erase = set()
+
+    for entry in base_entries[1:]:
+        if entry in new_entries or is_filter(entry):
+            continue
+
+        keys = erase_keys(entry)
+
+        if not any(key in erase for key in keys):
+            erase.add(min(keys, key=lambda key: sum(1 for e in users[key] if e in new_entries)))
+
+    kept = set(e for e in base_entries[1:] if not is_filter(e) and not any(key in erase for key in erase_keys(e)))
+    erase_lists = [b''.join(sorted(key for i, key in erase if i == n)) for n in range(3)]
+
+    header = struct.pack("<HIHHH", DELTA_MAGIC, base_version, *[len(l) for l in erase_lists])
+    return header + b''.join(erase_lists), [e for e in entries if e not in kept]
 
 def read_json(url_or_path):
     if url_or_path.startswith('http'):
@@ -77,6 +305,8 @@ def main():
     parser.add_argument('-d', '--dummy-sign', help="adds a dummy signature. Useful only to reproduce builds", action='store_true')
     parser.add_argument('-k', '--keycard', help="sign with Keycard", action='store_true')
     parser.add_argument('-v', '--version', help="the version in YYYYMMDD format", default=def_version, type=int)
+    parser.add_argument('-l', '--layout', help="the database layout. Version 1 is understood by all firmware versions, version 2 (sorted tables) only by firmware which has the table lookups", default=1, type=int, choices=[1, 2])
+    parser.add_argument('-b', '--base', help="output a delta update from this previous database instead of a full database")
     parser.add_argument('-o', '--output', help="the output file")
     args = parser.parse_args()
 
@@ -106,8 +336,34 @@ def main():
     elif args.dummy_sign or args.keycard:
         m = hashlib.sha256()
     
+    if args.layout == 2:
+        entries = serialize_db_v2(chains, tokens, abis, version)
+    else:
+        entries = serialize_db(chains, tokens, abis, version)
+
+    full_len = sum(len(entry) for entry in entries)
+
+    if args.base != None:
+        with open(args.base, 'rb') as f:
+            base_entries = parse_db(f.read())
+
+        if len(base_entries) == 0 or struct.unpack_from("<H", base_entries[0])[0] != VERSION_MAGIC:
+            raise ValueError("the base is not a database")
+
+        header, entries = serialize_delta(base_entries, entries)
+        delta_len = len(header) + sum(len(entry) for entry in entries)
+        print(f"delta: {delta_len} bytes, {len(entries)} entries, full database: {full_len} bytes")
+
     with open(args.output, 'wb') as f:
-        serialize_db(f, m, chains, tokens, abis, version)
+        if args.base != None:
+            # deltas are only ever sent to the device, so they are never padded
+            for entry in [header] + entries:
+                f.write(entry)
+
+                if m != None:
+                    m.update(entry)
+        else:
+            write_db(f, m, entries)
         if db_key != None:
             f.write(sign(db_key, m.digest()))
         elif args.keycard: